@@ -1,7 +1,7 @@
 """The experimental module contains unstable APIs for development and testing.
 """
 
-from _pybricks.experimental import pthread_raise
+from _pybricks.experimental import control_schedule, control_stats, pthread_raise
 from _thread import start_new_thread, get_ident, allocate_lock
 from usignal import pthread_kill, SIGUSR2
 
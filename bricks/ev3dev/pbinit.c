@@ -2,13 +2,18 @@
 // SPDX-License-Identifier: MIT
 // Copyright (c) 2018-2020 The Pybricks Authors
 
+#include <errno.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 #include <unistd.h>
 
+#include <sys/mman.h>
 #include <sys/time.h>
 #include <sys/timerfd.h>
 
@@ -21,9 +26,10 @@
 #include <pbio/config.h>
 #include <pbio/main.h>
 #include <pbio/light.h>
+#include <pbio/motorcmd.h>
+#include <pbio/motorpoll.h>
 
 #include "py/mpconfig.h"
-#include "py/mpthread.h"
 
 #include "pbinit.h"
 
@@ -31,25 +37,162 @@
 static volatile bool stopping_thread = false;
 static pthread_t task_caller_thread;
 
+// Timer that expires once every tick, at absolute deadlines
+static int task_caller_timer = -1;
+
+// Time at which the timer was started (us)
+static uint64_t task_caller_timer_start;
+
+// Timing statistics of the task caller thread, protected by pbio_mutex
+static pybricks_task_caller_stats_t task_caller_stats;
+
+// The task caller thread owns pbio. It holds this mutex while it runs the
+// control loop, and other threads hold it while they use pbio directly.
+static pthread_mutex_t pbio_mutex;
+
+static uint64_t timespec_to_us(const struct timespec *ts) {
+    return (uint64_t)ts->tv_sec * 1000000 + ts->tv_nsec / 1000;
+}
+
 // The background thread that keeps firing the task handler
 static void *task_caller(void *arg) {
-    struct timespec ts;
-    ts.tv_sec = 0;
-    ts.tv_nsec = PBIO_CONFIG_SERVO_PERIOD_MS * 1000000;
+    struct timespec now;
+    uint64_t deadline = task_caller_timer_start;
 
     while (!stopping_thread) {
-        MP_THREAD_GIL_ENTER();
+        // Wait for the next tick. The timer is periodic, so time spent
+        // processing events does not add to the period. If we were too late
+        // to see one or more ticks, they are counted but not made up for.
+        uint64_t expirations;
+        if (read(task_caller_timer, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+            continue;
+        }
+        deadline += expirations * PBIO_CONFIG_MOTORPOLL_TICK_MS * 1000;
+
+        pthread_mutex_lock(&pbio_mutex);
+
+        // Latency is measured from the deadline until we hold the lock, since
+        // that is when the control loop actually gets to run.
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        uint64_t latency = timespec_to_us(&now) - deadline;
+        task_caller_stats.ticks++;
+        task_caller_stats.missed += expirations - 1;
+        task_caller_stats.latency_total += latency;
+        if (latency > task_caller_stats.latency_max) {
+            task_caller_stats.latency_max = latency;
+        }
+
         while (pbio_do_one_event()) {
         }
-        MP_THREAD_GIL_EXIT();
+        pthread_mutex_unlock(&pbio_mutex);
 
-        clock_nanosleep(CLOCK_MONOTONIC, 0, &ts, NULL);
         etimer_request_poll();
     }
 
     return NULL;
 }
 
+// Optionally runs the task caller thread with real-time priority. This is
+// enabled by setting PYBRICKS_RT_PRIORITY to a SCHED_FIFO priority (1-99).
+static void task_caller_set_priority(pthread_attr_t *attr) {
+    const char *env = getenv("PYBRICKS_RT_PRIORITY");
+    if (!env) {
+        return;
+    }
+
+    int priority = atoi(env);
+    if (priority < sched_get_priority_min(SCHED_FIFO) || priority > sched_get_priority_max(SCHED_FIFO)) {
+        fprintf(stderr, "Ignoring invalid PYBRICKS_RT_PRIORITY=%s.\n", env);
+        return;
+    }
+
+    // Page faults would defeat the purpose, so keep everything in memory
+    if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+        fprintf(stderr, "Could not lock memory: %s\n", strerror(errno));
+    }
+
+    struct sched_param param = { .sched_priority = priority };
+    pthread_attr_setinheritsched(attr, PTHREAD_EXPLICIT_SCHED);
+    pthread_attr_setschedpolicy(attr, SCHED_FIFO);
+    pthread_attr_setschedparam(attr, &param);
+    task_caller_stats.priority = priority;
+}
+
+// Starts the task caller thread
+static void task_caller_start(void) {
+    // The thread must not wait behind a Python thread that got preempted
+    // while holding the lock. With priority inheritance, the holder is
+    // boosted until it releases the lock.
+    pthread_mutexattr_t mutex_attr;
+    pthread_mutexattr_init(&mutex_attr);
+    pthread_mutexattr_setprotocol(&mutex_attr, PTHREAD_PRIO_INHERIT);
+    pthread_mutex_init(&pbio_mutex, &mutex_attr);
+    pthread_mutexattr_destroy(&mutex_attr);
+
+    task_caller_timer = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (task_caller_timer == -1) {
+        fprintf(stderr, "Could not create control loop timer: %s\n", strerror(errno));
+        exit(1);
+    }
+
+    // First tick is one period from now, and every period after that
+    struct itimerspec spec;
+    clock_gettime(CLOCK_MONOTONIC, &spec.it_value);
+    task_caller_timer_start = timespec_to_us(&spec.it_value);
+    spec.it_interval.tv_sec = 0;
+    spec.it_interval.tv_nsec = PBIO_CONFIG_MOTORPOLL_TICK_MS * 1000000;
+    spec.it_value.tv_nsec += spec.it_interval.tv_nsec;
+    if (spec.it_value.tv_nsec >= 1000000000) {
+        spec.it_value.tv_sec++;
+        spec.it_value.tv_nsec -= 1000000000;
+    }
+    timerfd_settime(task_caller_timer, TFD_TIMER_ABSTIME, &spec, NULL);
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    task_caller_set_priority(&attr);
+
+    int ret = pthread_create(&task_caller_thread, &attr, task_caller, NULL);
+    if (ret == EPERM && task_caller_stats.priority) {
+        // Not allowed to use real-time scheduling, so run without it
+        fprintf(stderr, "Could not set real-time priority, running without.\n");
+        task_caller_stats.priority = 0;
+        pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+        ret = pthread_create(&task_caller_thread, &attr, task_caller, NULL);
+    }
+    pthread_attr_destroy(&attr);
+
+    if (ret != 0) {
+        fprintf(stderr, "Could not start control loop thread: %s\n", strerror(ret));
+        exit(1);
+    }
+}
+
+/**
+ * Gets the timing statistics of the thread that runs the control loop.
+ * @param [out] stats   The statistics
+ * @param [in]  reset   Whether to reset the statistics after getting them
+ */
+void pybricks_get_task_caller_stats(pybricks_task_caller_stats_t *stats, bool reset) {
+    pthread_mutex_lock(&pbio_mutex);
+    *stats = task_caller_stats;
+    if (reset) {
+        task_caller_stats = (pybricks_task_caller_stats_t) { .priority = stats->priority };
+    }
+    pthread_mutex_unlock(&pbio_mutex);
+}
+
+void pbio_lock(void) {
+    pthread_mutex_lock(&pbio_mutex);
+    pbio_motorcmd_process();
+}
+
+void pbio_unlock(void) {
+    // Make changes visible right away instead of after the next tick
+    _pbio_motorpoll_publish();
+    pthread_mutex_unlock(&pbio_mutex);
+}
+
 // Pybricks initialization tasks
 void pybricks_init() {
     GError *error = NULL;
@@ -99,7 +242,7 @@ void pybricks_init() {
     pbio_init();
     extern void ev3dev_status_light_init();
     ev3dev_status_light_init();
-    pthread_create(&task_caller_thread, NULL, task_caller, NULL);
+    task_caller_start();
 }
 
 // Pybricks deinitialization tasks
@@ -107,11 +250,13 @@ void pybricks_deinit() {
     // Signal motor thread to stop and wait for it to do so.
     stopping_thread = true;
     pthread_join(task_caller_thread, NULL);
+    close(task_caller_timer);
 }
 
 void pybricks_unhandled_exception() {
-    extern void _pbio_motorpoll_reset_all();
+    pbio_lock();
     _pbio_motorpoll_reset_all();
+    pbio_unlock();
     extern void _pb_ev3dev_speaker_beep_off();
     _pb_ev3dev_speaker_beep_off();
 }
@@ -4,8 +4,24 @@
 #ifndef MICROPY_INCLUDED_PBINIT_H
 #define MICROPY_INCLUDED_PBINIT_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Timing statistics of the thread that runs the control loop.
+ */
+typedef struct _pybricks_task_caller_stats_t {
+    int priority;               /**< SCHED_FIFO priority, or 0 if not real-time */
+    uint32_t ticks;             /**< Number of ticks that were handled */
+    uint32_t missed;            /**< Number of ticks that were skipped because the thread was too late */
+    uint32_t latency_max;       /**< Longest time from the deadline until the control loop ran (us) */
+    uint64_t latency_total;     /**< Sum of the above for all ticks (us) */
+} pybricks_task_caller_stats_t;
+
 void pybricks_init();
 
 void pybricks_deinit();
 
+void pybricks_get_task_caller_stats(pybricks_task_caller_stats_t *stats, bool reset);
+
 #endif // MICROPY_INCLUDED_PBINIT_H
@@ -6,3 +6,8 @@
 #define PBIO_CONFIG_LIGHT                   (1)
 #define PBIO_CONFIG_SERIAL                  (1)
 #define PBIO_CONFIG_TACHO                   (1)
+
+#define PBIO_CONFIG_MOTORCMD                (1)
+#define PBIO_CONFIG_MOTORPOLL_STATS         (1)
+
+#define PBIO_CONFIG_NUM_DRIVEBASES          (2)
@@ -10,5 +10,11 @@
 
 #define PBIO_CONFIG_UARTDEV                 (1)
 #define PBIO_CONFIG_UARTDEV_NUM_DEV         (6)
+#define PBIO_CONFIG_UARTDEV_STATS           (1)
 
 #define PBIO_CONFIG_ENABLE_SYS              (1)
+
+#define PBIO_CONFIG_MOTORPOLL_STATS         (1)
+
+#define PBIO_CONFIG_MOTORPOLL_TICK_MS       (2)
+#define PBIO_CONFIG_NUM_DRIVEBASES          (3)
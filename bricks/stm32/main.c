@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: MIT
 // Copyright (c) 2018-2020 The Pybricks Authors
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
@@ -8,6 +9,7 @@
 #include <pbio/button.h>
 #include <pbio/main.h>
 #include <pbio/light.h>
+#include <pbio/lzss.h>
 #include <pbsys/sys.h>
 
 #include <pybricks/util_mp/pb_obj_helper.h>
@@ -126,6 +128,220 @@ static pbio_error_t get_message(uint8_t *buf, uint32_t rx_len, int32_t time_out)
     }
 }
 
+// Writes data to the IDE, waiting for room in the stdout buffer if needed
+static pbio_error_t put_message(const uint8_t *buf, uint32_t tx_len) {
+    pbio_error_t err;
+    uint32_t count;
+
+    while (tx_len) {
+        while ((err = pbsys_stdout_write(buf, tx_len, &count)) == PBIO_ERROR_AGAIN) {
+            MICROPY_EVENT_POLL_HOOK
+        }
+        if (err != PBIO_SUCCESS) {
+            return err;
+        }
+        buf += count;
+        tx_len -= count;
+    }
+
+    return PBIO_SUCCESS;
+}
+
+// Download protocol version 2
+//
+// Instead of the program length, the IDE first sends DOWNLOAD_V2_MAGIC. This
+// is acknowledged with the usual checksum, followed by download_v2_info. Then
+// the IDE sends the program length as in the original protocol.
+//
+// The program is then split into chunks of DOWNLOAD_V2_CHUNK_SIZE bytes (the
+// last one may be shorter), which are sent as frames of:
+//
+//     chunk index (uint16 LE) | chunk data | CRC32 of index and data (LE)
+//
+// The IDE may send up to DOWNLOAD_V2_WINDOW frames before it has to wait for
+// an acknowledgement. Each reply is three bytes: DOWNLOAD_V2_ACK followed by
+// the index of the last chunk received in order, or DOWNLOAD_V2_NAK followed
+// by the index of the chunk to resend from. After a bad frame, the hub waits
+// until the IDE has stopped sending before replying with a NAK, so the IDE
+// can just resend everything from the given index. The hub also sends a NAK
+// whenever the line goes quiet before the download is complete, since the
+// IDE is then waiting for a reply that was lost, or for the rest of a frame
+// that lost some bytes.
+
+static const uint8_t download_v2_magic[4] = { 'P', 'B', 'D', '2' };
+
+#define DOWNLOAD_V2_CHUNK_SIZE (256)
+#define DOWNLOAD_V2_WINDOW (4)
+#define DOWNLOAD_V2_ACK (0x06)
+#define DOWNLOAD_V2_NAK (0x15)
+
+// How long the line has to be quiet before sending a NAK
+#define DOWNLOAD_V2_RESYNC_MS (100)
+
+// Give up if nothing at all arrives for this long. This is much longer than
+// the time the IDE waits for a reply before resending, so lost bytes are
+// recovered by NAKs and resends instead.
+#define DOWNLOAD_V2_TIMEOUT_MS (5000)
+
+static const uint8_t download_v2_info[4] = {
+    2, // protocol version
+    DOWNLOAD_V2_WINDOW,
+    DOWNLOAD_V2_CHUNK_SIZE & 0xff,
+    DOWNLOAD_V2_CHUNK_SIZE >> 8,
+};
+
+// CRC32 as used by zlib, one nibble at a time to keep the table small
+static uint32_t crc32_update(uint32_t crc, uint8_t data) {
+    static const uint32_t table[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC, 0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C, 0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+    crc ^= data;
+    crc = (crc >> 4) ^ table[crc & 0xf];
+    crc = (crc >> 4) ^ table[crc & 0xf];
+    return crc;
+}
+
+static pbio_error_t put_download_v2_reply(uint8_t status, uint32_t index) {
+    uint8_t reply[3] = { status, index & 0xff, (index >> 8) & 0xff };
+    return put_message(reply, sizeof(reply));
+}
+
+// Receive a program of known length with download protocol version 2
+static pbio_error_t get_program_v2(uint8_t *buf, uint32_t rx_len) {
+    uint32_t num_chunks = (rx_len + DOWNLOAD_V2_CHUNK_SIZE - 1) / DOWNLOAD_V2_CHUNK_SIZE;
+
+    // Next chunk that we need
+    uint32_t next = 0;
+    // Set after sending a NAK, until the requested chunk arrives
+    bool nak_sent = false;
+    // Set after a bad frame, until the line has been quiet for a while
+    bool resync = false;
+
+    // State of the frame being received
+    uint32_t pos = 0;
+    uint32_t index = 0;
+    uint32_t size = 0;
+    uint32_t crc = 0xffffffff;
+    uint32_t crc_rx = 0;
+
+    // Time of the last byte received, and of the last byte or NAK
+    mp_uint_t time_rx = mp_hal_ticks_ms();
+    mp_uint_t time_quiet = time_rx;
+    mp_uint_t time_now;
+    pbio_button_flags_t btn;
+    pbio_error_t err;
+    uint8_t c;
+
+    while (next < num_chunks) {
+
+        // Cancel if button is pressed
+        err = pbio_button_is_pressed(&btn);
+        if (err != PBIO_SUCCESS) {
+            return err;
+        }
+        if (btn & PBIO_BUTTON_CENTER) {
+            err = wait_for_button_release();
+            if (err != PBIO_SUCCESS) {
+                return err;
+            }
+            return PBIO_ERROR_CANCELED;
+        }
+
+        time_now = mp_hal_ticks_ms();
+
+        // Process everything that has arrived so far
+        while (next < num_chunks && pbsys_stdin_get_char(&c) == PBIO_SUCCESS) {
+            time_rx = time_now;
+            time_quiet = time_now;
+
+            if (resync) {
+                continue;
+            }
+
+            if (pos < 2) {
+                // Chunk index
+                crc = crc32_update(crc, c);
+                index |= c << (8 * pos);
+                if (pos == 1) {
+                    if (index >= num_chunks) {
+                        resync = true;
+                        continue;
+                    }
+                    size = MIN(DOWNLOAD_V2_CHUNK_SIZE, rx_len - index * DOWNLOAD_V2_CHUNK_SIZE);
+                }
+            } else if (pos < 2 + size) {
+                // Chunk data. Only chunks that arrive in order are kept.
+                crc = crc32_update(crc, c);
+                if (index == next) {
+                    buf[index * DOWNLOAD_V2_CHUNK_SIZE + pos - 2] = c;
+                }
+            } else {
+                // CRC32 of the frame
+                crc_rx |= (uint32_t)c << (8 * (pos - 2 - size));
+            }
+
+            if (++pos < 2 + size + 4) {
+                continue;
+            }
+
+            // Got a whole frame
+            if ((crc ^ 0xffffffff) != crc_rx) {
+                resync = true;
+                continue;
+            }
+
+            if (index == next) {
+                next++;
+                nak_sent = false;
+                err = put_download_v2_reply(DOWNLOAD_V2_ACK, index);
+            } else if (index < next) {
+                // The IDE missed an ACK, so tell it again how far we are
+                err = put_download_v2_reply(DOWNLOAD_V2_ACK, next - 1);
+            } else if (!nak_sent) {
+                // A chunk went missing
+                nak_sent = true;
+                err = put_download_v2_reply(DOWNLOAD_V2_NAK, next);
+            }
+            if (err != PBIO_SUCCESS) {
+                return err;
+            }
+
+            // Get ready for the next frame
+            pos = 0;
+            index = 0;
+            crc = 0xffffffff;
+            crc_rx = 0;
+        }
+
+        // When the line goes quiet, the IDE is waiting for a reply. The last
+        // frame was bad, cut short by lost bytes, or its ACK was lost, so ask
+        // for everything from the first missing chunk. After a bad frame,
+        // this also waits for the IDE to stop sending the rest of the window.
+        if (next < num_chunks && time_now - time_quiet > DOWNLOAD_V2_RESYNC_MS) {
+            resync = false;
+            nak_sent = true;
+            pos = 0;
+            index = 0;
+            crc = 0xffffffff;
+            crc_rx = 0;
+            err = put_download_v2_reply(DOWNLOAD_V2_NAK, next);
+            if (err != PBIO_SUCCESS) {
+                return err;
+            }
+            time_quiet = time_now;
+        }
+
+        if (next < num_chunks && time_now - time_rx > DOWNLOAD_V2_TIMEOUT_MS) {
+            return PBIO_ERROR_TIMEDOUT;
+        }
+
+        MICROPY_EVENT_POLL_HOOK
+    }
+
+    return PBIO_SUCCESS;
+}
+
 // Defined in linker script
 extern uint32_t _pb_user_mpy_size;
 extern uint8_t _pb_user_mpy_data;
@@ -161,6 +377,19 @@ static uint32_t get_user_program(uint8_t **buf, uint32_t *free_len) {
         return 0;
     }
 
+    // Newer IDEs ask for download protocol version 2 before sending the length
+    bool download_v2 = memcmp(&len, download_v2_magic, sizeof(len)) == 0;
+    if (download_v2) {
+        err = put_message(download_v2_info, sizeof(download_v2_info));
+        if (err != PBIO_SUCCESS) {
+            return 0;
+        }
+        err = get_message((uint8_t *)&len, sizeof(len), 500);
+        if (err != PBIO_SUCCESS) {
+            return 0;
+        }
+    }
+
     // Four spaces triggers REPL
     if (len == REPL_LEN) {
         return REPL_LEN;
@@ -178,7 +407,11 @@ static uint32_t get_user_program(uint8_t **buf, uint32_t *free_len) {
     }
 
     // Get the program
-    err = get_message(*buf, len, 500);
+    if (download_v2) {
+        err = get_program_v2(*buf, len);
+    } else {
+        err = get_message(*buf, len, 500);
+    }
 
     // Did not receive a whole program, so discard it
     if (err != PBIO_SUCCESS) {
@@ -190,6 +423,52 @@ static uint32_t get_user_program(uint8_t **buf, uint32_t *free_len) {
     return len;
 }
 
+// Programs compressed with tools/lzss.py start with this instead of the
+// usual .mpy header. The last byte gives the format of the compressed data.
+static const uint8_t lzss_magic[4] = {
+    'P', 'B', 'Z', (PBIO_LZSS_WINDOW_BITS << 4) | PBIO_LZSS_LENGTH_BITS,
+};
+
+// Reads a compressed .mpy, decompressing it on the fly so that the
+// uncompressed file never has to be in memory as a whole.
+typedef struct {
+    pbio_lzss_t lz;
+    const uint8_t *cur;
+    const uint8_t *end;
+    uint8_t *free_buf;
+    uint32_t free_len;
+} lzss_reader_t;
+
+static mp_uint_t lzss_reader_readbyte(void *data) {
+    lzss_reader_t *reader = data;
+    size_t in_len = reader->end - reader->cur;
+    size_t out_len = 1;
+    uint8_t c;
+    pbio_lzss_decode(&reader->lz, reader->cur, &in_len, &c, &out_len);
+    reader->cur += in_len;
+    return out_len ? c : MP_READER_EOF;
+}
+
+static void lzss_reader_close(void *data) {
+    lzss_reader_t *reader = data;
+    if (reader->free_len > 0) {
+        m_del(uint8_t, reader->free_buf, reader->free_len);
+    }
+    m_del_obj(lzss_reader_t, reader);
+}
+
+static void lzss_reader_new(mp_reader_t *reader, uint8_t *buf, uint32_t len, uint32_t free_len) {
+    lzss_reader_t *lzss = m_new_obj(lzss_reader_t);
+    pbio_lzss_init(&lzss->lz);
+    lzss->cur = buf + sizeof(lzss_magic);
+    lzss->end = buf + len;
+    lzss->free_buf = buf;
+    lzss->free_len = free_len;
+    reader->data = lzss;
+    reader->readbyte = lzss_reader_readbyte;
+    reader->close = lzss_reader_close;
+}
+
 static void run_user_program(uint32_t len, uint8_t *buf, uint32_t free_len) {
 
     if (len == 0) {
@@ -221,7 +500,11 @@ static void run_user_program(uint32_t len, uint8_t *buf, uint32_t free_len) {
     nlr_buf_t nlr;
     if (nlr_push(&nlr) == 0) {
         mp_reader_t reader;
-        mp_reader_new_mem(&reader, buf, len, free_len);
+        if (len >= sizeof(lzss_magic) && memcmp(buf, lzss_magic, sizeof(lzss_magic)) == 0) {
+            lzss_reader_new(&reader, buf, len, free_len);
+        } else {
+            mp_reader_new_mem(&reader, buf, len, free_len);
+        }
         mp_raw_code_t *raw_code = mp_raw_code_load(&reader);
         mp_obj_t module_fun = mp_make_function_from_raw_code(raw_code, MP_OBJ_NULL, MP_OBJ_NULL);
         mp_call_function_0(module_fun);
@@ -100,6 +100,7 @@ BUILD_DUAL_BOOT_BIN = $(PBTOP)/tools/build-dual-boot-bin.py
 BUILD_DUAL_BOOT_INSTALLER = $(PBTOP)/tools/build-dual-boot-installer.py
 CHECKSUM = $(PBTOP)/tools/checksum.py
 CHECKSUM_TYPE ?= xor
+LZSS = $(PBTOP)/tools/lzss.py
 METADATA = $(PBTOP)/tools/metadata.py
 OPENOCD ?= openocd
 OPENOCD_CONFIG ?= openocd_stm32$(PB_MCU_SERIES_LCASE).cfg
@@ -345,9 +346,12 @@ PBIO_SRC_C = $(addprefix lib/pbio/,\
 	src/light/color_light.c \
 	src/light/light_matrix.c \
 	src/logger.c \
+	src/lzss.c \
 	src/main.c \
 	src/math.c \
+	src/motorcmd.c \
 	src/motorpoll.c \
+	src/observer.c \
 	src/servo.c \
 	src/tacho.c \
 	src/trajectory_ext.c \
@@ -443,7 +447,19 @@ $(BUILD)/main.mpy: main.py
 	$(Q)$(MPY_CROSS) -o $@ $(MPY_CROSS_FLAGS) $<
 	$(ECHO) "`wc -c < $@` bytes"
 
-$(BUILD)/main.mpy.o: $(BUILD)/main.mpy
+$(BUILD)/main.mpy.lzss: $(BUILD)/main.mpy
+	$(ECHO) "LZSS $<"
+	$(Q)$(PYTHON) $(LZSS) $< $@
+	$(ECHO) "`wc -c < $@` bytes"
+
+# Hubs can set PB_COMPRESS_MAIN = 1 to store main.mpy compressed in flash
+ifeq ($(PB_COMPRESS_MAIN),1)
+MAIN_MPY = $(BUILD)/main.mpy.lzss
+else
+MAIN_MPY = $(BUILD)/main.mpy
+endif
+
+$(BUILD)/main.mpy.o: $(MAIN_MPY)
 	$(Q)$(OBJCOPY) -I binary -O elf32-littlearm -B arm \
 		--rename-section .data=.mpy,alloc,load,readonly,data,contents $^ $@
 
@@ -23,13 +23,20 @@ int mp_hal_stdin_rx_chr(void) {
 
 // Send string of given length
 void mp_hal_stdout_tx_strn(const char *str, mp_uint_t len) {
-    uint8_t c;
+    uint32_t count;
 
-    while (len--) {
-        c = *str++;
-        while (pbsys_stdout_put_char(c) == PBIO_ERROR_AGAIN) {
+    while (len) {
+        pbio_error_t err = pbsys_stdout_write((const uint8_t *)str, len, &count);
+        if (err == PBIO_ERROR_AGAIN) {
             // only run pbio events here - don't want keyboard interrupt in middle of printf()
             MICROPY_VM_HOOK_LOOP
+            continue;
+        }
+        if (err != PBIO_SUCCESS) {
+            // nowhere to send it, e.g. no connection, so the data is discarded
+            break;
         }
+        str += count;
+        len -= count;
     }
 }
@@ -9,5 +9,9 @@
 
 #define PBIO_CONFIG_UARTDEV                 (1)
 #define PBIO_CONFIG_UARTDEV_NUM_DEV         (4)
+#define PBIO_CONFIG_UARTDEV_STATS           (1)
 
 #define PBIO_CONFIG_ENABLE_SYS              (1)
+
+#define PBIO_CONFIG_MOTORPOLL_TICK_MS       (2)
+#define PBIO_CONFIG_NUM_DRIVEBASES          (2)
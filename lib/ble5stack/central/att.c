@@ -82,7 +82,12 @@ bStatus_t ATT_WriteRsp(uint16_t connHandle) {
 }
 
 bStatus_t ATT_HandleValueNoti(uint16_t connHandle, attHandleValueNoti_t *pNoti) {
-    uint8_t buf[32];
+    // big enough for notifications with a negotiated ATT_MTU larger than the default
+    uint8_t buf[TX_BUFFER_SIZE];
+
+    if (5 + pNoti->len > sizeof(buf)) {
+        return bleInvalidRange;
+    }
 
     buf[0] = connHandle & 0xFF;
     buf[1] = (connHandle >> 8) & 0xFF;
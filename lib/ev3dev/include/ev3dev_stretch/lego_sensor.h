@@ -51,7 +51,7 @@ typedef struct _lego_sensor_t lego_sensor_t;
 
 pbio_error_t lego_sensor_get(lego_sensor_t **sensor, pbio_port_t port, pbio_iodev_type_id_t valid_id);
 
-pbio_error_t lego_sensor_get_info(lego_sensor_t *sensor, uint8_t *data_len, lego_sensor_data_type_t *data_type);
+pbio_error_t lego_sensor_get_info(lego_sensor_t *sensor, uint8_t mode, uint8_t *data_len, lego_sensor_data_type_t *data_type);
 
 pbio_error_t lego_sensor_get_bin_data(lego_sensor_t *sensor, uint8_t **bin_data);
 
@@ -61,4 +61,8 @@ pbio_error_t lego_sensor_get_mode(lego_sensor_t *sensor, uint8_t *mode);
 
 pbio_error_t lego_sensor_set_mode(lego_sensor_t *sensor, uint8_t mode);
 
+pbio_error_t lego_sensor_get_hotplug_fd(int *fd);
+
+void lego_sensor_clear_hotplug(void);
+
 #endif // _PBIO_LEGO_SENSOR_H_
@@ -4,7 +4,9 @@
 #ifndef _PBIO_EV3DEVSYSFS_H_
 #define _PBIO_EV3DEVSYSFS_H_
 
+#include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 
 #include <pbio/error.h>
 #include <pbio/iodev.h>
@@ -27,5 +29,15 @@ pbio_error_t sysfs_read_int(FILE *file, int *dest);
 
 pbio_error_t sysfs_write_int(FILE *file, int val);
 
+pbio_error_t sysfs_open_fd(int *fd, const char *path);
+
+pbio_error_t sysfs_open_sensor_attr_fd(int *fd, int n, const char *attribute);
+
+pbio_error_t sysfs_parse_int(const char *buf, size_t len, int32_t *dest);
+
+pbio_error_t sysfs_pread_int(int fd, int32_t *dest);
+
+pbio_error_t sysfs_pread_bin(int fd, uint8_t *dest, size_t size);
+
 
 #endif // _PBIO_EV3DEVSYSFS_H_
@@ -5,6 +5,9 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
+
+#include <libudev.h>
 
 #include <ev3dev_stretch/lego_port.h>
 #include <ev3dev_stretch/lego_sensor.h>
@@ -17,66 +20,121 @@
 #define MAX_PATH_LENGTH 60
 #define MAX_READ_LENGTH "60"
 #define BIN_DATA_SIZE   32 // size of bin_data sysfs attribute
+#define MAX_MODES       12
+
+// Data info of one mode, as read from sysfs the first time the mode is used
+typedef struct {
+    uint8_t data_len;
+    lego_sensor_data_type_t data_type;
+} lego_sensor_mode_info_t;
 
 struct _lego_sensor_t {
     int n_sensor;
     int n_modes;
     FILE *f_mode;
     FILE *f_driver_name;
-    FILE *f_bin_data;
+    int fd_bin_data;
     FILE *f_num_values;
     FILE *f_bin_data_format;
-    char modes[12][17];
+    char modes[MAX_MODES][17];
+    // Whether the attributes above are open. While initializing, some of
+    // them may still be NULL or -1.
+    bool open;
+    // The detected device ID
+    pbio_iodev_type_id_t id;
+    // The current mode, if mode_known
+    uint8_t mode;
+    bool mode_known;
+    // Bit i is set if info[i] was read for mode i
+    uint16_t info_valid;
+    lego_sensor_mode_info_t info[MAX_MODES];
     uint8_t bin_data[PBIO_IODEV_MAX_DATA_SIZE]  __attribute__((aligned(32)));
 };
-// Initialize an ev3dev sensor by opening the relevant sysfs attributes
-static pbio_error_t ev3_sensor_init(lego_sensor_t *sensor, pbio_port_t port) {
-    pbio_error_t err;
 
-    err = sysfs_get_number(port, "/sys/class/lego-sensor", &sensor->n_sensor);
-    if (err != PBIO_SUCCESS) {
-        return err;
+// Close all sysfs attributes of a sensor, so it can be initialized again
+static void ev3_sensor_close(lego_sensor_t *sensor) {
+    if (!sensor->open) {
+        return;
+    }
+
+    FILE **files[] = { &sensor->f_driver_name, &sensor->f_mode, &sensor->f_bin_data_format, &sensor->f_num_values };
+    for (size_t i = 0; i < PBIO_ARRAY_SIZE(files); i++) {
+        if (*files[i]) {
+            fclose(*files[i]);
+            *files[i] = NULL;
+        }
+    }
+    if (sensor->fd_bin_data != -1) {
+        close(sensor->fd_bin_data);
+        sensor->fd_bin_data = -1;
     }
 
-    err = sysfs_open_sensor_attr(&sensor->f_driver_name, sensor->n_sensor, "driver_name", "r");
+    sensor->open = false;
+}
+
+// Get the ev3dev sensor number for a given port
+static pbio_error_t ev3_sensor_get_number(pbio_port_t port, int *n_sensor) {
+    return sysfs_get_number(port, "/sys/class/lego-sensor", n_sensor);
+}
+
+// Initialize an ev3dev sensor by opening the relevant sysfs attributes
+static pbio_error_t ev3_sensor_init(lego_sensor_t *sensor, int n_sensor) {
+    pbio_error_t err;
+
+    // Forget everything about the previous sensor on this port
+    ev3_sensor_close(sensor);
+    sensor->n_sensor = -1;
+    sensor->f_driver_name = NULL;
+    sensor->f_mode = NULL;
+    sensor->f_bin_data_format = NULL;
+    sensor->f_num_values = NULL;
+    sensor->fd_bin_data = -1;
+    sensor->mode_known = false;
+    sensor->info_valid = 0;
+    sensor->open = true;
+
+    err = sysfs_open_sensor_attr(&sensor->f_driver_name, n_sensor, "driver_name", "r");
     if (err != PBIO_SUCCESS) {
         return err;
     }
 
-    err = sysfs_open_sensor_attr(&sensor->f_mode, sensor->n_sensor, "mode", "r+");
+    err = sysfs_open_sensor_attr(&sensor->f_mode, n_sensor, "mode", "r+");
     if (err != PBIO_SUCCESS) {
         return err;
     }
 
-    err = sysfs_open_sensor_attr(&sensor->f_bin_data_format, sensor->n_sensor, "bin_data_format", "r");
+    err = sysfs_open_sensor_attr(&sensor->f_bin_data_format, n_sensor, "bin_data_format", "r");
     if (err != PBIO_SUCCESS) {
         return err;
     }
 
-    err = sysfs_open_sensor_attr(&sensor->f_num_values, sensor->n_sensor, "num_values", "r");
+    err = sysfs_open_sensor_attr(&sensor->f_num_values, n_sensor, "num_values", "r");
     if (err != PBIO_SUCCESS) {
         return err;
     }
 
-    err = sysfs_open_sensor_attr(&sensor->f_bin_data, sensor->n_sensor, "bin_data", "rb");
+    err = sysfs_open_sensor_attr_fd(&sensor->fd_bin_data, n_sensor, "bin_data");
     if (err != PBIO_SUCCESS) {
         return err;
     }
 
     FILE *f_modes;
-    err = sysfs_open_sensor_attr(&f_modes, sensor->n_sensor, "modes", "r");
+    err = sysfs_open_sensor_attr(&f_modes, n_sensor, "modes", "r");
     if (err != PBIO_SUCCESS) {
         return err;
     }
 
     sensor->n_modes = 0;
-    while (fscanf(f_modes, " %16s", sensor->modes[sensor->n_modes]) == 1) {
+    while (sensor->n_modes < MAX_MODES && fscanf(f_modes, " %16s", sensor->modes[sensor->n_modes]) == 1) {
         sensor->n_modes++;
     };
     if (fclose(f_modes) != 0) {
         return PBIO_ERROR_IO;
     }
 
+    // Only a fully initialized sensor can be used again later
+    sensor->n_sensor = n_sensor;
+
     return PBIO_SUCCESS;
 }
 
@@ -128,15 +186,10 @@ static pbio_error_t ev3_sensor_get_id(lego_sensor_t *sensor, pbio_iodev_type_id_
     return PBIO_SUCCESS;
 }
 
-// Get the device ID
+// Assert that the device has the expected ID
 static pbio_error_t ev3_sensor_assert_id(lego_sensor_t *sensor, pbio_iodev_type_id_t valid_id) {
 
-    pbio_error_t err;
-    pbio_iodev_type_id_t id;
-    err = ev3_sensor_get_id(sensor, &id);
-    if (err != PBIO_SUCCESS) {
-        return err;
-    }
+    pbio_iodev_type_id_t id = sensor->id;
 
     // If we are here, we have already confirmed that a lego-sensor exists.
     // So if the user asserts that this should be a LUMP or lego-sensor, this passes.
@@ -181,15 +234,31 @@ pbio_error_t lego_sensor_get(lego_sensor_t **sensor, pbio_port_t port, pbio_iode
     if (valid_id == PBIO_IODEV_TYPE_ID_CUSTOM_I2C  ||
         valid_id == PBIO_IODEV_TYPE_ID_CUSTOM_UART ||
         valid_id == PBIO_IODEV_TYPE_ID_NXT_COLOR_SENSOR) {
+        ev3_sensor_close(*sensor);
         return PBIO_SUCCESS;
     }
 
-    // Initialize sysfs
-    err = ev3_sensor_init(*sensor, port);
+    // Find the sensor on this port
+    int n_sensor;
+    err = ev3_sensor_get_number(port, &n_sensor);
     if (err != PBIO_SUCCESS) {
         return err;
     }
 
+    // ev3dev gives a new number to each sensor that is attached, so if the
+    // number is the same, this is still the sensor we already have open and
+    // we can keep what we know about it. Otherwise, start over.
+    if (!(*sensor)->open || n_sensor != (*sensor)->n_sensor) {
+        err = ev3_sensor_init(*sensor, n_sensor);
+        if (err == PBIO_SUCCESS) {
+            err = ev3_sensor_get_id(*sensor, &(*sensor)->id);
+        }
+        if (err != PBIO_SUCCESS) {
+            ev3_sensor_close(*sensor);
+            return err;
+        }
+    }
+
     // Assert that the expected device is attached
     err = ev3_sensor_assert_id(*sensor, valid_id);
     if (err != PBIO_SUCCESS) {
@@ -198,8 +267,23 @@ pbio_error_t lego_sensor_get(lego_sensor_t **sensor, pbio_port_t port, pbio_iode
     return PBIO_SUCCESS;
 }
 
-// Get the device info
-pbio_error_t lego_sensor_get_info(lego_sensor_t *sensor, uint8_t *data_len, lego_sensor_data_type_t *data_type) {
+// Data types as given by the bin_data_format attribute
+static const struct {
+    const char *name;
+    lego_sensor_data_type_t data_type;
+} data_types[] = {
+    { "s8", LEGO_SENSOR_DATA_TYPE_INT8 },
+    { "u8", LEGO_SENSOR_DATA_TYPE_UINT8 },
+    { "s16", LEGO_SENSOR_DATA_TYPE_INT16 },
+    { "u16", LEGO_SENSOR_DATA_TYPE_UINT16 },
+    { "s32", LEGO_SENSOR_DATA_TYPE_INT32 },
+    { "u32", LEGO_SENSOR_DATA_TYPE_UINT32 },
+    { "s16_be", LEGO_SENSOR_DATA_TYPE_INT16_BE },
+    { "float", LEGO_SENSOR_DATA_TYPE_FLOAT },
+};
+
+// Read the data info of the current mode from sysfs
+static pbio_error_t ev3_sensor_read_info(lego_sensor_t *sensor, lego_sensor_mode_info_t *info) {
 
     pbio_error_t err;
 
@@ -209,7 +293,7 @@ pbio_error_t lego_sensor_get_info(lego_sensor_t *sensor, uint8_t *data_len, lego
     if (err != PBIO_SUCCESS) {
         return err;
     }
-    *data_len = data_len_int;
+    info->data_len = data_len_int;
 
     // Read data type attribute
     char s_data_type[MAX_PATH_LENGTH];
@@ -219,34 +303,51 @@ pbio_error_t lego_sensor_get_info(lego_sensor_t *sensor, uint8_t *data_len, lego
     }
 
     // Convert data type identifier
-    if (!strcmp(s_data_type, "s8")) {
-        *data_type = LEGO_SENSOR_DATA_TYPE_INT8;
-    }
-    else if (!strcmp(s_data_type, "u8")) {
-        *data_type = LEGO_SENSOR_DATA_TYPE_UINT8;
-    }
-    else if (!strcmp(s_data_type, "s16")) {
-        *data_type = LEGO_SENSOR_DATA_TYPE_INT16;
-    }
-    else if (!strcmp(s_data_type, "u16")) {
-        *data_type = LEGO_SENSOR_DATA_TYPE_UINT16;
-    }
-    else if (!strcmp(s_data_type, "s32")) {
-        *data_type = LEGO_SENSOR_DATA_TYPE_INT32;
-    }
-    else if (!strcmp(s_data_type, "u32")) {
-        *data_type = LEGO_SENSOR_DATA_TYPE_UINT32;
+    for (size_t i = 0; i < PBIO_ARRAY_SIZE(data_types); i++) {
+        if (!strcmp(s_data_type, data_types[i].name)) {
+            info->data_type = data_types[i].data_type;
+            return PBIO_SUCCESS;
+        }
     }
-    else if (!strcmp(s_data_type, "s16_be")) {
-        *data_type = LEGO_SENSOR_DATA_TYPE_INT16_BE;
+    return PBIO_ERROR_FAILED;
+}
+
+/**
+ * Gets the number of values and their data type for a mode. These are read
+ * from sysfs only the first time, which requires the mode to be active.
+ * @param [in]  sensor      The sensor
+ * @param [in]  mode        The mode
+ * @param [out] data_len    The number of values
+ * @param [out] data_type   The data type of the values
+ * @return                  ::PBIO_ERROR_INVALID_OP if the info is not known
+ *                          yet and the mode is not active, otherwise an error
+ *                          code
+ */
+pbio_error_t lego_sensor_get_info(lego_sensor_t *sensor, uint8_t mode, uint8_t *data_len, lego_sensor_data_type_t *data_type) {
+
+    if (!sensor->open) {
+        return PBIO_ERROR_INVALID_OP;
     }
-    else if (!strcmp(s_data_type, "float")) {
-        *data_type = LEGO_SENSOR_DATA_TYPE_FLOAT;
+    if (mode >= sensor->n_modes) {
+        return PBIO_ERROR_INVALID_ARG;
     }
-    else {
-        return PBIO_ERROR_FAILED;
+
+    lego_sensor_mode_info_t *info = &sensor->info[mode];
+
+    if (!(sensor->info_valid & (1 << mode))) {
+        // The attributes only describe the active mode
+        if (!sensor->mode_known || sensor->mode != mode) {
+            return PBIO_ERROR_INVALID_OP;
+        }
+        pbio_error_t err = ev3_sensor_read_info(sensor, info);
+        if (err != PBIO_SUCCESS) {
+            return err;
+        }
+        sensor->info_valid |= 1 << mode;
     }
 
+    *data_len = info->data_len;
+    *data_type = info->data_type;
     return PBIO_SUCCESS;
 }
 
@@ -254,7 +355,7 @@ pbio_error_t lego_sensor_get_info(lego_sensor_t *sensor, uint8_t *data_len, lego
 pbio_error_t lego_sensor_get_mode_id_from_str(lego_sensor_t *sensor, const char *mode_str, uint8_t *mode) {
 
     // Find matching port mode string
-    for (size_t i = 0; i < PBIO_ARRAY_SIZE(sensor->modes); i++) {
+    for (int i = 0; i < sensor->n_modes; i++) {
         if (!strcmp(mode_str, sensor->modes[i])) {
             *mode = i;
             return PBIO_SUCCESS;
@@ -265,20 +366,28 @@ pbio_error_t lego_sensor_get_mode_id_from_str(lego_sensor_t *sensor, const char
     return PBIO_ERROR_INVALID_ARG;
 }
 
-// Get the current sensor mode
+// Get the current sensor mode. It is read from sysfs only the first time,
+// after which we keep track of it as we change it.
 pbio_error_t lego_sensor_get_mode(lego_sensor_t *sensor, uint8_t *mode) {
 
-    pbio_error_t err;
+    if (!sensor->mode_known) {
+        // Read mode string
+        char mode_str[MAX_PATH_LENGTH];
+        pbio_error_t err = sysfs_read_str(sensor->f_mode, mode_str);
+        if (err != PBIO_SUCCESS) {
+            return err;
+        }
 
-    // Read mode string
-    char mode_str[PBIO_ARRAY_SIZE(sensor->modes[0])];
-    err = sysfs_read_str(sensor->f_mode, mode_str);
-    if (err != PBIO_SUCCESS) {
-        return err;
+        // Find matching mode id
+        err = lego_sensor_get_mode_id_from_str(sensor, mode_str, &sensor->mode);
+        if (err != PBIO_SUCCESS) {
+            return err;
+        }
+        sensor->mode_known = true;
     }
 
-    // Return matching mode id
-    return lego_sensor_get_mode_id_from_str(sensor, mode_str, mode);
+    *mode = sensor->mode;
+    return PBIO_SUCCESS;
 }
 
 // Set the sensor mode
@@ -288,20 +397,78 @@ pbio_error_t lego_sensor_set_mode(lego_sensor_t *sensor, uint8_t mode) {
         return PBIO_ERROR_INVALID_ARG;
     }
 
-    return sysfs_write_str(sensor->f_mode, sensor->modes[mode]);
+    // If this fails, we no longer know which mode is active
+    sensor->mode_known = false;
+    pbio_error_t err = sysfs_write_str(sensor->f_mode, sensor->modes[mode]);
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+
+    sensor->mode = mode;
+    sensor->mode_known = true;
+    return PBIO_SUCCESS;
 }
 
 // Read 32 bytes from bin_data attribute
 pbio_error_t lego_sensor_get_bin_data(lego_sensor_t *sensor, uint8_t **bin_data) {
-    if (fseek(sensor->f_bin_data, 0, SEEK_SET) == -1) {
-        return PBIO_ERROR_IO;
-    }
-
-    if (fread(sensor->bin_data, 1, BIN_DATA_SIZE, sensor->f_bin_data) < BIN_DATA_SIZE) {
-        return PBIO_ERROR_IO;
+    pbio_error_t err = sysfs_pread_bin(sensor->fd_bin_data, sensor->bin_data, BIN_DATA_SIZE);
+    if (err != PBIO_SUCCESS) {
+        return err;
     }
 
     *bin_data = sensor->bin_data;
 
     return PBIO_SUCCESS;
 }
+
+// Monitor for sensors and ports that are added, removed or changed
+static struct udev *udev;
+static struct udev_monitor *monitor;
+
+/**
+ * Gets a file descriptor that becomes readable when a sensor or port is
+ * added, removed or changed, such as after changing the mode of a port. The
+ * events must be cleared with lego_sensor_clear_hotplug().
+ * @param [out] fd      The file descriptor
+ * @return              Error code
+ */
+pbio_error_t lego_sensor_get_hotplug_fd(int *fd) {
+    if (!monitor) {
+        udev = udev_new();
+        if (!udev) {
+            return PBIO_ERROR_FAILED;
+        }
+
+        monitor = udev_monitor_new_from_netlink(udev, "udev");
+        if (!monitor) {
+            udev = udev_unref(udev);
+            return PBIO_ERROR_FAILED;
+        }
+
+        if (udev_monitor_filter_add_match_subsystem_devtype(monitor, "lego-sensor", NULL) < 0 ||
+            udev_monitor_filter_add_match_subsystem_devtype(monitor, "lego-port", NULL) < 0 ||
+            udev_monitor_enable_receiving(monitor) < 0) {
+            monitor = udev_monitor_unref(monitor);
+            udev = udev_unref(udev);
+            return PBIO_ERROR_FAILED;
+        }
+    }
+
+    *fd = udev_monitor_get_fd(monitor);
+    return PBIO_SUCCESS;
+}
+
+/**
+ * Discards all events that were received by the hotplug monitor so far.
+ */
+void lego_sensor_clear_hotplug(void) {
+    struct udev_device *device;
+
+    if (!monitor) {
+        return;
+    }
+
+    while ((device = udev_monitor_receive_device(monitor))) {
+        udev_device_unref(device);
+    }
+}
@@ -2,11 +2,15 @@
 // Copyright (c) 2018-2020 The Pybricks Authors
 
 #include <dirent.h>
+#include <fcntl.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <unistd.h>
 
 #include <ev3dev_stretch/lego_sensor.h>
+#include <ev3dev_stretch/sysfs.h>
 
 #include <pbio/port.h>
 #include <pbio/iodev.h>
@@ -144,3 +148,92 @@ pbio_error_t sysfs_write_int(FILE *file, int val) {
 
     return PBIO_SUCCESS;
 }
+
+// The functions below use raw file descriptors instead of stdio, for
+// attributes that are read on every control loop iteration. Each read is a
+// single pread() syscall into a buffer on the stack, without seeking or the
+// overhead of scanf.
+
+// Most digits in an int32_t value
+#define MAX_INT_DIGITS 10
+
+// Longest integer attribute value, including sign and newline
+#define MAX_INT_LENGTH (MAX_INT_DIGITS + 2)
+
+// Open a sysfs attribute for reading with sysfs_pread_*()
+pbio_error_t sysfs_open_fd(int *fd, const char *path) {
+    *fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (*fd == -1) {
+        return PBIO_ERROR_IO;
+    }
+
+    return PBIO_SUCCESS;
+}
+
+// Open a sensor sysfs attribute for reading with sysfs_pread_*()
+pbio_error_t sysfs_open_sensor_attr_fd(int *fd, int n, const char *attribute) {
+    char path[MAX_PATH_LENGTH];
+
+    snprintf(path, MAX_PATH_LENGTH, "/sys/class/lego-sensor/sensor%d/%s", n, attribute);
+    return sysfs_open_fd(fd, path);
+}
+
+// Parse a decimal integer, optionally negative, such as "-123\n"
+pbio_error_t sysfs_parse_int(const char *buf, size_t len, int32_t *dest) {
+    size_t i = 0;
+    bool negative = false;
+
+    if (len > 0 && buf[0] == '-') {
+        negative = true;
+        i++;
+    }
+
+    // Need at least one digit
+    if (i == len || buf[i] < '0' || buf[i] > '9') {
+        return PBIO_ERROR_IO;
+    }
+
+    // Accumulate as negative, so that INT32_MIN does not overflow
+    int32_t value = 0;
+    size_t digits = 0;
+    for (; i < len && buf[i] >= '0' && buf[i] <= '9'; i++) {
+        int32_t digit = buf[i] - '0';
+        if (++digits > MAX_INT_DIGITS || value < (INT32_MIN + digit) / 10) {
+            return PBIO_ERROR_IO;
+        }
+        value = value * 10 - digit;
+    }
+
+    // Positive values cannot be INT32_MIN negated
+    if (!negative) {
+        if (value == INT32_MIN) {
+            return PBIO_ERROR_IO;
+        }
+        value = -value;
+    }
+
+    *dest = value;
+
+    return PBIO_SUCCESS;
+}
+
+// Read an int from a sysfs attribute opened with sysfs_open_fd()
+pbio_error_t sysfs_pread_int(int fd, int32_t *dest) {
+    char buf[MAX_INT_LENGTH];
+
+    ssize_t len = pread(fd, buf, sizeof(buf), 0);
+    if (len <= 0) {
+        return PBIO_ERROR_IO;
+    }
+
+    return sysfs_parse_int(buf, len, dest);
+}
+
+// Read exactly size bytes from a binary sysfs attribute opened with sysfs_open_fd()
+pbio_error_t sysfs_pread_bin(int fd, uint8_t *dest, size_t size) {
+    if (pread(fd, dest, size, 0) != (ssize_t)size) {
+        return PBIO_ERROR_IO;
+    }
+
+    return PBIO_SUCCESS;
+}
@@ -19,6 +19,7 @@
 #include <pbsys/sys.h>
 
 #include <contiki.h>
+#include <contiki-lib.h>
 #include <stm32f0xx.h>
 
 #include <att.h>
@@ -62,6 +63,12 @@
 // max data size for nRF UART characteristics
 #define NRF_CHAR_SIZE 20
 
+// largest ATT_MTU that we request or accept
+#define MAX_ATT_MTU 158
+
+// size of nRF UART tx buffer (must be power of 2 for ring buffer!)
+#define UART_TX_BUF_SIZE 128
+
 
 // Tx buffer for SPI writes
 static uint8_t write_buf[TX_BUFFER_SIZE];
@@ -85,6 +92,8 @@ static bool hci_command_status;
 static bool hci_command_complete;
 // handle to connected Bluetooth device
 static uint16_t conn_handle = NO_CONNECTION;
+// ATT_MTU negotiated for the current connection
+static uint16_t conn_mtu = ATT_MTU_SIZE;
 
 // GATT service handles
 static uint16_t gatt_service_handle, gatt_service_end_handle;
@@ -96,12 +105,14 @@ static uint16_t pybricks_service_handle, pybricks_service_end_handle, pybricks_c
 static uint16_t uart_service_handle, uart_service_end_handle, uart_rx_char_handle, uart_tx_char_handle;
 // nRF UART tx notifications enabled
 static bool uart_tx_notify_en;
-// nRF UART tx is in progress
-static bool uart_tx_busy;
 // buffer to queue UART tx data
-static uint8_t uart_tx_buf[NRF_CHAR_SIZE];
-// bytes used in uart_tx_buf
-static uint8_t uart_tx_buf_size;
+static struct ringbuf uart_tx_buf;
+// memory for uart_tx_buf
+static uint8_t uart_tx_data[UART_TX_BUF_SIZE];
+// data for the nRF UART tx notification that is being sent
+static uint8_t uart_tx_noti_buf[MAX_ATT_MTU - 3];
+// bytes used in uart_tx_noti_buf
+static uint8_t uart_tx_noti_size;
 
 // 6e400001-b5a3-f393-e0a-9e50e24dcca9e
 static const uint8_t pybricks_service_uuid[] = {
@@ -358,9 +369,18 @@ static void handle_event(uint8_t *packet) {
             switch (event_code) {
                 case ATT_EVENT_EXCHANGE_MTU_REQ: {
                     attExchangeMTURsp_t rsp;
+                    uint16_t client_mtu = (data[7] << 8) | data[6];
 
-                    rsp.serverRxMTU = 158;
+                    rsp.serverRxMTU = MAX_ATT_MTU;
                     ATT_ExchangeMTURsp(connection_handle, &rsp);
+                    conn_mtu = MAX(ATT_MTU_SIZE, MIN(client_mtu, MAX_ATT_MTU));
+                }
+                break;
+
+                case ATT_EVENT_EXCHANGEMTURSP: {
+                    uint16_t server_mtu = (data[7] << 8) | data[6];
+
+                    conn_mtu = MAX(ATT_MTU_SIZE, MIN(server_mtu, MAX_ATT_MTU));
                 }
                 break;
 
@@ -583,6 +603,7 @@ static void handle_event(uint8_t *packet) {
 
                 case GAP_LINK_ESTABLISHED:
                     conn_handle = (data[11] << 8) | data[10];
+                    conn_mtu = ATT_MTU_SIZE;
                     DBG("link: %04x", conn_handle);
                     break;
 
@@ -1102,32 +1123,53 @@ static PT_THREAD(set_discoverable(struct pt *pt)) {
     PT_END(pt);
 }
 
-pbio_error_t pbdrv_bluetooth_tx(uint8_t c) {
+pbio_error_t pbdrv_bluetooth_tx_buf(const uint8_t *data, uint32_t size, uint32_t *count) {
+    *count = 0;
+
     // make sure we have a Bluetooth connection
     if (!uart_tx_notify_en) {
         return PBIO_ERROR_INVALID_OP;
     }
 
-    // can't add the the buffer if tx is in progress or buffer is full
-    if (uart_tx_busy || uart_tx_buf_size == NRF_CHAR_SIZE) {
-        return PBIO_ERROR_AGAIN;
+    while (*count < size && ringbuf_put(&uart_tx_buf, data[*count])) {
+        (*count)++;
     }
 
-    // append the char
-    uart_tx_buf[uart_tx_buf_size] = c;
-    uart_tx_buf_size++;
+    if (size && *count == 0) {
+        return PBIO_ERROR_AGAIN;
+    }
 
-    // poke the process to start tx soon-ish. This way, we can accumulate up to
-    // NRF_CHAR_SIZE bytes before actually transmitting
-    // TODO: it probably would be better to poll here instead of using events
-    // so that we don't fill up the event queue with 20 events
-    process_post(&pbdrv_bluetooth_hci_process, PROCESS_EVENT_MSG, NULL);
+    // poke the process to start tx soon-ish. This way, we can accumulate more
+    // bytes before actually transmitting. Polling instead of posting events
+    // so that we don't fill up the event queue.
+    process_poll(&pbdrv_bluetooth_hci_process);
 
     return PBIO_SUCCESS;
 }
 
+pbio_error_t pbdrv_bluetooth_tx(uint8_t c) {
+    uint32_t count;
+    return pbdrv_bluetooth_tx_buf(&c, 1, &count);
+}
+
+static PT_THREAD(exchange_mtu(struct pt *pt)) {
+    attExchangeMTUReq_t req;
+
+    PT_BEGIN(pt);
+
+    PT_WAIT_WHILE(pt, write_xfer_size);
+    req.clientRxMTU = MAX_ATT_MTU;
+    GATT_ExchangeMTU(conn_handle, &req);
+    PT_WAIT_UNTIL(pt, hci_command_status);
+    // the negotiated MTU arrives later in ATT_EVENT_EXCHANGEMTURSP
+
+    PT_END(pt);
+}
+
 static PT_THREAD(uart_service_send_data(struct pt *pt))
 {
+    static struct etimer retry_timer;
+
     PT_BEGIN(pt);
 
 retry:
@@ -1141,8 +1183,8 @@ retry:
         attHandleValueNoti_t req;
 
         req.handle = uart_tx_char_handle;
-        req.len = uart_tx_buf_size;
-        req.pValue = uart_tx_buf;
+        req.len = uart_tx_noti_size;
+        req.pValue = uart_tx_noti_buf;
         ATT_HandleValueNoti(conn_handle, &req);
     }
     PT_WAIT_UNTIL(pt, hci_command_status);
@@ -1151,6 +1193,13 @@ retry:
     if (status == blePending) {
         goto retry;
     }
+    if (status == bleNoResources) {
+        // The stack has queued as many notifications as it can for now. They
+        // are sent at the next connection event, so try again a bit later.
+        etimer_set(&retry_timer, clock_from_msec(5));
+        PT_WAIT_UNTIL(pt, etimer_expired(&retry_timer));
+        goto retry;
+    }
 
     PT_END(pt);
 }
@@ -1206,11 +1255,17 @@ PROCESS_THREAD(pbdrv_bluetooth_hci_process, ev, data) {
         PROCESS_PT_SPAWN(&child_pt, init_uart_service(&child_pt));
         PROCESS_PT_SPAWN(&child_pt, set_discoverable(&child_pt));
 
+        // drop anything left over from a previous connection
+        ringbuf_init(&uart_tx_buf, uart_tx_data, UART_TX_BUF_SIZE);
+
         // TODO: we should have a timeout and stop scanning eventually
         pbsys_status_set(PBSYS_STATUS_BLE_ADVERTISING);
         PROCESS_WAIT_UNTIL(conn_handle != NO_CONNECTION);
         pbsys_status_clear(PBSYS_STATUS_BLE_ADVERTISING);
 
+        // ask for a larger MTU so that notifications can carry more data
+        PROCESS_PT_SPAWN(&child_pt, exchange_mtu(&child_pt));
+
         etimer_set(&timer, clock_from_msec(500));
 
         // conn_handle is set to 0 upon disconnection
@@ -1221,11 +1276,15 @@ PROCESS_THREAD(pbdrv_bluetooth_hci_process, ev, data) {
                 // just occasionally checking to see if we are still connected
                 continue;
             }
-            if (ev == PROCESS_EVENT_MSG && uart_tx_buf_size) {
-                uart_tx_busy = true;
+            // Send everything that has been queued, in notifications as large
+            // as the MTU allows. The stack can queue several notifications per
+            // connection interval, so we only have to wait when it is full.
+            while (uart_tx_notify_en && ringbuf_elements(&uart_tx_buf)) {
+                uart_tx_noti_size = 0;
+                while (uart_tx_noti_size < conn_mtu - 3 && ringbuf_elements(&uart_tx_buf)) {
+                    uart_tx_noti_buf[uart_tx_noti_size++] = ringbuf_get(&uart_tx_buf);
+                }
                 PROCESS_PT_SPAWN(&child_pt, uart_service_send_data(&child_pt));
-                uart_tx_busy = false;
-                uart_tx_buf_size = 0;
             }
         }
 
@@ -4,17 +4,30 @@
 // ev3dev-stretch PRU/IIO Quadrature Encoder Counter driver
 //
 // This driver uses the PRU quadrature encoder found in ev3dev-stretch.
+//
+// If the IIO device supports buffered capture, the counts of all motors are
+// read from /dev/iio:deviceN with a single read() per control loop iteration,
+// so that all motors are sampled at the same time. The rates are read the same
+// way if they are available as scan elements. Anything that can't be read from
+// the buffer is read from its own sysfs attribute instead.
 
 #include <pbdrv/config.h>
 
 #if PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO
 
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 
 #include <libudev.h>
 
+#include <ev3dev_stretch/sysfs.h>
+
 #include <pbio/util.h>
 #include "counter.h"
 
@@ -25,48 +38,154 @@
 #define dbg_err(s)
 #endif
 
+#define NUM_DEV PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_NUM_DEV
+
+// Number of scans that the kernel buffers between reads
+#define BUFFER_LENGTH "16"
+
+// Largest scan that is supported, in bytes
+#define MAX_SCAN_SIZE 64
+
+// Location and format of a channel in a buffered scan
+typedef struct {
+    bool enabled;
+    bool is_signed;
+    bool big_endian;
+    uint8_t bits;
+    uint8_t shift;
+    uint8_t storage_bytes;
+    uint8_t offset;
+} scan_element_t;
+
 typedef struct {
     pbdrv_counter_dev_t *dev;
-    FILE *count;
-    FILE *rate;
+    int count;
+    int rate;
+    scan_element_t count_element;
+    scan_element_t rate_element;
+    // Whether the values in the latest scan have not been read yet
+    bool count_fresh;
+    bool rate_fresh;
 } private_data_t;
 
-static private_data_t private_data[PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_NUM_DEV];
+static private_data_t private_data[NUM_DEV];
+
+// Buffered capture, shared by all counters
+static struct {
+    // The character device, or -1 if buffered capture is not used
+    int fd;
+    size_t scan_size;
+    bool have_scan;
+    uint8_t scan[MAX_SCAN_SIZE];
+} iio_buffer = {
+    .fd = -1,
+};
 
-static pbio_error_t pbdrv_counter_ev3dev_stretch_iio_get_count(pbdrv_counter_dev_t *dev, int32_t *count) {
-    private_data_t *priv = dev->priv;
+// Gets the value of a channel from a scan
+static int32_t scan_element_get(const scan_element_t *element, const uint8_t *scan) {
+    uint64_t value = 0;
 
-    if (!priv->count) {
-        return PBIO_ERROR_NO_DEV;
+    for (uint8_t i = 0; i < element->storage_bytes; i++) {
+        uint8_t byte = element->big_endian ? i : element->storage_bytes - 1 - i;
+        value = (value << 8) | scan[element->offset + byte];
+    }
+
+    value >>= element->shift;
+
+    if (element->bits < 64) {
+        uint64_t mask = (UINT64_C(1) << element->bits) - 1;
+        value &= mask;
+        if (element->is_signed && (value >> (element->bits - 1))) {
+            value |= ~mask;
+        }
     }
 
-    if (fseek(priv->count, 0, SEEK_SET) == -1) {
-        return PBIO_ERROR_IO;
+    return (int32_t)value;
+}
+
+// Reads all new scans from the buffer and keeps the latest one
+static void iio_buffer_update(void) {
+    static uint8_t buf[MAX_SCAN_SIZE * 16];
+    size_t max_len = sizeof(buf) / iio_buffer.scan_size * iio_buffer.scan_size;
+    bool new_scan = false;
+
+    for (;;) {
+        ssize_t len = read(iio_buffer.fd, buf, max_len);
+
+        // Nothing new, so the scan we already have is the latest
+        if (len < (ssize_t)iio_buffer.scan_size) {
+            break;
+        }
+
+        size_t last = (len / iio_buffer.scan_size - 1) * iio_buffer.scan_size;
+        memcpy(iio_buffer.scan, &buf[last], iio_buffer.scan_size);
+        iio_buffer.have_scan = true;
+        new_scan = true;
+
+        if ((size_t)len < max_len) {
+            break;
+        }
     }
 
-    if (fscanf(priv->count, "%d", count) == EOF) {
-        return PBIO_ERROR_IO;
+    // Values of the scan we already had stay used, so they are read again
+    // next time instead of being returned as new
+    if (!new_scan) {
+        return;
     }
 
-    return PBIO_SUCCESS;
+    for (size_t i = 0; i < PBIO_ARRAY_SIZE(private_data); i++) {
+        private_data[i].count_fresh = true;
+        private_data[i].rate_fresh = true;
+    }
 }
 
-static pbio_error_t pbdrv_counter_ev3dev_stretch_iio_get_rate(pbdrv_counter_dev_t *dev, int32_t *rate) {
+// Gets a value from the latest scan. A new scan is only read once the value
+// has been used, so there is one read() per control loop iteration for all
+// motors together, not one per value.
+static bool iio_buffer_get(const scan_element_t *element, bool *fresh, int32_t *value) {
+    if (!element->enabled) {
+        return false;
+    }
+
+    if (!*fresh) {
+        iio_buffer_update();
+    }
+
+    if (!iio_buffer.have_scan) {
+        return false;
+    }
+
+    *fresh = false;
+    *value = scan_element_get(element, iio_buffer.scan);
+    return true;
+}
+
+static pbio_error_t pbdrv_counter_ev3dev_stretch_iio_get_count(pbdrv_counter_dev_t *dev, int32_t *count) {
     private_data_t *priv = dev->priv;
 
-    if (!priv->rate) {
+    if (iio_buffer_get(&priv->count_element, &priv->count_fresh, count)) {
+        return PBIO_SUCCESS;
+    }
+
+    if (priv->count == -1) {
         return PBIO_ERROR_NO_DEV;
     }
 
-    if (fseek(priv->rate, 0, SEEK_SET) == -1) {
-        return PBIO_ERROR_IO;
+    return sysfs_pread_int(priv->count, count);
+}
+
+static pbio_error_t pbdrv_counter_ev3dev_stretch_iio_get_rate(pbdrv_counter_dev_t *dev, int32_t *rate) {
+    private_data_t *priv = dev->priv;
+
+    if (iio_buffer_get(&priv->rate_element, &priv->rate_fresh, rate)) {
+        return PBIO_SUCCESS;
     }
 
-    if (fscanf(priv->rate, "%d", rate) == EOF) {
-        return PBIO_ERROR_IO;
+    if (priv->rate == -1) {
+        return PBIO_ERROR_NO_DEV;
     }
 
-    return PBIO_SUCCESS;
+    return sysfs_pread_int(priv->rate, rate);
 }
 
 static const pbdrv_counter_funcs_t pbdrv_counter_ev3dev_stretch_iio_funcs = {
@@ -74,6 +193,195 @@ static const pbdrv_counter_funcs_t pbdrv_counter_ev3dev_stretch_iio_funcs = {
     .get_rate = pbdrv_counter_ev3dev_stretch_iio_get_rate,
 };
 
+static bool iio_write_attr(const char *syspath, const char *attr, const char *value) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", syspath, attr);
+
+    int fd = open(path, O_WRONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+
+    ssize_t len = write(fd, value, strlen(value));
+    close(fd);
+
+    return len == (ssize_t)strlen(value);
+}
+
+static bool iio_read_attr(const char *syspath, const char *attr, char *value, size_t size) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", syspath, attr);
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+
+    ssize_t len = read(fd, value, size - 1);
+    close(fd);
+
+    if (len <= 0) {
+        return false;
+    }
+    value[len] = '\0';
+
+    return true;
+}
+
+// Enables a scan element, such as in_count0, and gets its index and format
+static bool scan_element_enable(const char *syspath, const char *name, scan_element_t *element, int *index) {
+    char attr[64];
+    char value[32];
+
+    snprintf(attr, sizeof(attr), "scan_elements/%s_index", name);
+    if (!iio_read_attr(syspath, attr, value, sizeof(value)) || sscanf(value, "%d", index) != 1) {
+        return false;
+    }
+
+    // Such as "le:s32/32>>0". Repeated elements are not supported.
+    char endian, sign;
+    unsigned int bits, storage_bits, shift;
+    snprintf(attr, sizeof(attr), "scan_elements/%s_type", name);
+    if (!iio_read_attr(syspath, attr, value, sizeof(value)) ||
+        sscanf(value, "%ce:%c%u/%u>>%u", &endian, &sign, &bits, &storage_bits, &shift) != 5) {
+        return false;
+    }
+    if (storage_bits % 8 || storage_bits == 0 || storage_bits > 64 || bits == 0 || bits + shift > storage_bits) {
+        return false;
+    }
+
+    snprintf(attr, sizeof(attr), "scan_elements/%s_en", name);
+    if (!iio_write_attr(syspath, attr, "1")) {
+        return false;
+    }
+
+    element->big_endian = endian == 'b';
+    element->is_signed = sign == 's';
+    element->bits = bits;
+    element->shift = shift;
+    element->storage_bytes = storage_bits / 8;
+    element->enabled = true;
+
+    return true;
+}
+
+// Disables all scan elements, including the timestamp, so that only the ones
+// we enable are in the scan
+static bool scan_elements_disable_all(const char *syspath) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/scan_elements", syspath);
+
+    DIR *dir = opendir(path);
+    if (!dir) {
+        return false;
+    }
+
+    bool ok = true;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        size_t len = strlen(entry->d_name);
+        if (len < 3 || strcmp(&entry->d_name[len - 3], "_en") != 0) {
+            continue;
+        }
+        char attr[sizeof(entry->d_name) + 16];
+        snprintf(attr, sizeof(attr), "scan_elements/%s", entry->d_name);
+        if (!iio_write_attr(syspath, attr, "0")) {
+            ok = false;
+        }
+    }
+
+    closedir(dir);
+
+    return ok;
+}
+
+// Sets up buffered capture, if the IIO device supports it
+static void iio_buffer_init(const char *syspath) {
+    struct scan_order {
+        int index;
+        scan_element_t *element;
+    } elements[NUM_DEV * 2];
+    size_t num_elements = 0;
+    char name[32];
+
+    // Scan elements can only be changed while the buffer is disabled
+    iio_write_attr(syspath, "buffer/enable", "0");
+
+    // The scan layout below only accounts for the elements we enable
+    if (!scan_elements_disable_all(syspath)) {
+        dbg_err("failed to disable scan elements");
+        goto disable;
+    }
+
+    for (size_t i = 0; i < PBIO_ARRAY_SIZE(private_data); i++) {
+        private_data_t *priv = &private_data[i];
+
+        // Counts are required, rates are optional
+        snprintf(name, sizeof(name), "in_count%d", (int)i);
+        if (!scan_element_enable(syspath, name, &priv->count_element, &elements[num_elements].index)) {
+            dbg_err("count scan element not available");
+            goto disable;
+        }
+        elements[num_elements++].element = &priv->count_element;
+
+        snprintf(name, sizeof(name), "in_frequency%d", (int)i);
+        if (scan_element_enable(syspath, name, &priv->rate_element, &elements[num_elements].index)) {
+            elements[num_elements++].element = &priv->rate_element;
+        }
+    }
+
+    // Elements are stored in order of their index, each aligned to its size
+    for (size_t i = 1; i < num_elements; i++) {
+        for (size_t j = i; j > 0 && elements[j - 1].index > elements[j].index; j--) {
+            struct scan_order tmp = elements[j];
+            elements[j] = elements[j - 1];
+            elements[j - 1] = tmp;
+        }
+    }
+
+    size_t size = 0;
+    size_t largest = 1;
+    for (size_t i = 0; i < num_elements; i++) {
+        size_t bytes = elements[i].element->storage_bytes;
+        size = (size + bytes - 1) / bytes * bytes;
+        elements[i].element->offset = size;
+        size += bytes;
+        if (bytes > largest) {
+            largest = bytes;
+        }
+    }
+
+    // The scan as a whole is aligned to the largest element
+    iio_buffer.scan_size = (size + largest - 1) / largest * largest;
+    if (iio_buffer.scan_size > MAX_SCAN_SIZE) {
+        dbg_err("scan too large");
+        goto disable;
+    }
+
+    iio_write_attr(syspath, "buffer/length", BUFFER_LENGTH);
+    if (!iio_write_attr(syspath, "buffer/enable", "1")) {
+        dbg_err("failed to enable buffer");
+        goto disable;
+    }
+
+    snprintf(name, sizeof(name), "/dev/%s", strrchr(syspath, '/') + 1);
+    iio_buffer.fd = open(name, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (iio_buffer.fd == -1) {
+        dbg_err("failed to open buffer");
+        iio_write_attr(syspath, "buffer/enable", "0");
+        goto disable;
+    }
+
+    return;
+
+disable:
+    // Fall back to reading sysfs attributes
+    for (size_t i = 0; i < PBIO_ARRAY_SIZE(private_data); i++) {
+        private_data[i].count_element.enabled = false;
+        private_data[i].rate_element.enabled = false;
+    }
+}
+
 void pbdrv_counter_ev3dev_stretch_iio_init(pbdrv_counter_dev_t *devs) {
     char buf[256];
     struct udev *udev;
@@ -118,23 +426,17 @@ void pbdrv_counter_ev3dev_stretch_iio_init(pbdrv_counter_dev_t *devs) {
         private_data_t *priv = &private_data[i];
 
         snprintf(buf, sizeof(buf), "%s/in_count%d_raw", udev_list_entry_get_name(entry), (int)i);
-        priv->count = fopen(buf, "r");
-        if (!priv->count) {
+        if (sysfs_open_fd(&priv->count, buf) != PBIO_SUCCESS) {
             dbg_err("failed to open count attribute");
             continue;
         }
 
-        setbuf(priv->count, NULL);
-
         snprintf(buf, sizeof(buf), "%s/in_frequency%d_input", udev_list_entry_get_name(entry), (int)i);
-        priv->rate = fopen(buf, "r");
-        if (!priv->rate) {
+        if (sysfs_open_fd(&priv->rate, buf) != PBIO_SUCCESS) {
             dbg_err("failed to open rate attribute");
             continue;
         }
 
-        setbuf(priv->rate, NULL);
-
         // FIXME: assuming that these are the only counter devices
         // counter_id should be passed from platform data instead
         _Static_assert(PBDRV_CONFIG_COUNTER_EV3DEV_STRETCH_IIO_NUM_DEV == PBDRV_CONFIG_COUNTER_NUM_DEV,
@@ -144,6 +446,8 @@ void pbdrv_counter_ev3dev_stretch_iio_init(pbdrv_counter_dev_t *devs) {
         priv->dev->priv = priv;
     }
 
+    iio_buffer_init(udev_list_entry_get_name(entry));
+
 free_enumerate:
     udev_enumerate_unref(enumerate);
 free_udev:
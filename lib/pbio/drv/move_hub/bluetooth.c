@@ -11,6 +11,7 @@
 #include <string.h>
 
 #include <contiki.h>
+#include <contiki-lib.h>
 
 #include "pbio/config.h"
 #include "pbio/error.h"
@@ -39,6 +40,9 @@
 // max data size for nRF UART characteristics
 #define NRF_CHAR_SIZE 20
 
+// size of nRF UART tx buffer (must be power of 2 for ring buffer!)
+#define UART_TX_BUF_SIZE 128
+
 // BlueNRG header data for SPI write xfer
 static const uint8_t write_header_tx[BLUENRG_HEADER_SIZE] = { 0x0a };
 // BlueNRG header data for SPI read xfer
@@ -74,12 +78,16 @@ static uint16_t pybricks_service_handle, pybricks_char_handle;
 
 // nRF UART GATT service handles
 static uint16_t uart_service_handle, uart_rx_char_handle, uart_tx_char_handle;
-// nRF UART tx is in progress
-static bool uart_tx_busy;
 // buffer to queue UART tx data
-static uint8_t uart_tx_buf[NRF_CHAR_SIZE];
-// bytes used in uart_tx_buf
-static uint8_t uart_tx_buf_size;
+static struct ringbuf uart_tx_buf;
+// memory for uart_tx_buf
+static uint8_t uart_tx_data[UART_TX_BUF_SIZE];
+// data for the nRF UART tx notification that is being sent
+static uint8_t uart_tx_noti_buf[NRF_CHAR_SIZE];
+// bytes used in uart_tx_noti_buf
+static uint8_t uart_tx_noti_size;
+// set to false when the chip is out of tx buffers and true when it has some again
+static bool uart_tx_pool_available;
 
 
 PROCESS(pbdrv_bluetooth_hci_process, "Bluetooth HCI");
@@ -309,6 +317,9 @@ static void handle_event(hci_event_pckt *event) {
                     reset_reason = subevt->reason_code;
                 }
                 break;
+                case EVT_BLUE_GATT_TX_POOL_AVAILABLE:
+                    uart_tx_pool_available = true;
+                    break;
                 case EVT_BLUE_GATT_ATTRIBUTE_MODIFIED: {
                     evt_gatt_attr_modified *subevt = (evt_gatt_attr_modified *)evt->data;
                     if (subevt->attr_handle == pybricks_char_handle + 1) {
@@ -593,30 +604,35 @@ static PT_THREAD(set_discoverable(struct pt *pt)) {
     PT_END(pt);
 }
 
-pbio_error_t pbdrv_bluetooth_tx(uint8_t c) {
+pbio_error_t pbdrv_bluetooth_tx_buf(const uint8_t *data, uint32_t size, uint32_t *count) {
+    *count = 0;
+
     // make sure we have a Bluetooth connection
     if (!conn_handle) {
         return PBIO_ERROR_INVALID_OP;
     }
 
-    // can't add the the buffer if tx is in progress or buffer is full
-    if (uart_tx_busy || uart_tx_buf_size == NRF_CHAR_SIZE) {
-        return PBIO_ERROR_AGAIN;
+    while (*count < size && ringbuf_put(&uart_tx_buf, data[*count])) {
+        (*count)++;
     }
 
-    // append the char
-    uart_tx_buf[uart_tx_buf_size] = c;
-    uart_tx_buf_size++;
+    if (size && *count == 0) {
+        return PBIO_ERROR_AGAIN;
+    }
 
-    // poke the process to start tx soon-ish. This way, we can accumulate up to
-    // NRF_CHAR_SIZE bytes before actually transmitting
-    // TODO: it probably would be better to poll here instead of using events
-    // so that we don't fill up the event queue with 20 events
-    process_post(&pbdrv_bluetooth_hci_process, PROCESS_EVENT_MSG, NULL);
+    // poke the process to start tx soon-ish. This way, we can accumulate more
+    // bytes before actually transmitting. Polling instead of posting events
+    // so that we don't fill up the event queue.
+    process_poll(&pbdrv_bluetooth_hci_process);
 
     return PBIO_SUCCESS;
 }
 
+pbio_error_t pbdrv_bluetooth_tx(uint8_t c) {
+    uint32_t count;
+    return pbdrv_bluetooth_tx_buf(&c, 1, &count);
+}
+
 static PT_THREAD(uart_service_send_data(struct pt *pt))
 {
     tBleStatus ret;
@@ -625,15 +641,20 @@ static PT_THREAD(uart_service_send_data(struct pt *pt))
 
 retry:
     PT_WAIT_WHILE(pt, write_xfer_size);
+    uart_tx_pool_available = false;
     aci_gatt_update_char_value_begin(uart_service_handle, uart_tx_char_handle,
-        0, uart_tx_buf_size, uart_tx_buf);
+        0, uart_tx_noti_size, uart_tx_noti_buf);
     PT_WAIT_UNTIL(pt, hci_command_complete);
     ret = aci_gatt_update_char_value_end();
 
     if (ret == BLE_STATUS_INSUFFICIENT_RESOURCES) {
-        // this will happen if notifications are enabled and the previous
-        // changes haven't been sent over the air yet
-        goto retry;
+        // this will happen if notifications are enabled and the chip has
+        // queued as many previous changes as it can, but hasn't sent them
+        // over the air yet. It lets us know when there is room again.
+        PT_WAIT_UNTIL(pt, uart_tx_pool_available || !conn_handle);
+        if (conn_handle) {
+            goto retry;
+        }
     }
 
     PT_END(pt);
@@ -663,6 +684,9 @@ PROCESS_THREAD(pbdrv_bluetooth_hci_process, ev, data) {
         PROCESS_PT_SPAWN(&child_pt, init_uart_service(&child_pt));
         PROCESS_PT_SPAWN(&child_pt, set_discoverable(&child_pt));
 
+        // drop anything left over from a previous connection
+        ringbuf_init(&uart_tx_buf, uart_tx_data, UART_TX_BUF_SIZE);
+
         // TODO: we should have a timeout and stop scanning eventually
         pbsys_status_set(PBSYS_STATUS_BLE_ADVERTISING);
         PROCESS_WAIT_UNTIL(conn_handle);
@@ -678,11 +702,15 @@ PROCESS_THREAD(pbdrv_bluetooth_hci_process, ev, data) {
                 // just occasionally checking to see if we are still connected
                 continue;
             }
-            if (ev == PROCESS_EVENT_MSG && uart_tx_buf_size) {
-                uart_tx_busy = true;
+            // Send everything that has been queued. The chip can queue several
+            // notifications per connection interval, so we only have to wait
+            // when it runs out of buffers.
+            while (conn_handle && ringbuf_elements(&uart_tx_buf)) {
+                uart_tx_noti_size = 0;
+                while (uart_tx_noti_size < NRF_CHAR_SIZE && ringbuf_elements(&uart_tx_buf)) {
+                    uart_tx_noti_buf[uart_tx_noti_size++] = ringbuf_get(&uart_tx_buf);
+                }
                 PROCESS_PT_SPAWN(&child_pt, uart_service_send_data(&child_pt));
-                uart_tx_busy = false;
-                uart_tx_buf_size = 0;
             }
         }
 
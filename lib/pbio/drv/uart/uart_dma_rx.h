@@ -0,0 +1,128 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+// Receive buffer that is filled by a DMA stream in circular mode.
+//
+// The DMA controller writes each received byte to the next position in the
+// buffer and wraps around at the end, so the only state the hardware exposes
+// is the number of transfers remaining until the next wrap around (NDTR on
+// STM32). Together with the number of wrap arounds, which the driver counts in
+// the transfer complete interrupt, this gives the total number of bytes
+// received. These helpers compare that to the number of bytes read so far, so
+// that it is known when the DMA stream has overwritten bytes that were not
+// read yet. They don't touch any hardware so that they can be tested on the
+// host.
+
+#ifndef _UART_DMA_RX_H_
+#define _UART_DMA_RX_H_
+
+#include <stdint.h>
+
+/** Circular DMA receive buffer. */
+typedef struct {
+    /** The buffer that the DMA stream writes to. */
+    volatile uint8_t *data;
+    /** The size of data in bytes. Must be a power of 2. */
+    uint16_t size;
+    /** The number of times the DMA stream wrapped around, modulo 2^32. */
+    volatile uint32_t wraps;
+    /** The number of bytes read so far, modulo 2^32. */
+    uint32_t read_count;
+    /** The number of times unread bytes were overwritten. */
+    uint32_t overruns;
+} pbdrv_uart_dma_rx_buf_t;
+
+/**
+ * Initializes a receive buffer.
+ * @param [in]  buf     The receive buffer
+ * @param [in]  data    The memory that the DMA stream writes to
+ * @param [in]  size    The size of data in bytes. Must be a power of 2.
+ */
+static inline void pbdrv_uart_dma_rx_init(pbdrv_uart_dma_rx_buf_t *buf, volatile uint8_t *data, uint16_t size) {
+    buf->data = data;
+    buf->size = size;
+    buf->wraps = 0;
+    buf->read_count = 0;
+    buf->overruns = 0;
+}
+
+/**
+ * Counts one wrap around of the DMA stream. Call this from the transfer
+ * complete interrupt.
+ * @param [in]  buf     The receive buffer
+ */
+static inline void pbdrv_uart_dma_rx_handle_wrap(pbdrv_uart_dma_rx_buf_t *buf) {
+    buf->wraps++;
+}
+
+/**
+ * Gets the total number of bytes that the DMA stream has written.
+ *
+ * @p wraps and @p remaining must be a consistent snapshot. If the stream
+ * wrapped around but the transfer complete interrupt was not handled yet,
+ * @p wraps must already include it.
+ *
+ * @param [in]  buf         The receive buffer
+ * @param [in]  wraps       The number of wrap arounds
+ * @param [in]  remaining   The number of transfers remaining before the DMA stream wraps around
+ * @return                  The head count, modulo 2^32
+ */
+static inline uint32_t pbdrv_uart_dma_rx_get_head(const pbdrv_uart_dma_rx_buf_t *buf, uint32_t wraps, uint32_t remaining) {
+    // remaining counts down from size to 1 and is then reloaded, but it may
+    // read as 0 for a moment around the reload, which is the same as size.
+    return wraps * buf->size + ((buf->size - remaining) & (buf->size - 1));
+}
+
+/**
+ * Gets the number of bytes that have been received but not read yet.
+ * @param [in]  buf     The receive buffer
+ * @param [in]  head    The head count from pbdrv_uart_dma_rx_get_head()
+ * @return              The number of bytes available, which is more than
+ *                      the buffer size - 1 if unread bytes were overwritten
+ */
+static inline uint32_t pbdrv_uart_dma_rx_available(const pbdrv_uart_dma_rx_buf_t *buf, uint32_t head) {
+    // A head that is behind means that a wrap around was not counted yet, so
+    // the bytes are not there yet either.
+    if ((int32_t)(head - buf->read_count) < 0) {
+        return 0;
+    }
+    return head - buf->read_count;
+}
+
+/**
+ * Reads as many received bytes as available, up to @p length.
+ *
+ * If unread bytes were overwritten, they are all dropped and reading resumes
+ * at @p head. This is counted in the overruns field.
+ *
+ * @param [in]  buf     The receive buffer
+ * @param [in]  head    The head count from pbdrv_uart_dma_rx_get_head()
+ * @param [out] dst     The destination buffer
+ * @param [in]  length  The maximum number of bytes to read
+ * @return              The number of bytes read
+ */
+static inline uint16_t pbdrv_uart_dma_rx_read(pbdrv_uart_dma_rx_buf_t *buf, uint32_t head, uint8_t *dst, uint16_t length) {
+    uint32_t available = pbdrv_uart_dma_rx_available(buf, head);
+
+    // The byte at head is the next one to be overwritten, so at most size - 1
+    // bytes can be buffered without losing any.
+    if (available > buf->size - 1U) {
+        buf->read_count = head;
+        buf->overruns++;
+        return 0;
+    }
+
+    if (length > available) {
+        length = available;
+    }
+
+    for (uint16_t i = 0; i < length; i++) {
+        dst[i] = buf->data[(buf->read_count + i) & (buf->size - 1)];
+    }
+
+    buf->read_count += length;
+
+    return length;
+}
+
+#endif // _UART_DMA_RX_H_
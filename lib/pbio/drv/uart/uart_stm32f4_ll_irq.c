@@ -2,6 +2,11 @@
 // Copyright (c) 2018-2020 The Pybricks Authors
 
 // UART driver for STM32F4x using IRQ.
+//
+// Bytes are received either one at a time in the UART interrupt, or, if the
+// platform data gives a DMA stream, by DMA in circular mode. In the latter
+// case, the half transfer, transfer complete and idle line interrupts let us
+// know when there is new data, so there is no interrupt per byte.
 
 #include <pbdrv/config.h>
 
@@ -14,6 +19,7 @@
 #include <contiki.h>
 #include <contiki-lib.h>
 
+#include <stm32f4xx_ll_dma.h>
 #include <stm32f4xx_ll_rcc.h>
 #include <stm32f4xx_ll_usart.h>
 
@@ -21,6 +27,7 @@
 #include <pbio/error.h>
 #include <pbio/util.h>
 
+#include "./uart_dma_rx.h"
 #include "./uart_stm32f4_ll_irq.h"
 #include "../../src/processes.h"
 
@@ -33,6 +40,8 @@ typedef struct {
     const pbdrv_uart_stm32f4_ll_irq_platform_data_t *pdata;
     /** Circular buffer for caching received bytes. */
     struct ringbuf rx_buf;
+    /** Circular buffer written by DMA, used instead of rx_buf if pdata->rx_dma is set. */
+    pbdrv_uart_dma_rx_buf_t rx_dma_buf;
     /** Timer for read timeout. */
     struct etimer read_timer;
     /** Timer for write timeout. */
@@ -85,6 +94,9 @@ pbio_error_t pbdrv_uart_read_begin(pbdrv_uart_dev_t *uart_dev, uint8_t *msg, uin
 
     etimer_set(&uart->read_timer, clock_from_msec(timeout));
 
+    // Bytes may already be waiting in the receive buffer.
+    process_poll(&pbdrv_uart_process);
+
     return PBIO_SUCCESS;
 }
 
@@ -179,6 +191,145 @@ pbio_error_t pbdrv_uart_set_baud_rate(pbdrv_uart_dev_t *uart_dev, uint32_t baud)
     return PBIO_SUCCESS;
 }
 
+static bool dma_is_ht(DMA_TypeDef *DMAx, uint32_t stream) {
+    switch (stream) {
+        case LL_DMA_STREAM_0:
+            return LL_DMA_IsActiveFlag_HT0(DMAx);
+        case LL_DMA_STREAM_1:
+            return LL_DMA_IsActiveFlag_HT1(DMAx);
+        case LL_DMA_STREAM_2:
+            return LL_DMA_IsActiveFlag_HT2(DMAx);
+        case LL_DMA_STREAM_3:
+            return LL_DMA_IsActiveFlag_HT3(DMAx);
+        case LL_DMA_STREAM_4:
+            return LL_DMA_IsActiveFlag_HT4(DMAx);
+        case LL_DMA_STREAM_5:
+            return LL_DMA_IsActiveFlag_HT5(DMAx);
+        case LL_DMA_STREAM_6:
+            return LL_DMA_IsActiveFlag_HT6(DMAx);
+        case LL_DMA_STREAM_7:
+            return LL_DMA_IsActiveFlag_HT7(DMAx);
+        default:
+            return false;
+    }
+}
+
+static bool dma_is_tc(DMA_TypeDef *DMAx, uint32_t stream) {
+    switch (stream) {
+        case LL_DMA_STREAM_0:
+            return LL_DMA_IsActiveFlag_TC0(DMAx);
+        case LL_DMA_STREAM_1:
+            return LL_DMA_IsActiveFlag_TC1(DMAx);
+        case LL_DMA_STREAM_2:
+            return LL_DMA_IsActiveFlag_TC2(DMAx);
+        case LL_DMA_STREAM_3:
+            return LL_DMA_IsActiveFlag_TC3(DMAx);
+        case LL_DMA_STREAM_4:
+            return LL_DMA_IsActiveFlag_TC4(DMAx);
+        case LL_DMA_STREAM_5:
+            return LL_DMA_IsActiveFlag_TC5(DMAx);
+        case LL_DMA_STREAM_6:
+            return LL_DMA_IsActiveFlag_TC6(DMAx);
+        case LL_DMA_STREAM_7:
+            return LL_DMA_IsActiveFlag_TC7(DMAx);
+        default:
+            return false;
+    }
+}
+
+static void dma_clear_ht(DMA_TypeDef *DMAx, uint32_t stream) {
+    switch (stream) {
+        case LL_DMA_STREAM_0:
+            LL_DMA_ClearFlag_HT0(DMAx);
+            break;
+        case LL_DMA_STREAM_1:
+            LL_DMA_ClearFlag_HT1(DMAx);
+            break;
+        case LL_DMA_STREAM_2:
+            LL_DMA_ClearFlag_HT2(DMAx);
+            break;
+        case LL_DMA_STREAM_3:
+            LL_DMA_ClearFlag_HT3(DMAx);
+            break;
+        case LL_DMA_STREAM_4:
+            LL_DMA_ClearFlag_HT4(DMAx);
+            break;
+        case LL_DMA_STREAM_5:
+            LL_DMA_ClearFlag_HT5(DMAx);
+            break;
+        case LL_DMA_STREAM_6:
+            LL_DMA_ClearFlag_HT6(DMAx);
+            break;
+        case LL_DMA_STREAM_7:
+            LL_DMA_ClearFlag_HT7(DMAx);
+            break;
+    }
+}
+
+static void dma_clear_tc(DMA_TypeDef *DMAx, uint32_t stream) {
+    switch (stream) {
+        case LL_DMA_STREAM_0:
+            LL_DMA_ClearFlag_TC0(DMAx);
+            break;
+        case LL_DMA_STREAM_1:
+            LL_DMA_ClearFlag_TC1(DMAx);
+            break;
+        case LL_DMA_STREAM_2:
+            LL_DMA_ClearFlag_TC2(DMAx);
+            break;
+        case LL_DMA_STREAM_3:
+            LL_DMA_ClearFlag_TC3(DMAx);
+            break;
+        case LL_DMA_STREAM_4:
+            LL_DMA_ClearFlag_TC4(DMAx);
+            break;
+        case LL_DMA_STREAM_5:
+            LL_DMA_ClearFlag_TC5(DMAx);
+            break;
+        case LL_DMA_STREAM_6:
+            LL_DMA_ClearFlag_TC6(DMAx);
+            break;
+        case LL_DMA_STREAM_7:
+            LL_DMA_ClearFlag_TC7(DMAx);
+            break;
+    }
+}
+
+void pbdrv_uart_stm32f4_ll_irq_handle_rx_dma_irq(uint8_t id) {
+    const pbdrv_uart_stm32f4_ll_irq_platform_data_t *pdata = &pbdrv_uart_stm32f4_ll_irq_platform_data[id];
+
+    if (LL_DMA_IsEnabledIT_HT(pdata->rx_dma, pdata->rx_dma_stream) && dma_is_ht(pdata->rx_dma, pdata->rx_dma_stream)) {
+        dma_clear_ht(pdata->rx_dma, pdata->rx_dma_stream);
+        process_poll(&pbdrv_uart_process);
+    }
+
+    if (LL_DMA_IsEnabledIT_TC(pdata->rx_dma, pdata->rx_dma_stream) && dma_is_tc(pdata->rx_dma, pdata->rx_dma_stream)) {
+        dma_clear_tc(pdata->rx_dma, pdata->rx_dma_stream);
+        pbdrv_uart_dma_rx_handle_wrap(&pbdrv_uart[id].rx_dma_buf);
+        process_poll(&pbdrv_uart_process);
+    }
+}
+
+// Gets the total number of bytes written by the Rx DMA stream
+static uint32_t dma_rx_get_head(pbdrv_uart_t *uart) {
+    const pbdrv_uart_stm32f4_ll_irq_platform_data_t *pdata = uart->pdata;
+    uint32_t remaining;
+    bool wrapped;
+
+    // The wrap count can't change while the DMA interrupt is masked. A wrap
+    // around that was not handled yet shows up as a pending TC flag. It must
+    // not change while reading NDTR, or we can't tell which came first.
+    NVIC_DisableIRQ(pdata->rx_dma_irq);
+    do {
+        wrapped = dma_is_tc(pdata->rx_dma, pdata->rx_dma_stream);
+        remaining = LL_DMA_GetDataLength(pdata->rx_dma, pdata->rx_dma_stream);
+    } while (wrapped != dma_is_tc(pdata->rx_dma, pdata->rx_dma_stream));
+    uint32_t wraps = uart->rx_dma_buf.wraps + wrapped;
+    NVIC_EnableIRQ(pdata->rx_dma_irq);
+
+    return pbdrv_uart_dma_rx_get_head(&uart->rx_dma_buf, wraps, remaining);
+}
+
 void pbdrv_uart_stm32f4_ll_irq_handle_irq(uint8_t id) {
     pbdrv_uart_t *uart = &pbdrv_uart[id];
     USART_TypeDef *USARTx = uart->pdata->uart;
@@ -188,6 +339,11 @@ void pbdrv_uart_stm32f4_ll_irq_handle_irq(uint8_t id) {
         process_poll(&pbdrv_uart_process);
     }
 
+    if (LL_USART_IsEnabledIT_IDLE(USARTx) && LL_USART_IsActiveFlag_IDLE(USARTx)) {
+        LL_USART_ClearFlag_IDLE(USARTx);
+        process_poll(&pbdrv_uart_process);
+    }
+
     if (LL_USART_IsEnabledIT_TXE(USARTx) && LL_USART_IsActiveFlag_TXE(USARTx)) {
         LL_USART_TransmitData8(USARTx, uart->write_buf[uart->write_pos++]);
         // When all bytes have been written, wait for the Tx complete interrupt.
@@ -206,14 +362,24 @@ void pbdrv_uart_stm32f4_ll_irq_handle_irq(uint8_t id) {
 static void handle_poll() {
     for (int i = 0; i < PBDRV_CONFIG_UART_STM32F4_LL_IRQ_NUM_UART; i++) {
         pbdrv_uart_t *uart = &pbdrv_uart[i];
+        const pbdrv_uart_stm32f4_ll_irq_platform_data_t *pdata = uart->pdata;
 
         // if receive is pending and we have not received all bytes yet
-        while (uart->read_buf && uart->read_pos < uart->read_length) {
-            int c = ringbuf_get(&uart->rx_buf);
-            if (c == -1) {
-                break;
+        if (uart->read_buf && uart->read_pos < uart->read_length) {
+            if (pdata->rx_dma) {
+                // Bytes that were overwritten before being read are dropped
+                uint32_t head = dma_rx_get_head(uart);
+                uart->read_pos += pbdrv_uart_dma_rx_read(&uart->rx_dma_buf, head,
+                    &uart->read_buf[uart->read_pos], uart->read_length - uart->read_pos);
+            } else {
+                while (uart->read_pos < uart->read_length) {
+                    int c = ringbuf_get(&uart->rx_buf);
+                    if (c == -1) {
+                        break;
+                    }
+                    uart->read_buf[uart->read_pos++] = c;
+                }
             }
-            uart->read_buf[uart->read_pos++] = c;
         }
 
         // broadcast when read_buf is full
@@ -237,6 +403,10 @@ static void handle_exit() {
         const pbdrv_uart_stm32f4_ll_irq_platform_data_t *pdata = &pbdrv_uart_stm32f4_ll_irq_platform_data[i];
         LL_USART_Disable(pdata->uart);
         NVIC_DisableIRQ(pdata->irq);
+        if (pdata->rx_dma) {
+            LL_DMA_DisableStream(pdata->rx_dma, pdata->rx_dma_stream);
+            NVIC_DisableIRQ(pdata->rx_dma_irq);
+        }
     }
 }
 
@@ -252,6 +422,30 @@ PROCESS_THREAD(pbdrv_uart_process, ev, data) {
         pbdrv_uart_t *uart = &pbdrv_uart[i];
         uart->pdata = pdata;
         ringbuf_init(&uart->rx_buf, rx_data, RX_DATA_SIZE);
+        pbdrv_uart_dma_rx_init(&uart->rx_dma_buf, rx_data, RX_DATA_SIZE);
+
+        // configure Rx DMA
+
+        if (pdata->rx_dma) {
+            LL_DMA_SetChannelSelection(pdata->rx_dma, pdata->rx_dma_stream, pdata->rx_dma_ch);
+            LL_DMA_SetDataTransferDirection(pdata->rx_dma, pdata->rx_dma_stream, LL_DMA_DIRECTION_PERIPH_TO_MEMORY);
+            LL_DMA_SetStreamPriorityLevel(pdata->rx_dma, pdata->rx_dma_stream, LL_DMA_PRIORITY_LOW);
+            LL_DMA_SetMode(pdata->rx_dma, pdata->rx_dma_stream, LL_DMA_MODE_CIRCULAR);
+            LL_DMA_SetPeriphIncMode(pdata->rx_dma, pdata->rx_dma_stream, LL_DMA_PERIPH_NOINCREMENT);
+            LL_DMA_SetMemoryIncMode(pdata->rx_dma, pdata->rx_dma_stream, LL_DMA_MEMORY_INCREMENT);
+            LL_DMA_SetPeriphSize(pdata->rx_dma, pdata->rx_dma_stream, LL_DMA_PDATAALIGN_BYTE);
+            LL_DMA_SetMemorySize(pdata->rx_dma, pdata->rx_dma_stream, LL_DMA_MDATAALIGN_BYTE);
+            LL_DMA_DisableFifoMode(pdata->rx_dma, pdata->rx_dma_stream);
+            LL_DMA_SetPeriphAddress(pdata->rx_dma, pdata->rx_dma_stream, (uint32_t)&pdata->uart->DR);
+            LL_DMA_SetMemoryAddress(pdata->rx_dma, pdata->rx_dma_stream, (uint32_t)rx_data);
+            LL_DMA_SetDataLength(pdata->rx_dma, pdata->rx_dma_stream, RX_DATA_SIZE);
+
+            LL_DMA_EnableIT_HT(pdata->rx_dma, pdata->rx_dma_stream);
+            LL_DMA_EnableIT_TC(pdata->rx_dma, pdata->rx_dma_stream);
+
+            NVIC_SetPriority(pdata->rx_dma_irq, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), 0, 1));
+            NVIC_EnableIRQ(pdata->rx_dma_irq);
+        }
 
         // configure UART
 
@@ -265,12 +459,20 @@ PROCESS_THREAD(pbdrv_uart_process, ev, data) {
         uart_init.OverSampling = LL_USART_OVERSAMPLING_16;
         LL_USART_Init(pdata->uart, &uart_init);
         LL_USART_ConfigAsyncMode(pdata->uart);
-        LL_USART_EnableIT_RXNE(pdata->uart);
+        if (pdata->rx_dma) {
+            LL_USART_EnableDMAReq_RX(pdata->uart);
+            LL_USART_EnableIT_IDLE(pdata->uart);
+        } else {
+            LL_USART_EnableIT_RXNE(pdata->uart);
+        }
 
         NVIC_SetPriority(pdata->irq, NVIC_EncodePriority(NVIC_GetPriorityGrouping(), 0, 0));
         NVIC_EnableIRQ(pdata->irq);
 
         // start receiving as soon as everything is configured
+        if (pdata->rx_dma) {
+            LL_DMA_EnableStream(pdata->rx_dma, pdata->rx_dma_stream);
+        }
         LL_USART_Enable(pdata->uart);
     }
 
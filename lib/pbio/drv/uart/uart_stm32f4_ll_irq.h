@@ -18,6 +18,14 @@ typedef struct {
     USART_TypeDef *uart;
     /** The UART interupt number. */
     IRQn_Type irq;
+    /** The Rx DMA registers, or NULL to receive using the UART interrupt. */
+    DMA_TypeDef *rx_dma;
+    /** The Rx DMA stream (LL_DMA_STREAM_x). */
+    uint32_t rx_dma_stream;
+    /** The Rx DMA channel (LL_DMA_CHANNEL_x). */
+    uint32_t rx_dma_ch;
+    /** The Rx DMA interupt number. */
+    IRQn_Type rx_dma_irq;
 } pbdrv_uart_stm32f4_ll_irq_platform_data_t;
 
 /**
@@ -32,4 +40,10 @@ extern const pbdrv_uart_stm32f4_ll_irq_platform_data_t
  */
 void pbdrv_uart_stm32f4_ll_irq_handle_irq(uint8_t id);
 
+/**
+ * Callback to be called by the Rx DMA IRQ handler.
+ * @param id [in]   The UART instance ID.
+ */
+void pbdrv_uart_stm32f4_ll_irq_handle_rx_dma_irq(uint8_t id);
+
 #endif // _UART_STM32F4_LL_IRQ_H_
@@ -230,6 +230,23 @@ pbio_error_t pbsys_stdout_put_char(uint8_t c) {
     return PBIO_SUCCESS;
 }
 
+pbio_error_t pbsys_stdout_write(const uint8_t *data, uint32_t size, uint32_t *count) {
+    if (!usb_connected) {
+        // don't lock up print() when USB not connected - data is discarded
+        *count = size;
+        return PBIO_SUCCESS;
+    }
+    for (*count = 0; *count < size; (*count)++) {
+        if (ringbuf_put(&stdout_buf, data[*count]) == 0) {
+            break;
+        }
+    }
+    if (size && *count == 0) {
+        return PBIO_ERROR_AGAIN;
+    }
+    return PBIO_SUCCESS;
+}
+
 pbio_error_t pbsys_stdin_get_char(uint8_t *c) {
     if (ringbuf_elements(&stdin_buf) == 0) {
         return PBIO_ERROR_AGAIN;
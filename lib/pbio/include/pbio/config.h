@@ -16,8 +16,53 @@
 #define PBIO_CONFIG_SERVO_PERIOD_MS (6)
 #endif
 
+// number of drivebases that can be used at the same time
+#ifndef PBIO_CONFIG_NUM_DRIVEBASES
+#define PBIO_CONFIG_NUM_DRIVEBASES (1)
+#endif
+
+// interval at which the control tasks are checked, in ms. Tasks run at multiples of this.
+#ifndef PBIO_CONFIG_MOTORPOLL_TICK_MS
+#define PBIO_CONFIG_MOTORPOLL_TICK_MS (PBIO_CONFIG_SERVO_PERIOD_MS)
+#endif
+
+// maximum number of callbacks that can be run by the control loop alongside the servos
+#ifndef PBIO_CONFIG_MOTORPOLL_NUM_CALLBACKS
+#define PBIO_CONFIG_MOTORPOLL_NUM_CALLBACKS (2)
+#endif
+
+// use a model based observer for the servo speed feedback, for motors with a known model
+#ifndef PBIO_CONFIG_SERVO_OBSERVER
+#define PBIO_CONFIG_SERVO_OBSERVER (0)
+#endif
+
+// maximum number of angle targets that can be queued on each controller
+#ifndef PBIO_CONFIG_CONTROL_QUEUE_SIZE
+#define PBIO_CONFIG_CONTROL_QUEUE_SIZE (4)
+#endif
+
+// collect timing statistics of the servo/drivebase polling loop
+#ifndef PBIO_CONFIG_MOTORPOLL_STATS
+#define PBIO_CONFIG_MOTORPOLL_STATS (0)
+#endif
+
+// post servo and drivebase commands to a control loop running on its own thread, see pbio/motorcmd.h
+#ifndef PBIO_CONFIG_MOTORCMD
+#define PBIO_CONFIG_MOTORCMD (0)
+#endif
+
+// maximum number of commands that can be waiting for the control loop. Must be a power of 2.
+#ifndef PBIO_CONFIG_MOTORCMD_QUEUE_SIZE
+#define PBIO_CONFIG_MOTORCMD_QUEUE_SIZE (32)
+#endif
+
 #ifndef PBIO_CONFIG_UARTDEV
 #define PBIO_CONFIG_UARTDEV (0)
 #endif
 
+// collect LEGO UART protocol statistics for each port
+#ifndef PBIO_CONFIG_UARTDEV_STATS
+#define PBIO_CONFIG_UARTDEV_STATS (0)
+#endif
+
 #endif // _PBIO_CONFIG_H_
@@ -9,6 +9,7 @@
 
 #include <fixmath.h>
 
+#include <pbio/config.h>
 #include <pbio/error.h>
 #include <pbio/port.h>
 #include <pbio/trajectory.h>
@@ -28,6 +29,7 @@ typedef struct _pbio_control_settings_t {
     int32_t rate_tolerance;         /**< Allowed deviation (counts/s) from target speed. Hence, if speed target is zero, any speed below this tolerance is considered to be standstill. */
     int32_t count_tolerance;        /**< Allowed deviation (counts) from target before motion is considered complete */
     int32_t abs_acceleration;       /**< Encoder acceleration/deceleration rate when beginning to move or stopping. Positive value in counts per second per second */
+    int32_t abs_jerk;               /**< Limit on the rate of change of the acceleration, in counts per second cubed. Zero gives trapezoidal speed profiles, otherwise S-curves. */
     int16_t pid_kp;                 /**< Proportional position control constant (and integral speed control constant) */
     int16_t pid_ki;                 /**< Integral position control constant */
     int16_t pid_kd;                 /**< Derivative position control constant (and proportional speed control constant) */
@@ -66,6 +68,25 @@ typedef enum {
     PBIO_CONTROL_ANGLE,  /**< Run to an angle */
 } pbio_control_type_t;
 
+/**
+ * Angle target waiting in the queue until the ongoing maneuver is near completion
+ */
+typedef struct _pbio_control_segment_t {
+    int32_t target_count;           /**< Target encoder count */
+    int32_t target_rate;            /**< Target encoder rate */
+    int32_t acceleration;           /**< Encoder acceleration */
+    pbio_actuation_t after_stop;    /**< What to do if this is the last segment */
+} pbio_control_segment_t;
+
+/**
+ * Bounded FIFO of queued angle targets
+ */
+typedef struct _pbio_control_queue_t {
+    pbio_control_segment_t segments[PBIO_CONFIG_CONTROL_QUEUE_SIZE];
+    uint8_t first;                  /**< Index of the oldest segment */
+    uint8_t count;                  /**< Number of queued segments */
+} pbio_control_queue_t;
+
 typedef struct _pbio_control_t {
     pbio_control_type_t type;
     pbio_control_settings_t settings;
@@ -74,7 +95,9 @@ typedef struct _pbio_control_t {
     pbio_rate_integrator_t rate_integrator;
     pbio_count_integrator_t count_integrator;
     pbio_control_on_target_t on_target_func;
+    pbio_control_queue_t queue;
     pbio_log_t log;
+    uint32_t period;                /**< Time between control updates (ms) */
     bool stalled;
     bool on_target;
 } pbio_control_t;
@@ -86,6 +109,9 @@ int32_t pbio_control_user_to_counts(pbio_control_settings_t *s, int32_t user);
 void pbio_control_settings_get_limits(pbio_control_settings_t *s, int32_t *speed, int32_t *acceleration, int32_t *actuation);
 pbio_error_t pbio_control_settings_set_limits(pbio_control_settings_t *ctl, int32_t speed, int32_t acceleration, int32_t actuation);
 
+void pbio_control_settings_get_jerk(pbio_control_settings_t *s, int32_t *jerk);
+pbio_error_t pbio_control_settings_set_jerk(pbio_control_settings_t *s, int32_t jerk);
+
 void pbio_control_settings_get_pid(pbio_control_settings_t *s, int16_t *pid_kp, int16_t *pid_ki, int16_t *pid_kd, int32_t *integral_range, int32_t *integral_rate, int32_t *control_offset);
 pbio_error_t pbio_control_settings_set_pid(pbio_control_settings_t *s, int16_t pid_kp, int16_t pid_ki, int16_t pid_kd, int32_t integral_range, int32_t integral_rate, int32_t control_offset);
 
@@ -98,11 +124,14 @@ pbio_error_t pbio_control_settings_set_stall_tolerances(pbio_control_settings_t
 int32_t pbio_control_settings_get_max_integrator(pbio_control_settings_t *s);
 int32_t pbio_control_get_ref_time(pbio_control_t *ctl, int32_t time_now);
 
+void pbio_control_set_period(pbio_control_t *ctl, uint32_t period);
+
 void pbio_control_stop(pbio_control_t *ctl);
 pbio_error_t pbio_control_start_angle_control(pbio_control_t *ctl, int32_t time_now, int32_t count_now, int32_t target_count, int32_t rate_now, int32_t target_rate, int32_t acceleration, pbio_actuation_t after_stop);
 pbio_error_t pbio_control_start_relative_angle_control(pbio_control_t *ctl, int32_t time_now, int32_t count_now, int32_t relative_target_count, int32_t rate_now, int32_t target_rate, int32_t acceleration, pbio_actuation_t after_stop);
 pbio_error_t pbio_control_start_timed_control(pbio_control_t *ctl, int32_t time_now, int32_t duration, int32_t count_now, int32_t rate_now, int32_t target_rate, int32_t acceleration, pbio_control_on_target_t stop_func, pbio_actuation_t after_stop);
 pbio_error_t pbio_control_start_hold_control(pbio_control_t *ctl, int32_t time_now, int32_t target_count);
+pbio_error_t pbio_control_queue_angle_control(pbio_control_t *ctl, int32_t time_now, int32_t count_now, int32_t target_count, int32_t rate_now, int32_t target_rate, int32_t acceleration, pbio_actuation_t after_stop);
 
 
 bool pbio_control_is_stalled(pbio_control_t *ctl);
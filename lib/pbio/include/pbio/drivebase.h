@@ -15,6 +15,9 @@ typedef struct _pbio_drivebase_t {
     int32_t dif_offset;
     pbio_control_t control_heading;
     pbio_control_t control_distance;
+    #if PBIO_CONFIG_MOTORCMD
+    pbio_motorcmd_link_t link;
+    #endif
 } pbio_drivebase_t;
 
 pbio_error_t pbio_drivebase_setup(pbio_drivebase_t *db, pbio_servo_t *left, pbio_servo_t *right, fix16_t wheel_diameter, fix16_t axle_track);
@@ -38,6 +41,7 @@ pbio_error_t pbio_drivebase_stop_force(pbio_drivebase_t *db);
 // Measuring
 
 pbio_error_t pbio_drivebase_get_state(pbio_drivebase_t *db, int32_t *distance, int32_t *drive_speed, int32_t *angle, int32_t *turn_rate);
+pbio_error_t pbio_drivebase_get_last_state(pbio_drivebase_t *db, int32_t *distance, int32_t *drive_speed, int32_t *angle, int32_t *turn_rate);
 
 pbio_error_t pbio_drivebase_reset_state(pbio_drivebase_t *db);
 
@@ -175,6 +175,12 @@ typedef enum {
  */
 #define PBIO_IODEV_MAX_DATA_SIZE    LUMP_MAX_MSG_SIZE
 
+/**
+ * Max number of values that a device can send at the same time when using a
+ * mode combination. Each mode in the combination adds all of its values.
+ */
+#define PBIO_IODEV_MAX_COMBO_VALUES (8)
+
 /**
  * Max size of units of measurements (not including null terminator)
  */
@@ -357,6 +363,9 @@ typedef struct {
     pbio_error_t (*write_begin)(pbio_iodev_t *iodev, const uint8_t *data, uint8_t size);
     pbio_error_t (*write_end)(pbio_iodev_t *iodev);
     void (*write_cancel)(pbio_iodev_t *iodev);
+    pbio_error_t (*set_mode_combo_begin)(pbio_iodev_t *iodev, const uint8_t *modes, uint8_t num_modes);
+    pbio_error_t (*set_mode_combo_end)(pbio_iodev_t *iodev);
+    void (*set_mode_combo_cancel)(pbio_iodev_t *iodev);
 } pbio_iodev_ops_t;
 
 struct _pbio_iodev_t {
@@ -380,6 +389,25 @@ struct _pbio_iodev_t {
      * Motor capability flags.
      */
     pbio_iodev_motor_flags_t motor_flags;
+    /**
+     * Incremented each time new data is stored in *bin_data*. This wraps
+     * around, so it should only be compared for equality.
+     */
+    uint32_t data_seq;
+    /**
+     * The number of modes in the active mode combination, or 0 if the device
+     * is sending data for *mode* only.
+     */
+    uint8_t num_combo_modes;
+    /**
+     * The modes in the active mode combination.
+     */
+    uint8_t combo_modes[PBIO_IODEV_MAX_COMBO_VALUES];
+    /**
+     * Offset of the data of each mode in *combo_modes* in *bin_data*. Each
+     * offset is aligned to 4 bytes, so the values can be read directly.
+     */
+    uint8_t combo_offsets[PBIO_IODEV_MAX_COMBO_VALUES];
     /**
      * Most recent binary data read from the device. How to interpret this data
      * is determined by the ::pbio_iodev_mode_t info associated with the current
@@ -394,9 +422,15 @@ struct _pbio_iodev_t {
 size_t pbio_iodev_size_of(pbio_iodev_data_type_t type);
 pbio_error_t pbio_iodev_get_data_format(pbio_iodev_t *iodev, uint8_t mode, uint8_t *len, pbio_iodev_data_type_t *type);
 pbio_error_t pbio_iodev_get_data(pbio_iodev_t *iodev, uint8_t **data);
+pbio_error_t pbio_iodev_get_data_seq(pbio_iodev_t *iodev, uint32_t *seq);
+pbio_error_t pbio_iodev_wait_data(pbio_iodev_t *iodev, uint32_t seq);
+pbio_error_t pbio_iodev_get_combo_data(pbio_iodev_t *iodev, uint8_t mode, uint8_t **data);
 pbio_error_t pbio_iodev_set_mode_begin(pbio_iodev_t *iodev, uint8_t mode);
 pbio_error_t pbio_iodev_set_mode_end(pbio_iodev_t *iodev);
 void pbio_iodev_set_mode_cancel(pbio_iodev_t *iodev);
+pbio_error_t pbio_iodev_set_mode_combo_begin(pbio_iodev_t *iodev, const uint8_t *modes, uint8_t num_modes);
+pbio_error_t pbio_iodev_set_mode_combo_end(pbio_iodev_t *iodev);
+void pbio_iodev_set_mode_combo_cancel(pbio_iodev_t *iodev);
 pbio_error_t pbio_iodev_set_data_begin(pbio_iodev_t *iodev, uint8_t mode, const uint8_t *data);
 pbio_error_t pbio_iodev_set_data_end(pbio_iodev_t *iodev);
 void pbio_iodev_set_data_cancel(pbio_iodev_t *iodev);
@@ -17,20 +17,30 @@
 
 typedef struct _pbio_log_t {
     bool active;
+    bool circular;
     uint32_t skipped;
     uint32_t sampled;
+    uint32_t drained;
+    uint32_t dropped;
+    uint32_t head;
     uint32_t len;
-    int32_t start;
+    uint32_t start;
     uint8_t num_values;
     int32_t *data;
     uint32_t sample_div;
+    uint32_t period;
 } pbio_log_t;
 
 void pbio_logger_start(pbio_log_t *log, int32_t *buf, uint32_t len, int32_t div);
+void pbio_logger_start_circular(pbio_log_t *log, int32_t *buf, uint32_t len, int32_t div);
 pbio_error_t pbio_logger_read(pbio_log_t *log, int32_t sindex, int32_t *buf);
+pbio_error_t pbio_logger_drain(pbio_log_t *log, int32_t *buf, uint32_t max_rows, uint32_t *rows);
+uint32_t pbio_logger_dropped(pbio_log_t *log);
 pbio_error_t pbio_logger_update(pbio_log_t *log, int32_t *buf);
 int32_t pbio_logger_rows(pbio_log_t *log);
 int32_t pbio_logger_cols(pbio_log_t *log);
+void pbio_logger_set_period(pbio_log_t *log, uint32_t period);
+uint32_t pbio_logger_period(pbio_log_t *log);
 void pbio_logger_stop(pbio_log_t *log);
 
 #endif // _PBIO_LOGGER_H_
@@ -0,0 +1,35 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+#ifndef _PBIO_LZSS_H_
+#define _PBIO_LZSS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Number of bits in a back-reference offset. This sets the window size. */
+#define PBIO_LZSS_WINDOW_BITS (8)
+
+/** Number of bits in a back-reference length. */
+#define PBIO_LZSS_LENGTH_BITS (4)
+
+/** Streaming LZSS decoder state. */
+typedef struct {
+    /** The most recently decoded bytes. */
+    uint8_t window[1 << PBIO_LZSS_WINDOW_BITS];
+    /** Index in window of the next decoded byte. */
+    uint16_t head;
+    /** Offset of the back-reference that is being copied. */
+    uint16_t offset;
+    /** Number of bytes left to copy from the back-reference. */
+    uint16_t count;
+    /** Number of valid bits in bits. */
+    uint8_t num_bits;
+    /** Input bits that have not been decoded yet. */
+    uint32_t bits;
+} pbio_lzss_t;
+
+void pbio_lzss_init(pbio_lzss_t *lz);
+void pbio_lzss_decode(pbio_lzss_t *lz, const uint8_t *in, size_t *in_len, uint8_t *out, size_t *out_len);
+
+#endif // _PBIO_LZSS_H_
@@ -0,0 +1,200 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+// Servo and drivebase commands that are posted to the control loop.
+//
+// When PBIO_CONFIG_MOTORCMD is enabled, pbio_do_one_event() runs on its own
+// thread, which owns all servos and drivebases. The most frequently used
+// commands are posted to a single-producer, single-consumer queue without
+// taking any lock, and the control loop runs them at the start of its next
+// poll. After each poll, the control loop publishes the state of each servo
+// and drivebase, which can be read back without taking any lock either.
+//
+// Only one thread may post commands and read back the state at a time. Any
+// other access to pbio must be done while holding pbio_lock().
+//
+// When PBIO_CONFIG_MOTORCMD is disabled, the same functions call pbio
+// directly, so the caller does not need to know which one is used.
+
+#ifndef _PBIO_MOTORCMD_H_
+#define _PBIO_MOTORCMD_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <pbio/config.h>
+#include <pbio/control.h>
+#include <pbio/drivebase.h>
+#include <pbio/error.h>
+#include <pbio/motorpoll.h>
+#include <pbio/servo.h>
+
+#if PBIO_CONFIG_MOTORCMD
+
+// Provided by the platform that runs the control loop on its own thread
+
+/**
+ * Waits until the control loop is not running and keeps it from running, so
+ * that pbio can be used directly. Commands that were posted before are run
+ * first, so that they take effect in the order they were given.
+ */
+void pbio_lock(void);
+
+/**
+ * Lets the control loop run again after pbio_lock().
+ */
+void pbio_unlock(void);
+
+#else // PBIO_CONFIG_MOTORCMD
+
+static inline void pbio_lock(void) {
+}
+static inline void pbio_unlock(void) {
+}
+
+#endif // PBIO_CONFIG_MOTORCMD
+
+#if PBDRV_CONFIG_NUM_MOTOR_CONTROLLER != 0
+
+/**
+ * Type of command.
+ */
+typedef enum {
+    PBIO_MOTORCMD_SERVO_RUN,                /**< pbio_servo_run() */
+    PBIO_MOTORCMD_SERVO_RUN_TIME,           /**< pbio_servo_run_time() */
+    PBIO_MOTORCMD_SERVO_RUN_UNTIL_STALLED,  /**< pbio_servo_run_until_stalled() */
+    PBIO_MOTORCMD_SERVO_RUN_ANGLE,          /**< pbio_servo_run_angle() */
+    PBIO_MOTORCMD_SERVO_RUN_TARGET,         /**< pbio_servo_run_target() */
+    PBIO_MOTORCMD_SERVO_QUEUE_TARGET,       /**< pbio_servo_queue_target() */
+    PBIO_MOTORCMD_SERVO_TRACK_TARGET,       /**< pbio_servo_track_target() */
+    PBIO_MOTORCMD_SERVO_STOP,               /**< pbio_servo_stop() */
+    PBIO_MOTORCMD_SERVO_SET_DUTY_CYCLE,     /**< pbio_servo_set_duty_cycle() */
+    PBIO_MOTORCMD_DRIVEBASE_STRAIGHT,       /**< pbio_drivebase_straight() */
+    PBIO_MOTORCMD_DRIVEBASE_TURN,           /**< pbio_drivebase_turn() */
+    PBIO_MOTORCMD_DRIVEBASE_DRIVE,          /**< pbio_drivebase_drive() */
+    PBIO_MOTORCMD_DRIVEBASE_STOP,           /**< pbio_drivebase_stop() */
+} pbio_motorcmd_type_t;
+
+/**
+ * A command with its arguments, in the order of the function it calls.
+ */
+typedef struct _pbio_motorcmd_t {
+    pbio_motorcmd_type_t type;
+    pbio_servo_t *srv;          /**< The servo, for servo commands */
+    pbio_drivebase_t *db;       /**< The drivebase, for drivebase commands */
+    int32_t args[3];
+} pbio_motorcmd_t;
+
+/**
+ * Single-producer, single-consumer queue of commands.
+ */
+typedef struct _pbio_motorcmd_queue_t {
+    pbio_motorcmd_t cmds[PBIO_CONFIG_MOTORCMD_QUEUE_SIZE];
+    uint32_t head;  /**< Number of commands pushed, only written by the producer */
+    uint32_t tail;  /**< Number of commands popped, only written by the consumer */
+} pbio_motorcmd_queue_t;
+
+void pbio_motorcmd_queue_init(pbio_motorcmd_queue_t *queue);
+bool pbio_motorcmd_queue_push(pbio_motorcmd_queue_t *queue, const pbio_motorcmd_t *cmd);
+bool pbio_motorcmd_queue_pop(pbio_motorcmd_queue_t *queue, pbio_motorcmd_t *cmd);
+
+#if PBIO_CONFIG_MOTORCMD
+
+// Used by the control loop
+
+void pbio_motorcmd_process(void);
+void pbio_motorcmd_discard(void);
+void pbio_motorcmd_publish_servo(pbio_servo_t *srv, pbio_error_t status);
+void pbio_motorcmd_publish_drivebase(pbio_drivebase_t *db, pbio_error_t status);
+
+// Used by the thread that posts commands
+
+pbio_error_t pbio_motorcmd_servo_run(pbio_servo_t *srv, int32_t speed);
+pbio_error_t pbio_motorcmd_servo_run_time(pbio_servo_t *srv, int32_t speed, int32_t duration, pbio_actuation_t after_stop);
+pbio_error_t pbio_motorcmd_servo_run_until_stalled(pbio_servo_t *srv, int32_t speed, pbio_actuation_t after_stop);
+pbio_error_t pbio_motorcmd_servo_run_angle(pbio_servo_t *srv, int32_t speed, int32_t angle, pbio_actuation_t after_stop);
+pbio_error_t pbio_motorcmd_servo_run_target(pbio_servo_t *srv, int32_t speed, int32_t target, pbio_actuation_t after_stop);
+pbio_error_t pbio_motorcmd_servo_queue_target(pbio_servo_t *srv, int32_t speed, int32_t target, pbio_actuation_t after_stop);
+pbio_error_t pbio_motorcmd_servo_track_target(pbio_servo_t *srv, int32_t target);
+pbio_error_t pbio_motorcmd_servo_stop(pbio_servo_t *srv, pbio_actuation_t after_stop);
+pbio_error_t pbio_motorcmd_servo_set_duty_cycle(pbio_servo_t *srv, int32_t duty_steps);
+pbio_error_t pbio_motorcmd_servo_get_status(pbio_servo_t *srv, bool *done);
+pbio_error_t pbio_motorcmd_servo_get_state_user(pbio_servo_t *srv, int32_t *angle, int32_t *speed, int32_t *duty);
+pbio_error_t pbio_motorcmd_servo_get_angle(pbio_servo_t *srv, int32_t *angle);
+pbio_error_t pbio_motorcmd_servo_get_speed(pbio_servo_t *srv, int32_t *speed);
+
+pbio_error_t pbio_motorcmd_drivebase_straight(pbio_drivebase_t *db, int32_t distance, int32_t straight_speed, int32_t straight_acceleration);
+pbio_error_t pbio_motorcmd_drivebase_turn(pbio_drivebase_t *db, int32_t angle, int32_t turn_rate, int32_t turn_acceleration);
+pbio_error_t pbio_motorcmd_drivebase_drive(pbio_drivebase_t *db, int32_t speed, int32_t turn_rate);
+pbio_error_t pbio_motorcmd_drivebase_stop(pbio_drivebase_t *db, pbio_actuation_t after_stop);
+pbio_error_t pbio_motorcmd_drivebase_get_status(pbio_drivebase_t *db, bool *done);
+pbio_error_t pbio_motorcmd_drivebase_get_state(pbio_drivebase_t *db, int32_t *distance, int32_t *drive_speed, int32_t *angle, int32_t *turn_rate);
+
+#else // PBIO_CONFIG_MOTORCMD
+
+static inline pbio_error_t pbio_motorcmd_servo_run(pbio_servo_t *srv, int32_t speed) {
+    return pbio_servo_run(srv, speed);
+}
+static inline pbio_error_t pbio_motorcmd_servo_run_time(pbio_servo_t *srv, int32_t speed, int32_t duration, pbio_actuation_t after_stop) {
+    return pbio_servo_run_time(srv, speed, duration, after_stop);
+}
+static inline pbio_error_t pbio_motorcmd_servo_run_until_stalled(pbio_servo_t *srv, int32_t speed, pbio_actuation_t after_stop) {
+    return pbio_servo_run_until_stalled(srv, speed, after_stop);
+}
+static inline pbio_error_t pbio_motorcmd_servo_run_angle(pbio_servo_t *srv, int32_t speed, int32_t angle, pbio_actuation_t after_stop) {
+    return pbio_servo_run_angle(srv, speed, angle, after_stop);
+}
+static inline pbio_error_t pbio_motorcmd_servo_run_target(pbio_servo_t *srv, int32_t speed, int32_t target, pbio_actuation_t after_stop) {
+    return pbio_servo_run_target(srv, speed, target, after_stop);
+}
+static inline pbio_error_t pbio_motorcmd_servo_queue_target(pbio_servo_t *srv, int32_t speed, int32_t target, pbio_actuation_t after_stop) {
+    return pbio_servo_queue_target(srv, speed, target, after_stop);
+}
+static inline pbio_error_t pbio_motorcmd_servo_track_target(pbio_servo_t *srv, int32_t target) {
+    return pbio_servo_track_target(srv, target);
+}
+static inline pbio_error_t pbio_motorcmd_servo_stop(pbio_servo_t *srv, pbio_actuation_t after_stop) {
+    return pbio_servo_stop(srv, after_stop);
+}
+static inline pbio_error_t pbio_motorcmd_servo_set_duty_cycle(pbio_servo_t *srv, int32_t duty_steps) {
+    return pbio_servo_set_duty_cycle(srv, duty_steps);
+}
+static inline pbio_error_t pbio_motorcmd_servo_get_status(pbio_servo_t *srv, bool *done) {
+    *done = pbio_control_is_done(&srv->control);
+    return pbio_motorpoll_get_servo_status(srv);
+}
+static inline pbio_error_t pbio_motorcmd_servo_get_state_user(pbio_servo_t *srv, int32_t *angle, int32_t *speed, int32_t *duty) {
+    return pbio_servo_get_state_user(srv, angle, speed, duty);
+}
+static inline pbio_error_t pbio_motorcmd_servo_get_angle(pbio_servo_t *srv, int32_t *angle) {
+    return pbio_tacho_get_angle(srv->tacho, angle);
+}
+static inline pbio_error_t pbio_motorcmd_servo_get_speed(pbio_servo_t *srv, int32_t *speed) {
+    return pbio_tacho_get_angular_rate(srv->tacho, speed);
+}
+
+static inline pbio_error_t pbio_motorcmd_drivebase_straight(pbio_drivebase_t *db, int32_t distance, int32_t straight_speed, int32_t straight_acceleration) {
+    return pbio_drivebase_straight(db, distance, straight_speed, straight_acceleration);
+}
+static inline pbio_error_t pbio_motorcmd_drivebase_turn(pbio_drivebase_t *db, int32_t angle, int32_t turn_rate, int32_t turn_acceleration) {
+    return pbio_drivebase_turn(db, angle, turn_rate, turn_acceleration);
+}
+static inline pbio_error_t pbio_motorcmd_drivebase_drive(pbio_drivebase_t *db, int32_t speed, int32_t turn_rate) {
+    return pbio_drivebase_drive(db, speed, turn_rate);
+}
+static inline pbio_error_t pbio_motorcmd_drivebase_stop(pbio_drivebase_t *db, pbio_actuation_t after_stop) {
+    return pbio_drivebase_stop(db, after_stop);
+}
+static inline pbio_error_t pbio_motorcmd_drivebase_get_status(pbio_drivebase_t *db, bool *done) {
+    *done = pbio_control_is_done(&db->control_distance) && pbio_control_is_done(&db->control_heading);
+    return pbio_motorpoll_get_drivebase_status(db);
+}
+static inline pbio_error_t pbio_motorcmd_drivebase_get_state(pbio_drivebase_t *db, int32_t *distance, int32_t *drive_speed, int32_t *angle, int32_t *turn_rate) {
+    return pbio_drivebase_get_state(db, distance, drive_speed, angle, turn_rate);
+}
+
+#endif // PBIO_CONFIG_MOTORCMD
+
+#endif // PBDRV_CONFIG_NUM_MOTOR_CONTROLLER
+
+#endif // _PBIO_MOTORCMD_H_
@@ -4,23 +4,80 @@
 #ifndef _PBIO_MOTORPOLL_H_
 #define _PBIO_MOTORPOLL_H_
 
+#include <stdint.h>
+
+#include <pbio/config.h>
 #include <pbio/drivebase.h>
 #include <pbio/error.h>
 #include <pbio/servo.h>
 
 #if PBDRV_CONFIG_NUM_MOTOR_CONTROLLER != 0
 
+/**
+ * Function that is called periodically by the control loop.
+ * @param [in]  context     The context given when the callback was added
+ * @return                  ::PBIO_ERROR_AGAIN to keep being called, or any other value to stop
+ */
+typedef pbio_error_t (*pbio_motorpoll_callback_t)(void *context);
+
+#if PBIO_CONFIG_MOTORPOLL_STATS
+
+// Number of bins in each timing histogram. The last bin counts everything beyond.
+#define PBIO_MOTORPOLL_STATS_NUM_BINS (16)
+
+// Bin width (us) for the time between successive polls
+#define PBIO_MOTORPOLL_STATS_PERIOD_BIN_US (1000)
+
+// Bin width (us) for the time it takes to update one servo or drivebase
+#define PBIO_MOTORPOLL_STATS_EXEC_BIN_US (25)
+
+/**
+ * Histogram of durations in microseconds.
+ */
+typedef struct _pbio_motorpoll_histogram_t {
+    uint32_t bin_width;                             /**< Width of each bin (us) */
+    uint32_t bins[PBIO_MOTORPOLL_STATS_NUM_BINS];   /**< Number of samples in each bin */
+    uint32_t count;                                 /**< Total number of samples */
+    uint32_t max;                                   /**< Longest duration (us) */
+    uint64_t total;                                 /**< Sum of all durations (us) */
+} pbio_motorpoll_histogram_t;
+
+/**
+ * Timing statistics of the control loop.
+ */
+typedef struct _pbio_motorpoll_stats_t {
+    pbio_motorpoll_histogram_t period;                                          /**< Time between successive polls */
+    pbio_motorpoll_histogram_t servo[PBDRV_CONFIG_NUM_MOTOR_CONTROLLER];       /**< Update time of each active servo */
+    pbio_motorpoll_histogram_t drivebase[PBIO_CONFIG_NUM_DRIVEBASES];          /**< Update time of each active drivebase */
+    uint32_t overruns;                                                          /**< Number of polls that came a full period late or more */
+} pbio_motorpoll_stats_t;
+
+const pbio_motorpoll_stats_t *pbio_motorpoll_get_stats(void);
+void pbio_motorpoll_reset_stats(void);
+
+#endif // PBIO_CONFIG_MOTORPOLL_STATS
+
 pbio_error_t pbio_motorpoll_get_servo(pbio_port_t port, pbio_servo_t **srv);
 pbio_error_t pbio_motorpoll_get_servo_status(pbio_servo_t *srv);
 pbio_error_t pbio_motorpoll_set_servo_status(pbio_servo_t *srv, pbio_error_t err);
 
-pbio_error_t pbio_motorpoll_get_drivebase(pbio_drivebase_t **db);
+pbio_error_t pbio_motorpoll_get_drivebase(pbio_servo_t *left, pbio_servo_t *right, pbio_drivebase_t **db);
 pbio_error_t pbio_motorpoll_get_drivebase_status(pbio_drivebase_t *db);
 pbio_error_t pbio_motorpoll_set_drivebase_status(pbio_drivebase_t *db, pbio_error_t err);
 
+pbio_error_t pbio_motorpoll_set_servo_schedule(pbio_servo_t *srv, uint32_t period, uint8_t priority);
+pbio_error_t pbio_motorpoll_set_drivebase_schedule(pbio_drivebase_t *db, uint32_t period, uint8_t priority);
+
+pbio_error_t pbio_motorpoll_add_callback(pbio_motorpoll_callback_t callback, void *context, uint32_t period, uint8_t priority);
+pbio_error_t pbio_motorpoll_remove_callback(pbio_motorpoll_callback_t callback, void *context);
+
 void _pbio_motorpoll_reset_all(void);
 void _pbio_motorpoll_poll(void);
 
+#if PBIO_CONFIG_MOTORCMD
+void _pbio_motorpoll_publish(void);
+#endif
+
 #else
 
 static inline void _pbio_motorpoll_reset_all(void) {
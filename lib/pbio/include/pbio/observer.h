@@ -0,0 +1,41 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+#ifndef _PBIO_OBSERVER_H_
+#define _PBIO_OBSERVER_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * Simplified DC motor model used by the observer
+ */
+typedef struct _pbio_observer_model_t {
+    int32_t rate_max;       /**< Encoder rate (counts/s) at maximum duty without load */
+    int32_t damping;        /**< Inverse of the mechanical time constant (1/s) */
+    int32_t friction;       /**< Deceleration (counts/s^2) due to friction */
+    int32_t bandwidth;      /**< Observer bandwidth (rad/s). Higher values track faster, lower values filter more */
+} pbio_observer_model_t;
+
+/**
+ * Estimated motor state. Values are in counts, counts/s, and counts/s^2,
+ * scaled by 2^16.
+ */
+typedef struct _pbio_observer_t {
+    const pbio_observer_model_t *model; /**< Model of the motor, or NULL if there is none */
+    bool initialized;                   /**< Whether the estimate has been initialized with a measurement */
+    int32_t time_prev;                  /**< Time (us) of the previous update */
+    int64_t count;                      /**< Estimated encoder count */
+    int64_t rate;                       /**< Estimated encoder rate */
+    int64_t disturbance;                /**< Estimated deceleration caused by friction and load */
+} pbio_observer_t;
+
+void pbio_observer_setup(pbio_observer_t *obs, const pbio_observer_model_t *model);
+
+void pbio_observer_reset(pbio_observer_t *obs, int32_t time_now, int32_t count, int32_t rate);
+
+void pbio_observer_update(pbio_observer_t *obs, int32_t time_now, int32_t count, int32_t rate, int32_t duty, bool coasting);
+
+void pbio_observer_get_estimated_state(pbio_observer_t *obs, int32_t *count, int32_t *rate, int32_t *disturbance);
+
+#endif // _PBIO_OBSERVER_H_
@@ -20,17 +20,53 @@
 #include <pbio/trajectory.h>
 #include <pbio/control.h>
 #include <pbio/logger.h>
+#include <pbio/observer.h>
 
 #include <pbio/iodev.h>
 
 #if PBDRV_CONFIG_NUM_MOTOR_CONTROLLER != 0
 
+#if PBIO_CONFIG_MOTORCMD
+
+/**
+ * State of a servo or drivebase as seen by the thread that posts commands.
+ */
+typedef struct _pbio_motorcmd_state_t {
+    uint32_t processed;         /**< Number of commands processed so far */
+    uint32_t failed;            /**< Number of the most recent command that failed, or 0 if none */
+    pbio_error_t err;           /**< Error of the most recent command that failed */
+    pbio_error_t status;        /**< Status in the control loop, as set with pbio_motorpoll_set_servo_status() */
+    pbio_error_t state_err;     /**< Error while reading the values below, if any */
+    bool done;                  /**< Whether the ongoing maneuver is complete */
+    int32_t values[4];          /**< Angle, speed, duty for a servo or distance, speed, angle, turn rate for a drivebase */
+} pbio_motorcmd_state_t;
+
+/**
+ * Links a servo or drivebase owned by the control loop to the thread that
+ * posts commands to it. See pbio/motorcmd.h.
+ */
+typedef struct _pbio_motorcmd_link_t {
+    uint32_t seq;                       /**< Sequence lock for published, odd while it is being written */
+    pbio_motorcmd_state_t published;    /**< State as last published by the control loop */
+    pbio_motorcmd_state_t current;      /**< State being updated by the control loop */
+    uint32_t posted;                    /**< Number of commands posted so far */
+    uint32_t reported;                  /**< Number of the most recent failed command that was reported */
+} pbio_motorcmd_link_t;
+
+#endif // PBIO_CONFIG_MOTORCMD
+
 typedef struct _pbio_servo_t {
     bool claimed;
     pbio_dcmotor_t *dcmotor;
     pbio_tacho_t *tacho;
     pbio_control_t control;
+    #if PBIO_CONFIG_SERVO_OBSERVER
+    pbio_observer_t observer;
+    #endif
     pbio_port_t port;
+    #if PBIO_CONFIG_MOTORCMD
+    pbio_motorcmd_link_t link;
+    #endif
 } pbio_servo_t;
 
 pbio_error_t pbio_servo_setup(pbio_servo_t *srv, pbio_direction_t direction, fix16_t gear_ratio);
@@ -42,12 +78,15 @@ pbio_error_t pbio_servo_stop(pbio_servo_t *srv, pbio_actuation_t after_stop);
 pbio_error_t pbio_servo_stop_force(pbio_servo_t *srv);
 
 pbio_error_t pbio_servo_set_duty_cycle(pbio_servo_t *srv, int32_t duty_steps);
+pbio_error_t pbio_servo_get_state_user(pbio_servo_t *srv, int32_t *angle, int32_t *speed, int32_t *duty);
+pbio_error_t pbio_servo_get_last_state_user(pbio_servo_t *srv, int32_t *angle, int32_t *speed, int32_t *duty);
 
 pbio_error_t pbio_servo_run(pbio_servo_t *srv, int32_t speed);
 pbio_error_t pbio_servo_run_time(pbio_servo_t *srv, int32_t speed, int32_t duration, pbio_actuation_t after_stop);
 pbio_error_t pbio_servo_run_until_stalled(pbio_servo_t *srv, int32_t speed, pbio_actuation_t after_stop);
 pbio_error_t pbio_servo_run_angle(pbio_servo_t *srv, int32_t speed, int32_t angle, pbio_actuation_t after_stop);
 pbio_error_t pbio_servo_run_target(pbio_servo_t *srv, int32_t speed, int32_t target, pbio_actuation_t after_stop);
+pbio_error_t pbio_servo_queue_target(pbio_servo_t *srv, int32_t speed, int32_t target, pbio_actuation_t after_stop);
 pbio_error_t pbio_servo_track_target(pbio_servo_t *srv, int32_t target);
 
 pbio_error_t pbio_servo_control_update(pbio_servo_t *srv);
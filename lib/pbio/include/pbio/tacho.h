@@ -24,6 +24,11 @@ pbio_error_t pbio_tacho_reset_angle(pbio_tacho_t *tacho, int32_t reset_angle, bo
 pbio_error_t pbio_tacho_get_rate(pbio_tacho_t *tacho, int32_t *encoder_rate);
 pbio_error_t pbio_tacho_get_angular_rate(pbio_tacho_t *tacho, int32_t *angular_rate);
 
+pbio_error_t pbio_tacho_get_last_count(pbio_tacho_t *tacho, int32_t *count);
+pbio_error_t pbio_tacho_get_last_angle(pbio_tacho_t *tacho, int32_t *angle);
+pbio_error_t pbio_tacho_get_last_rate(pbio_tacho_t *tacho, int32_t *encoder_rate);
+pbio_error_t pbio_tacho_get_last_angular_rate(pbio_tacho_t *tacho, int32_t *angular_rate);
+
 #else
 
 static inline pbio_error_t pbio_tacho_get(pbio_port_t port, pbio_tacho_t **tacho, pbio_direction_t direction, fix16_t gear_ratio) {
@@ -46,6 +51,19 @@ static inline pbio_error_t pbio_tacho_get_angular_rate(pbio_tacho_t *tacho, int3
     return PBIO_ERROR_NOT_SUPPORTED;
 }
 
+static inline pbio_error_t pbio_tacho_get_last_count(pbio_tacho_t *tacho, int32_t *count) {
+    return PBIO_ERROR_NOT_SUPPORTED;
+}
+static inline pbio_error_t pbio_tacho_get_last_angle(pbio_tacho_t *tacho, int32_t *angle) {
+    return PBIO_ERROR_NOT_SUPPORTED;
+}
+static inline pbio_error_t pbio_tacho_get_last_rate(pbio_tacho_t *tacho, int32_t *encoder_rate) {
+    return PBIO_ERROR_NOT_SUPPORTED;
+}
+static inline pbio_error_t pbio_tacho_get_last_angular_rate(pbio_tacho_t *tacho, int32_t *angular_rate) {
+    return PBIO_ERROR_NOT_SUPPORTED;
+}
+
 #endif // PBIO_CONFIG_TACHO
 
 #endif // _PBIO_TACHO_H_
@@ -50,23 +50,29 @@ typedef struct _pbio_trajectory_t {
     int32_t w1;                          /**<  Encoder rate target when not accelerating */
     int32_t a0;                          /**<  Encoder acceleration during in-phase */
     int32_t a2;                          /**<  Encoder acceleration during out-phase */
+    int32_t tj;                          /**<  Time to ramp acceleration up or down in a jerk limited maneuver, or zero for a trapezoidal speed profile. The maneuver ends at t3 + tj. */
+    int64_t w0_coef;                     /**<  Precomputed w0 in fixed point millicounts per microsecond */
+    int64_t w1_coef;                     /**<  Precomputed w1 in fixed point millicounts per microsecond */
+    int64_t a0_coef;                     /**<  Precomputed a0 / 2 in fixed point millicounts per microsecond squared */
+    int64_t a2_coef;                     /**<  Precomputed a2 / 2 in fixed point millicounts per microsecond squared */
+    int64_t tj_coef;                     /**<  Precomputed 1 / tj in fixed point, or zero if tj is zero */
 } pbio_trajectory_t;
 
 // Core trajectory generators
 
 void pbio_trajectory_make_stationary(pbio_trajectory_t *ref, int32_t t0, int32_t th0);
 
-pbio_error_t pbio_trajectory_make_time_based(pbio_trajectory_t *ref, int32_t t0, int32_t duration, int32_t th0, int32_t th0_ext, int32_t w0, int32_t wt, int32_t wmax, int32_t a, int32_t amax);
+pbio_error_t pbio_trajectory_make_time_based(pbio_trajectory_t *ref, int32_t t0, int32_t duration, int32_t th0, int32_t th0_ext, int32_t w0, int32_t wt, int32_t wmax, int32_t a, int32_t amax, int32_t j);
 
-pbio_error_t pbio_trajectory_make_angle_based(pbio_trajectory_t *ref, int32_t t0, int32_t th0, int32_t th3, int32_t w0, int32_t wt, int32_t wmax, int32_t a, int32_t amax);
+pbio_error_t pbio_trajectory_make_angle_based(pbio_trajectory_t *ref, int32_t t0, int32_t th0, int32_t th3, int32_t w0, int32_t wt, int32_t wmax, int32_t a, int32_t amax, int32_t j);
 
 void pbio_trajectory_get_reference(pbio_trajectory_t *traject, int32_t time_ref, int32_t *count_ref, int32_t *count_ref_ext, int32_t *rate_ref, int32_t *acceleration_ref);
 
 // Extended and patched trajectories
 
-pbio_error_t pbio_trajectory_make_time_based_patched(pbio_trajectory_t *ref, int32_t t0, int32_t t3, int32_t wt, int32_t wmax, int32_t a, int32_t amax);
+pbio_error_t pbio_trajectory_make_time_based_patched(pbio_trajectory_t *ref, int32_t t0, int32_t t3, int32_t wt, int32_t wmax, int32_t a, int32_t amax, int32_t j);
 
-pbio_error_t pbio_trajectory_make_angle_based_patched(pbio_trajectory_t *ref, int32_t t0, int32_t th3, int32_t wt, int32_t wmax, int32_t a, int32_t amax);
+pbio_error_t pbio_trajectory_make_angle_based_patched(pbio_trajectory_t *ref, int32_t t0, int32_t th3, int32_t wt, int32_t wmax, int32_t a, int32_t amax, int32_t j);
 
 
 #endif // _PBIO_TRAJECTORY_H_
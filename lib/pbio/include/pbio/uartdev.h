@@ -26,6 +26,31 @@ typedef struct {
 
 extern const pbio_uartdev_platform_data_t pbio_uartdev_platform_data[PBIO_CONFIG_UARTDEV_NUM_DEV];
 
+#if PBIO_CONFIG_UARTDEV_STATS
+
+/**
+ * Statistics of the LEGO UART protocol on one port.
+ */
+typedef struct _pbio_uartdev_stats_t {
+    uint32_t rx_bytes;              /**< Number of bytes received */
+    uint32_t tx_bytes;              /**< Number of bytes sent */
+    uint32_t rx_msgs;               /**< Number of messages received with a good checksum */
+    uint32_t rx_data_msgs;          /**< Number of DATA messages received with a good checksum */
+    uint32_t checksum_errors;       /**< Number of messages received with a bad checksum */
+    uint32_t bad_msgs;              /**< Number of messages dropped because of a bad header */
+    uint32_t keepalive_misses;      /**< Number of keepalive periods without any DATA */
+    uint32_t resyncs;               /**< Number of times the connection was lost and had to be synced again */
+    uint32_t baud_changes;          /**< Number of times the baud rate was changed */
+    uint32_t data_intervals;        /**< Number of times between two DATA messages */
+    uint32_t data_interval_max;     /**< Longest time (us) between two DATA messages */
+    uint64_t data_interval_total;   /**< Sum of all times (us) between two DATA messages */
+} pbio_uartdev_stats_t;
+
+pbio_error_t pbio_uartdev_get_stats(uint8_t id, const pbio_uartdev_stats_t **stats);
+pbio_error_t pbio_uartdev_reset_stats(uint8_t id);
+
+#endif // PBIO_CONFIG_UARTDEV_STATS
+
 #else // PBIO_CONFIG_UARTDEV
 
 static inline pbio_error_t pbio_uartdev_get(uint8_t id, pbio_iodev_t **iodev) {
@@ -87,6 +87,22 @@ pbio_error_t pbsys_stdin_get_char(uint8_t *c);
  */
 pbio_error_t pbsys_stdout_put_char(uint8_t c);
 
+/**
+ * Write data to stdout.
+ *
+ * As much of the data as can be written at this time is written, so callers
+ * should keep calling this with the rest of the data until *count* adds up.
+ *
+ * @param [in]  data    The data to write
+ * @param [in]  size    The size of @p data in bytes
+ * @param [out] count   The number of bytes that were written
+ * @return              ::PBIO_SUCCESS if at least one byte was written,
+ *                      ::PBIO_ERROR_AGAIN if nothing could be written at this
+ *                      time or ::PBIO_ERROR_NOT_SUPPORTED if the platform
+ *                      does not have a stdout.
+ */
+pbio_error_t pbsys_stdout_write(const uint8_t *data, uint32_t size, uint32_t *count);
+
 #else // PBIO_CONFIG_ENABLE_SYS
 
 static inline void pbsys_prepare_user_program(const pbsys_user_program_callbacks_t *callbacks) {
@@ -100,6 +116,10 @@ static inline pbio_error_t pbsys_stdin_get_char(uint8_t *c) {
 static inline pbio_error_t pbsys_stdout_put_char(uint8_t c) {
     return PBIO_ERROR_NOT_SUPPORTED;
 }
+static inline pbio_error_t pbsys_stdout_write(const uint8_t *data, uint32_t size, uint32_t *count) {
+    *count = 0;
+    return PBIO_ERROR_NOT_SUPPORTED;
+}
 
 #endif // PBIO_CONFIG_ENABLE_SYS
 
@@ -65,6 +65,10 @@ pbio_error_t pbsys_stdout_put_char(uint8_t c) {
     return pbdrv_bluetooth_tx(c);
 }
 
+pbio_error_t pbsys_stdout_write(const uint8_t *data, uint32_t size, uint32_t *count) {
+    return pbdrv_bluetooth_tx_buf(data, size, count);
+}
+
 static void init(void) {
     IWDG->KR = 0x5555; // enable register access
     IWDG->PR = IWDG_PR_PR_2; // divide by 64
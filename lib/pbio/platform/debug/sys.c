@@ -59,6 +59,18 @@ pbio_error_t pbsys_stdout_put_char(uint8_t c) {
     return PBIO_SUCCESS;
 }
 
+pbio_error_t pbsys_stdout_write(const uint8_t *data, uint32_t size, uint32_t *count) {
+    // The UART takes one byte at a time
+    for (*count = 0; *count < size; (*count)++) {
+        pbio_error_t err = pbsys_stdout_put_char(data[*count]);
+        if (err != PBIO_SUCCESS) {
+            return *count ? PBIO_SUCCESS : err;
+        }
+    }
+
+    return PBIO_SUCCESS;
+}
+
 PROCESS_THREAD(pbsys_process, ev, data) {
     static struct etimer timer;
 
@@ -63,6 +63,10 @@ pbio_error_t pbsys_stdout_put_char(uint8_t c) {
     return pbdrv_bluetooth_tx(c);
 }
 
+pbio_error_t pbsys_stdout_write(const uint8_t *data, uint32_t size, uint32_t *count) {
+    return pbdrv_bluetooth_tx_buf(data, size, count);
+}
+
 static void handle_stdin_char(uint8_t c) {
     uint8_t new_head = (stdin_buf_head + 1) & (STDIN_BUF_SIZE - 1);
 
@@ -16,6 +16,7 @@
 #include "../../drv/uart/uart_stm32f4_ll_irq.h"
 
 #include "stm32f4xx_hal.h"
+#include "stm32f4xx_ll_dma.h"
 
 // bootloader magic
 
@@ -301,18 +302,34 @@ const pbdrv_uart_stm32f4_ll_irq_platform_data_t
     [UART_PORT_A] = {
         .uart = UART7,
         .irq = UART7_IRQn,
+        .rx_dma = DMA1,
+        .rx_dma_stream = LL_DMA_STREAM_3,
+        .rx_dma_ch = LL_DMA_CHANNEL_5,
+        .rx_dma_irq = DMA1_Stream3_IRQn,
     },
     [UART_PORT_B] = {
         .uart = UART4,
         .irq = UART4_IRQn,
+        .rx_dma = DMA1,
+        .rx_dma_stream = LL_DMA_STREAM_2,
+        .rx_dma_ch = LL_DMA_CHANNEL_4,
+        .rx_dma_irq = DMA1_Stream2_IRQn,
     },
     [UART_PORT_C] = {
         .uart = UART8,
         .irq = UART8_IRQn,
+        .rx_dma = DMA1,
+        .rx_dma_stream = LL_DMA_STREAM_6,
+        .rx_dma_ch = LL_DMA_CHANNEL_5,
+        .rx_dma_irq = DMA1_Stream6_IRQn,
     },
     [UART_PORT_D] = {
         .uart = UART5,
         .irq = UART5_IRQn,
+        .rx_dma = DMA1,
+        .rx_dma_stream = LL_DMA_STREAM_0,
+        .rx_dma_ch = LL_DMA_CHANNEL_4,
+        .rx_dma_irq = DMA1_Stream0_IRQn,
     },
     [UART_PORT_E] = {
         .uart = UART10,
@@ -324,6 +341,26 @@ const pbdrv_uart_stm32f4_ll_irq_platform_data_t
     },
 };
 
+// overrides weak function in setup.m
+void DMA1_Stream0_IRQHandler(void) {
+    pbdrv_uart_stm32f4_ll_irq_handle_rx_dma_irq(UART_PORT_D);
+}
+
+// overrides weak function in setup.m
+void DMA1_Stream2_IRQHandler(void) {
+    pbdrv_uart_stm32f4_ll_irq_handle_rx_dma_irq(UART_PORT_B);
+}
+
+// overrides weak function in setup.m
+void DMA1_Stream3_IRQHandler(void) {
+    pbdrv_uart_stm32f4_ll_irq_handle_rx_dma_irq(UART_PORT_A);
+}
+
+// overrides weak function in setup.m
+void DMA1_Stream6_IRQHandler(void) {
+    pbdrv_uart_stm32f4_ll_irq_handle_rx_dma_irq(UART_PORT_C);
+}
+
 // overrides weak function in setup.m
 void UART4_IRQHandler(void) {
     pbdrv_uart_stm32f4_ll_irq_handle_irq(UART_PORT_B);
@@ -622,7 +659,7 @@ void SystemInit(void) {
 
     // enable clocks
     RCC->AHB1ENR |= RCC_AHB1ENR_GPIOAEN | RCC_AHB1ENR_GPIOBEN | RCC_AHB1ENR_GPIOCEN |
-        RCC_AHB1ENR_GPIODEN | RCC_AHB1ENR_GPIOEEN | RCC_AHB1ENR_DMA2EN;
+        RCC_AHB1ENR_GPIODEN | RCC_AHB1ENR_GPIOEEN | RCC_AHB1ENR_DMA1EN | RCC_AHB1ENR_DMA2EN;
     RCC->APB1ENR |= RCC_APB1ENR_UART4EN | RCC_APB1ENR_UART5EN | RCC_APB1ENR_UART7EN |
         RCC_APB1ENR_UART8EN | RCC_APB1ENR_TIM2EN | RCC_APB1ENR_TIM3EN |
         RCC_APB1ENR_TIM4EN | RCC_APB1ENR_TIM12EN | RCC_APB1ENR_I2C2EN;
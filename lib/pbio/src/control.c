@@ -9,6 +9,38 @@
 #include <pbio/trajectory.h>
 #include <pbio/integrator.h>
 
+static void queue_clear(pbio_control_t *ctl) {
+    ctl->queue.first = 0;
+    ctl->queue.count = 0;
+}
+
+// Switch to the next queued angle target once the ongoing maneuver starts decelerating
+static void queue_advance(pbio_control_t *ctl, int32_t time_ref) {
+
+    // Nothing to do if there is no next target, or if we are not there yet
+    if (ctl->queue.count == 0 || ctl->type != PBIO_CONTROL_ANGLE || time_ref - ctl->trajectory.t2 < 0) {
+        return;
+    }
+
+    pbio_control_segment_t *next = &ctl->queue.segments[ctl->queue.first];
+    if (++ctl->queue.first == PBIO_CONFIG_CONTROL_QUEUE_SIZE) {
+        ctl->queue.first = 0;
+    }
+    ctl->queue.count--;
+
+    // Continue from the current reference instead of decelerating. If the next
+    // target is further along, we move through the current target at speed.
+    // Otherwise we reverse at the current target. If the new trajectory can't
+    // be made, we just finish the current one.
+    pbio_error_t err = pbio_trajectory_make_angle_based_patched(&ctl->trajectory, time_ref, next->target_count, next->target_rate, ctl->settings.max_rate, next->acceleration, ctl->settings.abs_acceleration, ctl->settings.abs_jerk);
+    if (err != PBIO_SUCCESS) {
+        queue_clear(ctl);
+        return;
+    }
+    ctl->after_stop = next->after_stop;
+    ctl->on_target = false;
+}
+
 void control_update(pbio_control_t *ctl, int32_t time_now, int32_t count_now, int32_t rate_now, pbio_actuation_t *actuation_type, int32_t *control) {
 
     // Declare current time, positions, rates, and their reference value and error
@@ -22,6 +54,9 @@ void control_update(pbio_control_t *ctl, int32_t time_now, int32_t count_now, in
     // This compensates for any time we may have spent pausing when the motor was stalled.
     time_ref = pbio_control_get_ref_time(ctl, time_now);
 
+    // Blend into the next queued maneuver, if any
+    queue_advance(ctl, time_ref);
+
     // Get reference signals
     pbio_trajectory_get_reference(&ctl->trajectory, time_ref, &count_ref, &count_ref_ext, &rate_ref, &acceleration_ref);
 
@@ -55,7 +90,7 @@ void control_update(pbio_control_t *ctl, int32_t time_now, int32_t count_now, in
     // We want to stop building up further errors if we are at the proportional duty limit. So, we pause the trajectory
     // if we get at this limit. We wait a little longer though, to make sure it does not fall back to below the limit
     // within one sample, which we can predict using the current rate times the loop time, with a factor two tolerance.
-    int32_t max_windup_duty = (ctl->settings.max_control - ctl->settings.control_offset) + (ctl->settings.pid_kp * abs(rate_now) * PBIO_CONFIG_SERVO_PERIOD_MS * 2) / MS_PER_SECOND;
+    int32_t max_windup_duty = (ctl->settings.max_control - ctl->settings.control_offset) + (ctl->settings.pid_kp * abs(rate_now) * (int32_t)ctl->period * 2) / MS_PER_SECOND;
 
     // Position anti-windup: pause trajectory or integration if falling behind despite using maximum duty
 
@@ -120,8 +155,14 @@ void control_update(pbio_control_t *ctl, int32_t time_now, int32_t count_now, in
     pbio_logger_update(&ctl->log, log_data);
 }
 
+// Sets the time between control updates, as scheduled by the control loop
+void pbio_control_set_period(pbio_control_t *ctl, uint32_t period) {
+    ctl->period = period;
+    pbio_logger_set_period(&ctl->log, period);
+}
 
 void pbio_control_stop(pbio_control_t *ctl) {
+    queue_clear(ctl);
     ctl->type = PBIO_CONTROL_NONE;
     ctl->on_target = true;
     ctl->on_target_func = pbio_control_on_target_always;
@@ -132,6 +173,9 @@ pbio_error_t pbio_control_start_angle_control(pbio_control_t *ctl, int32_t time_
 
     pbio_error_t err;
 
+    // A new command replaces any queued maneuvers
+    queue_clear(ctl);
+
     // Set new maneuver action and stop type, and state
     ctl->after_stop = after_stop;
     ctl->on_target = false;
@@ -140,7 +184,7 @@ pbio_error_t pbio_control_start_angle_control(pbio_control_t *ctl, int32_t time_
     // Compute the trajectory
     if (ctl->type == PBIO_CONTROL_NONE) {
         // If no control is ongoing, start from physical state
-        err = pbio_trajectory_make_angle_based(&ctl->trajectory, time_now, count_now, target_count, rate_now, target_rate, ctl->settings.max_rate, acceleration, ctl->settings.abs_acceleration);
+        err = pbio_trajectory_make_angle_based(&ctl->trajectory, time_now, count_now, target_count, rate_now, target_rate, ctl->settings.max_rate, acceleration, ctl->settings.abs_acceleration, ctl->settings.abs_jerk);
         if (err != PBIO_SUCCESS) {
             return err;
         }
@@ -149,7 +193,7 @@ pbio_error_t pbio_control_start_angle_control(pbio_control_t *ctl, int32_t time_
         int32_t time_ref = pbio_control_get_ref_time(ctl, time_now);
 
         // Make the new trajectory and try to patch to existing one
-        err = pbio_trajectory_make_angle_based_patched(&ctl->trajectory, time_ref, target_count, target_rate, ctl->settings.max_rate, acceleration, ctl->settings.abs_acceleration);
+        err = pbio_trajectory_make_angle_based_patched(&ctl->trajectory, time_ref, target_count, target_rate, ctl->settings.max_rate, acceleration, ctl->settings.abs_acceleration, ctl->settings.abs_jerk);
         if (err != PBIO_SUCCESS) {
             return err;
         }
@@ -197,6 +241,9 @@ pbio_error_t pbio_control_start_relative_angle_control(pbio_control_t *ctl, int3
 
 pbio_error_t pbio_control_start_hold_control(pbio_control_t *ctl, int32_t time_now, int32_t target_count) {
 
+    // A new command replaces any queued maneuvers
+    queue_clear(ctl);
+
     // Set new maneuver action and stop type, and state
     ctl->after_stop = PBIO_ACTUATION_HOLD;
     ctl->on_target = false;
@@ -222,6 +269,9 @@ pbio_error_t pbio_control_start_timed_control(pbio_control_t *ctl, int32_t time_
 
     pbio_error_t err;
 
+    // A new command replaces any queued maneuvers
+    queue_clear(ctl);
+
     // Set new maneuver action and stop type, and state
     ctl->after_stop = after_stop;
     ctl->on_target = false;
@@ -230,7 +280,7 @@ pbio_error_t pbio_control_start_timed_control(pbio_control_t *ctl, int32_t time_
     // Compute the trajectory
     if (ctl->type == PBIO_CONTROL_TIMED) {
         // If timed control is already ongoing make the new trajectory and try to patch to existing one
-        err = pbio_trajectory_make_time_based_patched(&ctl->trajectory, time_now, duration, target_rate, ctl->settings.max_rate, acceleration, ctl->settings.abs_acceleration);
+        err = pbio_trajectory_make_time_based_patched(&ctl->trajectory, time_now, duration, target_rate, ctl->settings.max_rate, acceleration, ctl->settings.abs_acceleration, ctl->settings.abs_jerk);
         if (err != PBIO_SUCCESS) {
             return err;
         }
@@ -241,13 +291,13 @@ pbio_error_t pbio_control_start_timed_control(pbio_control_t *ctl, int32_t time_
         pbio_trajectory_get_reference(&ctl->trajectory, time_ref, &count_start, &unused, &rate_start, &unused);
 
         // Now start the timed trajectory from there
-        err = pbio_trajectory_make_time_based(&ctl->trajectory, time_now, duration, count_start, 0, rate_start, target_rate, ctl->settings.max_rate, acceleration, ctl->settings.abs_acceleration);
+        err = pbio_trajectory_make_time_based(&ctl->trajectory, time_now, duration, count_start, 0, rate_start, target_rate, ctl->settings.max_rate, acceleration, ctl->settings.abs_acceleration, ctl->settings.abs_jerk);
         if (err != PBIO_SUCCESS) {
             return err;
         }
     } else {
         // If no control is ongoing, start from physical state
-        err = pbio_trajectory_make_time_based(&ctl->trajectory, time_now, duration, count_now, 0, rate_now, target_rate, ctl->settings.max_rate, acceleration, ctl->settings.abs_acceleration);
+        err = pbio_trajectory_make_time_based(&ctl->trajectory, time_now, duration, count_now, 0, rate_now, target_rate, ctl->settings.max_rate, acceleration, ctl->settings.abs_acceleration, ctl->settings.abs_jerk);
         if (err != PBIO_SUCCESS) {
             return err;
         }
@@ -265,6 +315,50 @@ pbio_error_t pbio_control_start_timed_control(pbio_control_t *ctl, int32_t time_
     return PBIO_SUCCESS;
 }
 
+/**
+ * Runs to a target after the ongoing angle maneuver, without stopping in
+ * between. If no angle maneuver is ongoing, this starts right away.
+ * @param [in]  ctl             The controller
+ * @param [in]  time_now        The wall time (microseconds)
+ * @param [in]  count_now       The current encoder count
+ * @param [in]  target_count    The target encoder count
+ * @param [in]  rate_now        The current encoder rate
+ * @param [in]  target_rate     The target encoder rate
+ * @param [in]  acceleration    The encoder acceleration
+ * @param [in]  after_stop      What to do when this is the last maneuver
+ * @return                      ::PBIO_SUCCESS, ::PBIO_ERROR_AGAIN if the queue is full,
+ *                              or the error of starting the maneuver right away
+ */
+pbio_error_t pbio_control_queue_angle_control(pbio_control_t *ctl, int32_t time_now, int32_t count_now, int32_t target_count, int32_t rate_now, int32_t target_rate, int32_t acceleration, pbio_actuation_t after_stop) {
+
+    if (ctl->type != PBIO_CONTROL_ANGLE) {
+        return pbio_control_start_angle_control(ctl, time_now, count_now, target_count, rate_now, target_rate, acceleration, after_stop);
+    }
+
+    // Same argument checks as when starting right away
+    if (target_rate == 0) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+
+    if (ctl->queue.count == PBIO_CONFIG_CONTROL_QUEUE_SIZE) {
+        return PBIO_ERROR_AGAIN;
+    }
+
+    uint8_t index = ctl->queue.first + ctl->queue.count;
+    if (index >= PBIO_CONFIG_CONTROL_QUEUE_SIZE) {
+        index -= PBIO_CONFIG_CONTROL_QUEUE_SIZE;
+    }
+    ctl->queue.segments[index] = (pbio_control_segment_t) {
+        .target_count = target_count,
+        .target_rate = target_rate,
+        .acceleration = acceleration,
+        .after_stop = after_stop,
+    };
+    ctl->queue.count++;
+
+    return PBIO_SUCCESS;
+}
+
 static bool _pbio_control_on_target_always(pbio_trajectory_t *trajectory, pbio_control_settings_t *settings, int32_t time, int32_t count, int32_t rate, bool stalled) {
     return true;
 }
@@ -277,7 +371,7 @@ pbio_control_on_target_t pbio_control_on_target_never = _pbio_control_on_target_
 
 static bool _pbio_control_on_target_angle(pbio_trajectory_t *trajectory, pbio_control_settings_t *settings, int32_t time, int32_t count, int32_t rate, bool stalled) {
     // if not enough time has expired to be done even in the ideal case, we are certainly not done
-    if (time - trajectory->t3 < 0) {
+    if (time - (trajectory->t3 + trajectory->tj) < 0) {
         return false;
     }
 
@@ -302,7 +396,7 @@ static bool _pbio_control_on_target_angle(pbio_trajectory_t *trajectory, pbio_co
 pbio_control_on_target_t pbio_control_on_target_angle = _pbio_control_on_target_angle;
 
 static bool _pbio_control_on_target_time(pbio_trajectory_t *trajectory, pbio_control_settings_t *settings, int32_t time, int32_t count, int32_t rate, bool stalled) {
-    return time >= trajectory->t3;
+    return time >= trajectory->t3 + trajectory->tj;
 }
 pbio_control_on_target_t pbio_control_on_target_time = _pbio_control_on_target_time;
 
@@ -338,6 +432,18 @@ pbio_error_t pbio_control_settings_set_limits(pbio_control_settings_t *s, int32_
     return PBIO_SUCCESS;
 }
 
+void pbio_control_settings_get_jerk(pbio_control_settings_t *s, int32_t *jerk) {
+    *jerk = pbio_control_counts_to_user(s, s->abs_jerk);
+}
+
+pbio_error_t pbio_control_settings_set_jerk(pbio_control_settings_t *s, int32_t jerk) {
+    if (jerk < 0) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+    s->abs_jerk = pbio_control_user_to_counts(s, jerk);
+    return PBIO_SUCCESS;
+}
+
 void pbio_control_settings_get_pid(pbio_control_settings_t *s, int16_t *pid_kp, int16_t *pid_ki, int16_t *pid_kd, int32_t *integral_range, int32_t *integral_rate, int32_t *control_offset) {
     *pid_kp = s->pid_kp;
     *pid_ki = s->pid_ki;
@@ -419,5 +525,5 @@ bool pbio_control_is_stalled(pbio_control_t *ctl) {
 }
 
 bool pbio_control_is_done(pbio_control_t *ctl) {
-    return ctl->type == PBIO_CONTROL_NONE || ctl->on_target;
+    return ctl->type == PBIO_CONTROL_NONE || (ctl->on_target && ctl->queue.count == 0);
 }
@@ -23,6 +23,7 @@ static pbio_error_t drivebase_adopt_settings(pbio_control_settings_t *s_distance
     // As acceleration, we take double the single motor amount, because drivebases are
     // usually expected to respond quickly to speed setpoint changes
     s_distance->abs_acceleration = (s_left->abs_acceleration + s_right->abs_acceleration) * 2;
+    s_distance->abs_jerk = (s_left->abs_jerk + s_right->abs_jerk) * 2;
 
     // Although counts/errors add up twice as fast, both motors actuate, so apply half of the average PID
     s_distance->pid_kp = (s_left->pid_kp + s_right->pid_kp) / 4;
@@ -46,39 +47,38 @@ static pbio_error_t drivebase_adopt_settings(pbio_control_settings_t *s_distance
     return PBIO_SUCCESS;
 }
 
-// Get the physical state of a drivebase
-static pbio_error_t drivebase_get_state(pbio_drivebase_t *db,
-    int32_t *time_now,
+// Get the physical state of a drivebase, either read now or as last read
+static pbio_error_t drivebase_read_state(pbio_drivebase_t *db,
+    bool last,
     int32_t *sum,
     int32_t *sum_rate,
     int32_t *dif,
     int32_t *dif_rate) {
 
+    pbio_error_t (*get_count)(pbio_tacho_t *, int32_t *) = last ? pbio_tacho_get_last_count : pbio_tacho_get_count;
+    pbio_error_t (*get_rate)(pbio_tacho_t *, int32_t *) = last ? pbio_tacho_get_last_rate : pbio_tacho_get_rate;
     pbio_error_t err;
 
-    // Read current state of this motor: current time, speed, and position
-    *time_now = clock_usecs();
-
     int32_t count_left;
-    err = pbio_tacho_get_count(db->left->tacho, &count_left);
+    err = get_count(db->left->tacho, &count_left);
     if (err != PBIO_SUCCESS) {
         return err;
     }
 
     int32_t count_right;
-    err = pbio_tacho_get_count(db->right->tacho, &count_right);
+    err = get_count(db->right->tacho, &count_right);
     if (err != PBIO_SUCCESS) {
         return err;
     }
 
     int32_t rate_left;
-    err = pbio_tacho_get_rate(db->left->tacho, &rate_left);
+    err = get_rate(db->left->tacho, &rate_left);
     if (err != PBIO_SUCCESS) {
         return err;
     }
 
     int32_t rate_right;
-    err = pbio_tacho_get_rate(db->right->tacho, &rate_right);
+    err = get_rate(db->right->tacho, &rate_right);
     if (err != PBIO_SUCCESS) {
         return err;
     }
@@ -91,6 +91,19 @@ static pbio_error_t drivebase_get_state(pbio_drivebase_t *db,
     return PBIO_SUCCESS;
 }
 
+// Get the physical state of a drivebase
+static pbio_error_t drivebase_get_state(pbio_drivebase_t *db,
+    int32_t *time_now,
+    int32_t *sum,
+    int32_t *sum_rate,
+    int32_t *dif,
+    int32_t *dif_rate) {
+
+    // Read current state of this motor: current time, speed, and position
+    *time_now = clock_usecs();
+    return drivebase_read_state(db, false, sum, sum_rate, dif, dif_rate);
+}
+
 // Get the physical state of a drivebase
 static pbio_error_t pbio_drivebase_actuate(pbio_drivebase_t *db, pbio_actuation_t actuation, int32_t sum_control, int32_t dif_control) {
     pbio_error_t err;
@@ -149,6 +162,11 @@ pbio_error_t pbio_drivebase_setup(pbio_drivebase_t *db, pbio_servo_t *left, pbio
         return err;
     }
 
+    // Release the servos this drivebase used before, if any
+    if (err == PBIO_SUCCESS) {
+        pbio_drivebase_claim_servos(db, false);
+    }
+
     // Reset both motors to a passive state
     err = pbio_servo_stop(left, PBIO_ACTUATION_COAST);
     if (err != PBIO_SUCCESS) {
@@ -409,9 +427,10 @@ pbio_error_t pbio_drivebase_drive(pbio_drivebase_t *db, int32_t speed, int32_t t
     return PBIO_SUCCESS;
 }
 
-pbio_error_t pbio_drivebase_get_state(pbio_drivebase_t *db, int32_t *distance, int32_t *drive_speed, int32_t *angle, int32_t *turn_rate) {
-    int32_t time_now, sum, sum_rate, dif, dif_rate;
-    pbio_error_t err = drivebase_get_state(db, &time_now, &sum, &sum_rate, &dif, &dif_rate);
+// Get the state of a drivebase in user units, either read now or as last read
+static pbio_error_t drivebase_get_state_user(pbio_drivebase_t *db, bool last, int32_t *distance, int32_t *drive_speed, int32_t *angle, int32_t *turn_rate) {
+    int32_t sum, sum_rate, dif, dif_rate;
+    pbio_error_t err = drivebase_read_state(db, last, &sum, &sum_rate, &dif, &dif_rate);
     if (err != PBIO_SUCCESS) {
         return err;
     }
@@ -422,6 +441,16 @@ pbio_error_t pbio_drivebase_get_state(pbio_drivebase_t *db, int32_t *distance, i
     return PBIO_SUCCESS;
 }
 
+pbio_error_t pbio_drivebase_get_state(pbio_drivebase_t *db, int32_t *distance, int32_t *drive_speed, int32_t *angle, int32_t *turn_rate) {
+    return drivebase_get_state_user(db, false, distance, drive_speed, angle, turn_rate);
+}
+
+// Same as pbio_drivebase_get_state(), but as last read by the control loop,
+// without reading the counters again
+pbio_error_t pbio_drivebase_get_last_state(pbio_drivebase_t *db, int32_t *distance, int32_t *drive_speed, int32_t *angle, int32_t *turn_rate) {
+    return drivebase_get_state_user(db, true, distance, drive_speed, angle, turn_rate);
+}
+
 pbio_error_t pbio_drivebase_reset_state(pbio_drivebase_t *db) {
     int32_t time_now, sum_rate, dif_rate;
     return drivebase_get_state(db, &time_now, &db->sum_offset, &sum_rate, &db->dif_offset, &dif_rate);
@@ -72,6 +72,75 @@ pbio_error_t pbio_iodev_get_data(pbio_iodev_t *iodev, uint8_t **data) {
     return PBIO_SUCCESS;
 }
 
+/**
+ * Gets the data sequence number of an I/O device.
+ * @param [in]  iodev       The I/O device
+ * @param [out] seq         The current sequence number
+ * @return                  ::PBIO_SUCCESS on success
+ *                          ::PBIO_ERROR_NO_DEV if the port does not have a device attached
+ *
+ * The sequence number changes each time the device delivers new data, so it
+ * can be passed to ::pbio_iodev_wait_data() to wait for the next sample.
+ */
+pbio_error_t pbio_iodev_get_data_seq(pbio_iodev_t *iodev, uint32_t *seq) {
+    if (iodev->info->type_id == PBIO_IODEV_TYPE_ID_NONE) {
+        return PBIO_ERROR_NO_DEV;
+    }
+
+    *seq = iodev->data_seq;
+
+    return PBIO_SUCCESS;
+}
+
+/**
+ * Checks if an I/O device has new data since a given sequence number.
+ * @param [in]  iodev       The I/O device
+ * @param [in]  seq         Sequence number from ::pbio_iodev_get_data_seq()
+ * @return                  ::PBIO_SUCCESS if new data is available
+ *                          ::PBIO_ERROR_AGAIN if there is no new data yet
+ *                          ::PBIO_ERROR_NO_DEV if the port does not have a device attached
+ *
+ * This does not block. Callers should poll it until it no longer returns
+ * ::PBIO_ERROR_AGAIN, for example from the MicroPython event poll hook.
+ */
+pbio_error_t pbio_iodev_wait_data(pbio_iodev_t *iodev, uint32_t seq) {
+    if (iodev->info->type_id == PBIO_IODEV_TYPE_ID_NONE) {
+        return PBIO_ERROR_NO_DEV;
+    }
+
+    if (iodev->data_seq == seq) {
+        return PBIO_ERROR_AGAIN;
+    }
+
+    return PBIO_SUCCESS;
+}
+
+/**
+ * Gets the raw data of one mode in the active mode combination of an I/O device.
+ * @param [in]  iodev       The I/O device
+ * @param [in]  mode        The mode
+ * @param [out] data        Pointer to hold array of data values
+ * @return                  ::PBIO_SUCCESS on success
+ *                          ::PBIO_ERROR_NO_DEV if the port does not have a device attached
+ *                          ::PBIO_ERROR_INVALID_OP if the mode is not part of the active mode combination
+ *
+ * The binary format and size of *data* is determined by ::pbio_iodev_get_data_format().
+ */
+pbio_error_t pbio_iodev_get_combo_data(pbio_iodev_t *iodev, uint8_t mode, uint8_t **data) {
+    if (iodev->info->type_id == PBIO_IODEV_TYPE_ID_NONE) {
+        return PBIO_ERROR_NO_DEV;
+    }
+
+    for (uint8_t i = 0; i < iodev->num_combo_modes; i++) {
+        if (iodev->combo_modes[i] == mode) {
+            *data = iodev->bin_data + iodev->combo_offsets[i];
+            return PBIO_SUCCESS;
+        }
+    }
+
+    return PBIO_ERROR_INVALID_OP;
+}
+
 /**
  * Sets the mode of an I/O device.
  * @param [in]  iodev       The I/O device
@@ -108,6 +177,58 @@ void pbio_iodev_set_mode_cancel(pbio_iodev_t *iodev) {
     iodev->ops->set_mode_cancel(iodev);
 }
 
+/**
+ * Sets a combination of modes, so that an I/O device sends the data of all of
+ * these modes at the same time.
+ * @param [in]  iodev       The I/O device
+ * @param [in]  modes       The modes
+ * @param [in]  num_modes   The number of modes
+ * @return                  ::PBIO_SUCCESS on success
+ *                          ::PBIO_ERROR_INVALID_ARG if a mode is not valid or the modes have too many values
+ *                          ::PBIO_ERROR_NOT_SUPPORTED if the device does not support combining these modes
+ *                          ::PBIO_ERROR_AGAIN if the device is busy with something else
+ *
+ * The combination stays active until the mode is changed with
+ * ::pbio_iodev_set_mode_begin(). Use ::pbio_iodev_get_combo_data() to get the
+ * data of each mode.
+ */
+pbio_error_t pbio_iodev_set_mode_combo_begin(pbio_iodev_t *iodev, const uint8_t *modes, uint8_t num_modes) {
+    if (!iodev->ops->set_mode_combo_begin) {
+        return PBIO_ERROR_NOT_SUPPORTED;
+    }
+
+    if (num_modes == 0 || num_modes > PBIO_IODEV_MAX_COMBO_VALUES) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+
+    for (uint8_t i = 0; i < num_modes; i++) {
+        if (modes[i] >= iodev->info->num_modes) {
+            return PBIO_ERROR_INVALID_ARG;
+        }
+        if (!(iodev->info->mode_combos & (1 << modes[i]))) {
+            return PBIO_ERROR_NOT_SUPPORTED;
+        }
+    }
+
+    return iodev->ops->set_mode_combo_begin(iodev, modes, num_modes);
+}
+
+pbio_error_t pbio_iodev_set_mode_combo_end(pbio_iodev_t *iodev) {
+    if (!iodev->ops->set_mode_combo_end) {
+        return PBIO_ERROR_NOT_SUPPORTED;
+    }
+
+    return iodev->ops->set_mode_combo_end(iodev);
+}
+
+void pbio_iodev_set_mode_combo_cancel(pbio_iodev_t *iodev) {
+    if (!iodev->ops->set_mode_combo_cancel) {
+        return;
+    }
+
+    iodev->ops->set_mode_combo_cancel(iodev);
+}
+
 /**
  * Sets the raw data of an I/O device.
  * @param [in]  iodev       The I/O device
@@ -3,6 +3,7 @@
 
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
 #include <inttypes.h>
 
 #include <contiki.h>
@@ -11,32 +12,67 @@
 #include <pbio/error.h>
 #include <pbio/logger.h>
 
+static void logger_start(pbio_log_t *log, int32_t *buf, uint32_t len, int32_t div, bool circular) {
+    // (re-)initialize logger status for this servo
+    log->sampled = 0;
+    log->drained = 0;
+    log->dropped = 0;
+    log->head = 0;
+    log->skipped = 0;
+    log->data = buf;
+    log->len = len;
+    log->sample_div = div;
+    log->start = clock_time();
+    log->circular = circular;
+    log->active = len > 0;
+}
+
 /**
- * Starts logging in the background.
+ * Starts logging in the background. Logging stops when the buffer is full.
  * @param [in]  log     pointer to log
  * @param [in]  buf     array large enough to hold @p len rows of data
  * @param [in]  len     maximum number of rows that can be logged
  * @param [in]  div     clock divider to slow down sampling period
  */
 void pbio_logger_start(pbio_log_t *log, int32_t *buf, uint32_t len, int32_t div) {
-    // (re-)initialize logger status for this servo
-    log->sampled = 0;
-    log->skipped = 0;
-    log->data = buf;
-    log->len = len;
-    log->sample_div = div;
-    log->start = clock_usecs();
-    log->active = true;
+    logger_start(log, buf, len, div, false);
+}
+
+/**
+ * Starts logging in the background. Logging continues until stopped, and
+ * overwrites the oldest rows when the buffer is full.
+ * @param [in]  log     pointer to log
+ * @param [in]  buf     array large enough to hold @p len rows of data
+ * @param [in]  len     number of most recent rows to keep
+ * @param [in]  div     clock divider to slow down sampling period
+ */
+void pbio_logger_start_circular(pbio_log_t *log, int32_t *buf, uint32_t len, int32_t div) {
+    logger_start(log, buf, len, div, true);
 }
 
+// Number of rows currently held in the buffer
 int32_t pbio_logger_rows(pbio_log_t *log) {
-    return log->sampled;
+    return log->sampled < log->len ? log->sampled : log->len;
+}
+
+// Number of rows that were overwritten before they could be drained
+uint32_t pbio_logger_dropped(pbio_log_t *log) {
+    return log->dropped;
 }
 
 int32_t pbio_logger_cols(pbio_log_t *log) {
     return log->num_values;
 }
 
+// Time between calls to pbio_logger_update (ms), before the sample divisor
+void pbio_logger_set_period(pbio_log_t *log, uint32_t period) {
+    log->period = period;
+}
+
+uint32_t pbio_logger_period(pbio_log_t *log) {
+    return log->period;
+}
+
 void pbio_logger_stop(pbio_log_t *log) {
     // Release the logger for re-use
     log->active = false;
@@ -55,28 +91,36 @@ pbio_error_t pbio_logger_update(pbio_log_t *log, int32_t *buf) {
     }
     log->skipped = 0;
 
-    // Raise error if log is full, which should not happen
-    if (log->sampled > log->len) {
-        log->active = false;
-        return PBIO_ERROR_FAILED;
+    if (!log->circular) {
+        // Raise error if log is full, which should not happen
+        if (log->sampled > log->len) {
+            log->active = false;
+            return PBIO_ERROR_FAILED;
+        }
+
+        // Stop successfully when done
+        if (log->sampled == log->len) {
+            log->active = false;
+            return PBIO_SUCCESS;
+        }
     }
 
-    // Stop successfully when done
-    if (log->sampled == log->len) {
-        log->active = false;
-        return PBIO_SUCCESS;
-    }
+    int32_t *row = &log->data[log->head * log->num_values];
 
     // Write time of logging
-    log->data[log->sampled * log->num_values] = (clock_usecs() - log->start) / 1000;
+    row[0] = clock_to_msec(clock_time() - log->start);
 
     // Write the data
     for (uint8_t i = NUM_DEFAULT_LOG_VALUES; i < log->num_values; i++) {
-        log->data[log->sampled * log->num_values + i] = buf[i - NUM_DEFAULT_LOG_VALUES];
+        row[i] = buf[i - NUM_DEFAULT_LOG_VALUES];
     }
 
-    // Increment sample counter
+    // Increment sample counter and advance to the next row, wrapping around
+    // in circular mode. In linear mode, we stop before this wraps.
     log->sampled++;
+    if (++log->head == log->len) {
+        log->head = 0;
+    }
 
     return PBIO_SUCCESS;
 }
@@ -89,13 +133,22 @@ pbio_error_t pbio_logger_read(pbio_log_t *log, int32_t sindex, int32_t *buf) {
     }
 
     // Get index or latest sample if requested index is -1
-    uint32_t index = sindex < 0 ? log->sampled - 1 : (uint32_t)sindex;
+    uint32_t rows = pbio_logger_rows(log);
+    uint32_t index = sindex < 0 ? rows - 1 : (uint32_t)sindex;
 
     // Ensure index is within bounds
-    if (index >= log->sampled) {
+    if (index >= rows) {
         return PBIO_ERROR_INVALID_ARG;
     }
 
+    // Once a circular log has wrapped around, the oldest row is at the head
+    if (log->sampled > log->len) {
+        index += log->head;
+        if (index >= log->len) {
+            index -= log->len;
+        }
+    }
+
     // Read the data
     for (uint8_t i = 0; i < log->num_values; i++) {
         buf[i] = log->data[index * log->num_values + i];
@@ -103,3 +156,44 @@ pbio_error_t pbio_logger_read(pbio_log_t *log, int32_t sindex, int32_t *buf) {
 
     return PBIO_SUCCESS;
 }
+
+/**
+ * Copies all rows that were logged since the previous call out of the log,
+ * oldest first. This can be called while logging is active.
+ * @param [in]  log         pointer to log
+ * @param [out] buf         array large enough to hold @p max_rows rows of data
+ * @param [in]  max_rows    maximum number of rows to copy
+ * @param [out] rows        number of rows copied
+ * @return                  ::PBIO_SUCCESS
+ */
+pbio_error_t pbio_logger_drain(pbio_log_t *log, int32_t *buf, uint32_t max_rows, uint32_t *rows) {
+
+    uint32_t pending = log->sampled - log->drained;
+
+    // Rows that were overwritten before they were drained are lost
+    if (pending > log->len) {
+        log->dropped += pending - log->len;
+        log->drained = log->sampled - log->len;
+        pending = log->len;
+    }
+
+    uint32_t n = pending < max_rows ? pending : max_rows;
+    if (n == 0) {
+        *rows = 0;
+        return PBIO_SUCCESS;
+    }
+
+    // Pending rows end just before the head, possibly wrapping around
+    uint32_t index = log->head >= pending ? log->head - pending : log->head + log->len - pending;
+
+    // Copy up to the end of the buffer, then from the start
+    uint32_t first = n < log->len - index ? n : log->len - index;
+    size_t row_size = log->num_values * sizeof(*buf);
+    memcpy(buf, &log->data[index * log->num_values], first * row_size);
+    memcpy(&buf[first * log->num_values], log->data, (n - first) * row_size);
+
+    log->drained += n;
+    *rows = n;
+
+    return PBIO_SUCCESS;
+}
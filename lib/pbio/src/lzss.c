@@ -0,0 +1,102 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+// Decoder for LZSS compressed data, in the same bit stream format as
+// heatshrink. Each item starts with a flag bit. A 1 is followed by an 8-bit
+// literal byte. A 0 is followed by the offset minus one and the length minus
+// one of an earlier run of bytes to repeat, using PBIO_LZSS_WINDOW_BITS and
+// PBIO_LZSS_LENGTH_BITS bits. Bits are stored most significant bit first.
+//
+// Only a window of recently decoded bytes is kept, so data can be decoded
+// in small pieces as it arrives, using very little memory.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <pbio/lzss.h>
+
+#define WINDOW_MASK ((1 << PBIO_LZSS_WINDOW_BITS) - 1)
+
+#define LITERAL_BITS (1 + 8)
+#define BACKREF_BITS (1 + PBIO_LZSS_WINDOW_BITS + PBIO_LZSS_LENGTH_BITS)
+
+/**
+ * Initializes a decoder at the start of new compressed data.
+ * @param [out] lz      The decoder
+ */
+void pbio_lzss_init(pbio_lzss_t *lz) {
+    // Offsets that reach past the start of the data read zeros
+    memset(lz->window, 0, sizeof(lz->window));
+    lz->head = 0;
+    lz->count = 0;
+    lz->num_bits = 0;
+    lz->bits = 0;
+}
+
+// Takes n bits from the decoder input
+static uint32_t take_bits(pbio_lzss_t *lz, uint8_t n) {
+    lz->num_bits -= n;
+    return (lz->bits >> lz->num_bits) & ((1 << n) - 1);
+}
+
+/**
+ * Decodes as much data as fits in the output buffer or as the input allows.
+ *
+ * Input that is consumed but does not complete an item yet is kept by the
+ * decoder, so the remaining input can be passed in the next call. Once all
+ * input has been given, the end of the data has been reached when no more
+ * output is produced.
+ *
+ * @param [in]      lz      The decoder
+ * @param [in]      in      The compressed data
+ * @param [in, out] in_len  The size of in / the number of bytes consumed
+ * @param [out]     out     Buffer for the decoded data
+ * @param [in, out] out_len The size of out / the number of bytes decoded
+ */
+void pbio_lzss_decode(pbio_lzss_t *lz, const uint8_t *in, size_t *in_len, uint8_t *out, size_t *out_len) {
+    size_t in_pos = 0;
+    size_t out_pos = 0;
+
+    while (out_pos < *out_len) {
+        uint8_t c;
+
+        if (lz->count) {
+            // Repeat the next byte of the back-reference
+            c = lz->window[(lz->head - lz->offset) & WINDOW_MASK];
+            lz->count--;
+        } else {
+            // Get enough bits for the longest item, if available
+            while (lz->num_bits < BACKREF_BITS && in_pos < *in_len) {
+                lz->bits = (lz->bits << 8) | in[in_pos++];
+                lz->num_bits += 8;
+            }
+
+            // Stop if the next item is not complete yet
+            if (lz->num_bits < LITERAL_BITS) {
+                break;
+            }
+            bool literal = (lz->bits >> (lz->num_bits - 1)) & 1;
+            if (!literal && lz->num_bits < BACKREF_BITS) {
+                break;
+            }
+
+            lz->num_bits--;
+            if (literal) {
+                c = take_bits(lz, 8);
+            } else {
+                lz->offset = take_bits(lz, PBIO_LZSS_WINDOW_BITS) + 1;
+                lz->count = take_bits(lz, PBIO_LZSS_LENGTH_BITS) + 1;
+                continue;
+            }
+        }
+
+        out[out_pos++] = c;
+        lz->window[lz->head] = c;
+        lz->head = (lz->head + 1) & WINDOW_MASK;
+    }
+
+    *in_len = in_pos;
+    *out_len = out_pos;
+}
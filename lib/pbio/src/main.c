@@ -89,7 +89,7 @@ int pbio_do_one_event(void) {
     // pbio_do_one_event() can be called quite frequently (e.g. in a tight loop) so we
     // don't want to call all of the subroutines unless enough time has
     // actually elapsed to do something useful.
-    if (now - prev_fast_poll_time >= clock_from_msec(PBIO_CONFIG_SERVO_PERIOD_MS)) {
+    if (now - prev_fast_poll_time >= clock_from_msec(PBIO_CONFIG_MOTORPOLL_TICK_MS)) {
         _pbio_motorpoll_poll();
         prev_fast_poll_time = clock_time();
     }
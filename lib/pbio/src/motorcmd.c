@@ -0,0 +1,399 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <pbio/config.h>
+#include <pbio/control.h>
+#include <pbio/drivebase.h>
+#include <pbio/motorcmd.h>
+#include <pbio/servo.h>
+
+#if PBDRV_CONFIG_NUM_MOTOR_CONTROLLER != 0
+
+// The head and tail keep counting up, so they wrap around consistently only
+// if the queue size divides 2^32.
+#if PBIO_CONFIG_MOTORCMD_QUEUE_SIZE & (PBIO_CONFIG_MOTORCMD_QUEUE_SIZE - 1)
+#error "PBIO_CONFIG_MOTORCMD_QUEUE_SIZE must be a power of 2"
+#endif
+
+/**
+ * Initializes an empty command queue.
+ * @param [out] queue   The queue
+ */
+void pbio_motorcmd_queue_init(pbio_motorcmd_queue_t *queue) {
+    queue->head = 0;
+    queue->tail = 0;
+}
+
+/**
+ * Adds a command to the queue. May only be called by the producer.
+ * @param [in]  queue   The queue
+ * @param [in]  cmd     The command
+ * @return              True if the command was added, false if the queue is full
+ */
+bool pbio_motorcmd_queue_push(pbio_motorcmd_queue_t *queue, const pbio_motorcmd_t *cmd) {
+    uint32_t head = queue->head;
+
+    // The consumer must be done reading the slot before we reuse it
+    if (head - __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE) == PBIO_CONFIG_MOTORCMD_QUEUE_SIZE) {
+        return false;
+    }
+    queue->cmds[head & (PBIO_CONFIG_MOTORCMD_QUEUE_SIZE - 1)] = *cmd;
+
+    // Make the command visible to the consumer before the new head
+    __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+/**
+ * Takes the oldest command from the queue. May only be called by the consumer.
+ * @param [in]  queue   The queue
+ * @param [out] cmd     The command
+ * @return              True if a command was taken, false if the queue is empty
+ */
+bool pbio_motorcmd_queue_pop(pbio_motorcmd_queue_t *queue, pbio_motorcmd_t *cmd) {
+    uint32_t tail = queue->tail;
+
+    if (__atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) == tail) {
+        return false;
+    }
+    *cmd = queue->cmds[tail & (PBIO_CONFIG_MOTORCMD_QUEUE_SIZE - 1)];
+
+    // Free the slot only after we are done reading it
+    __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+#if PBIO_CONFIG_MOTORCMD
+
+static pbio_motorcmd_queue_t queue;
+
+// Publishes the current state of a link. This is a sequence lock: readers
+// retry if the sequence number was odd or changed while they were reading.
+static void link_publish(pbio_motorcmd_link_t *link) {
+    uint32_t seq = link->seq;
+    __atomic_store_n(&link->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    link->published = link->current;
+    __atomic_store_n(&link->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+// Reads the state of a link as last published by the control loop
+static void link_read(pbio_motorcmd_link_t *link, pbio_motorcmd_state_t *state) {
+    uint32_t seq;
+    do {
+        seq = __atomic_load_n(&link->seq, __ATOMIC_ACQUIRE);
+        *state = link->published;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    } while ((seq & 1) || seq != __atomic_load_n(&link->seq, __ATOMIC_RELAXED));
+}
+
+// Gets the link of the servo or drivebase that a command is for
+static pbio_motorcmd_link_t *link_of(const pbio_motorcmd_t *cmd) {
+    return cmd->type < PBIO_MOTORCMD_DRIVEBASE_STRAIGHT ? &cmd->srv->link : &cmd->db->link;
+}
+
+// Runs one command on the control loop
+static pbio_error_t motorcmd_run(const pbio_motorcmd_t *cmd) {
+    const int32_t *a = cmd->args;
+    switch (cmd->type) {
+        case PBIO_MOTORCMD_SERVO_RUN:
+            return pbio_servo_run(cmd->srv, a[0]);
+        case PBIO_MOTORCMD_SERVO_RUN_TIME:
+            return pbio_servo_run_time(cmd->srv, a[0], a[1], a[2]);
+        case PBIO_MOTORCMD_SERVO_RUN_UNTIL_STALLED:
+            return pbio_servo_run_until_stalled(cmd->srv, a[0], a[1]);
+        case PBIO_MOTORCMD_SERVO_RUN_ANGLE:
+            return pbio_servo_run_angle(cmd->srv, a[0], a[1], a[2]);
+        case PBIO_MOTORCMD_SERVO_RUN_TARGET:
+            return pbio_servo_run_target(cmd->srv, a[0], a[1], a[2]);
+        case PBIO_MOTORCMD_SERVO_QUEUE_TARGET:
+            return pbio_servo_queue_target(cmd->srv, a[0], a[1], a[2]);
+        case PBIO_MOTORCMD_SERVO_TRACK_TARGET:
+            return pbio_servo_track_target(cmd->srv, a[0]);
+        case PBIO_MOTORCMD_SERVO_STOP:
+            return pbio_servo_stop(cmd->srv, a[0]);
+        case PBIO_MOTORCMD_SERVO_SET_DUTY_CYCLE:
+            return pbio_servo_set_duty_cycle(cmd->srv, a[0]);
+        case PBIO_MOTORCMD_DRIVEBASE_STRAIGHT:
+            return pbio_drivebase_straight(cmd->db, a[0], a[1], a[2]);
+        case PBIO_MOTORCMD_DRIVEBASE_TURN:
+            return pbio_drivebase_turn(cmd->db, a[0], a[1], a[2]);
+        case PBIO_MOTORCMD_DRIVEBASE_DRIVE:
+            return pbio_drivebase_drive(cmd->db, a[0], a[1]);
+        case PBIO_MOTORCMD_DRIVEBASE_STOP:
+            return pbio_drivebase_stop(cmd->db, a[0]);
+    }
+    return PBIO_ERROR_INVALID_ARG;
+}
+
+/**
+ * Runs all commands that were posted so far. This must only be called by the
+ * control loop, or while holding pbio_lock(). The results are made visible
+ * to the posting thread when the servo or drivebase is published.
+ */
+void pbio_motorcmd_process(void) {
+    pbio_motorcmd_t cmd;
+    while (pbio_motorcmd_queue_pop(&queue, &cmd)) {
+        pbio_error_t err = motorcmd_run(&cmd);
+        pbio_motorcmd_state_t *state = &link_of(&cmd)->current;
+        state->processed++;
+        if (err != PBIO_SUCCESS) {
+            state->failed = state->processed;
+            state->err = err;
+        }
+    }
+}
+
+/**
+ * Drops all commands that were posted but not run yet, such as when the
+ * control loop is reset. They count as processed so nobody waits for them.
+ */
+void pbio_motorcmd_discard(void) {
+    pbio_motorcmd_t cmd;
+    while (pbio_motorcmd_queue_pop(&queue, &cmd)) {
+        link_of(&cmd)->current.processed++;
+    }
+}
+
+/**
+ * Publishes the state of a servo to the posting thread. This uses the
+ * counts and rates last read by the control loop, so it does not read the
+ * counters again.
+ * @param [in]  srv     The servo
+ * @param [in]  status  The status of the servo in the control loop
+ */
+void pbio_motorcmd_publish_servo(pbio_servo_t *srv, pbio_error_t status) {
+    pbio_motorcmd_state_t *state = &srv->link.current;
+    state->status = status;
+    if (srv->tacho == NULL) {
+        // Servo was never set up
+        state->state_err = PBIO_ERROR_NO_DEV;
+        state->done = true;
+    } else {
+        state->state_err = pbio_servo_get_last_state_user(srv, &state->values[0], &state->values[1], &state->values[2]);
+        state->done = pbio_control_is_done(&srv->control);
+    }
+    link_publish(&srv->link);
+}
+
+/**
+ * Publishes the state of a drivebase to the posting thread. This uses the
+ * counts and rates last read by the control loop, so it does not read the
+ * counters again.
+ * @param [in]  db      The drivebase
+ * @param [in]  status  The status of the drivebase in the control loop
+ */
+void pbio_motorcmd_publish_drivebase(pbio_drivebase_t *db, pbio_error_t status) {
+    pbio_motorcmd_state_t *state = &db->link.current;
+    state->status = status;
+    if (db->left == NULL) {
+        // Drivebase is not in use
+        state->state_err = PBIO_ERROR_NO_DEV;
+        state->done = true;
+    } else {
+        state->state_err = pbio_drivebase_get_last_state(db, &state->values[0], &state->values[1], &state->values[2], &state->values[3]);
+        state->done = pbio_control_is_done(&db->control_distance) && pbio_control_is_done(&db->control_heading);
+    }
+    link_publish(&db->link);
+}
+
+// Gets the error of a failed command that was not reported yet, if any
+static pbio_error_t link_get_failure(pbio_motorcmd_link_t *link, const pbio_motorcmd_state_t *state) {
+    if (state->failed == link->reported) {
+        return PBIO_SUCCESS;
+    }
+    link->reported = state->failed;
+    return state->err;
+}
+
+// Posts a command. Errors of earlier commands for the same servo or drivebase
+// are reported here, and the new command is not posted in that case.
+static pbio_error_t motorcmd_post(const pbio_motorcmd_t *cmd) {
+    pbio_motorcmd_link_t *link = link_of(cmd);
+    pbio_motorcmd_state_t state;
+    link_read(link, &state);
+    pbio_error_t err = link_get_failure(link, &state);
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+
+    // If the control loop is behind, catch up on its behalf
+    if (!pbio_motorcmd_queue_push(&queue, cmd)) {
+        pbio_lock();
+        pbio_motorcmd_process();
+        pbio_unlock();
+        pbio_motorcmd_queue_push(&queue, cmd);
+    }
+    link->posted++;
+    return PBIO_SUCCESS;
+}
+
+// Gets the status of a servo or drivebase, and whether all commands posted
+// to it are processed and the resulting maneuver is done.
+static pbio_error_t link_get_status(pbio_motorcmd_link_t *link, bool *done) {
+    pbio_motorcmd_state_t state;
+    link_read(link, &state);
+    pbio_error_t err = link_get_failure(link, &state);
+    if (err != PBIO_SUCCESS) {
+        *done = true;
+        return err;
+    }
+    *done = state.processed == link->posted && state.done;
+    return state.status;
+}
+
+pbio_error_t pbio_motorcmd_servo_run(pbio_servo_t *srv, int32_t speed) {
+    pbio_motorcmd_t cmd = { .type = PBIO_MOTORCMD_SERVO_RUN, .srv = srv, .args = { speed } };
+    return motorcmd_post(&cmd);
+}
+
+pbio_error_t pbio_motorcmd_servo_run_time(pbio_servo_t *srv, int32_t speed, int32_t duration, pbio_actuation_t after_stop) {
+    pbio_motorcmd_t cmd = { .type = PBIO_MOTORCMD_SERVO_RUN_TIME, .srv = srv, .args = { speed, duration, after_stop } };
+    return motorcmd_post(&cmd);
+}
+
+pbio_error_t pbio_motorcmd_servo_run_until_stalled(pbio_servo_t *srv, int32_t speed, pbio_actuation_t after_stop) {
+    pbio_motorcmd_t cmd = { .type = PBIO_MOTORCMD_SERVO_RUN_UNTIL_STALLED, .srv = srv, .args = { speed, after_stop } };
+    return motorcmd_post(&cmd);
+}
+
+pbio_error_t pbio_motorcmd_servo_run_angle(pbio_servo_t *srv, int32_t speed, int32_t angle, pbio_actuation_t after_stop) {
+    pbio_motorcmd_t cmd = { .type = PBIO_MOTORCMD_SERVO_RUN_ANGLE, .srv = srv, .args = { speed, angle, after_stop } };
+    return motorcmd_post(&cmd);
+}
+
+pbio_error_t pbio_motorcmd_servo_run_target(pbio_servo_t *srv, int32_t speed, int32_t target, pbio_actuation_t after_stop) {
+    pbio_motorcmd_t cmd = { .type = PBIO_MOTORCMD_SERVO_RUN_TARGET, .srv = srv, .args = { speed, target, after_stop } };
+    return motorcmd_post(&cmd);
+}
+
+pbio_error_t pbio_motorcmd_servo_queue_target(pbio_servo_t *srv, int32_t speed, int32_t target, pbio_actuation_t after_stop) {
+    pbio_motorcmd_t cmd = { .type = PBIO_MOTORCMD_SERVO_QUEUE_TARGET, .srv = srv, .args = { speed, target, after_stop } };
+    return motorcmd_post(&cmd);
+}
+
+pbio_error_t pbio_motorcmd_servo_track_target(pbio_servo_t *srv, int32_t target) {
+    pbio_motorcmd_t cmd = { .type = PBIO_MOTORCMD_SERVO_TRACK_TARGET, .srv = srv, .args = { target } };
+    return motorcmd_post(&cmd);
+}
+
+pbio_error_t pbio_motorcmd_servo_stop(pbio_servo_t *srv, pbio_actuation_t after_stop) {
+    pbio_motorcmd_t cmd = { .type = PBIO_MOTORCMD_SERVO_STOP, .srv = srv, .args = { after_stop } };
+    return motorcmd_post(&cmd);
+}
+
+pbio_error_t pbio_motorcmd_servo_set_duty_cycle(pbio_servo_t *srv, int32_t duty_steps) {
+    pbio_motorcmd_t cmd = { .type = PBIO_MOTORCMD_SERVO_SET_DUTY_CYCLE, .srv = srv, .args = { duty_steps } };
+    return motorcmd_post(&cmd);
+}
+
+/**
+ * Gets the status of a servo as last published by the control loop.
+ * @param [in]  srv     The servo
+ * @param [out] done    Whether all posted commands were processed and the resulting maneuver is complete
+ * @return              The error of a failed command that was not reported yet,
+ *                      otherwise the status of the servo in the control loop
+ */
+pbio_error_t pbio_motorcmd_servo_get_status(pbio_servo_t *srv, bool *done) {
+    return link_get_status(&srv->link, done);
+}
+
+/**
+ * Gets the state of a servo as last published by the control loop.
+ * @param [in]  srv     The servo
+ * @param [out] angle   Angle in degrees
+ * @param [out] speed   Speed in degrees per second
+ * @param [out] duty    Duty cycle in percent
+ * @return              Error code
+ */
+pbio_error_t pbio_motorcmd_servo_get_state_user(pbio_servo_t *srv, int32_t *angle, int32_t *speed, int32_t *duty) {
+    pbio_motorcmd_state_t state;
+    link_read(&srv->link, &state);
+    *angle = state.values[0];
+    *speed = state.values[1];
+    *duty = state.values[2];
+    return state.state_err;
+}
+
+/**
+ * Gets the angle of a servo as last published by the control loop.
+ * @param [in]  srv     The servo
+ * @param [out] angle   Angle in degrees
+ * @return              Error code
+ */
+pbio_error_t pbio_motorcmd_servo_get_angle(pbio_servo_t *srv, int32_t *angle) {
+    pbio_motorcmd_state_t state;
+    link_read(&srv->link, &state);
+    *angle = state.values[0];
+    return state.state_err;
+}
+
+/**
+ * Gets the speed of a servo as last published by the control loop.
+ * @param [in]  srv     The servo
+ * @param [out] speed   Speed in degrees per second
+ * @return              Error code
+ */
+pbio_error_t pbio_motorcmd_servo_get_speed(pbio_servo_t *srv, int32_t *speed) {
+    pbio_motorcmd_state_t state;
+    link_read(&srv->link, &state);
+    *speed = state.values[1];
+    return state.state_err;
+}
+
+pbio_error_t pbio_motorcmd_drivebase_straight(pbio_drivebase_t *db, int32_t distance, int32_t straight_speed, int32_t straight_acceleration) {
+    pbio_motorcmd_t cmd = { .type = PBIO_MOTORCMD_DRIVEBASE_STRAIGHT, .db = db, .args = { distance, straight_speed, straight_acceleration } };
+    return motorcmd_post(&cmd);
+}
+
+pbio_error_t pbio_motorcmd_drivebase_turn(pbio_drivebase_t *db, int32_t angle, int32_t turn_rate, int32_t turn_acceleration) {
+    pbio_motorcmd_t cmd = { .type = PBIO_MOTORCMD_DRIVEBASE_TURN, .db = db, .args = { angle, turn_rate, turn_acceleration } };
+    return motorcmd_post(&cmd);
+}
+
+pbio_error_t pbio_motorcmd_drivebase_drive(pbio_drivebase_t *db, int32_t speed, int32_t turn_rate) {
+    pbio_motorcmd_t cmd = { .type = PBIO_MOTORCMD_DRIVEBASE_DRIVE, .db = db, .args = { speed, turn_rate } };
+    return motorcmd_post(&cmd);
+}
+
+pbio_error_t pbio_motorcmd_drivebase_stop(pbio_drivebase_t *db, pbio_actuation_t after_stop) {
+    pbio_motorcmd_t cmd = { .type = PBIO_MOTORCMD_DRIVEBASE_STOP, .db = db, .args = { after_stop } };
+    return motorcmd_post(&cmd);
+}
+
+/**
+ * Gets the status of a drivebase as last published by the control loop.
+ * @param [in]  db      The drivebase
+ * @param [out] done    Whether all posted commands were processed and the resulting maneuver is complete
+ * @return              The error of a failed command that was not reported yet,
+ *                      otherwise the status of the drivebase in the control loop
+ */
+pbio_error_t pbio_motorcmd_drivebase_get_status(pbio_drivebase_t *db, bool *done) {
+    return link_get_status(&db->link, done);
+}
+
+/**
+ * Gets the state of a drivebase as last published by the control loop.
+ * @param [in]  db          The drivebase
+ * @param [out] distance    Distance traveled in mm
+ * @param [out] drive_speed Speed in mm/s
+ * @param [out] angle       Angle turned in degrees
+ * @param [out] turn_rate   Turn rate in degrees per second
+ * @return                  Error code
+ */
+pbio_error_t pbio_motorcmd_drivebase_get_state(pbio_drivebase_t *db, int32_t *distance, int32_t *drive_speed, int32_t *angle, int32_t *turn_rate) {
+    pbio_motorcmd_state_t state;
+    link_read(&db->link, &state);
+    *distance = state.values[0];
+    *drive_speed = state.values[1];
+    *angle = state.values[2];
+    *turn_rate = state.values[3];
+    return state.state_err;
+}
+
+#endif // PBIO_CONFIG_MOTORCMD
+
+#endif // PBDRV_CONFIG_NUM_MOTOR_CONTROLLER
@@ -1,8 +1,15 @@
 // SPDX-License-Identifier: MIT
 // Copyright (c) 2018-2020 The Pybricks Authors
 
+#include <stdbool.h>
+#include <string.h>
+
+#include <contiki.h>
+
+#include <pbio/config.h>
 #include <pbio/control.h>
 #include <pbio/drivebase.h>
+#include <pbio/motorcmd.h>
 #include <pbio/motorpoll.h>
 #include <pbio/servo.h>
 
@@ -11,8 +18,232 @@
 static pbio_servo_t servo[PBDRV_CONFIG_NUM_MOTOR_CONTROLLER];
 static pbio_error_t servo_err[PBDRV_CONFIG_NUM_MOTOR_CONTROLLER];
 
-static pbio_drivebase_t drivebase;
-static pbio_error_t drivebase_err;
+static pbio_drivebase_t drivebase[PBIO_CONFIG_NUM_DRIVEBASES];
+static pbio_error_t drivebase_err[PBIO_CONFIG_NUM_DRIVEBASES];
+
+static pbio_motorpoll_callback_t callback_func[PBIO_CONFIG_MOTORPOLL_NUM_CALLBACKS];
+static void *callback_context[PBIO_CONFIG_MOTORPOLL_NUM_CALLBACKS];
+
+// Each servo, drivebase, and callback is a task with its own period, given
+// in multiples of the tick at which the loop is polled.
+#define TASK_DRIVEBASE(i) (PBDRV_CONFIG_NUM_MOTOR_CONTROLLER + (i))
+#define TASK_CALLBACK(i) (TASK_DRIVEBASE(PBIO_CONFIG_NUM_DRIVEBASES) + (i))
+#define NUM_TASKS (TASK_CALLBACK(PBIO_CONFIG_MOTORPOLL_NUM_CALLBACKS))
+
+typedef struct _task_t {
+    clock_time_t period;    // Time between runs
+    clock_time_t phase;     // Offset of the runs with respect to the start of the schedule
+    clock_time_t last;      // Time slot of the most recent run
+    uint8_t priority;       // Tasks that are due in the same tick run in order of priority
+} task_t;
+
+static task_t tasks[NUM_TASKS];
+
+// Task indexes sorted by priority, highest first
+static uint8_t task_order[NUM_TASKS];
+
+// Start of the schedule. All phases are relative to this.
+static clock_time_t schedule_start;
+
+#if PBIO_CONFIG_MOTORPOLL_STATS
+
+static pbio_motorpoll_stats_t stats;
+
+// Time of the previous poll, if any, used to measure the poll period
+static int32_t prev_poll_time;
+static bool prev_poll_valid;
+
+static void histogram_reset(pbio_motorpoll_histogram_t *hist, uint32_t bin_width) {
+    memset(hist, 0, sizeof(*hist));
+    hist->bin_width = bin_width;
+}
+
+static void histogram_add(pbio_motorpoll_histogram_t *hist, uint32_t duration) {
+    uint32_t bin = duration / hist->bin_width;
+    hist->bins[bin < PBIO_MOTORPOLL_STATS_NUM_BINS ? bin : PBIO_MOTORPOLL_STATS_NUM_BINS - 1]++;
+    hist->count++;
+    hist->total += duration;
+    if (duration > hist->max) {
+        hist->max = duration;
+    }
+}
+
+// Get timing statistics of the control loop since the last reset
+const pbio_motorpoll_stats_t *pbio_motorpoll_get_stats(void) {
+    return &stats;
+}
+
+// Clear timing statistics of the control loop
+void pbio_motorpoll_reset_stats(void) {
+    histogram_reset(&stats.period, PBIO_MOTORPOLL_STATS_PERIOD_BIN_US);
+    for (int i = 0; i < PBDRV_CONFIG_NUM_MOTOR_CONTROLLER; i++) {
+        histogram_reset(&stats.servo[i], PBIO_MOTORPOLL_STATS_EXEC_BIN_US);
+    }
+    for (int i = 0; i < PBIO_CONFIG_NUM_DRIVEBASES; i++) {
+        histogram_reset(&stats.drivebase[i], PBIO_MOTORPOLL_STATS_EXEC_BIN_US);
+    }
+    stats.overruns = 0;
+    prev_poll_valid = false;
+}
+
+#endif // PBIO_CONFIG_MOTORPOLL_STATS
+
+static uint32_t gcd(uint32_t a, uint32_t b) {
+    while (b != 0) {
+        uint32_t r = a % b;
+        a = b;
+        b = r;
+    }
+    return a;
+}
+
+// Sets the time slot of the most recent run to the latest slot that is not in
+// the future, so the task is next due one period later. This skips any runs
+// that were missed without shifting the phase.
+static void task_align(task_t *task, clock_time_t now) {
+    if (now - task->last >= task->period) {
+        task->last = now - (now - task->last) % task->period;
+    }
+}
+
+// Schedule a task with the given period. The phase is chosen to coincide with
+// as few other tasks as possible, so that not all tasks run in the same tick.
+static pbio_error_t task_schedule(uint8_t index, uint32_t period, uint8_t priority) {
+
+    // Period must be a nonzero multiple of the tick
+    if (period == 0 || period % PBIO_CONFIG_MOTORPOLL_TICK_MS != 0) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+
+    task_t *task = &tasks[index];
+    task->period = clock_from_msec(period);
+    task->priority = priority;
+
+    // Controllers need to know how often they are updated
+    if (index < TASK_DRIVEBASE(0)) {
+        pbio_control_set_period(&servo[index].control, period);
+    } else if (index < TASK_CALLBACK(0)) {
+        pbio_control_set_period(&drivebase[index - TASK_DRIVEBASE(0)].control_distance, period);
+        pbio_control_set_period(&drivebase[index - TASK_DRIVEBASE(0)].control_heading, period);
+    }
+
+    // Count the tasks that would run in the same tick for each candidate phase.
+    // Two tasks coincide if their phases differ by a multiple of the greatest
+    // common divisor of their periods.
+    uint32_t best_count = UINT32_MAX;
+    for (clock_time_t phase = 0; phase < task->period; phase += clock_from_msec(PBIO_CONFIG_MOTORPOLL_TICK_MS)) {
+        uint32_t count = 0;
+        for (uint8_t i = 0; i < NUM_TASKS; i++) {
+            if (i == index || tasks[i].period == 0) {
+                continue;
+            }
+            uint32_t g = gcd(task->period, tasks[i].period);
+            if ((phase + task->period - tasks[i].phase % task->period) % g == 0) {
+                count++;
+            }
+        }
+        if (count < best_count) {
+            best_count = count;
+            task->phase = phase;
+        }
+    }
+
+    // The first run is in the first time slot from now on at the chosen phase
+    clock_time_t now = clock_time();
+    clock_time_t late = now - (schedule_start + task->phase - task->period);
+    task->last = now - ((late - 1) % task->period + 1);
+
+    // Keep the tasks sorted by priority. Tasks with equal priority keep the
+    // order of their indexes, so servos are updated before the drivebases.
+    for (uint8_t i = 0; i < NUM_TASKS; i++) {
+        task_order[i] = i;
+    }
+    for (uint8_t i = 1; i < NUM_TASKS; i++) {
+        uint8_t current = task_order[i];
+        uint8_t j = i;
+        while (j > 0 && tasks[task_order[j - 1]].priority < tasks[current].priority) {
+            task_order[j] = task_order[j - 1];
+            j--;
+        }
+        task_order[j] = current;
+    }
+
+    return PBIO_SUCCESS;
+}
+
+/**
+ * Sets how often a servo is updated.
+ * @param [in]  srv         The servo
+ * @param [in]  period      Time between updates (ms), a multiple of ::PBIO_CONFIG_MOTORPOLL_TICK_MS
+ * @param [in]  priority    Tasks due in the same tick are updated highest priority first
+ * @return                  Error code
+ */
+pbio_error_t pbio_motorpoll_set_servo_schedule(pbio_servo_t *srv, uint32_t period, uint8_t priority) {
+    for (uint8_t i = 0; i < PBDRV_CONFIG_NUM_MOTOR_CONTROLLER; i++) {
+        if (srv == &servo[i]) {
+            return task_schedule(i, period, priority);
+        }
+    }
+    return PBIO_ERROR_INVALID_ARG;
+}
+
+/**
+ * Sets how often the drivebase is updated.
+ * @param [in]  db          The drivebase
+ * @param [in]  period      Time between updates (ms), a multiple of ::PBIO_CONFIG_MOTORPOLL_TICK_MS
+ * @param [in]  priority    Tasks due in the same tick are updated highest priority first
+ * @return                  Error code
+ */
+pbio_error_t pbio_motorpoll_set_drivebase_schedule(pbio_drivebase_t *db, uint32_t period, uint8_t priority) {
+    for (uint8_t i = 0; i < PBIO_CONFIG_NUM_DRIVEBASES; i++) {
+        if (db == &drivebase[i]) {
+            return task_schedule(TASK_DRIVEBASE(i), period, priority);
+        }
+    }
+    return PBIO_ERROR_INVALID_ARG;
+}
+
+/**
+ * Adds a function to be called periodically by the control loop, until it
+ * returns anything other than ::PBIO_ERROR_AGAIN or until it is removed.
+ * @param [in]  callback    The function to call
+ * @param [in]  context     Argument passed to the function
+ * @param [in]  period      Time between calls (ms), a multiple of ::PBIO_CONFIG_MOTORPOLL_TICK_MS
+ * @param [in]  priority    Tasks due in the same tick are run highest priority first
+ * @return                  ::PBIO_ERROR_NO_DEV if there is no room for another callback,
+ *                          otherwise the result of validating the schedule
+ */
+pbio_error_t pbio_motorpoll_add_callback(pbio_motorpoll_callback_t callback, void *context, uint32_t period, uint8_t priority) {
+    for (uint8_t i = 0; i < PBIO_CONFIG_MOTORPOLL_NUM_CALLBACKS; i++) {
+        if (callback_func[i] == NULL) {
+            pbio_error_t err = task_schedule(TASK_CALLBACK(i), period, priority);
+            if (err != PBIO_SUCCESS) {
+                return err;
+            }
+            callback_func[i] = callback;
+            callback_context[i] = context;
+            return PBIO_SUCCESS;
+        }
+    }
+    return PBIO_ERROR_NO_DEV;
+}
+
+/**
+ * Removes a function that was added with pbio_motorpoll_add_callback().
+ * @param [in]  callback    The function
+ * @param [in]  context     The argument it was added with
+ * @return                  Error code
+ */
+pbio_error_t pbio_motorpoll_remove_callback(pbio_motorpoll_callback_t callback, void *context) {
+    for (uint8_t i = 0; i < PBIO_CONFIG_MOTORPOLL_NUM_CALLBACKS; i++) {
+        if (callback_func[i] == callback && callback_context[i] == context) {
+            callback_func[i] = NULL;
+            tasks[TASK_CALLBACK(i)].period = 0;
+            return PBIO_SUCCESS;
+        }
+    }
+    return PBIO_ERROR_INVALID_ARG;
+}
 
 // Get pointer to servo by port index
 pbio_error_t pbio_motorpoll_get_servo(pbio_port_t port, pbio_servo_t **srv) {
@@ -47,33 +278,112 @@ pbio_error_t pbio_motorpoll_get_servo_status(pbio_servo_t *srv) {
     return PBIO_ERROR_INVALID_ARG;
 }
 
-// Get pointer to drivebase
-pbio_error_t pbio_motorpoll_get_drivebase(pbio_drivebase_t **db) {
-    // Get pointer to device (at the moment, there is only one drivebase)
-    *db = &drivebase;
+/**
+ * Gets a drivebase for the given pair of servos. A servo can be part of only
+ * one drivebase, so if either servo is already used by a drivebase, that one
+ * is returned to be set up again. Otherwise, an unused drivebase is returned.
+ * @param [in]  left    The left servo
+ * @param [in]  right   The right servo
+ * @param [out] db      The drivebase
+ * @return              ::PBIO_ERROR_INVALID_OP if the servos are used by two different drivebases,
+ *                      ::PBIO_ERROR_NO_DEV if all drivebases are in use, otherwise ::PBIO_SUCCESS
+ */
+pbio_error_t pbio_motorpoll_get_drivebase(pbio_servo_t *left, pbio_servo_t *right, pbio_drivebase_t **db) {
+
+    pbio_drivebase_t *unused = NULL;
+    *db = NULL;
+
+    for (uint8_t i = 0; i < PBIO_CONFIG_NUM_DRIVEBASES; i++) {
+        pbio_drivebase_t *candidate = &drivebase[i];
+
+        // Remember the first drivebase that is not used
+        if (candidate->left == NULL) {
+            if (unused == NULL) {
+                unused = candidate;
+            }
+            continue;
+        }
+
+        // Take the drivebase that already uses either servo
+        if (candidate->left == left || candidate->left == right || candidate->right == left || candidate->right == right) {
+            if (*db != NULL) {
+                return PBIO_ERROR_INVALID_OP;
+            }
+            *db = candidate;
+        }
+    }
+
+    if (*db != NULL) {
+        return PBIO_SUCCESS;
+    }
+    if (unused == NULL) {
+        return PBIO_ERROR_NO_DEV;
+    }
+    *db = unused;
     return PBIO_SUCCESS;
 }
 
 // Set status of the drivebase, which tells us whether to poll or not
 pbio_error_t pbio_motorpoll_set_drivebase_status(pbio_drivebase_t *db, pbio_error_t err) {
-    if (db != &drivebase) {
-        return PBIO_ERROR_INVALID_ARG;
+    for (int i = 0; i < PBIO_CONFIG_NUM_DRIVEBASES; i++) {
+        if (db == &drivebase[i]) {
+            drivebase_err[i] = err;
+            return PBIO_SUCCESS;
+        }
     }
-    drivebase_err = err;
-    return PBIO_SUCCESS;
+    return PBIO_ERROR_INVALID_ARG;
 }
 
 // Get status of the drivebase, which tells us whether to poll or not
 pbio_error_t pbio_motorpoll_get_drivebase_status(pbio_drivebase_t *db) {
-    if (db != &drivebase) {
-        return PBIO_ERROR_INVALID_ARG;
+    for (int i = 0; i < PBIO_CONFIG_NUM_DRIVEBASES; i++) {
+        if (db == &drivebase[i]) {
+            return drivebase_err[i];
+        }
     }
-    return drivebase_err;
+    return PBIO_ERROR_INVALID_ARG;
 }
 
+#if PBIO_CONFIG_MOTORCMD
+
+/**
+ * Publishes the state of all servos and drivebases to the thread that posts
+ * commands. This is done after each poll, but can also be done after using
+ * pbio directly, so the effect is visible right away.
+ */
+void _pbio_motorpoll_publish(void) {
+    for (int i = 0; i < PBDRV_CONFIG_NUM_MOTOR_CONTROLLER; i++) {
+        pbio_motorcmd_publish_servo(&servo[i], servo_err[i]);
+    }
+    for (int i = 0; i < PBIO_CONFIG_NUM_DRIVEBASES; i++) {
+        pbio_motorcmd_publish_drivebase(&drivebase[i], drivebase_err[i]);
+    }
+}
+
+#endif // PBIO_CONFIG_MOTORCMD
 
 void _pbio_motorpoll_reset_all(void) {
 
+    #if PBIO_CONFIG_MOTORPOLL_STATS
+    pbio_motorpoll_reset_stats();
+    #endif
+
+    #if PBIO_CONFIG_MOTORCMD
+    // Commands that did not run yet are for the old program
+    pbio_motorcmd_discard();
+    #endif
+
+    // Start a new schedule with the default period for all servos and
+    // drivebases, and without callbacks
+    schedule_start = clock_time();
+    memset(tasks, 0, sizeof(tasks));
+    for (int i = 0; i < PBIO_CONFIG_MOTORPOLL_NUM_CALLBACKS; i++) {
+        callback_func[i] = NULL;
+    }
+    for (uint8_t i = 0; i < TASK_CALLBACK(0); i++) {
+        task_schedule(i, PBIO_CONFIG_SERVO_PERIOD_MS, 0);
+    }
+
     // Set ports for all servos on init
     for (int i = 0; i < PBDRV_CONFIG_NUM_MOTOR_CONTROLLER; i++) {
         servo[i].port = PBIO_PORT_A + i;
@@ -81,10 +391,14 @@ void _pbio_motorpoll_reset_all(void) {
 
     pbio_error_t err;
 
-    // Force stop the drivebase
-    err = pbio_drivebase_stop_force(&drivebase);
-    if (err != PBIO_SUCCESS) {
-        drivebase_err = err;
+    // Force stop the drivebases and release their servos
+    for (int i = 0; i < PBIO_CONFIG_NUM_DRIVEBASES; i++) {
+        err = pbio_drivebase_stop_force(&drivebase[i]);
+        if (err != PBIO_SUCCESS) {
+            drivebase_err[i] = err;
+        }
+        drivebase[i].left = NULL;
+        drivebase[i].right = NULL;
     }
 
     // Force stop the servos
@@ -94,30 +408,107 @@ void _pbio_motorpoll_reset_all(void) {
             servo_err[i] = err;
         }
     }
-}
 
-void _pbio_motorpoll_poll(void) {
+    #if PBIO_CONFIG_MOTORCMD
+    _pbio_motorpoll_publish();
+    #endif
+}
 
+// Run one task, and save error if encountered. Returns whether it was active.
+static bool task_run(uint8_t index) {
     pbio_error_t err;
 
-    // Poll servos
-    for (int i = 0; i < PBDRV_CONFIG_NUM_MOTOR_CONTROLLER; i++) {
-        // Poll servo again if it says so, and save error if encountered
-        if (servo_err[i] == PBIO_ERROR_AGAIN) {
-            err = pbio_servo_control_update(&servo[i]);
-            if (err != PBIO_SUCCESS) {
-                servo_err[i] = err;
-            }
+    // Poll servo again if it says so
+    if (index < TASK_DRIVEBASE(0)) {
+        if (servo_err[index] != PBIO_ERROR_AGAIN) {
+            return false;
+        }
+        err = pbio_servo_control_update(&servo[index]);
+        if (err != PBIO_SUCCESS) {
+            servo_err[index] = err;
         }
+        return true;
     }
 
-    // Poll drivebase again if it says so, and save error if encountered
-    if (drivebase_err == PBIO_ERROR_AGAIN) {
-        err = pbio_drivebase_update(&drivebase);
+    // Poll drivebase again if it says so
+    if (index < TASK_CALLBACK(0)) {
+        uint8_t i = index - TASK_DRIVEBASE(0);
+        if (drivebase_err[i] != PBIO_ERROR_AGAIN) {
+            return false;
+        }
+        err = pbio_drivebase_update(&drivebase[i]);
         if (err != PBIO_SUCCESS) {
-            drivebase_err = err;
+            drivebase_err[i] = err;
+        }
+        return true;
+    }
+
+    // Call the callback again unless it says it is done
+    uint8_t i = index - TASK_CALLBACK(0);
+    if (callback_func[i] == NULL) {
+        return false;
+    }
+    if (callback_func[i](callback_context[i]) != PBIO_ERROR_AGAIN) {
+        callback_func[i] = NULL;
+        tasks[index].period = 0;
+    }
+    return true;
+}
+
+void _pbio_motorpoll_poll(void) {
+
+    #if PBIO_CONFIG_MOTORCMD
+    // Start the maneuvers that were posted since the previous poll
+    pbio_motorcmd_process();
+    #endif
+
+    clock_time_t now = clock_time();
+
+    #if PBIO_CONFIG_MOTORPOLL_STATS
+    int32_t time_start = clock_usecs();
+    int32_t time_end;
+
+    // Time since previous poll. If we are a full tick late, we missed one.
+    if (prev_poll_valid) {
+        uint32_t period = time_start - prev_poll_time;
+        histogram_add(&stats.period, period);
+        if (period >= 2 * PBIO_CONFIG_MOTORPOLL_TICK_MS * US_PER_MS) {
+            stats.overruns++;
         }
     }
+    prev_poll_time = time_start;
+    prev_poll_valid = true;
+    #endif
+
+    // Run the tasks that are due, highest priority first
+    for (uint8_t k = 0; k < NUM_TASKS; k++) {
+        uint8_t index = task_order[k];
+        task_t *task = &tasks[index];
+
+        if (task->period == 0 || now - task->last < task->period) {
+            continue;
+        }
+        task->last += task->period;
+        task_align(task, now);
+
+        if (!task_run(index)) {
+            continue;
+        }
+
+        #if PBIO_CONFIG_MOTORPOLL_STATS
+        time_end = clock_usecs();
+        if (index < TASK_DRIVEBASE(0)) {
+            histogram_add(&stats.servo[index], time_end - time_start);
+        } else if (index < TASK_CALLBACK(0)) {
+            histogram_add(&stats.drivebase[index - TASK_DRIVEBASE(0)], time_end - time_start);
+        }
+        time_start = time_end;
+        #endif
+    }
+
+    #if PBIO_CONFIG_MOTORCMD
+    _pbio_motorpoll_publish();
+    #endif
 }
 
 #endif // PBDRV_CONFIG_NUM_MOTOR_CONTROLLER
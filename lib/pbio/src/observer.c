@@ -0,0 +1,140 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+// State observer for DC motors. The motor model predicts how the speed
+// changes in response to the applied duty cycle and friction. The prediction
+// is then corrected using the measured encoder count. Any remaining
+// difference, such as an external load, is estimated as a disturbance. This
+// gives a speed estimate with finer resolution than the speed reported by
+// the motor, which is especially noticeable at low speeds.
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include <pbdrv/motor.h>
+
+#include <pbio/observer.h>
+#include <pbio/trajectory.h>
+
+// The state is stored in fixed point with this many fractional bits
+#define OBSERVER_SHIFT (16)
+
+// If updates are further apart than this (us), the estimate is reset
+#define OBSERVER_MAX_DT (50 * US_PER_MS)
+
+// If the estimate is further off than this (counts), the estimate is reset
+#define OBSERVER_MAX_ERROR (32)
+
+// 2^32 / US_PER_SECOND, rounded up
+#define US_PER_SECOND_RECIPROCAL (4295)
+
+// 2^32 / PBDRV_MAX_DUTY, rounded up
+#define MAX_DUTY_RECIPROCAL (429497)
+
+// Evaluate x * dt / US_PER_SECOND without a division, for dt up to OBSERVER_MAX_DT
+static int64_t per_us(int64_t x, int32_t dt) {
+    return (x * dt * US_PER_SECOND_RECIPROCAL) >> 32;
+}
+
+/**
+ * Sets up an observer for a motor.
+ * @param [out] obs     The observer
+ * @param [in]  model   The motor model, or NULL if the motor has none
+ */
+void pbio_observer_setup(pbio_observer_t *obs, const pbio_observer_model_t *model) {
+    obs->model = model;
+    obs->initialized = false;
+}
+
+/**
+ * Resets the estimated state to the measured state.
+ * @param [in]  obs         The observer
+ * @param [in]  time_now    The current time (us)
+ * @param [in]  count       The measured encoder count
+ * @param [in]  rate        The measured encoder rate (counts/s)
+ */
+void pbio_observer_reset(pbio_observer_t *obs, int32_t time_now, int32_t count, int32_t rate) {
+    obs->time_prev = time_now;
+    obs->count = ((int64_t)count) << OBSERVER_SHIFT;
+    obs->rate = ((int64_t)rate) << OBSERVER_SHIFT;
+    obs->disturbance = 0;
+    obs->initialized = true;
+}
+
+/**
+ * Updates the estimated state with a new measurement.
+ * @param [in]  obs         The observer
+ * @param [in]  time_now    The current time (us)
+ * @param [in]  count       The measured encoder count
+ * @param [in]  rate        The measured encoder rate (counts/s), only used to (re)initialize the estimate
+ * @param [in]  duty        The duty cycle that was applied since the previous update
+ * @param [in]  coasting    Whether the motor was coasting since the previous update
+ */
+void pbio_observer_update(pbio_observer_t *obs, int32_t time_now, int32_t count, int32_t rate, int32_t duty, bool coasting) {
+
+    const pbio_observer_model_t *model = obs->model;
+    if (model == NULL) {
+        return;
+    }
+
+    // Start from the measured state if the estimate is not recent
+    int32_t dt = time_now - obs->time_prev;
+    if (!obs->initialized || dt > OBSERVER_MAX_DT) {
+        pbio_observer_reset(obs, time_now, count, rate);
+        return;
+    }
+    if (dt <= 0) {
+        return;
+    }
+    obs->time_prev = time_now;
+
+    // Predict the new state. A driven motor tends to the speed that
+    // corresponds to the duty cycle. A coasting motor is not driven at all.
+    int64_t rate_new = obs->rate - per_us(obs->disturbance, dt);
+    if (!coasting) {
+        int64_t rate_duty = (((int64_t)model->rate_max) * duty * MAX_DUTY_RECIPROCAL) >> (32 - OBSERVER_SHIFT);
+        rate_new += per_us(rate_duty - obs->rate, dt) * model->damping;
+    }
+
+    // Friction slows the motor down, but does not reverse it
+    int64_t rate_friction = per_us(((int64_t)model->friction) << OBSERVER_SHIFT, dt);
+    if (rate_new > rate_friction) {
+        rate_new -= rate_friction;
+    } else if (rate_new < -rate_friction) {
+        rate_new += rate_friction;
+    } else {
+        rate_new = 0;
+    }
+    obs->count += per_us((obs->rate + rate_new) / 2, dt);
+    obs->rate = rate_new;
+
+    // Difference between the measured and predicted count
+    int64_t error = (((int64_t)count) << OBSERVER_SHIFT) - obs->count;
+
+    // If the model is way off, such as after a collision, start over
+    if (error > ((int64_t)OBSERVER_MAX_ERROR << OBSERVER_SHIFT) || error < -((int64_t)OBSERVER_MAX_ERROR << OBSERVER_SHIFT)) {
+        pbio_observer_reset(obs, time_now, count, rate);
+        return;
+    }
+
+    // Correct the prediction, with gains that place all observer poles at the bandwidth
+    int64_t error_dt = per_us(error, dt);
+    int32_t l = model->bandwidth;
+    obs->count += error_dt * 3 * l;
+    obs->rate += error_dt * 3 * l * l;
+    obs->disturbance -= error_dt * l * l * l;
+}
+
+/**
+ * Gets the estimated state.
+ * @param [in]  obs         The observer
+ * @param [out] count       The estimated encoder count
+ * @param [out] rate        The estimated encoder rate (counts/s)
+ * @param [out] disturbance The estimated deceleration (counts/s^2) due to friction and load
+ */
+void pbio_observer_get_estimated_state(pbio_observer_t *obs, int32_t *count, int32_t *rate, int32_t *disturbance) {
+    int64_t half = 1 << (OBSERVER_SHIFT - 1);
+    *count = (obs->count + half) >> OBSERVER_SHIFT;
+    *rate = (obs->rate + half) >> OBSERVER_SHIFT;
+    *disturbance = (obs->disturbance + half) >> OBSERVER_SHIFT;
+}
@@ -117,6 +117,27 @@ static pbio_control_settings_t settings_servo_default = {
     .actuation_scale = 100,
 };
 
+#if PBIO_CONFIG_SERVO_OBSERVER
+
+static const pbio_observer_model_t model_servo_boost_interactive = {
+    .rate_max = 1200,
+    .damping = 20,
+    .friction = 1920,
+    .bandwidth = 20,
+};
+
+static const pbio_observer_model_t *get_servo_model(pbio_iodev_type_id_t id) {
+    switch (id) {
+        case PBIO_IODEV_TYPE_ID_INTERACTIVE_MOTOR:
+            return &model_servo_boost_interactive;
+        default:
+            // Motors without a model use the measured speed
+            return NULL;
+    }
+}
+
+#endif // PBIO_CONFIG_SERVO_OBSERVER
+
 static void load_servo_settings(pbio_control_settings_t *s, pbio_iodev_type_id_t id) {
     switch (id) {
         case PBIO_IODEV_TYPE_ID_EV3_MEDIUM_MOTOR:
@@ -181,6 +202,10 @@ pbio_error_t pbio_servo_setup(pbio_servo_t *srv, pbio_direction_t direction, fix
     // For a servo, counts per output unit is counts per degree at the gear train output
     srv->control.settings.counts_per_unit = fix16_mul(F16C(PBDRV_CONFIG_COUNTER_COUNTS_PER_DEGREE, 0), gear_ratio);
 
+    #if PBIO_CONFIG_SERVO_OBSERVER
+    pbio_observer_setup(&srv->observer, get_servo_model(srv->dcmotor->id));
+    #endif
+
     return PBIO_SUCCESS;
 }
 
@@ -193,6 +218,11 @@ pbio_error_t pbio_servo_reset_angle(pbio_servo_t *srv, int32_t reset_angle, bool
         return PBIO_ERROR_INVALID_OP;
     }
 
+    #if PBIO_CONFIG_SERVO_OBSERVER
+    // The count jumps, so start estimating again from the next measurement
+    pbio_observer_setup(&srv->observer, srv->observer.model);
+    #endif
+
     // If the motor was in a passive mode (coast, brake, user duty),
     // just reset angle and leave motor state unchanged.
     if (srv->control.type == PBIO_CONTROL_NONE) {
@@ -242,6 +272,23 @@ static pbio_error_t servo_get_state(pbio_servo_t *srv, int32_t *time_now, int32_
     if (err != PBIO_SUCCESS) {
         return err;
     }
+
+    #if PBIO_CONFIG_SERVO_OBSERVER
+    // If there is a model of this motor, use the estimated speed instead
+    if (srv->observer.model != NULL) {
+        pbio_passivity_t state;
+        int32_t duty_now;
+        err = pbio_dcmotor_get_state(srv->dcmotor, &state, &duty_now);
+        if (err != PBIO_SUCCESS) {
+            return err;
+        }
+        pbio_observer_update(&srv->observer, *time_now, *count_now, *rate_now, duty_now, state == PBIO_DCMOTOR_COAST);
+
+        int32_t unused;
+        pbio_observer_get_estimated_state(&srv->observer, &unused, rate_now, &unused);
+    }
+    #endif
+
     return PBIO_SUCCESS;
 }
 
@@ -311,6 +358,54 @@ pbio_error_t pbio_servo_set_duty_cycle(pbio_servo_t *srv, int32_t duty_steps) {
     return pbio_dcmotor_set_duty_cycle_usr(srv->dcmotor, duty_steps);
 }
 
+// Gets the state of a servo in user units, either read now or as last read
+static pbio_error_t servo_get_state_user(pbio_servo_t *srv, bool last, int32_t *angle, int32_t *speed, int32_t *duty) {
+    pbio_error_t err = last ?
+        pbio_tacho_get_last_angle(srv->tacho, angle) :
+        pbio_tacho_get_angle(srv->tacho, angle);
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+    err = last ?
+        pbio_tacho_get_last_angular_rate(srv->tacho, speed) :
+        pbio_tacho_get_angular_rate(srv->tacho, speed);
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+    pbio_passivity_t state;
+    err = pbio_dcmotor_get_state(srv->dcmotor, &state, duty);
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+    *duty = *duty * PBIO_DUTY_USER_STEPS / PBDRV_MAX_DUTY;
+    return PBIO_SUCCESS;
+}
+
+/**
+ * Gets the state of a servo in user units, all sampled at the same time.
+ * @param [in]  srv     The servo
+ * @param [out] angle   The angle (deg)
+ * @param [out] speed   The speed (deg/s)
+ * @param [out] duty    The applied duty cycle (%)
+ * @return              Error code
+ */
+pbio_error_t pbio_servo_get_state_user(pbio_servo_t *srv, int32_t *angle, int32_t *speed, int32_t *duty) {
+    return servo_get_state_user(srv, false, angle, speed, duty);
+}
+
+/**
+ * Gets the state of a servo in user units as last read by the control loop,
+ * without reading the counter again.
+ * @param [in]  srv     The servo
+ * @param [out] angle   The angle (deg)
+ * @param [out] speed   The speed (deg/s)
+ * @param [out] duty    The applied duty cycle (%)
+ * @return              Error code
+ */
+pbio_error_t pbio_servo_get_last_state_user(pbio_servo_t *srv, int32_t *angle, int32_t *speed, int32_t *duty) {
+    return servo_get_state_user(srv, true, angle, speed, duty);
+}
+
 pbio_error_t pbio_servo_stop(pbio_servo_t *srv, pbio_actuation_t after_stop) {
 
     // Return if this servo is already in use by higher level entity
@@ -477,6 +572,29 @@ pbio_error_t pbio_servo_run_angle(pbio_servo_t *srv, int32_t speed, int32_t angl
     return pbio_control_start_relative_angle_control(&srv->control, time_now, count_now, relative_target_count, rate_now, target_rate, srv->control.settings.abs_acceleration, after_stop);
 }
 
+pbio_error_t pbio_servo_queue_target(pbio_servo_t *srv, int32_t speed, int32_t target, pbio_actuation_t after_stop) {
+
+    pbio_error_t err;
+
+    // Return if this servo is already in use by higher level entity
+    if (srv->claimed) {
+        return PBIO_ERROR_INVALID_OP;
+    }
+
+    // Get targets in unit of counts
+    int32_t target_rate = pbio_control_user_to_counts(&srv->control.settings, speed);
+    int32_t target_count = pbio_control_user_to_counts(&srv->control.settings, target);
+
+    // Get the initial physical motor state, used if nothing is running yet.
+    int32_t time_now, count_now, rate_now;
+    err = servo_get_state(srv, &time_now, &count_now, &rate_now);
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+
+    return pbio_control_queue_angle_control(&srv->control, time_now, count_now, target_count, rate_now, target_rate, srv->control.settings.abs_acceleration, after_stop);
+}
+
 pbio_error_t pbio_servo_track_target(pbio_servo_t *srv, int32_t target) {
 
     // Return if this servo is already in use by higher level entity
@@ -16,6 +16,11 @@ struct _pbio_tacho_t {
     int32_t offset;
     fix16_t counts_per_degree;
     pbdrv_counter_dev_t *counter;
+    // Most recent readings, with the direction applied but not the offset
+    int32_t last_count;
+    int32_t last_rate;
+    bool have_last_count;
+    bool have_last_rate;
 };
 
 static pbio_tacho_t tachos[PBDRV_CONFIG_NUM_MOTOR_CONTROLLER];
@@ -63,6 +68,8 @@ static pbio_error_t pbio_tacho_setup(pbio_tacho_t *tacho, uint8_t counter_id, pb
 
     // Configure direction
     tacho->direction = direction;
+    tacho->have_last_count = false;
+    tacho->have_last_rate = false;
 
     // Get counter device
     pbio_error_t err = pbdrv_counter_get_dev(counter_id, &tacho->counter);
@@ -106,11 +113,32 @@ pbio_error_t pbio_tacho_get_count(pbio_tacho_t *tacho, int32_t *count) {
     if (tacho->direction == PBIO_DIRECTION_COUNTERCLOCKWISE) {
         *count = -*count;
     }
+    tacho->last_count = *count;
+    tacho->have_last_count = true;
     *count -= tacho->offset;
 
     return PBIO_SUCCESS;
 }
 
+/**
+ * Gets the count as it was last read by pbio_tacho_get_count(), without
+ * reading the counter again. The counter is read only if it was not read
+ * since the tacho was set up.
+ * @param [in]  tacho   The tacho
+ * @param [out] count   The count
+ * @return              Error code
+ */
+pbio_error_t pbio_tacho_get_last_count(pbio_tacho_t *tacho, int32_t *count) {
+    if (!tacho->have_last_count) {
+        return pbio_tacho_get_count(tacho, count);
+    }
+
+    // Apply the current offset, so that resets are visible right away
+    *count = tacho->last_count - tacho->offset;
+
+    return PBIO_SUCCESS;
+}
+
 
 
 pbio_error_t pbio_tacho_get_angle(pbio_tacho_t *tacho, int32_t *angle) {
@@ -127,6 +155,20 @@ pbio_error_t pbio_tacho_get_angle(pbio_tacho_t *tacho, int32_t *angle) {
     return PBIO_SUCCESS;
 }
 
+pbio_error_t pbio_tacho_get_last_angle(pbio_tacho_t *tacho, int32_t *angle) {
+    int32_t encoder_count;
+    pbio_error_t err;
+
+    err = pbio_tacho_get_last_count(tacho, &encoder_count);
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+
+    *angle = pbio_math_div_i32_fix16(encoder_count, tacho->counts_per_degree);
+
+    return PBIO_SUCCESS;
+}
+
 pbio_error_t pbio_tacho_reset_angle(pbio_tacho_t *tacho, int32_t reset_angle, bool reset_to_abs) {
     if (reset_to_abs) {
         return pbio_tacho_reset_count_to_abs(tacho);
@@ -146,6 +188,26 @@ pbio_error_t pbio_tacho_get_rate(pbio_tacho_t *tacho, int32_t *rate) {
     if (tacho->direction == PBIO_DIRECTION_COUNTERCLOCKWISE) {
         *rate = -*rate;
     }
+    tacho->last_rate = *rate;
+    tacho->have_last_rate = true;
+
+    return PBIO_SUCCESS;
+}
+
+/**
+ * Gets the rate as it was last read by pbio_tacho_get_rate(), without
+ * reading the counter again. The counter is read only if it was not read
+ * since the tacho was set up.
+ * @param [in]  tacho           The tacho
+ * @param [out] encoder_rate    The rate
+ * @return                      Error code
+ */
+pbio_error_t pbio_tacho_get_last_rate(pbio_tacho_t *tacho, int32_t *encoder_rate) {
+    if (!tacho->have_last_rate) {
+        return pbio_tacho_get_rate(tacho, encoder_rate);
+    }
+
+    *encoder_rate = tacho->last_rate;
 
     return PBIO_SUCCESS;
 }
@@ -164,4 +226,18 @@ pbio_error_t pbio_tacho_get_angular_rate(pbio_tacho_t *tacho, int32_t *angular_r
     return PBIO_SUCCESS;
 }
 
+pbio_error_t pbio_tacho_get_last_angular_rate(pbio_tacho_t *tacho, int32_t *angular_rate) {
+    int32_t encoder_rate;
+    pbio_error_t err;
+
+    err = pbio_tacho_get_last_rate(tacho, &encoder_rate);
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+
+    *angular_rate = pbio_math_div_i32_fix16(encoder_rate, tacho->counts_per_degree);
+
+    return PBIO_SUCCESS;
+}
+
 #endif // PBIO_CONFIG_TACHO
@@ -15,10 +15,59 @@ static int64_t as_mcount(int32_t count, int32_t count_ext) {
 }
 
 static void as_count(int64_t mcount, int32_t *count, int32_t *count_ext) {
-    *count = (int32_t)(mcount / 1000);
+    // This runs on every control update, so avoid the slow 64-bit division.
+    // Estimate the quotient by multiplying by 2^25 / 125 on mcount / 8, then
+    // correct the estimate. Round towards zero, like the division would.
+    uint64_t abs_mcount = mcount < 0 ? -mcount : mcount;
+    uint64_t quotient = ((abs_mcount >> 3) * 268436) >> 25;
+    while (quotient * 1000 > abs_mcount) {
+        quotient--;
+    }
+    while (abs_mcount - quotient * 1000 >= 1000) {
+        quotient++;
+    }
+    *count = mcount < 0 ? -(int32_t)quotient : (int32_t)quotient;
     *count_ext = mcount - ((int64_t)*count) * 1000;
 }
 
+// The reference is evaluated on every control update, so the speeds and
+// accelerations are converted once when the trajectory is made, into a fixed
+// point basis that needs only multiplications and shifts to evaluate:
+//
+// - Speeds in millicounts per microsecond, scaled by 2^RATE_SHIFT
+// - Half accelerations in millicounts per microsecond squared, scaled by
+//   2^(RATE_SHIFT + ACCELERATION_SHIFT)
+// - The reciprocal of the smoothing window in 1/microsecond, scaled by 2^WINDOW_SHIFT
+#define RATE_SHIFT (24)
+#define ACCELERATION_SHIFT (28)
+#define WINDOW_SHIFT (32)
+
+// 2^WINDOW_SHIFT / 12
+#define WINDOW_TWELFTH (357913941)
+
+// Division rounded to nearest, for use when making trajectories only
+static int64_t div_round(int64_t numerator, int64_t denominator) {
+    return (numerator + (numerator < 0 ? -denominator : denominator) / 2) / denominator;
+}
+
+static int64_t rate_to_coef(int32_t rate) {
+    // rate * 2^24 / 1000
+    return div_round(((int64_t)rate) * (1 << 21), 125);
+}
+
+static int64_t acceleration_to_coef(int32_t acceleration) {
+    // acceleration / 2 * 2^52 / 10^9
+    return div_round(((int64_t)acceleration) * ((int64_t)1 << 42), 1953125);
+}
+
+static void make_coefficients(pbio_trajectory_t *ref) {
+    ref->w0_coef = rate_to_coef(ref->w0);
+    ref->w1_coef = rate_to_coef(ref->w1);
+    ref->a0_coef = acceleration_to_coef(ref->a0);
+    ref->a2_coef = acceleration_to_coef(ref->a2);
+    ref->tj_coef = ref->tj > 0 ? div_round((int64_t)1 << WINDOW_SHIFT, ref->tj) : 0;
+}
+
 void reverse_trajectory(pbio_trajectory_t *ref) {
     // Mirror angles about initial angle th0
 
@@ -70,8 +119,13 @@ void pbio_trajectory_make_stationary(pbio_trajectory_t *ref, int32_t t0, int32_t
     ref->a0 = 0;
     ref->a2 = 0;
 
+    // No smoothing needed
+    ref->tj = 0;
+
     // This is a finite maneuver
     ref->forever = false;
+
+    make_coefficients(ref);
 }
 
 static int64_t x_time(int32_t b, int32_t t) {
@@ -82,7 +136,15 @@ static int64_t x_time2(int32_t b, int32_t t) {
     return x_time(x_time(b, t), t) / (2 * US_PER_MS);
 }
 
-pbio_error_t pbio_trajectory_make_time_based(pbio_trajectory_t *ref, int32_t t0, int32_t duration, int32_t th0, int32_t th0_ext, int32_t w0, int32_t wt, int32_t wmax, int32_t a, int32_t amax) {
+// Time (us) it takes to ramp up to acceleration a with jerk j, or zero for no jerk limit
+static int32_t get_jerk_time(int32_t a, int32_t j) {
+    if (j <= 0) {
+        return 0;
+    }
+    return min(wdiva(a, j), US_PER_SECOND);
+}
+
+static pbio_error_t make_time_based_trapezoid(pbio_trajectory_t *ref, int32_t t0, int32_t duration, int32_t th0, int32_t th0_ext, int32_t w0, int32_t wt, int32_t wmax, int32_t a, int32_t amax) {
 
     // Work with time intervals instead of absolute time. Read 'm' as '-'.
     int32_t t3mt0;
@@ -196,21 +258,49 @@ pbio_error_t pbio_trajectory_make_time_based(pbio_trajectory_t *ref, int32_t t0,
     return PBIO_SUCCESS;
 }
 
-pbio_error_t pbio_trajectory_make_angle_based(pbio_trajectory_t *ref, int32_t t0, int32_t th0, int32_t th3, int32_t w0, int32_t wt, int32_t wmax, int32_t a, int32_t amax) {
+static pbio_error_t make_time_based(pbio_trajectory_t *ref, int32_t t0, int32_t duration, int32_t th0, int32_t th0_ext, int32_t w0, int32_t wt, int32_t wmax, int32_t a, int32_t amax, int32_t tj) {
 
-    // Return error for zero speed
-    if (wt == 0) {
-        return PBIO_ERROR_INVALID_ARG;
-    }
-    // Return error for maneuver that is too long
-    if (abs((th3 - th0) / wt) + 1 > DURATION_MAX_S) {
-        return PBIO_ERROR_INVALID_ARG;
+    // The smoothed maneuver takes tj longer than the trapezoid it is made
+    // from, so shorten the trapezoid to keep the requested duration.
+    if (duration != DURATION_FOREVER && duration >= 0) {
+        tj = min(tj, duration / 2);
+        duration -= tj;
     }
-    // Return empty maneuver for zero angle
-    if (th3 == th0) {
-        pbio_trajectory_make_stationary(ref, t0, th0);
-        return PBIO_SUCCESS;
+
+    // Smoothing makes the reference lag behind the trapezoid by w0 * tj / 2
+    // at the start, so move the trapezoid ahead by as much.
+    int64_t mth0 = as_mcount(th0, th0_ext) + x_time(w0, tj) / 2;
+    as_count(mth0, &th0, &th0_ext);
+
+    pbio_error_t err = make_time_based_trapezoid(ref, t0, duration, th0, th0_ext, w0, wt, wmax, a, amax);
+    if (err != PBIO_SUCCESS) {
+        return err;
     }
+    ref->tj = tj;
+    make_coefficients(ref);
+    return PBIO_SUCCESS;
+}
+
+/**
+ * Makes a trajectory that runs at a target speed for a given duration.
+ * @param [out] ref         The trajectory
+ * @param [in]  t0          Start time (us)
+ * @param [in]  duration    Duration (us) or ::DURATION_FOREVER
+ * @param [in]  th0         Initial encoder count
+ * @param [in]  th0_ext     Initial encoder millicounts
+ * @param [in]  w0          Initial encoder rate
+ * @param [in]  wt          Target encoder rate
+ * @param [in]  wmax        Maximum encoder rate
+ * @param [in]  a           Encoder acceleration
+ * @param [in]  amax        Maximum encoder acceleration
+ * @param [in]  j           Maximum encoder jerk, or zero for a trapezoidal speed profile
+ * @return                  ::PBIO_SUCCESS or ::PBIO_ERROR_INVALID_ARG
+ */
+pbio_error_t pbio_trajectory_make_time_based(pbio_trajectory_t *ref, int32_t t0, int32_t duration, int32_t th0, int32_t th0_ext, int32_t w0, int32_t wt, int32_t wmax, int32_t a, int32_t amax, int32_t j) {
+    return make_time_based(ref, t0, duration, th0, th0_ext, w0, wt, wmax, a, amax, get_jerk_time(min(a, amax), j));
+}
+
+static pbio_error_t make_angle_based_trapezoid(pbio_trajectory_t *ref, int32_t t0, int32_t th0, int32_t th3, int32_t w0, int32_t wt, int32_t wmax, int32_t a, int32_t amax) {
 
     // Remember if the original user-specified maneuver was backward
     bool backward = th3 < th0;
@@ -298,31 +388,163 @@ pbio_error_t pbio_trajectory_make_angle_based(pbio_trajectory_t *ref, int32_t t0
     return PBIO_SUCCESS;
 }
 
-// Evaluate the reference speed and velocity at the (shifted) time
-void pbio_trajectory_get_reference(pbio_trajectory_t *traject, int32_t time_ref, int32_t *count_ref, int32_t *count_ref_ext, int32_t *rate_ref, int32_t *acceleration_ref) {
+/**
+ * Makes a trajectory that runs to a target encoder count and stops there.
+ * @param [out] ref         The trajectory
+ * @param [in]  t0          Start time (us)
+ * @param [in]  th0         Initial encoder count
+ * @param [in]  th3         Target encoder count
+ * @param [in]  w0          Initial encoder rate
+ * @param [in]  wt          Target encoder rate
+ * @param [in]  wmax        Maximum encoder rate
+ * @param [in]  a           Encoder acceleration
+ * @param [in]  amax        Maximum encoder acceleration
+ * @param [in]  j           Maximum encoder jerk, or zero for a trapezoidal speed profile
+ * @return                  ::PBIO_SUCCESS or ::PBIO_ERROR_INVALID_ARG
+ */
+pbio_error_t pbio_trajectory_make_angle_based(pbio_trajectory_t *ref, int32_t t0, int32_t th0, int32_t th3, int32_t w0, int32_t wt, int32_t wmax, int32_t a, int32_t amax, int32_t j) {
 
-    int64_t mcount_ref;
+    // Return error for zero speed
+    if (wt == 0) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+    // Return error for maneuver that is too long
+    if (abs((th3 - th0) / wt) + 1 > DURATION_MAX_S) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+    // Return empty maneuver for zero angle
+    if (th3 == th0) {
+        pbio_trajectory_make_stationary(ref, t0, th0);
+        return PBIO_SUCCESS;
+    }
+
+    // Smoothing makes the reference lag behind the trapezoid by w0 * tj / 2
+    // at the start, so move the start of the trapezoid ahead by as much. The
+    // target stays the same, because the reference ends at standstill.
+    int32_t tj = get_jerk_time(min(a, amax), j);
+    th0 += x_time(w0, tj) / 2 / 1000;
+
+    pbio_error_t err = make_angle_based_trapezoid(ref, t0, th0, th3, w0, wt, wmax, a, amax);
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+    ref->tj = tj;
+    make_coefficients(ref);
+    return PBIO_SUCCESS;
+}
+
+// Evaluate one phase of the trapezoidal reference, dt after the start of the phase
+static void get_reference_phase(int64_t mcount_start, int64_t rate_coef, int64_t acceleration_coef, int32_t dt, int64_t *mcount_ref, int32_t *rate_ref) {
+    int64_t acceleration_dt = (acceleration_coef * dt) >> ACCELERATION_SHIFT;
+    *mcount_ref = mcount_start + (((rate_coef + acceleration_dt) * dt + (1 << (RATE_SHIFT - 1))) >> RATE_SHIFT);
+    *rate_ref = ((rate_coef + 2 * acceleration_dt) * MS_PER_SECOND + (1 << (RATE_SHIFT - 1))) >> RATE_SHIFT;
+}
+
+// Evaluate the trapezoidal reference at the given time
+static void get_reference_trapezoid(pbio_trajectory_t *traject, int32_t time_ref, int64_t *mcount_ref, int32_t *rate_ref, int32_t *acceleration_ref) {
 
     if (time_ref - traject->t1 < 0) {
-        // If we are here, then we are still in the acceleration phase. Includes conversion from microseconds to seconds, in two steps to avoid overflows and round off errors
-        *rate_ref = traject->w0 + timest(traject->a0, time_ref - traject->t0);
-        mcount_ref = as_mcount(traject->th0, traject->th0_ext) + x_time(traject->w0, time_ref - traject->t0) + x_time2(traject->a0, time_ref - traject->t0);
+        // If we are here, then we are still in the acceleration phase
+        get_reference_phase(as_mcount(traject->th0, traject->th0_ext), traject->w0_coef, traject->a0_coef, time_ref - traject->t0, mcount_ref, rate_ref);
         *acceleration_ref = traject->a0;
     } else if (traject->forever || time_ref - traject->t2 <= 0) {
         // If we are here, then we are in the constant speed phase
-        *rate_ref = traject->w1;
-        mcount_ref = as_mcount(traject->th1, traject->th1_ext) + x_time(traject->w1, time_ref - traject->t1);
+        get_reference_phase(as_mcount(traject->th1, traject->th1_ext), traject->w1_coef, 0, time_ref - traject->t1, mcount_ref, rate_ref);
         *acceleration_ref = 0;
     } else if (time_ref - traject->t3 <= 0) {
         // If we are here, then we are in the deceleration phase
-        *rate_ref = traject->w1 + timest(traject->a2,    time_ref - traject->t2);
-        mcount_ref = as_mcount(traject->th2, traject->th2_ext) + x_time(traject->w1, time_ref - traject->t2) + x_time2(traject->a2, time_ref - traject->t2);
+        get_reference_phase(as_mcount(traject->th2, traject->th2_ext), traject->w1_coef, traject->a2_coef, time_ref - traject->t2, mcount_ref, rate_ref);
         *acceleration_ref = traject->a2;
     } else {
         // If we are here, we are in the zero speed phase (relevant when holding position)
         *rate_ref = 0;
-        mcount_ref = as_mcount(traject->th3, traject->th3_ext);
+        *mcount_ref = as_mcount(traject->th3, traject->th3_ext);
+        *acceleration_ref = 0;
+    }
+}
+
+// Evaluate the trapezoidal reference at the given time, assuming it ran at constant speed before the start
+static void get_reference_extended(pbio_trajectory_t *traject, int32_t time_ref, int64_t *mcount_ref, int32_t *rate_ref, int32_t *acceleration_ref) {
+    if (time_ref - traject->t0 < 0) {
+        get_reference_phase(as_mcount(traject->th0, traject->th0_ext), traject->w0_coef, 0, time_ref - traject->t0, mcount_ref, rate_ref);
         *acceleration_ref = 0;
+        return;
+    }
+    get_reference_trapezoid(traject, time_ref, mcount_ref, rate_ref, acceleration_ref);
+}
+
+// Integral of the trapezoidal reference minus the offset (millicounts) over an interval
+// that lies within one phase, divided by the window tj. Evaluated around the middle of
+// the interval, the terms with odd powers of time vanish.
+static int64_t get_reference_integral(pbio_trajectory_t *traject, int32_t time_start, int32_t duration, int64_t offset) {
+    if (duration <= 0) {
+        return 0;
+    }
+    int64_t mcount_mid;
+    int32_t rate_mid, acceleration_mid;
+    get_reference_extended(traject, time_start + duration / 2, &mcount_mid, &rate_mid, &acceleration_mid);
+
+    // Fraction of the window covered by this interval
+    int64_t fraction = duration * traject->tj_coef;
+
+    // The phase acceleration is a0, a2, or zero, so we can look up its coefficient
+    int64_t acceleration_coef = acceleration_mid == 0 ? 0 : (acceleration_mid == traject->a0 ? traject->a0_coef : traject->a2_coef);
+
+    // Half acceleration times duration squared, in millicounts
+    int64_t mcount_accel = ((((acceleration_coef * duration) >> ACCELERATION_SHIFT) * duration) >> RATE_SHIFT);
+
+    return (((mcount_mid - offset) * fraction) >> WINDOW_SHIFT) +
+           ((mcount_accel * ((fraction * WINDOW_TWELFTH) >> WINDOW_SHIFT)) >> WINDOW_SHIFT);
+}
+
+// Evaluate the jerk limited reference at the given time. This is the moving average of
+// the trapezoidal reference over the preceding time window tj. This turns each constant
+// acceleration phase into one with linearly increasing and decreasing acceleration.
+static void get_reference_smooth(pbio_trajectory_t *traject, int32_t time_ref, int64_t *mcount_ref, int32_t *rate_ref, int32_t *acceleration_ref) {
+
+    int32_t tj = traject->tj;
+
+    // Once the window has passed the end of the trapezoid, we are standing still
+    if (!traject->forever && time_ref - tj - traject->t3 >= 0) {
+        *mcount_ref = as_mcount(traject->th3, traject->th3_ext);
+        *rate_ref = 0;
+        *acceleration_ref = 0;
+        return;
+    }
+
+    // Trapezoidal reference at the start and end of the window
+    int64_t mcount_start, mcount_end;
+    int32_t rate_start, rate_end, unused;
+    get_reference_extended(traject, time_ref - tj, &mcount_start, &rate_start, &unused);
+    get_reference_extended(traject, time_ref, &mcount_end, &rate_end, &unused);
+
+    // Integrate over the window, splitting it where the trapezoid changes phase
+    int32_t phase_start[] = {traject->t0, traject->t1, traject->t2, traject->t3};
+    int32_t num_phases = traject->forever ? 2 : 4;
+    int32_t time_start = time_ref - tj;
+    int64_t average = mcount_end;
+    for (int32_t i = 0; i < num_phases; i++) {
+        if (phase_start[i] - time_start > 0 && phase_start[i] - time_ref < 0) {
+            average += get_reference_integral(traject, time_start, phase_start[i] - time_start, mcount_end);
+            time_start = phase_start[i];
+        }
+    }
+    average += get_reference_integral(traject, time_start, time_ref - time_start, mcount_end);
+
+    // The average position, and its derivatives, rounded to nearest
+    *mcount_ref = average;
+    *rate_ref = ((mcount_end - mcount_start) * MS_PER_SECOND * traject->tj_coef + ((int64_t)1 << (WINDOW_SHIFT - 1))) >> WINDOW_SHIFT;
+    *acceleration_ref = (((int64_t)(rate_end - rate_start)) * US_PER_SECOND * traject->tj_coef + ((int64_t)1 << (WINDOW_SHIFT - 1))) >> WINDOW_SHIFT;
+}
+
+// Evaluate the reference speed and velocity at the (shifted) time
+void pbio_trajectory_get_reference(pbio_trajectory_t *traject, int32_t time_ref, int32_t *count_ref, int32_t *count_ref_ext, int32_t *rate_ref, int32_t *acceleration_ref) {
+
+    int64_t mcount_ref;
+    if (traject->tj > 0) {
+        get_reference_smooth(traject, time_ref, &mcount_ref, rate_ref, acceleration_ref);
+    } else {
+        get_reference_trapezoid(traject, time_ref, &mcount_ref, rate_ref, acceleration_ref);
     }
 
     // Split high res angle into counts and millicounts
@@ -332,7 +554,7 @@ void pbio_trajectory_get_reference(pbio_trajectory_t *traject, int32_t time_ref,
     if (time_ref - traject->t0 > (DURATION_MAX_S + 120) * MS_PER_SECOND * US_PER_MS) {
         // Infinite maneuvers just maintain the same reference speed, continuing again from current time
         if (traject->forever) {
-            pbio_trajectory_make_time_based(traject, time_ref, DURATION_FOREVER, *count_ref, *count_ref_ext, traject->w1, traject->w1, traject->w1, abs(traject->a2), abs(traject->a2));
+            make_time_based(traject, time_ref, DURATION_FOREVER, *count_ref, *count_ref_ext, traject->w1, traject->w1, traject->w1, abs(traject->a2), abs(traject->a2), traject->tj);
         }
         // All other maneuvers are considered complete and just stop. In practice, other maneuvers are not
         // allowed to be this long. This just ensures that if a motor stops and holds, it will continue to
@@ -8,7 +8,7 @@
 #include <pbio/math.h>
 #include <pbio/trajectory.h>
 
-static pbio_error_t pbio_trajectory_patch(pbio_trajectory_t *ref, bool time_based, int32_t t0, int32_t duration, int32_t th3, int32_t wt, int32_t wmax, int32_t a, int32_t amax) {
+static pbio_error_t pbio_trajectory_patch(pbio_trajectory_t *ref, bool time_based, int32_t t0, int32_t duration, int32_t th3, int32_t wt, int32_t wmax, int32_t a, int32_t amax, int32_t j) {
 
     // Get current reference point and acceleration, which will be the 0-point for the new trajectory
     int32_t th0;
@@ -21,9 +21,9 @@ static pbio_error_t pbio_trajectory_patch(pbio_trajectory_t *ref, bool time_base
     pbio_error_t err;
     pbio_trajectory_t nominal;
     if (time_based) {
-        err = pbio_trajectory_make_time_based(&nominal, t0, duration, th0, th0_ext, w0, wt, wmax, a, amax);
+        err = pbio_trajectory_make_time_based(&nominal, t0, duration, th0, th0_ext, w0, wt, wmax, a, amax, j);
     } else {
-        err = pbio_trajectory_make_angle_based(&nominal, t0, th0, th3, w0, wt, wmax, a, amax);
+        err = pbio_trajectory_make_angle_based(&nominal, t0, th0, th3, w0, wt, wmax, a, amax, j);
     }
     if (err != PBIO_SUCCESS) {
         return err;
@@ -33,7 +33,8 @@ static pbio_error_t pbio_trajectory_patch(pbio_trajectory_t *ref, bool time_base
     // the trajectories are tangent at this point. Then we can patch the new trajectory
     // by letting its first segment be equal to the current segment of the ongoing trajectory.
     // This provides a seamless transition without having to resort to numerical tricks.
-    if (acceleration_ref == nominal.a0) {
+    // This does not apply to jerk limited trajectories, which already start smoothly.
+    if (acceleration_ref == nominal.a0 && ref->tj == 0 && nominal.tj == 0) {
         // Find which section of the ongoing maneuver we were in, and take corresponding segment starting point
         if (t0 - ref->t1 < 0) {
             // We are still in the acceleration segment, so we can restart from its starting point
@@ -69,9 +70,9 @@ static pbio_error_t pbio_trajectory_patch(pbio_trajectory_t *ref, bool time_base
         // Now we can make the new trajectory with a starting point coincident
         // with a point on the existing trajectory
         if (time_based) {
-            return pbio_trajectory_make_time_based(ref, t0, duration, th0, th0_ext, w0, wt, wmax, a, amax);
+            return pbio_trajectory_make_time_based(ref, t0, duration, th0, th0_ext, w0, wt, wmax, a, amax, j);
         } else {
-            return pbio_trajectory_make_angle_based(ref, t0, th0, th3, w0, wt, wmax, a, amax);
+            return pbio_trajectory_make_angle_based(ref, t0, th0, th3, w0, wt, wmax, a, amax, j);
         }
 
     } else {
@@ -81,10 +82,10 @@ static pbio_error_t pbio_trajectory_patch(pbio_trajectory_t *ref, bool time_base
     }
 }
 
-pbio_error_t pbio_trajectory_make_time_based_patched(pbio_trajectory_t *ref, int32_t t0, int32_t duration, int32_t wt, int32_t wmax, int32_t a, int32_t amax) {
-    return pbio_trajectory_patch(ref, true, t0, duration, 0, wt, wmax, a, amax);
+pbio_error_t pbio_trajectory_make_time_based_patched(pbio_trajectory_t *ref, int32_t t0, int32_t duration, int32_t wt, int32_t wmax, int32_t a, int32_t amax, int32_t j) {
+    return pbio_trajectory_patch(ref, true, t0, duration, 0, wt, wmax, a, amax, j);
 }
 
-pbio_error_t pbio_trajectory_make_angle_based_patched(pbio_trajectory_t *ref, int32_t t0, int32_t th3, int32_t wt, int32_t wmax, int32_t a, int32_t amax) {
-    return pbio_trajectory_patch(ref, false, t0, 0, th3, wt, wmax, a, amax);
+pbio_error_t pbio_trajectory_make_angle_based_patched(pbio_trajectory_t *ref, int32_t t0, int32_t th3, int32_t wt, int32_t wmax, int32_t a, int32_t amax, int32_t j) {
+    return pbio_trajectory_patch(ref, false, t0, 0, th3, wt, wmax, a, amax, j);
 }
@@ -33,6 +33,12 @@
 #define DBG_ERR(expr)
 #endif
 
+#if PBIO_CONFIG_UARTDEV_STATS
+#define STATS_ADD(data, field, n) ((data)->stats.field += (n))
+#else
+#define STATS_ADD(data, field, n)
+#endif
+
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
@@ -162,6 +168,12 @@ typedef enum {
  * @tx_busy: mutex that protects tx_msg
  * @mode_change_tx_done: Flag to keep ev3_uart_set_mode_end() blocked until
  * mode has actually changed
+ * @combo_rec: Flag that indicates that DATA for the active mode combination
+ *      has been received
+ * @stats: Protocol statistics
+ * @data_time: Time (us) when the previous DATA message was received
+ * @data_time_valid: Flag that indicates that @data_time is from the current
+ *      connection
  * @speed_payload: Buffer for holding baud rate change message data
  * @mode_combo_payload: Buffer for holding mode combo message data
  * @mode_combo_size: Actual size of mode combo message
@@ -195,9 +207,15 @@ typedef struct {
     bool data_rec;
     bool tx_busy;
     bool mode_change_tx_done;
+    bool combo_rec;
     uint8_t speed_payload[4];
-    uint8_t mode_combo_payload[5];
+    uint8_t mode_combo_payload[PBIO_IODEV_MAX_COMBO_VALUES + 2];
     uint8_t mode_combo_size;
+    #if PBIO_CONFIG_UARTDEV_STATS
+    pbio_uartdev_stats_t stats;
+    uint32_t data_time;
+    bool data_time_valid;
+    #endif
 } uartdev_port_data_t;
 
 enum {
@@ -243,6 +261,47 @@ pbio_error_t pbio_uartdev_get(uint8_t id, pbio_iodev_t **iodev) {
     return PBIO_SUCCESS;
 }
 
+#if PBIO_CONFIG_UARTDEV_STATS
+
+/**
+ * Gets the protocol statistics of a UART device.
+ * @param [in]  id      The UART device ID
+ * @param [out] stats   The statistics
+ * @return              ::PBIO_SUCCESS on success
+ *                      ::PBIO_ERROR_INVALID_ARG if the ID is not valid
+ *
+ * The statistics are kept when a device is disconnected, so that they also
+ * show how often the connection was lost.
+ */
+pbio_error_t pbio_uartdev_get_stats(uint8_t id, const pbio_uartdev_stats_t **stats) {
+    if (id >= PBIO_CONFIG_UARTDEV_NUM_DEV) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+
+    *stats = &dev_data[id].stats;
+
+    return PBIO_SUCCESS;
+}
+
+/**
+ * Resets the protocol statistics of a UART device.
+ * @param [in]  id      The UART device ID
+ * @return              ::PBIO_SUCCESS on success
+ *                      ::PBIO_ERROR_INVALID_ARG if the ID is not valid
+ */
+pbio_error_t pbio_uartdev_reset_stats(uint8_t id) {
+    if (id >= PBIO_CONFIG_UARTDEV_NUM_DEV) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+
+    dev_data[id].stats = (pbio_uartdev_stats_t) { 0 };
+    dev_data[id].data_time_valid = false;
+
+    return PBIO_SUCCESS;
+}
+
+#endif // PBIO_CONFIG_UARTDEV_STATS
+
 static inline uint32_t uint32_le(uint8_t *bytes) {
     return bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (bytes[3] << 24);
 }
@@ -304,6 +363,61 @@ static void pbio_uartdev_set_mode_flags(pbio_iodev_type_id_t type_id, uint8_t mo
     }
 }
 
+#if PBIO_CONFIG_UARTDEV_STATS
+// Keeps track of the time between DATA messages
+static void pbio_uartdev_stats_data_rec(uartdev_port_data_t *data) {
+    uint32_t now = clock_usecs();
+
+    if (data->data_time_valid) {
+        uint32_t interval = now - data->data_time;
+        data->stats.data_intervals++;
+        data->stats.data_interval_total += interval;
+        if (interval > data->stats.data_interval_max) {
+            data->stats.data_interval_max = interval;
+        }
+    }
+    data->data_time = now;
+    data->data_time_valid = true;
+    data->stats.rx_data_msgs++;
+}
+#endif // PBIO_CONFIG_UARTDEV_STATS
+
+// Splits DATA for a mode combination into the data of each mode. Devices send
+// this data with the combo index as the mode, padded to a power of two like
+// any other DATA message. Returns false if the message does not match the
+// layout of the combination, e.g. because it was sent before the device
+// switched to the mode combination.
+static bool pbio_uartdev_demux_combo(uartdev_port_data_t *data, uint8_t mode, uint8_t size) {
+    uint8_t lens[PBIO_IODEV_MAX_COMBO_VALUES];
+    uint8_t total = 0;
+    uint8_t padded = 1;
+
+    // we always set up combo index 0
+    if (mode != 0) {
+        return false;
+    }
+
+    for (uint8_t i = 0; i < data->iodev.num_combo_modes; i++) {
+        pbio_iodev_mode_t *mode_info = &data->info->mode_info[data->iodev.combo_modes[i]];
+        lens[i] = mode_info->num_values * pbio_iodev_size_of(mode_info->data_type);
+        total += lens[i];
+    }
+    while (padded < total) {
+        padded <<= 1;
+    }
+    if (size != padded) {
+        return false;
+    }
+
+    uint8_t *src = data->rx_msg + 1;
+    for (uint8_t i = 0; i < data->iodev.num_combo_modes; i++) {
+        memcpy(data->iodev.bin_data + data->iodev.combo_offsets[i], src, lens[i]);
+        src += lens[i];
+    }
+
+    return true;
+}
+
 static void pbio_uartdev_parse_msg(uartdev_port_data_t *data) {
     uint32_t speed;
     uint8_t msg_type, cmd, msg_size, mode, cmd2;
@@ -332,6 +446,7 @@ static void pbio_uartdev_parse_msg(uartdev_port_data_t *data) {
         }
         if (checksum != data->rx_msg[msg_size - 1]) {
             DBG_ERR(data->last_err = "Bad checksum");
+            STATS_ADD(data, checksum_errors, 1);
             // if INFO messages are done and we are now receiving data, it is
             // OK to occasionally have a bad checksum
             if (data->status == PBIO_UARTDEV_STATUS_DATA) {
@@ -349,6 +464,8 @@ static void pbio_uartdev_parse_msg(uartdev_port_data_t *data) {
         }
     }
 
+    STATS_ADD(data, rx_msgs, 1);
+
     switch (msg_type) {
         case LUMP_MSG_TYPE_SYS:
             switch (cmd) {
@@ -661,12 +778,22 @@ static void pbio_uartdev_parse_msg(uartdev_port_data_t *data) {
                 goto err;
             }
 
+            #if PBIO_CONFIG_UARTDEV_STATS
+            pbio_uartdev_stats_data_rec(data);
+            #endif
+
             if (PBIO_IODEV_IS_FEEDBACK_MOTOR(&data->iodev) && data->write_cmd_size > 0) {
                 data->tacho_rate = data->rx_msg[1];
                 data->tacho_count = uint32_le(data->rx_msg + 2);
                 if (data->iodev.motor_flags & PBIO_IODEV_MOTOR_FLAG_HAS_ABS_POS) {
                     data->abs_pos = data->rx_msg[7] << 8 | data->rx_msg[6];
                 }
+            } else if (data->iodev.num_combo_modes) {
+                // Data for all modes in the combination is sent in one message
+                if (pbio_uartdev_demux_combo(data, mode, msg_size - 2)) {
+                    data->combo_rec = true;
+                    data->iodev.data_seq++;
+                }
             } else {
                 if (mode >= data->info->num_modes) {
                     DBG_ERR(data->last_err = "Invalid mode received");
@@ -675,6 +802,7 @@ static void pbio_uartdev_parse_msg(uartdev_port_data_t *data) {
                 data->iodev.mode = mode;
                 if (mode == data->new_mode) {
                     memcpy(data->iodev.bin_data, data->rx_msg + 1, msg_size - 2);
+                    data->iodev.data_seq++;
                 }
             }
 
@@ -762,11 +890,29 @@ static pbio_error_t ev3_uart_begin_tx_msg(uartdev_port_data_t *port_data, lump_m
     err = pbdrv_uart_write_begin(port_data->uart, port_data->tx_msg, offset + i + 2, EV3_UART_IO_TIMEOUT);
     if (err != PBIO_SUCCESS) {
         port_data->tx_busy = false;
+    } else {
+        STATS_ADD(port_data, tx_bytes, offset + i + 2);
     }
 
     return err;
 }
 
+// Fills the WRITE payload that makes the device send all values of the
+// given modes in one DATA message. Returns the payload size.
+static uint8_t pbio_uartdev_set_combo_payload(uartdev_port_data_t *data, const uint8_t *modes, uint8_t num_modes) {
+    uint8_t size = 2;
+
+    for (uint8_t i = 0; i < num_modes; i++) {
+        for (uint8_t j = 0; j < data->info->mode_info[modes[i]].num_values; j++) {
+            data->mode_combo_payload[size++] = modes[i] << 4 | j; // mode, dataset
+        }
+    }
+    data->mode_combo_payload[0] = 0x20 | (size - 2); // mode combo command, x values
+    data->mode_combo_payload[1] = 0; // combo index
+
+    return size;
+}
+
 static PT_THREAD(pbio_uartdev_send_speed_msg(uartdev_port_data_t * data, uint32_t speed)) {
     pbio_error_t err;
 
@@ -810,8 +956,12 @@ static PT_THREAD(pbio_uartdev_update(uartdev_port_data_t * data)) {
     // reset state for new device
     data->info->type_id = PBIO_IODEV_TYPE_ID_NONE;
     data->iodev.motor_flags = PBIO_IODEV_MOTOR_FLAG_NONE;
+    data->iodev.num_combo_modes = 0;
     data->ext_mode = 0;
     data->status = PBIO_UARTDEV_STATUS_SYNCING;
+    #if PBIO_CONFIG_UARTDEV_STATS
+    data->data_time_valid = false;
+    #endif
     // default max tacho rate for BOOST external motor since it is the only
     // motor that does not send this info
     data->max_tacho_rate = 1500;
@@ -820,6 +970,7 @@ static PT_THREAD(pbio_uartdev_update(uartdev_port_data_t * data)) {
 
     // Send SPEED command at 115200 baud
     PBIO_PT_WAIT_READY(&data->pt, pbdrv_uart_set_baud_rate(data->uart, EV3_UART_SPEED_LPF2));
+    STATS_ADD(data, baud_changes, 1);
     PT_SPAWN(&data->pt, &data->speed_pt, pbio_uartdev_send_speed_msg(data, EV3_UART_SPEED_LPF2));
 
     // read one byte to check for ACK
@@ -830,9 +981,13 @@ static PT_THREAD(pbio_uartdev_update(uartdev_port_data_t * data)) {
     }
 
     PBIO_PT_WAIT_READY(&data->pt, err = pbdrv_uart_read_end(data->uart));
+    if (err == PBIO_SUCCESS) {
+        STATS_ADD(data, rx_bytes, 1);
+    }
     if ((err == PBIO_SUCCESS && data->rx_msg[0] != LUMP_SYS_ACK) || err == PBIO_ERROR_TIMEDOUT) {
         // if we did not get ACK within 100ms, then switch to slow baud rate for sync
         PBIO_PT_WAIT_READY(&data->pt, pbdrv_uart_set_baud_rate(data->uart, EV3_UART_SPEED_MIN));
+        STATS_ADD(data, baud_changes, 1);
     } else if (err != PBIO_SUCCESS) {
         DBG_ERR(data->last_err = "UART Rx error during baud");
         goto err;
@@ -853,6 +1008,7 @@ static PT_THREAD(pbio_uartdev_update(uartdev_port_data_t * data)) {
             DBG_ERR(data->last_err = "UART Rx error during sync");
             goto err;
         }
+        STATS_ADD(data, rx_bytes, 1);
 
         if (data->rx_msg[0] == (LUMP_MSG_TYPE_CMD | LUMP_CMD_TYPE)) {
             break;
@@ -871,6 +1027,7 @@ static PT_THREAD(pbio_uartdev_update(uartdev_port_data_t * data)) {
         DBG_ERR(data->last_err = "UART Rx error while reading type");
         goto err;
     }
+    STATS_ADD(data, rx_bytes, 2);
 
     if (data->rx_msg[1] < EV3_UART_TYPE_MIN || data->rx_msg[1] > EV3_UART_TYPE_MAX) {
         DBG_ERR(data->last_err = "Bad device type id");
@@ -880,6 +1037,7 @@ static PT_THREAD(pbio_uartdev_update(uartdev_port_data_t * data)) {
     checksum = 0xff ^ data->rx_msg[0] ^ data->rx_msg[1];
     if (data->rx_msg[2] != checksum) {
         DBG_ERR(data->last_err = "Bad checksum for type id");
+        STATS_ADD(data, checksum_errors, 1);
         goto err;
     }
 
@@ -911,10 +1069,12 @@ static PT_THREAD(pbio_uartdev_update(uartdev_port_data_t * data)) {
             DBG_ERR(data->last_err = "UART Rx end error during info header");
             goto err;
         }
+        STATS_ADD(data, rx_bytes, 1);
 
         data->rx_msg_size = ev3_uart_get_msg_size(data->rx_msg[0]);
         if (data->rx_msg_size > EV3_UART_MAX_MESSAGE_SIZE) {
             DBG_ERR(data->last_err = "Bad message size during info");
+            STATS_ADD(data, bad_msgs, 1);
             goto err;
         }
 
@@ -930,6 +1090,7 @@ static PT_THREAD(pbio_uartdev_update(uartdev_port_data_t * data)) {
                 DBG_ERR(data->last_err = "UART Rx end error during info");
                 goto err;
             }
+            STATS_ADD(data, rx_bytes, data->rx_msg_size - 1);
         }
 
         // at this point, we have a full data->msg that can be parsed
@@ -959,6 +1120,7 @@ static PT_THREAD(pbio_uartdev_update(uartdev_port_data_t * data)) {
         goto err;
     }
     data->tx_busy = false;
+    STATS_ADD(data, tx_bytes, 1);
 
     // schedule baud rate change
     etimer_set(&data->timer, clock_from_msec(10));
@@ -966,6 +1128,7 @@ static PT_THREAD(pbio_uartdev_update(uartdev_port_data_t * data)) {
 
     // change the baud rate
     PBIO_PT_WAIT_READY(&data->pt, pbdrv_uart_set_baud_rate(data->uart, data->new_baud_rate));
+    STATS_ADD(data, baud_changes, 1);
 
     // setting type_id in info struct lets external modules know a device is connected
     data->info->type_id = data->type_id;
@@ -974,15 +1137,12 @@ static PT_THREAD(pbio_uartdev_update(uartdev_port_data_t * data)) {
     PT_INIT(&data->data_pt);
 
     if (PBIO_IODEV_IS_FEEDBACK_MOTOR(&data->iodev)) {
-        data->mode_combo_size = __builtin_popcount(data->info->mode_combos) + 2;
-        data->mode_combo_payload[0] = 0x20 | (data->mode_combo_size - 2); // mode combo command, x modes
-        data->mode_combo_payload[1] = 0; // combo index
-        data->mode_combo_payload[2] = 1 << 4 | 0; // mode 1, dataset 0
-        data->mode_combo_payload[3] = 2 << 4 | 0; // mode 2, dataset 0
-        data->mode_combo_payload[4] = 3 << 4 | 0; // mode 3, dataset 0
         // HACK: we are cheating here and assuming that all mode combinations
-        // are consecutive, starting with mode 1 and data->mode_combo_size
-        // chops off any unused mode (i.e. APOS)
+        // are consecutive, starting with mode 1 (SPEED, POS, APOS), and the
+        // number of modes in the combination chops off any unused mode
+        static const uint8_t motor_combo_modes[] = { 1, 2, 3 };
+        data->mode_combo_size = pbio_uartdev_set_combo_payload(data, motor_combo_modes,
+            MIN(__builtin_popcount(data->info->mode_combos), PBIO_ARRAY_SIZE(motor_combo_modes)));
 
         // setup motor to send position and speed data
         PBIO_PT_WAIT_READY(&data->pt,
@@ -1009,6 +1169,7 @@ static PT_THREAD(pbio_uartdev_update(uartdev_port_data_t * data)) {
         // make sure we are receiving data
         if (!data->data_rec) {
             data->num_data_err++;
+            STATS_ADD(data, keepalive_misses, 1);
             DBG_ERR(data->last_err = "No data since last keepalive");
             if (data->num_data_err > 6) {
                 data->status = PBIO_UARTDEV_STATUS_ERR;
@@ -1034,6 +1195,7 @@ static PT_THREAD(pbio_uartdev_update(uartdev_port_data_t * data)) {
             goto err;
         }
         data->tx_busy = false;
+        STATS_ADD(data, tx_bytes, 1);
     }
 
 err:
@@ -1042,6 +1204,7 @@ err:
     etimer_stop(&data->timer);
     debug_pr("%s\n", data->last_err);
     data->err_count++;
+    STATS_ADD(data, resyncs, 1);
 
     process_post(PROCESS_BROADCAST, PROCESS_EVENT_SERVICE_REMOVED, NULL);
 
@@ -1068,10 +1231,12 @@ static PT_THREAD(pbio_uartdev_receive_data(uartdev_port_data_t * data)) {
             DBG_ERR(data->last_err = "UART Rx data header end error");
             break;
         }
+        STATS_ADD(data, rx_bytes, 1);
 
         data->rx_msg_size = ev3_uart_get_msg_size(data->rx_msg[0]);
         if (data->rx_msg_size < 3 || data->rx_msg_size > EV3_UART_MAX_MESSAGE_SIZE) {
             DBG_ERR(data->last_err = "Bad data message size");
+            STATS_ADD(data, bad_msgs, 1);
             continue;
         }
 
@@ -1080,6 +1245,7 @@ static PT_THREAD(pbio_uartdev_receive_data(uartdev_port_data_t * data)) {
         if (msg_type != LUMP_MSG_TYPE_DATA && (msg_type != LUMP_MSG_TYPE_CMD ||
                                                (cmd != LUMP_CMD_WRITE && cmd != LUMP_CMD_EXT_MODE))) {
             DBG_ERR(data->last_err = "Bad msg type");
+            STATS_ADD(data, bad_msgs, 1);
             continue;
         }
 
@@ -1094,6 +1260,7 @@ static PT_THREAD(pbio_uartdev_receive_data(uartdev_port_data_t * data)) {
             DBG_ERR(data->last_err = "UART Rx data end error");
             break;
         }
+        STATS_ADD(data, rx_bytes, data->rx_msg_size - 1);
 
         // at this point, we have a full data->msg that can be parsed
         pbio_uartdev_parse_msg(data);
@@ -1113,6 +1280,7 @@ static pbio_error_t ev3_uart_set_mode_begin(pbio_iodev_t *iodev, uint8_t mode) {
 
     port_data->new_mode = mode;
     port_data->mode_change_tx_done = false;
+    port_data->iodev.num_combo_modes = 0;
 
     return PBIO_SUCCESS;
 }
@@ -1145,6 +1313,87 @@ static pbio_error_t ev3_uart_set_mode_end(pbio_iodev_t *iodev) {
     return PBIO_SUCCESS;
 }
 
+static pbio_error_t ev3_uart_set_mode_combo_begin(pbio_iodev_t *iodev, const uint8_t *modes, uint8_t num_modes) {
+    uartdev_port_data_t *port_data = PBIO_CONTAINER_OF(iodev, uartdev_port_data_t, iodev);
+    uint8_t offsets[PBIO_IODEV_MAX_COMBO_VALUES];
+    uint8_t num_values = 0;
+    uint8_t offset = 0;
+    pbio_error_t err;
+
+    // motors already use a mode combination for position and speed
+    if (PBIO_IODEV_IS_FEEDBACK_MOTOR(iodev)) {
+        return PBIO_ERROR_NOT_SUPPORTED;
+    }
+
+    // Each mode gets its own 4-byte aligned slot in bin_data
+    for (uint8_t i = 0; i < num_modes; i++) {
+        pbio_iodev_mode_t *mode_info = &port_data->info->mode_info[modes[i]];
+        num_values += mode_info->num_values;
+        offsets[i] = offset;
+        offset += (mode_info->num_values * pbio_iodev_size_of(mode_info->data_type) + 3) & ~3;
+    }
+    if (num_values > PBIO_IODEV_MAX_COMBO_VALUES || offset > PBIO_IODEV_MAX_DATA_SIZE) {
+        return PBIO_ERROR_INVALID_ARG;
+    }
+
+    if (port_data->tx_busy || port_data->mode_change_tx_done) {
+        return PBIO_ERROR_AGAIN;
+    }
+
+    port_data->mode_combo_size = pbio_uartdev_set_combo_payload(port_data, modes, num_modes);
+    err = ev3_uart_begin_tx_msg(port_data, LUMP_MSG_TYPE_CMD, LUMP_CMD_WRITE,
+        port_data->mode_combo_payload, port_data->mode_combo_size);
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+
+    memcpy(iodev->combo_modes, modes, num_modes);
+    memcpy(iodev->combo_offsets, offsets, num_modes);
+    iodev->num_combo_modes = num_modes;
+    port_data->mode_change_tx_done = false;
+
+    return PBIO_SUCCESS;
+}
+
+static pbio_error_t ev3_uart_set_mode_combo_end(pbio_iodev_t *iodev) {
+    uartdev_port_data_t *port_data = PBIO_CONTAINER_OF(iodev, uartdev_port_data_t, iodev);
+    pbio_error_t err;
+
+    if (!port_data->mode_change_tx_done) {
+        err = pbdrv_uart_write_end(port_data->uart);
+        if (err != PBIO_ERROR_AGAIN) {
+            port_data->tx_busy = false;
+            port_data->mode_change_tx_done = true;
+        }
+
+        if (err == PBIO_SUCCESS) {
+            port_data->combo_rec = false;
+            return PBIO_ERROR_AGAIN;
+        }
+
+        if (err != PBIO_ERROR_AGAIN) {
+            iodev->num_combo_modes = 0;
+            port_data->mode_change_tx_done = false;
+        }
+
+        return err;
+    }
+
+    // The combination was canceled, or the device was reset while waiting
+    if (iodev->num_combo_modes == 0) {
+        port_data->mode_change_tx_done = false;
+        return PBIO_ERROR_CANCELED;
+    }
+
+    if (!port_data->combo_rec) {
+        return PBIO_ERROR_AGAIN;
+    }
+
+    port_data->mode_change_tx_done = false;
+
+    return PBIO_SUCCESS;
+}
+
 static pbio_error_t ev3_uart_set_data_begin(pbio_iodev_t *iodev, const uint8_t *data) {
     uartdev_port_data_t *port_data = PBIO_CONTAINER_OF(iodev, uartdev_port_data_t, iodev);
     pbio_iodev_mode_t *mode = &port_data->info->mode_info[iodev->mode];
@@ -1184,6 +1433,16 @@ static void ev3_uart_write_cancel(pbio_iodev_t *iodev) {
     pbdrv_uart_write_cancel(port_data->uart);
 }
 
+static void ev3_uart_set_mode_combo_cancel(pbio_iodev_t *iodev) {
+    uartdev_port_data_t *port_data = PBIO_CONTAINER_OF(iodev, uartdev_port_data_t, iodev);
+
+    pbdrv_uart_write_cancel(port_data->uart);
+
+    // Stop waiting for data in the combination layout, in case the device
+    // never sends it
+    iodev->num_combo_modes = 0;
+}
+
 static const pbio_iodev_ops_t pbio_uartdev_ops = {
     .set_mode_begin = ev3_uart_set_mode_begin,
     .set_mode_end = ev3_uart_set_mode_end,
@@ -1194,6 +1453,9 @@ static const pbio_iodev_ops_t pbio_uartdev_ops = {
     .write_begin = ev3_uart_write_begin,
     .write_end = ev3_uart_write_end,
     .write_cancel = ev3_uart_write_cancel,
+    .set_mode_combo_begin = ev3_uart_set_mode_combo_begin,
+    .set_mode_combo_end = ev3_uart_set_mode_combo_end,
+    .set_mode_combo_cancel = ev3_uart_set_mode_combo_cancel,
 };
 
 static pbio_error_t pbio_uartdev_get_count(pbdrv_counter_dev_t *dev, int32_t *count) {
@@ -0,0 +1,372 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+// Closed-loop control benchmarks. This runs the servo and drivebase
+// controllers against simulated motors for a long stretch of simulated time,
+// and reports the CPU time per control update along with tracking and
+// settling performance. This is meant to catch regressions in control
+// quality and control loop cost on a host, before testing on a hub.
+//
+// The program fails if the tracking error or settling time of a benchmark
+// exceeds its limit, or if a maneuver does not settle at all. CPU time is
+// only reported, since it depends on the machine.
+//
+// Usage: bench-pbio [simulated seconds per benchmark]
+
+#include <inttypes.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <contiki.h>
+
+#include <pbdrv/core.h>
+#include <pbio/config.h>
+#include <pbio/control.h>
+#include <pbio/drivebase.h>
+#include <pbio/error.h>
+#include <pbio/motorpoll.h>
+#include <pbio/servo.h>
+
+#include "test-pbio.h"
+
+#define BENCH_DEFAULT_DURATION (1000) // seconds
+
+// Results of one benchmark
+typedef struct {
+    const char *name;
+    uint32_t ticks;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t sum_sq_error;
+    int32_t max_error;
+    uint32_t maneuvers;
+    uint32_t settled;
+    uint32_t timeouts;
+    int64_t total_settle_us;
+    int32_t max_settle_us;
+} bench_result_t;
+
+// Benchmark-specific callbacks
+typedef struct {
+    const char *name;
+    // Largest allowed rms tracking error, in counts
+    double max_rms_error;
+    // Largest allowed settling time, in ms
+    int32_t max_settle_ms;
+    // Sets up the devices under test
+    pbio_error_t (*setup)(void);
+    // Starts the next maneuver
+    pbio_error_t (*start)(uint32_t index);
+    // Runs one control update
+    pbio_error_t (*update)(void);
+    // Gets the current tracking error, in counts
+    int32_t (*get_error)(void);
+    // Gets the nominal end time of the current maneuver
+    int32_t (*get_end_time)(void);
+    // Checks whether the current maneuver is complete
+    bool (*is_done)(void);
+} bench_t;
+
+static pbio_servo_t *servo;
+static pbio_servo_t *servo_right;
+static pbio_drivebase_t *drivebase;
+
+static int32_t get_control_error(pbio_control_t *ctl, int32_t count_now) {
+    // There is no reference to track when passive
+    if (ctl->type == PBIO_CONTROL_NONE) {
+        return 0;
+    }
+    int32_t time_ref = pbio_control_get_ref_time(ctl, clock_usecs());
+    int32_t count_ref, unused;
+    pbio_trajectory_get_reference(&ctl->trajectory, time_ref, &count_ref, &unused, &unused, &unused);
+    return count_ref - count_now;
+}
+
+// Servo benchmarks
+
+static pbio_error_t servo_setup(void) {
+    pbio_error_t err = pbio_motorpoll_get_servo(PBIO_PORT_A, &servo);
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+    pbio_test_motor_sim_init(PBIO_PORT_A, &pbio_test_motor_sim_params_default, 0);
+    pbio_test_motor_sim_step(0);
+    return pbio_servo_setup(servo, PBIO_DIRECTION_CLOCKWISE, F16C(1, 0));
+}
+
+static pbio_error_t servo_start_angle(uint32_t index) {
+    static const int32_t angles[] = { 90, 360, -180, 45, -315 };
+    static const int32_t speeds[] = { 200, 800, 500, 100, 1000 };
+    int32_t n = sizeof(angles) / sizeof(angles[0]);
+    return pbio_servo_run_angle(servo, speeds[index % n], angles[(index / 3) % n], PBIO_ACTUATION_HOLD);
+}
+
+static pbio_error_t servo_start_time(uint32_t index) {
+    static const int32_t speeds[] = { 300, -700, 900, -150 };
+    int32_t n = sizeof(speeds) / sizeof(speeds[0]);
+    return pbio_servo_run_time(servo, speeds[index % n], 2000, PBIO_ACTUATION_HOLD);
+}
+
+static pbio_error_t servo_update(void) {
+    return pbio_servo_control_update(servo);
+}
+
+static int32_t servo_get_error(void) {
+    int32_t count_now;
+    pbio_tacho_get_count(servo->tacho, &count_now);
+    return get_control_error(&servo->control, count_now);
+}
+
+static int32_t servo_get_end_time(void) {
+    return servo->control.trajectory.t3 + servo->control.trajectory.tj;
+}
+
+static bool servo_is_done(void) {
+    return pbio_control_is_done(&servo->control);
+}
+
+// Drivebase benchmarks
+
+static pbio_error_t drivebase_setup(void) {
+    pbio_error_t err = pbio_motorpoll_get_servo(PBIO_PORT_A, &servo);
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+    err = pbio_motorpoll_get_servo(PBIO_PORT_B, &servo_right);
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+    err = pbio_motorpoll_get_drivebase(servo, servo_right, &drivebase);
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+
+    // Make the motors slightly different, as they would be in practice
+    pbio_test_motor_sim_params_t params = pbio_test_motor_sim_params_default;
+    pbio_test_motor_sim_init(PBIO_PORT_A, &params, 0);
+    params.friction *= 1.2;
+    params.load = 0.02;
+    pbio_test_motor_sim_init(PBIO_PORT_B, &params, 0);
+    pbio_test_motor_sim_step(0);
+
+    err = pbio_servo_setup(servo, PBIO_DIRECTION_COUNTERCLOCKWISE, F16C(1, 0));
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+    err = pbio_servo_setup(servo_right, PBIO_DIRECTION_CLOCKWISE, F16C(1, 0));
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+    return pbio_drivebase_setup(drivebase, servo, servo_right, F16C(56, 0), F16C(112, 0));
+}
+
+static pbio_error_t drivebase_start(uint32_t index) {
+    static const int32_t distances[] = { 200, -100, 500, -600 };
+    static const int32_t angles[] = { 90, -180, 45, 45 };
+    int32_t n = sizeof(distances) / sizeof(distances[0]);
+    if (index % 2) {
+        return pbio_drivebase_turn(drivebase, angles[(index / 2) % n], 200, 400);
+    }
+    return pbio_drivebase_straight(drivebase, distances[(index / 2) % n], 200, 400);
+}
+
+static pbio_error_t drivebase_update(void) {
+    return pbio_drivebase_update(drivebase);
+}
+
+static int32_t drivebase_get_error(void) {
+    int32_t count_left, count_right;
+    pbio_tacho_get_count(drivebase->left->tacho, &count_left);
+    pbio_tacho_get_count(drivebase->right->tacho, &count_right);
+
+    // Error of either wheel is half of the error in both the sum and difference
+    int32_t sum_error = get_control_error(&drivebase->control_distance, count_left + count_right);
+    int32_t dif_error = get_control_error(&drivebase->control_heading, count_left - count_right);
+    return (abs(sum_error) + abs(dif_error)) / 2;
+}
+
+static int32_t drivebase_get_end_time(void) {
+    pbio_trajectory_t *distance = &drivebase->control_distance.trajectory;
+    pbio_trajectory_t *heading = &drivebase->control_heading.trajectory;
+    return max(distance->t3 + distance->tj, heading->t3 + heading->tj);
+}
+
+static bool drivebase_is_done(void) {
+    return pbio_control_is_done(&drivebase->control_distance) && pbio_control_is_done(&drivebase->control_heading);
+}
+
+static const bench_t benchmarks[] = {
+    {
+        .name = "servo/run_angle",
+        .max_rms_error = 4.0,
+        .max_settle_ms = 20,
+        .setup = servo_setup,
+        .start = servo_start_angle,
+        .update = servo_update,
+        .get_error = servo_get_error,
+        .get_end_time = servo_get_end_time,
+        .is_done = servo_is_done,
+    },
+    {
+        .name = "servo/run_time",
+        .max_rms_error = 9.0,
+        .max_settle_ms = 20,
+        .setup = servo_setup,
+        .start = servo_start_time,
+        .update = servo_update,
+        .get_error = servo_get_error,
+        .get_end_time = servo_get_end_time,
+        .is_done = servo_is_done,
+    },
+    {
+        .name = "drivebase/straight_turn",
+        .max_rms_error = 6.0,
+        .max_settle_ms = 20,
+        .setup = drivebase_setup,
+        .start = drivebase_start,
+        .update = drivebase_update,
+        .get_error = drivebase_get_error,
+        .get_end_time = drivebase_get_end_time,
+        .is_done = drivebase_is_done,
+    },
+};
+
+static uint64_t nsecs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Maximum time to wait for a maneuver to settle before moving on
+#define BENCH_SETTLE_TIMEOUT (2000 * US_PER_MS)
+
+// Time to hold still after settling, before starting the next maneuver
+#define BENCH_HOLD_TIME (200 * US_PER_MS)
+
+static pbio_error_t run_benchmark(const bench_t *bench, uint32_t duration, bench_result_t *result) {
+
+    *result = (bench_result_t) { .name = bench->name };
+
+    // Start from a clean state, like a new user program would
+    pbdrv_init();
+    _pbio_motorpoll_reset_all();
+
+    pbio_error_t err = bench->setup();
+    if (err != PBIO_SUCCESS) {
+        return err;
+    }
+
+    uint32_t ticks = (uint64_t)duration * MS_PER_SECOND / PBIO_CONFIG_SERVO_PERIOD_MS;
+    int32_t time_settled = clock_usecs();
+    bool running = false;
+
+    while (result->ticks < ticks) {
+
+        // Start the next maneuver once the previous one has settled for a while
+        if (!running && clock_usecs() - time_settled >= BENCH_HOLD_TIME) {
+            err = bench->start(result->maneuvers++);
+            if (err != PBIO_SUCCESS) {
+                return err;
+            }
+            running = true;
+        }
+
+        // Advance the simulation by one control period
+        pbio_test_motor_sim_step(PBIO_CONFIG_SERVO_PERIOD_MS * US_PER_MS);
+        clock_tick(clock_from_msec(PBIO_CONFIG_SERVO_PERIOD_MS));
+
+        // Run and time the control update
+        uint64_t start = nsecs();
+        err = bench->update();
+        uint64_t elapsed = nsecs() - start;
+        if (err != PBIO_SUCCESS) {
+            return err;
+        }
+        result->ticks++;
+        result->total_ns += elapsed;
+        result->max_ns = max(result->max_ns, elapsed);
+
+        // Tracking error with respect to the reference trajectory
+        int32_t error = abs(bench->get_error());
+        result->sum_sq_error += (uint64_t)error * error;
+        result->max_error = max(result->max_error, error);
+
+        // Settling time is the time past the nominal end of the maneuver
+        if (running) {
+            int32_t late = clock_usecs() - bench->get_end_time();
+            if (bench->is_done() && late >= 0) {
+                result->settled++;
+                result->total_settle_us += late;
+                result->max_settle_us = max(result->max_settle_us, late);
+                time_settled = clock_usecs();
+                running = false;
+            } else if (late > BENCH_SETTLE_TIMEOUT) {
+                // Give up on this one, but keep going
+                result->timeouts++;
+                time_settled = clock_usecs();
+                running = false;
+            }
+        }
+    }
+
+    return PBIO_SUCCESS;
+}
+
+static double get_rms_error(const bench_result_t *r) {
+    return r->ticks ? sqrt((double)r->sum_sq_error / r->ticks) : 0.0;
+}
+
+static void print_result(const bench_result_t *r) {
+    printf("%s:\n", r->name);
+    printf("  ticks:           %" PRIu32 "\n", r->ticks);
+    printf("  ns per tick:     %" PRIu64 " (max %" PRIu64 ")\n", r->ticks ? r->total_ns / r->ticks : 0, r->max_ns);
+    printf("  error (counts):  %.2f rms (max %" PRId32 ")\n", get_rms_error(r), r->max_error);
+    printf("  maneuvers:       %" PRIu32 " (%" PRIu32 " settled, %" PRIu32 " timed out)\n", r->maneuvers, r->settled, r->timeouts);
+    printf("  settling (ms):   %" PRId64 " mean (max %" PRId32 ")\n",
+        r->settled ? r->total_settle_us / r->settled / US_PER_MS : 0, r->max_settle_us / US_PER_MS);
+}
+
+// Checks the result against the limits of the benchmark
+static bool check_result(const bench_t *bench, const bench_result_t *r) {
+    bool ok = true;
+    if (get_rms_error(r) > bench->max_rms_error) {
+        printf("%s: FAIL: rms error %.2f exceeds %.2f\n", bench->name, get_rms_error(r), bench->max_rms_error);
+        ok = false;
+    }
+    if (r->max_settle_us / US_PER_MS > bench->max_settle_ms) {
+        printf("%s: FAIL: settling time %" PRId32 " ms exceeds %" PRId32 " ms\n",
+            bench->name, r->max_settle_us / US_PER_MS, bench->max_settle_ms);
+        ok = false;
+    }
+    if (r->timeouts > 0) {
+        printf("%s: FAIL: %" PRIu32 " maneuvers did not settle\n", bench->name, r->timeouts);
+        ok = false;
+    }
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    uint32_t duration = argc > 1 ? strtoul(argv[1], NULL, 0) : BENCH_DEFAULT_DURATION;
+    int ret = EXIT_SUCCESS;
+
+    printf("control period: %d ms, duration: %" PRIu32 " s\n", PBIO_CONFIG_SERVO_PERIOD_MS, duration);
+
+    for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++) {
+        bench_result_t result;
+        pbio_error_t err = run_benchmark(&benchmarks[i], duration, &result);
+        if (err != PBIO_SUCCESS) {
+            printf("%s: failed with error %d\n", benchmarks[i].name, err);
+            ret = EXIT_FAILURE;
+            continue;
+        }
+        print_result(&result);
+        if (!check_result(&benchmarks[i], &result)) {
+            ret = EXIT_FAILURE;
+        }
+    }
+
+    return ret;
+}
@@ -17,20 +17,25 @@ typedef struct {
     int32_t rate;
 } test_private_data_t;
 
-static test_private_data_t test_private_data;
+static test_private_data_t test_private_data[PBDRV_CONFIG_COUNTER_NUM_DEV];
 
 // Functions for tests to poke counter state
 
 void pbio_test_counter_set_count(int32_t count) {
-    test_private_data.count = count;
+    test_private_data[0].count = count;
 }
 
 void pbio_test_counter_set_abs_count(int32_t count) {
-    test_private_data.abs_count = count;
+    test_private_data[0].abs_count = count;
 }
 
 void pbio_test_counter_set_rate(int32_t rate) {
-    test_private_data.rate = rate;
+    test_private_data[0].rate = rate;
+}
+
+void pbio_test_counter_set_state(uint8_t id, int32_t count, int32_t rate) {
+    test_private_data[id].count = count;
+    test_private_data[id].rate = rate;
 }
 
 // Counter driver implementation
@@ -60,8 +65,10 @@ static const pbdrv_counter_funcs_t test_funcs = {
 };
 
 void pbdrv_counter_test_init(pbdrv_counter_dev_t *devs) {
-    devs[0].funcs = &test_funcs;
-    devs[0].priv = &test_private_data;
+    for (int i = 0; i < PBDRV_CONFIG_COUNTER_NUM_DEV; i++) {
+        devs[i].funcs = &test_funcs;
+        devs[i].priv = &test_private_data[i];
+    }
 }
 
 // Tests
@@ -73,10 +80,10 @@ void test_counter_get(void *env) {
     tt_want(pbdrv_counter_get_dev(0, &dev) == PBIO_ERROR_AGAIN);
 
     // bad id
-    tt_want(pbdrv_counter_get_dev(1, &dev) == PBIO_ERROR_NO_DEV);
+    tt_want(pbdrv_counter_get_dev(PBDRV_CONFIG_COUNTER_NUM_DEV, &dev) == PBIO_ERROR_NO_DEV);
 
     // proper usage
     pbdrv_counter_init();
     tt_want(pbdrv_counter_get_dev(0, &dev) == PBIO_SUCCESS);
-    tt_want(dev->priv == &test_private_data);
+    tt_want(dev->priv == &test_private_data[0]);
 }
@@ -0,0 +1,186 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+// Simulated motor driver for tests and benchmarks. The driver records the
+// h-bridge output for each port. Optionally, a simple DC motor model can be
+// attached to a port. It turns the applied duty cycle into motion and feeds
+// the resulting angle and speed back into the test counter driver, closing
+// the control loop without hardware.
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <pbdrv/config.h>
+#include <pbdrv/motor.h>
+#include <pbio/error.h>
+#include <pbio/iodev.h>
+#include <pbio/port.h>
+
+#include "../test-pbio.h"
+
+// Integration step of the motor model, in microseconds
+#define MOTOR_SIM_STEP_US (100)
+
+typedef struct {
+    pbio_test_h_bridge_output_t output;
+    int16_t duty_cycle;
+    bool simulated;
+    pbio_test_motor_sim_params_t params;
+    double angle;
+    double speed;
+} test_motor_t;
+
+static test_motor_t test_motors[PBDRV_CONFIG_NUM_MOTOR_CONTROLLER];
+
+static test_motor_t *get_test_motor(pbio_port_t port) {
+    if (port < PBDRV_CONFIG_FIRST_MOTOR_PORT || port > PBDRV_CONFIG_LAST_MOTOR_PORT) {
+        return NULL;
+    }
+    return &test_motors[port - PBDRV_CONFIG_FIRST_MOTOR_PORT];
+}
+
+// Motor driver implementation
+
+pbio_error_t pbdrv_motor_coast(pbio_port_t port) {
+    test_motor_t *motor = get_test_motor(port);
+    if (motor == NULL) {
+        return PBIO_ERROR_INVALID_PORT;
+    }
+    motor->output = PBIO_TEST_H_BRIDGE_OUTPUT_LL;
+    motor->duty_cycle = 0;
+    return PBIO_SUCCESS;
+}
+
+pbio_error_t pbdrv_motor_set_duty_cycle(pbio_port_t port, int16_t duty_cycle) {
+    test_motor_t *motor = get_test_motor(port);
+    if (motor == NULL) {
+        return PBIO_ERROR_INVALID_PORT;
+    }
+    if (duty_cycle > 0) {
+        motor->output = PBIO_TEST_H_BRIDGE_OUTPUT_LH;
+    } else if (duty_cycle < 0) {
+        motor->output = PBIO_TEST_H_BRIDGE_OUTPUT_HL;
+    } else {
+        motor->output = PBIO_TEST_H_BRIDGE_OUTPUT_HH;
+    }
+    motor->duty_cycle = duty_cycle;
+    return PBIO_SUCCESS;
+}
+
+pbio_error_t pbdrv_motor_get_id(pbio_port_t port, pbio_iodev_type_id_t *id) {
+    const char *motor_id = getenv("PBIO_TEST_MOTOR_TYPE");
+    *id = motor_id == NULL ? PBIO_IODEV_TYPE_ID_INTERACTIVE_MOTOR : atoi(motor_id);
+    return PBIO_SUCCESS;
+}
+
+pbio_error_t pbdrv_motor_setup(pbio_port_t port, bool is_servo) {
+    return PBIO_SUCCESS;
+}
+
+// Functions for tests to inspect the driver output
+
+void pbio_test_motor_get_output(pbio_port_t port, pbio_test_h_bridge_output_t *output, uint16_t *duty_cycle) {
+    test_motor_t *motor = get_test_motor(port);
+    *output = motor->output;
+    *duty_cycle = abs(motor->duty_cycle);
+}
+
+// Motor model
+
+/**
+ * Default model parameters, roughly matching a BOOST Interactive Motor.
+ */
+const pbio_test_motor_sim_params_t pbio_test_motor_sim_params_default = {
+    .no_load_speed = 1200.0,
+    .time_constant = 0.05,
+    .friction = 0.08,
+    .load = 0.0,
+    // LUMP motors report speed in steps of about 1% of the maximum speed
+    .rate_resolution = 10,
+};
+
+/**
+ * Attaches a simulated motor to a port and resets it to standstill.
+ * @param [in]  port    The motor port
+ * @param [in]  params  The model parameters
+ * @param [in]  angle   The initial angle in degrees
+ */
+void pbio_test_motor_sim_init(pbio_port_t port, const pbio_test_motor_sim_params_t *params, double angle) {
+    test_motor_t *motor = get_test_motor(port);
+    motor->simulated = true;
+    motor->params = *params;
+    motor->angle = angle;
+    motor->speed = 0;
+}
+
+static void motor_sim_update(test_motor_t *motor, double dt) {
+    const pbio_test_motor_sim_params_t *p = &motor->params;
+
+    // Acceleration at stall torque, used to scale all torques below
+    double accel_stall = p->no_load_speed / p->time_constant;
+
+    // Electrical torque. When coasting, the windings are open so there is no
+    // torque. Otherwise the motor is driven (or braked if duty is zero) and
+    // back EMF reduces the torque as speed increases.
+    double accel = 0;
+    if (motor->output != PBIO_TEST_H_BRIDGE_OUTPUT_LL) {
+        accel = (p->no_load_speed * motor->duty_cycle / PBDRV_MAX_DUTY - motor->speed) / p->time_constant;
+    }
+
+    // External load torque
+    accel -= p->load * accel_stall;
+
+    // Coulomb friction opposes motion, or holds the motor if it does not move
+    double accel_friction = p->friction * accel_stall;
+    if (motor->speed == 0 && fabs(accel) <= accel_friction) {
+        return;
+    }
+    double direction = motor->speed != 0 ? copysign(1, motor->speed) : copysign(1, accel);
+    double speed = motor->speed + (accel - direction * accel_friction) * dt;
+
+    // Friction can stop the motor, but not reverse it
+    if (motor->speed != 0 && copysign(1, speed) != direction) {
+        speed = 0;
+    }
+
+    motor->angle += (motor->speed + speed) / 2 * dt;
+    motor->speed = speed;
+}
+
+/**
+ * Advances all simulated motors and updates the corresponding counters.
+ * @param [in]  usecs   The simulated time step in microseconds
+ */
+void pbio_test_motor_sim_step(uint32_t usecs) {
+    for (int i = 0; i < PBDRV_CONFIG_NUM_MOTOR_CONTROLLER; i++) {
+        test_motor_t *motor = &test_motors[i];
+        if (!motor->simulated) {
+            continue;
+        }
+
+        for (uint32_t t = 0; t < usecs; t += MOTOR_SIM_STEP_US) {
+            uint32_t dt = usecs - t < MOTOR_SIM_STEP_US ? usecs - t : MOTOR_SIM_STEP_US;
+            motor_sim_update(motor, dt / 1e6);
+        }
+
+        // Quantize the state the way the encoder and speed estimator would
+        int32_t resolution = motor->params.rate_resolution > 0 ? motor->params.rate_resolution : 1;
+        int32_t count = (int32_t)floor(motor->angle * PBDRV_CONFIG_COUNTER_COUNTS_PER_DEGREE);
+        int32_t rate = (int32_t)lround(motor->speed * PBDRV_CONFIG_COUNTER_COUNTS_PER_DEGREE / resolution) * resolution;
+        pbio_test_counter_set_state(i, count, rate);
+    }
+}
+
+/**
+ * Gets the exact (unquantized) state of a simulated motor.
+ * @param [in]  port    The motor port
+ * @param [out] angle   The angle in degrees
+ * @param [out] speed   The speed in degrees per second
+ */
+void pbio_test_motor_sim_get_state(pbio_port_t port, double *angle, double *speed) {
+    test_motor_t *motor = get_test_motor(port);
+    *angle = motor->angle;
+    *speed = motor->speed;
+}
@@ -0,0 +1,124 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+#include <stdint.h>
+
+#include <tinytest.h>
+#include <tinytest_macros.h>
+
+#include "../drv/uart/uart_dma_rx.h"
+
+#define TEST_SIZE 16
+
+static volatile uint8_t test_data[TEST_SIZE];
+
+// remaining transfer count of the simulated DMA stream
+static uint32_t test_remaining;
+
+// Simulates the DMA stream receiving bytes in circular mode, including the
+// transfer complete interrupt
+static void test_dma_receive(pbdrv_uart_dma_rx_buf_t *buf, uint8_t first, uint8_t count) {
+    for (uint8_t i = 0; i < count; i++) {
+        test_data[TEST_SIZE - test_remaining] = first + i;
+        if (--test_remaining == 0) {
+            test_remaining = TEST_SIZE;
+            pbdrv_uart_dma_rx_handle_wrap(buf);
+        }
+    }
+}
+
+void test_uart_dma_rx(void *env) {
+    pbdrv_uart_dma_rx_buf_t buf;
+    uint8_t dst[TEST_SIZE];
+    uint32_t head;
+
+    pbdrv_uart_dma_rx_init(&buf, test_data, TEST_SIZE);
+    test_remaining = TEST_SIZE;
+
+    // nothing received yet
+    head = pbdrv_uart_dma_rx_get_head(&buf, buf.wraps, test_remaining);
+    tt_want_int_op(head, ==, 0);
+    tt_want_int_op(pbdrv_uart_dma_rx_available(&buf, head), ==, 0);
+    tt_want_int_op(pbdrv_uart_dma_rx_read(&buf, head, dst, sizeof(dst)), ==, 0);
+
+    // partial read leaves the rest for later
+    test_dma_receive(&buf, 10, 5);
+    head = pbdrv_uart_dma_rx_get_head(&buf, buf.wraps, test_remaining);
+    tt_want_int_op(head, ==, 5);
+    tt_want_int_op(pbdrv_uart_dma_rx_available(&buf, head), ==, 5);
+    tt_want_int_op(pbdrv_uart_dma_rx_read(&buf, head, dst, 3), ==, 3);
+    tt_want_int_op(dst[0], ==, 10);
+    tt_want_int_op(dst[2], ==, 12);
+    tt_want_int_op(buf.read_count, ==, 3);
+
+    // asking for more than available only returns what is there
+    tt_want_int_op(pbdrv_uart_dma_rx_read(&buf, head, dst, sizeof(dst)), ==, 2);
+    tt_want_int_op(dst[0], ==, 13);
+    tt_want_int_op(dst[1], ==, 14);
+    tt_want_int_op(pbdrv_uart_dma_rx_available(&buf, head), ==, 0);
+
+    // data that wraps around the end of the buffer
+    test_dma_receive(&buf, 20, 14);
+    head = pbdrv_uart_dma_rx_get_head(&buf, buf.wraps, test_remaining);
+    tt_want_int_op(head, ==, TEST_SIZE + 3);
+    tt_want_int_op(pbdrv_uart_dma_rx_available(&buf, head), ==, 14);
+    tt_want_int_op(pbdrv_uart_dma_rx_read(&buf, head, dst, 14), ==, 14);
+    for (int i = 0; i < 14; i++) {
+        tt_want_int_op(dst[i], ==, 20 + i);
+    }
+    tt_want_int_op(buf.read_count, ==, TEST_SIZE + 3);
+
+    // stream at the end of the buffer, just before the reload
+    test_dma_receive(&buf, 40, TEST_SIZE - 3 - 1);
+    head = pbdrv_uart_dma_rx_get_head(&buf, buf.wraps, test_remaining);
+    tt_want_int_op(test_remaining, ==, 1);
+    tt_want_int_op(head, ==, 2 * TEST_SIZE - 1);
+    tt_want_int_op(pbdrv_uart_dma_rx_available(&buf, head), ==, TEST_SIZE - 4);
+
+    // NDTR can read as 0 for a moment while it is reloaded
+    test_dma_receive(&buf, 52, 1);
+    head = pbdrv_uart_dma_rx_get_head(&buf, buf.wraps, 0);
+    tt_want_int_op(head, ==, 2 * TEST_SIZE);
+    tt_want_int_op(head, ==, pbdrv_uart_dma_rx_get_head(&buf, buf.wraps, test_remaining));
+
+    // most that can be buffered is one less than the buffer size
+    tt_want_int_op(pbdrv_uart_dma_rx_available(&buf, head), ==, TEST_SIZE - 3);
+    test_dma_receive(&buf, 53, 2);
+    head = pbdrv_uart_dma_rx_get_head(&buf, buf.wraps, test_remaining);
+    tt_want_int_op(pbdrv_uart_dma_rx_available(&buf, head), ==, TEST_SIZE - 1);
+    tt_want_int_op(pbdrv_uart_dma_rx_read(&buf, head, dst, sizeof(dst)), ==, TEST_SIZE - 1);
+    for (int i = 0; i < TEST_SIZE - 1; i++) {
+        tt_want_int_op(dst[i], ==, 40 + i);
+    }
+    tt_want_int_op(pbdrv_uart_dma_rx_available(&buf, head), ==, 0);
+
+    // wrap around that was not counted yet looks like nothing was received
+    test_dma_receive(&buf, 60, TEST_SIZE - 2);
+    tt_want_int_op(test_remaining, ==, TEST_SIZE);
+    head = pbdrv_uart_dma_rx_get_head(&buf, buf.wraps - 1, test_remaining);
+    tt_want_int_op(pbdrv_uart_dma_rx_available(&buf, head), ==, 0);
+    tt_want_int_op(pbdrv_uart_dma_rx_read(&buf, head, dst, sizeof(dst)), ==, 0);
+    tt_want_int_op(buf.overruns, ==, 0);
+
+    // receiving more than fits overwrites unread bytes, so they are dropped
+    test_dma_receive(&buf, 80, 5);
+    head = pbdrv_uart_dma_rx_get_head(&buf, buf.wraps, test_remaining);
+    tt_want_int_op(pbdrv_uart_dma_rx_available(&buf, head), ==, TEST_SIZE + 3);
+    tt_want_int_op(pbdrv_uart_dma_rx_read(&buf, head, dst, sizeof(dst)), ==, 0);
+    tt_want_int_op(buf.overruns, ==, 1);
+    tt_want_int_op(pbdrv_uart_dma_rx_available(&buf, head), ==, 0);
+
+    // reading resumes with the bytes received after that
+    test_dma_receive(&buf, 90, 3);
+    head = pbdrv_uart_dma_rx_get_head(&buf, buf.wraps, test_remaining);
+    tt_want_int_op(pbdrv_uart_dma_rx_read(&buf, head, dst, sizeof(dst)), ==, 3);
+    tt_want_int_op(dst[0], ==, 90);
+    tt_want_int_op(dst[2], ==, 92);
+    tt_want_int_op(buf.overruns, ==, 1);
+
+    // also after many wrap arounds without reading
+    test_dma_receive(&buf, 100, 5 * TEST_SIZE + 2);
+    head = pbdrv_uart_dma_rx_get_head(&buf, buf.wraps, test_remaining);
+    tt_want_int_op(pbdrv_uart_dma_rx_read(&buf, head, dst, sizeof(dst)), ==, 0);
+    tt_want_int_op(buf.overruns, ==, 2);
+}
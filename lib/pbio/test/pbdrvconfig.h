@@ -4,7 +4,7 @@
 #define PBDRV_CONFIG_BUTTON                         (1)
 
 #define PBDRV_CONFIG_COUNTER                        (1)
-#define PBDRV_CONFIG_COUNTER_NUM_DEV                (1)
+#define PBDRV_CONFIG_COUNTER_NUM_DEV                (4)
 #define PBDRV_CONFIG_COUNTER_TEST                   (1)
 
 #define PBDRV_CONFIG_LED                            (1)
@@ -21,6 +21,9 @@
 
 #define PBDRV_CONFIG_MOTOR                          (1)
 #define PBDRV_CONFIG_HAS_PORT_A                     (1)
+#define PBDRV_CONFIG_HAS_PORT_B                     (1)
+#define PBDRV_CONFIG_HAS_PORT_C                     (1)
+#define PBDRV_CONFIG_HAS_PORT_D                     (1)
 #define PBDRV_CONFIG_FIRST_MOTOR_PORT               PBIO_PORT_A
-#define PBDRV_CONFIG_LAST_MOTOR_PORT                PBIO_PORT_A
-#define PBDRV_CONFIG_NUM_MOTOR_CONTROLLER           (1)
+#define PBDRV_CONFIG_LAST_MOTOR_PORT                PBIO_PORT_D
+#define PBDRV_CONFIG_NUM_MOTOR_CONTROLLER           (4)
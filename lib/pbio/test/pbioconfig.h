@@ -8,3 +8,12 @@
 
 #define PBIO_CONFIG_UARTDEV                 (1)
 #define PBIO_CONFIG_UARTDEV_NUM_DEV         (1)
+#define PBIO_CONFIG_UARTDEV_STATS           (1)
+
+#define PBIO_CONFIG_MOTORPOLL_STATS         (1)
+
+#define PBIO_CONFIG_MOTORCMD                (1)
+
+#define PBIO_CONFIG_NUM_DRIVEBASES          (2)
+
+#define PBIO_CONFIG_SERVO_OBSERVER          (1)
@@ -0,0 +1,83 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <contiki.h>
+#include <tinytest.h>
+#include <tinytest_macros.h>
+
+#include <pbdrv/core.h>
+#include <pbio/control.h>
+#include <pbio/drivebase.h>
+#include <pbio/error.h>
+#include <pbio/motorpoll.h>
+#include <pbio/servo.h>
+
+#include "../test-pbio.h"
+
+void test_drivebase_pool(void *env) {
+    pbio_servo_t *srv[4];
+    pbio_drivebase_t *db_chassis, *db_turret, *db;
+    int32_t distance, angle, unused;
+
+    pbdrv_init();
+    _pbio_motorpoll_reset_all();
+
+    for (int i = 0; i < 4; i++) {
+        pbio_test_motor_sim_init(PBIO_PORT_A + i, &pbio_test_motor_sim_params_default, 0);
+    }
+    pbio_test_motor_sim_step(0);
+
+    for (int i = 0; i < 4; i++) {
+        tt_uint_op(pbio_motorpoll_get_servo(PBIO_PORT_A + i, &srv[i]), ==, PBIO_SUCCESS);
+        tt_uint_op(pbio_servo_setup(srv[i], i % 2 ? PBIO_DIRECTION_CLOCKWISE : PBIO_DIRECTION_COUNTERCLOCKWISE, F16C(1, 0)), ==, PBIO_SUCCESS);
+    }
+
+    // each pair of servos gets its own drivebase
+    tt_uint_op(pbio_motorpoll_get_drivebase(srv[0], srv[1], &db_chassis), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_drivebase_setup(db_chassis, srv[0], srv[1], F16C(56, 0), F16C(112, 0)), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_motorpoll_set_drivebase_status(db_chassis, PBIO_ERROR_AGAIN), ==, PBIO_SUCCESS);
+
+    tt_uint_op(pbio_motorpoll_get_drivebase(srv[2], srv[3], &db_turret), ==, PBIO_SUCCESS);
+    tt_ptr_op(db_turret, !=, db_chassis);
+    tt_uint_op(pbio_drivebase_setup(db_turret, srv[2], srv[3], F16C(56, 0), F16C(112, 0)), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_motorpoll_set_drivebase_status(db_turret, PBIO_ERROR_AGAIN), ==, PBIO_SUCCESS);
+
+    // a servo belongs to at most one drivebase
+    tt_uint_op(pbio_motorpoll_get_drivebase(srv[1], srv[0], &db), ==, PBIO_SUCCESS);
+    tt_ptr_op(db, ==, db_chassis);
+    tt_uint_op(pbio_motorpoll_get_drivebase(srv[1], srv[2], &db), ==, PBIO_ERROR_INVALID_OP);
+
+    // both drivebases run at the same time
+    tt_uint_op(pbio_drivebase_straight(db_chassis, 200, 200, 400), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_drivebase_turn(db_turret, 90, 200, 400), ==, PBIO_SUCCESS);
+
+    for (int i = 0; i < 5000 / PBIO_CONFIG_SERVO_PERIOD_MS; i++) {
+        if (pbio_control_is_done(&db_chassis->control_distance) && pbio_control_is_done(&db_turret->control_heading)) {
+            break;
+        }
+        pbio_test_motor_sim_step(PBIO_CONFIG_SERVO_PERIOD_MS * 1000);
+        clock_tick(clock_from_msec(PBIO_CONFIG_SERVO_PERIOD_MS));
+        _pbio_motorpoll_poll();
+    }
+    tt_uint_op(pbio_motorpoll_get_drivebase_status(db_chassis), ==, PBIO_ERROR_AGAIN);
+    tt_uint_op(pbio_motorpoll_get_drivebase_status(db_turret), ==, PBIO_ERROR_AGAIN);
+
+    tt_uint_op(pbio_drivebase_get_state(db_chassis, &distance, &unused, &angle, &unused), ==, PBIO_SUCCESS);
+    tt_want_int_op(abs(distance - 200), <=, 2);
+    tt_want_int_op(abs(angle), <=, 2);
+
+    tt_uint_op(pbio_drivebase_get_state(db_turret, &distance, &unused, &angle, &unused), ==, PBIO_SUCCESS);
+    tt_want_int_op(abs(distance), <=, 2);
+    tt_want_int_op(abs(angle - 90), <=, 2);
+
+    // resetting releases all drivebases
+    _pbio_motorpoll_reset_all();
+    tt_uint_op(pbio_motorpoll_get_drivebase(srv[2], srv[3], &db), ==, PBIO_SUCCESS);
+    tt_ptr_op(db, ==, db_chassis);
+
+end:
+    ;
+}
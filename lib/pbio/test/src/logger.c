@@ -0,0 +1,95 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+#include <stdint.h>
+
+#include <contiki.h>
+#include <tinytest.h>
+#include <tinytest_macros.h>
+
+#include <pbio/error.h>
+#include <pbio/logger.h>
+
+#define TEST_LOG_COLS (NUM_DEFAULT_LOG_VALUES + 1)
+#define TEST_LOG_ROWS (4)
+
+// Logs one row, with the given value after the timestamp
+static void test_log_value(pbio_log_t *log, int32_t value) {
+    clock_tick(clock_from_msec(10));
+    tt_want_int_op(pbio_logger_update(log, &value), ==, PBIO_SUCCESS);
+}
+
+void test_logger_linear(void *env) {
+    pbio_log_t log = { .num_values = TEST_LOG_COLS };
+    int32_t buf[TEST_LOG_ROWS * TEST_LOG_COLS];
+    int32_t row[TEST_LOG_COLS];
+
+    pbio_logger_start(&log, buf, TEST_LOG_ROWS, 1);
+    for (int32_t i = 0; i < TEST_LOG_ROWS + 2; i++) {
+        test_log_value(&log, i);
+    }
+
+    // logging stops when the buffer is full
+    tt_want(!log.active);
+    tt_want_int_op(pbio_logger_rows(&log), ==, TEST_LOG_ROWS);
+    tt_want_int_op(pbio_logger_read(&log, 0, row), ==, PBIO_SUCCESS);
+    tt_want_int_op(row[0], ==, 10);
+    tt_want_int_op(row[1], ==, 0);
+    tt_want_int_op(pbio_logger_read(&log, -1, row), ==, PBIO_SUCCESS);
+    tt_want_int_op(row[1], ==, TEST_LOG_ROWS - 1);
+    tt_want_int_op(pbio_logger_read(&log, TEST_LOG_ROWS, row), ==, PBIO_ERROR_INVALID_ARG);
+}
+
+void test_logger_circular(void *env) {
+    pbio_log_t log = { .num_values = TEST_LOG_COLS };
+    int32_t buf[TEST_LOG_ROWS * TEST_LOG_COLS];
+    int32_t out[TEST_LOG_ROWS * TEST_LOG_COLS];
+    int32_t row[TEST_LOG_COLS];
+    uint32_t rows;
+
+    pbio_logger_start_circular(&log, buf, TEST_LOG_ROWS, 1);
+
+    // drain a partially filled log
+    test_log_value(&log, 0);
+    test_log_value(&log, 1);
+    tt_want_int_op(pbio_logger_drain(&log, out, TEST_LOG_ROWS, &rows), ==, PBIO_SUCCESS);
+    tt_want_int_op(rows, ==, 2);
+    tt_want_int_op(out[1], ==, 0);
+    tt_want_int_op(out[TEST_LOG_COLS + 1], ==, 1);
+
+    // nothing new to drain
+    tt_want_int_op(pbio_logger_drain(&log, out, TEST_LOG_ROWS, &rows), ==, PBIO_SUCCESS);
+    tt_want_int_op(rows, ==, 0);
+
+    // wrap around, but drain before anything is lost
+    for (int32_t i = 2; i < 5; i++) {
+        test_log_value(&log, i);
+    }
+    tt_want(log.active);
+    tt_want_int_op(pbio_logger_drain(&log, out, 2, &rows), ==, PBIO_SUCCESS);
+    tt_want_int_op(rows, ==, 2);
+    tt_want_int_op(out[1], ==, 2);
+    tt_want_int_op(out[TEST_LOG_COLS + 1], ==, 3);
+    tt_want_int_op(pbio_logger_drain(&log, out, TEST_LOG_ROWS, &rows), ==, PBIO_SUCCESS);
+    tt_want_int_op(rows, ==, 1);
+    tt_want_int_op(out[1], ==, 4);
+
+    // overrun the buffer, losing the oldest rows
+    for (int32_t i = 5; i < 15; i++) {
+        test_log_value(&log, i);
+    }
+    tt_want_int_op(pbio_logger_rows(&log), ==, TEST_LOG_ROWS);
+    tt_want_int_op(pbio_logger_read(&log, 0, row), ==, PBIO_SUCCESS);
+    tt_want_int_op(row[1], ==, 11);
+    tt_want_int_op(pbio_logger_read(&log, -1, row), ==, PBIO_SUCCESS);
+    tt_want_int_op(row[1], ==, 14);
+    tt_want_int_op(pbio_logger_drain(&log, out, TEST_LOG_ROWS, &rows), ==, PBIO_SUCCESS);
+    tt_want_int_op(rows, ==, TEST_LOG_ROWS);
+    tt_want_int_op(pbio_logger_dropped(&log), ==, 6);
+    for (uint32_t i = 0; i < TEST_LOG_ROWS; i++) {
+        tt_want_int_op(out[i * TEST_LOG_COLS + 1], ==, 11 + i);
+    }
+
+    // timestamps keep increasing
+    tt_want_int_op(out[TEST_LOG_COLS], ==, out[0] + 10);
+}
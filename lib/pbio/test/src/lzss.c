@@ -0,0 +1,74 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+#include <stdint.h>
+#include <string.h>
+
+#include <tinytest.h>
+#include <tinytest_macros.h>
+
+#include <pbio/lzss.h>
+
+// Made with tools/lzss.py
+static const uint8_t test_compressed[] = {
+    0xa8, 0x5e, 0x6c, 0x57, 0x2b, 0x4d, 0x8e, 0xd7, 0x73, 0x90,
+    0x02, 0x3e, 0xe7, 0x21, 0x90, 0x58, 0x40, 0x1e, 0x00, 0x70,
+};
+
+// Has literals, back-references and back-references that overlap themselves
+static const char test_text[] = "Pybricks Pybricks Pybricks! aaaaaaaaaaaaaaaaaaaaaaaaa";
+
+void test_lzss_decode(void *env) {
+    pbio_lzss_t lz;
+    uint8_t out[sizeof(test_text) + 8];
+    size_t in_len, out_len;
+
+    // all at once
+    pbio_lzss_init(&lz);
+    in_len = sizeof(test_compressed);
+    out_len = sizeof(out);
+    pbio_lzss_decode(&lz, test_compressed, &in_len, out, &out_len);
+    tt_want_int_op(in_len, ==, sizeof(test_compressed));
+    tt_want_int_op(out_len, ==, strlen(test_text));
+    tt_want(memcmp(out, test_text, strlen(test_text)) == 0);
+
+    // nothing more comes out at the end of the data
+    in_len = 0;
+    out_len = sizeof(out);
+    pbio_lzss_decode(&lz, test_compressed, &in_len, out, &out_len);
+    tt_want_int_op(out_len, ==, 0);
+
+    // one byte in at a time, as if it arrives in small pieces
+    pbio_lzss_init(&lz);
+    memset(out, 0, sizeof(out));
+    size_t total = 0;
+    for (size_t i = 0; i < sizeof(test_compressed); i++) {
+        in_len = 1;
+        out_len = sizeof(out) - total;
+        pbio_lzss_decode(&lz, &test_compressed[i], &in_len, &out[total], &out_len);
+        tt_want_int_op(in_len, ==, 1);
+        total += out_len;
+    }
+    tt_want_int_op(total, ==, strlen(test_text));
+    tt_want(memcmp(out, test_text, strlen(test_text)) == 0);
+
+    // one byte out at a time, as the MicroPython reader does
+    pbio_lzss_init(&lz);
+    memset(out, 0, sizeof(out));
+    const uint8_t *in = test_compressed;
+    const uint8_t *end = test_compressed + sizeof(test_compressed);
+    total = 0;
+    for (;;) {
+        in_len = end - in;
+        out_len = 1;
+        pbio_lzss_decode(&lz, in, &in_len, &out[total], &out_len);
+        in += in_len;
+        if (out_len == 0) {
+            break;
+        }
+        total += out_len;
+    }
+    tt_want(in == end);
+    tt_want_int_op(total, ==, strlen(test_text));
+    tt_want(memcmp(out, test_text, strlen(test_text)) == 0);
+}
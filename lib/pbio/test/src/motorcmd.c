@@ -0,0 +1,209 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <tinytest.h>
+#include <tinytest_macros.h>
+
+#include <contiki.h>
+
+#include <pbdrv/core.h>
+#include <pbio/motorcmd.h>
+#include <pbio/motorpoll.h>
+#include <pbio/servo.h>
+
+#include "../test-pbio.h"
+
+// The control loop runs on the test thread, so there is nothing to lock
+static int lock_count;
+
+void pbio_lock(void) {
+    lock_count++;
+}
+
+void pbio_unlock(void) {
+}
+
+#define TEST_QUEUE_COUNT (100000)
+
+static pbio_motorcmd_queue_t test_queue;
+
+// Pushes increasing numbers to the queue, waiting whenever it is full
+static void *test_queue_producer(void *arg) {
+    pbio_motorcmd_t cmd = { .type = PBIO_MOTORCMD_SERVO_RUN };
+    for (int32_t i = 0; i < TEST_QUEUE_COUNT; i++) {
+        cmd.args[0] = i;
+        cmd.args[2] = -i;
+        while (!pbio_motorcmd_queue_push(&test_queue, &cmd)) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+void test_motorcmd_queue(void *env) {
+    pbio_motorcmd_t cmd = { .type = PBIO_MOTORCMD_SERVO_RUN };
+    pthread_t producer;
+
+    pbio_motorcmd_queue_init(&test_queue);
+    tt_want(!pbio_motorcmd_queue_pop(&test_queue, &cmd));
+
+    // first in, first out, up to the size of the queue
+    for (int32_t i = 0; i < PBIO_CONFIG_MOTORCMD_QUEUE_SIZE; i++) {
+        cmd.args[0] = i;
+        tt_want(pbio_motorcmd_queue_push(&test_queue, &cmd));
+    }
+    tt_want(!pbio_motorcmd_queue_push(&test_queue, &cmd));
+    tt_want(pbio_motorcmd_queue_pop(&test_queue, &cmd));
+    tt_want_int_op(cmd.args[0], ==, 0);
+    tt_want(pbio_motorcmd_queue_push(&test_queue, &cmd));
+    for (int32_t i = 1; i < PBIO_CONFIG_MOTORCMD_QUEUE_SIZE; i++) {
+        tt_want(pbio_motorcmd_queue_pop(&test_queue, &cmd));
+        tt_want_int_op(cmd.args[0], ==, i);
+    }
+    tt_want(pbio_motorcmd_queue_pop(&test_queue, &cmd));
+    tt_want(!pbio_motorcmd_queue_pop(&test_queue, &cmd));
+
+    // counters wrap around without losing track of the size
+    test_queue.head = test_queue.tail = UINT32_MAX - 2;
+    for (int32_t i = 0; i < PBIO_CONFIG_MOTORCMD_QUEUE_SIZE; i++) {
+        cmd.args[0] = i;
+        tt_want(pbio_motorcmd_queue_push(&test_queue, &cmd));
+    }
+    tt_want(!pbio_motorcmd_queue_push(&test_queue, &cmd));
+    for (int32_t i = 0; i < PBIO_CONFIG_MOTORCMD_QUEUE_SIZE; i++) {
+        tt_want(pbio_motorcmd_queue_pop(&test_queue, &cmd));
+        tt_want_int_op(cmd.args[0], ==, i);
+    }
+
+    // commands arrive complete and in order when pushed from another thread
+    pbio_motorcmd_queue_init(&test_queue);
+    tt_assert(pthread_create(&producer, NULL, test_queue_producer, NULL) == 0);
+    for (int32_t i = 0; i < TEST_QUEUE_COUNT; i++) {
+        while (!pbio_motorcmd_queue_pop(&test_queue, &cmd)) {
+            sched_yield();
+        }
+        if (cmd.args[0] != i || cmd.args[2] != -i) {
+            tt_fail_msg("command out of order or incomplete");
+            break;
+        }
+    }
+    pthread_join(producer, NULL);
+
+end:
+    ;
+}
+
+// Runs the control loop for the given time
+static void test_motorcmd_run(int32_t duration) {
+    for (int32_t time = 0; time < duration; time += PBIO_CONFIG_SERVO_PERIOD_MS) {
+        pbio_test_motor_sim_step(PBIO_CONFIG_SERVO_PERIOD_MS * 1000);
+        clock_tick(clock_from_msec(PBIO_CONFIG_SERVO_PERIOD_MS));
+        _pbio_motorpoll_poll();
+    }
+}
+
+void test_motorcmd_servo(void *env) {
+    pbio_servo_t *servo;
+    int32_t angle, speed, duty;
+    bool done;
+
+    pbdrv_init();
+    _pbio_motorpoll_reset_all();
+
+    pbio_test_motor_sim_init(PBIO_PORT_A, &pbio_test_motor_sim_params_default, 0);
+    pbio_test_motor_sim_step(0);
+
+    tt_uint_op(pbio_motorpoll_get_servo(PBIO_PORT_A, &servo), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_servo_setup(servo, PBIO_DIRECTION_CLOCKWISE, F16C(1, 0)), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_motorpoll_set_servo_status(servo, PBIO_ERROR_AGAIN), ==, PBIO_SUCCESS);
+    _pbio_motorpoll_publish();
+
+    // idle servo is done
+    tt_uint_op(pbio_motorcmd_servo_get_status(servo, &done), ==, PBIO_ERROR_AGAIN);
+    tt_want(done);
+    tt_uint_op(pbio_motorcmd_servo_get_state_user(servo, &angle, &speed, &duty), ==, PBIO_SUCCESS);
+    tt_want_int_op(angle, ==, 0);
+
+    // command does nothing until the control loop picks it up
+    tt_uint_op(pbio_motorcmd_servo_run_angle(servo, 500, 180, PBIO_ACTUATION_HOLD), ==, PBIO_SUCCESS);
+    tt_want(pbio_control_is_done(&servo->control));
+    tt_uint_op(pbio_motorcmd_servo_get_status(servo, &done), ==, PBIO_ERROR_AGAIN);
+    tt_want(!done);
+
+    test_motorcmd_run(PBIO_CONFIG_SERVO_PERIOD_MS);
+    tt_want(!pbio_control_is_done(&servo->control));
+    tt_uint_op(pbio_motorcmd_servo_get_status(servo, &done), ==, PBIO_ERROR_AGAIN);
+    tt_want(!done);
+
+    test_motorcmd_run(2000);
+    tt_uint_op(pbio_motorcmd_servo_get_status(servo, &done), ==, PBIO_ERROR_AGAIN);
+    tt_want(done);
+    tt_uint_op(pbio_motorcmd_servo_get_state_user(servo, &angle, &speed, &duty), ==, PBIO_SUCCESS);
+    tt_want_int_op(abs(angle - 180), <=, 5);
+    static int32_t value;
+    tt_uint_op(pbio_motorcmd_servo_get_angle(servo, &value), ==, PBIO_SUCCESS);
+    tt_want_int_op(value, ==, angle);
+    tt_uint_op(pbio_motorcmd_servo_get_speed(servo, &value), ==, PBIO_SUCCESS);
+    tt_want_int_op(value, ==, speed);
+
+    // state is only updated by the control loop
+    tt_uint_op(pbio_servo_reset_angle(servo, 0, false), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_motorcmd_servo_get_state_user(servo, &angle, &speed, &duty), ==, PBIO_SUCCESS);
+    tt_want_int_op(abs(angle - 180), <=, 5);
+    _pbio_motorpoll_publish();
+    tt_uint_op(pbio_motorcmd_servo_get_state_user(servo, &angle, &speed, &duty), ==, PBIO_SUCCESS);
+    tt_want_int_op(abs(angle), <=, 1);
+
+    // publishing does not read the counter again, so the motor moving in the
+    // meantime does not show up until the control loop runs
+    static int32_t angle_then;
+    tt_uint_op(pbio_motorcmd_servo_run(servo, 500), ==, PBIO_SUCCESS);
+    test_motorcmd_run(200);
+    tt_uint_op(pbio_motorcmd_servo_get_state_user(servo, &angle_then, &speed, &duty), ==, PBIO_SUCCESS);
+    tt_want_int_op(angle_then, >, 0);
+    pbio_test_motor_sim_step(100 * 1000);
+    _pbio_motorpoll_publish();
+    tt_uint_op(pbio_motorcmd_servo_get_state_user(servo, &angle, &speed, &duty), ==, PBIO_SUCCESS);
+    tt_want_int_op(angle, ==, angle_then);
+    test_motorcmd_run(PBIO_CONFIG_SERVO_PERIOD_MS);
+    tt_uint_op(pbio_motorcmd_servo_get_state_user(servo, &angle, &speed, &duty), ==, PBIO_SUCCESS);
+    tt_want_int_op(angle, >, angle_then);
+    tt_uint_op(pbio_motorcmd_servo_stop(servo, PBIO_ACTUATION_COAST), ==, PBIO_SUCCESS);
+    test_motorcmd_run(PBIO_CONFIG_SERVO_PERIOD_MS);
+
+    // a failed command is reported once, after the control loop ran it
+    servo->claimed = true;
+    tt_uint_op(pbio_motorcmd_servo_run(servo, 500), ==, PBIO_SUCCESS);
+    test_motorcmd_run(PBIO_CONFIG_SERVO_PERIOD_MS);
+    tt_uint_op(pbio_motorcmd_servo_get_status(servo, &done), ==, PBIO_ERROR_INVALID_OP);
+    tt_want(done);
+    tt_uint_op(pbio_motorcmd_servo_get_status(servo, &done), ==, PBIO_ERROR_AGAIN);
+    tt_want(done);
+    tt_uint_op(pbio_motorcmd_servo_run(servo, 500), ==, PBIO_SUCCESS);
+    test_motorcmd_run(PBIO_CONFIG_SERVO_PERIOD_MS);
+    tt_uint_op(pbio_motorcmd_servo_run(servo, 500), ==, PBIO_ERROR_INVALID_OP);
+    servo->claimed = false;
+
+    // a full queue is processed by the posting thread while holding the lock
+    lock_count = 0;
+    for (int i = 0; i < PBIO_CONFIG_MOTORCMD_QUEUE_SIZE; i++) {
+        tt_uint_op(pbio_motorcmd_servo_run(servo, i), ==, PBIO_SUCCESS);
+    }
+    tt_want_int_op(lock_count, ==, 0);
+    tt_uint_op(pbio_motorcmd_servo_run(servo, 100), ==, PBIO_SUCCESS);
+    tt_want_int_op(lock_count, ==, 1);
+
+    // resetting the control loop drops the commands that did not run yet
+    _pbio_motorpoll_reset_all();
+    tt_uint_op(pbio_motorcmd_servo_get_status(servo, &done), ==, PBIO_ERROR_AGAIN);
+    tt_want(done);
+
+end:
+    ;
+}
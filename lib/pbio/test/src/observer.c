@@ -0,0 +1,90 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <tinytest.h>
+#include <tinytest_macros.h>
+
+#include <pbdrv/motor.h>
+#include <pbio/observer.h>
+#include <pbio/trajectory.h>
+
+#include "../test-pbio.h"
+
+#define TEST_PERIOD (6 * US_PER_MS)
+
+// Model that matches the default simulated motor
+static const pbio_observer_model_t test_model = {
+    .rate_max = 1200,
+    .damping = 20,
+    .friction = 1920,
+    .bandwidth = 10,
+};
+
+/**
+ * Runs the simulated motor with the given duty cycles, one second each, and
+ * compares the measured and estimated speeds to the real speed.
+ * @param [in]  params          The simulated motor parameters
+ * @param [in]  duty_steps      The duty cycles
+ * @param [in]  num_steps       The number of duty cycles
+ * @param [out] rms_measured    RMS error of the measured speed
+ * @param [out] rms_estimated   RMS error of the estimated speed
+ */
+static void run_observer(const pbio_test_motor_sim_params_t *params, const int32_t *duty_steps, int32_t num_steps, double *rms_measured, double *rms_estimated) {
+    pbio_observer_t obs;
+    pbio_observer_setup(&obs, &test_model);
+    pbio_test_motor_sim_init(PBIO_PORT_A, params, 0);
+
+    double sum_sq_measured = 0;
+    double sum_sq_estimated = 0;
+    int32_t samples = 0;
+
+    for (int32_t time = 0; time < num_steps * US_PER_SECOND; time += TEST_PERIOD) {
+        int32_t duty = duty_steps[time / US_PER_SECOND];
+        pbdrv_motor_set_duty_cycle(PBIO_PORT_A, duty);
+        pbio_test_motor_sim_step(TEST_PERIOD);
+
+        // Quantize the state like the simulated counter does
+        double angle, speed;
+        pbio_test_motor_sim_get_state(PBIO_PORT_A, &angle, &speed);
+        int32_t count = floor(angle);
+        int32_t rate = lround(speed / params->rate_resolution) * params->rate_resolution;
+
+        pbio_observer_update(&obs, time + TEST_PERIOD, count, rate, duty, false);
+
+        int32_t count_est, rate_est, disturbance_est;
+        pbio_observer_get_estimated_state(&obs, &count_est, &rate_est, &disturbance_est);
+        tt_want_int_op(abs(count_est - count), <=, 2);
+
+        // Compare during the second half of each step, when the estimate has settled
+        if (time % US_PER_SECOND >= US_PER_SECOND / 2) {
+            sum_sq_measured += (rate - speed) * (rate - speed);
+            sum_sq_estimated += (rate_est - speed) * (rate_est - speed);
+            samples++;
+        }
+    }
+
+    *rms_measured = sqrt(sum_sq_measured / samples);
+    *rms_estimated = sqrt(sum_sq_estimated / samples);
+}
+
+void test_observer_speed(void *env) {
+    double rms_measured, rms_estimated;
+
+    // Slow motion, where the speed resolution of the motor is coarse. The
+    // estimate should be closer to the real speed than the measured speed.
+    static const int32_t duty_slow[] = { 0, 850, 900, 830, -870, -850, 0 };
+    run_observer(&pbio_test_motor_sim_params_default, duty_slow, 7, &rms_measured, &rms_estimated);
+    tt_want(rms_estimated < rms_measured * 2 / 3);
+
+    // Faster motion with an external load that is not in the model. The
+    // estimate should settle to within the speed resolution of the motor.
+    pbio_test_motor_sim_params_t params = pbio_test_motor_sim_params_default;
+    params.load = 0.05;
+    static const int32_t duty_fast[] = { 0, 6000, -3000, 8000, 2000, 0 };
+    run_observer(&params, duty_fast, 6, &rms_measured, &rms_estimated);
+    tt_want(rms_estimated < params.rate_resolution);
+}
@@ -15,6 +15,7 @@
 #include <tinytest.h>
 #include <tinytest_macros.h>
 
+#include <pbdrv/core.h>
 #include <pbio/control.h>
 #include <pbio/error.h>
 #include <pbio/logger.h>
@@ -26,48 +27,6 @@
 // wait an additional 1 second before ending test
 #define TEST_END_COUNT 1000 // clock ticks
 
-// Motor driver implementation
-
-typedef enum {
-    H_BRIDGE_OUTPUT_LL,
-    H_BRIDGE_OUTPUT_LH,
-    H_BRIDGE_OUTPUT_HL,
-    H_BRIDGE_OUTPUT_HH,
-} h_bridge_output_t;
-
-static struct {
-    uint16_t duty_cycle;
-    h_bridge_output_t output;
-} test_motor_driver;
-
-pbio_error_t pbdrv_motor_coast(pbio_port_t port) {
-    test_motor_driver.output = H_BRIDGE_OUTPUT_LL;
-    test_motor_driver.duty_cycle = 0;
-    return PBIO_SUCCESS;
-}
-
-pbio_error_t pbdrv_motor_set_duty_cycle(pbio_port_t port, int16_t duty_cycle) {
-    if (duty_cycle > 0) {
-        test_motor_driver.output = H_BRIDGE_OUTPUT_LH;
-    } else if (duty_cycle < 0) {
-        test_motor_driver.output = H_BRIDGE_OUTPUT_HL;
-    } else {
-        test_motor_driver.output = H_BRIDGE_OUTPUT_HH;
-    }
-    test_motor_driver.duty_cycle = abs(duty_cycle);
-    return PBIO_SUCCESS;
-}
-
-pbio_error_t pbdrv_motor_get_id(pbio_port_t port, pbio_iodev_type_id_t *id) {
-    const char *motor_id = getenv("PBIO_TEST_MOTOR_TYPE");
-    *id = motor_id == NULL ? PBIO_IODEV_TYPE_ID_INTERACTIVE_MOTOR : atoi(motor_id);
-    return PBIO_SUCCESS;
-}
-
-pbio_error_t pbdrv_motor_setup(pbio_port_t port, bool is_servo) {
-    return PBIO_SUCCESS;
-}
-
 // Tests
 
 /**
@@ -81,6 +40,8 @@ static PT_THREAD(test_servo_run_func(struct pt *pt, const char *name, pbio_error
     static int32_t *log_buf = NULL;
     static FILE *log_file;
     static uint32_t control_done_count;
+    pbio_test_h_bridge_output_t output;
+    uint16_t duty_cycle;
 
     PT_BEGIN(pt);
 
@@ -201,8 +162,9 @@ static PT_THREAD(test_servo_run_func(struct pt *pt, const char *name, pbio_error
             // it to get a more accurate test
             if (motor_sim_pid) {
                 // write current output state to the motor simulator
-                fprintf(motor_sim_in, "%d ", test_motor_driver.output);
-                fprintf(motor_sim_in, "%d ", test_motor_driver.duty_cycle);
+                pbio_test_motor_get_output(PBIO_PORT_A, &output, &duty_cycle);
+                fprintf(motor_sim_in, "%d ", output);
+                fprintf(motor_sim_in, "%d ", duty_cycle);
                 fprintf(motor_sim_in, "\n");
 
                 // need to check if child process is still running, otherwise
@@ -254,9 +216,10 @@ static PT_THREAD(test_servo_run_func(struct pt *pt, const char *name, pbio_error
 
             // write current state to log file
             if (pbio_logger_rows(&servo->control.log)) {
+                pbio_test_motor_get_output(PBIO_PORT_A, &output, &duty_cycle);
                 fprintf(log_file, "%d,", clock_to_msec(clock_time()));
-                fprintf(log_file, "%d,", test_motor_driver.output);
-                fprintf(log_file, "%d,", test_motor_driver.duty_cycle);
+                fprintf(log_file, "%d,", output);
+                fprintf(log_file, "%d,", duty_cycle);
 
                 for (int i = 0; i < pbio_logger_cols(&servo->control.log); i++) {
                     fprintf(log_file, "%d,", log_buf[i]);
@@ -323,3 +286,235 @@ PT_THREAD(test_servo_run_time(struct pt *pt)) {
 
     PT_END(pt);
 }
+
+void test_motorpoll_stats(void *env) {
+    pbio_servo_t *servo;
+    const pbio_motorpoll_stats_t *stats = pbio_motorpoll_get_stats();
+
+    pbdrv_init();
+    _pbio_motorpoll_reset_all();
+
+    tt_uint_op(pbio_motorpoll_get_servo(PBIO_PORT_A, &servo), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_servo_setup(servo, PBIO_DIRECTION_CLOCKWISE, F16C(1, 0)), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_motorpoll_set_servo_status(servo, PBIO_ERROR_AGAIN), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_servo_run(servo, 500), ==, PBIO_SUCCESS);
+
+    // nothing is recorded until the loop runs
+    tt_uint_op(stats->period.count, ==, 0);
+    tt_uint_op(stats->servo[0].count, ==, 0);
+
+    // 10 polls on time, then one late by two periods
+    for (int i = 0; i < 10; i++) {
+        _pbio_motorpoll_poll();
+        clock_tick(clock_from_msec(PBIO_CONFIG_SERVO_PERIOD_MS));
+    }
+    clock_tick(clock_from_msec(2 * PBIO_CONFIG_SERVO_PERIOD_MS));
+    _pbio_motorpoll_poll();
+
+    // first poll has no previous poll to measure the period against
+    tt_uint_op(stats->period.count, ==, 10);
+    tt_uint_op(stats->period.bins[PBIO_CONFIG_SERVO_PERIOD_MS * 1000 / PBIO_MOTORPOLL_STATS_PERIOD_BIN_US], ==, 9);
+    tt_uint_op(stats->period.bins[PBIO_MOTORPOLL_STATS_NUM_BINS - 1], ==, 1);
+    tt_uint_op(stats->period.max, ==, 3 * PBIO_CONFIG_SERVO_PERIOD_MS * 1000);
+    tt_uint_op(stats->overruns, ==, 1);
+
+    // only the active servo is timed
+    tt_uint_op(stats->servo[0].count, ==, 11);
+    tt_uint_op(stats->servo[1].count, ==, 0);
+    tt_uint_op(stats->drivebase[0].count, ==, 0);
+
+    pbio_motorpoll_reset_stats();
+    tt_uint_op(stats->period.count, ==, 0);
+    tt_uint_op(stats->servo[0].count, ==, 0);
+    tt_uint_op(stats->overruns, ==, 0);
+
+end:
+    ;
+}
+
+void test_servo_queue_target(void *env) {
+    pbio_servo_t *servo;
+    int32_t angle, time_ref, count_ref, rate_ref, unused;
+    int32_t min_rate_through_waypoint = INT32_MAX;
+    bool reversed = false;
+
+    pbdrv_init();
+    _pbio_motorpoll_reset_all();
+
+    pbio_test_motor_sim_init(PBIO_PORT_A, &pbio_test_motor_sim_params_default, 0);
+    pbio_test_motor_sim_step(0);
+
+    tt_uint_op(pbio_motorpoll_get_servo(PBIO_PORT_A, &servo), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_servo_setup(servo, PBIO_DIRECTION_CLOCKWISE, F16C(1, 0)), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_motorpoll_set_servo_status(servo, PBIO_ERROR_AGAIN), ==, PBIO_SUCCESS);
+
+    // first target starts right away, the others are queued
+    tt_uint_op(pbio_servo_queue_target(servo, 500, 180, PBIO_ACTUATION_HOLD), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_servo_queue_target(servo, 500, 360, PBIO_ACTUATION_HOLD), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_servo_queue_target(servo, 500, 90, PBIO_ACTUATION_HOLD), ==, PBIO_SUCCESS);
+    tt_uint_op(servo->control.queue.count, ==, 2);
+
+    // fill up the queue
+    for (int i = servo->control.queue.count; i < PBIO_CONFIG_CONTROL_QUEUE_SIZE; i++) {
+        tt_uint_op(pbio_servo_queue_target(servo, 500, 90, PBIO_ACTUATION_HOLD), ==, PBIO_SUCCESS);
+    }
+    tt_uint_op(pbio_servo_queue_target(servo, 500, 90, PBIO_ACTUATION_HOLD), ==, PBIO_ERROR_AGAIN);
+
+    for (int i = 0; i < 5000 / PBIO_CONFIG_SERVO_PERIOD_MS && !pbio_control_is_done(&servo->control); i++) {
+        pbio_test_motor_sim_step(PBIO_CONFIG_SERVO_PERIOD_MS * 1000);
+        clock_tick(clock_from_msec(PBIO_CONFIG_SERVO_PERIOD_MS));
+        _pbio_motorpoll_poll();
+
+        time_ref = pbio_control_get_ref_time(&servo->control, clock_usecs());
+        pbio_trajectory_get_reference(&servo->control.trajectory, time_ref, &count_ref, &unused, &rate_ref, &unused);
+
+        // the reference should not stop at the first waypoint on the way to the second
+        if (!reversed && count_ref > 150 && count_ref < 210) {
+            min_rate_through_waypoint = min(min_rate_through_waypoint, rate_ref);
+        }
+        reversed |= rate_ref < 0;
+    }
+
+    tt_want(pbio_control_is_done(&servo->control));
+    tt_want(reversed);
+    tt_want_int_op(min_rate_through_waypoint, >, 250);
+
+    tt_uint_op(pbio_tacho_get_angle(servo->tacho, &angle), ==, PBIO_SUCCESS);
+    tt_want_int_op(abs(angle - 90), <=, 5);
+
+    // a new command discards the queue
+    tt_uint_op(pbio_servo_queue_target(servo, 500, 180, PBIO_ACTUATION_HOLD), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_servo_queue_target(servo, 500, 360, PBIO_ACTUATION_HOLD), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_servo_run_target(servo, 500, 0, PBIO_ACTUATION_HOLD), ==, PBIO_SUCCESS);
+    tt_uint_op(servo->control.queue.count, ==, 0);
+
+end:
+    ;
+}
+
+// Records the order in which test callbacks are called
+static int32_t callback_log[16];
+static int32_t callback_log_count;
+
+static pbio_error_t test_callback(void *context) {
+    int32_t *calls_left = context;
+    if (callback_log_count < 16) {
+        callback_log[callback_log_count++] = *calls_left;
+    }
+    return --*calls_left > 0 ? PBIO_ERROR_AGAIN : PBIO_SUCCESS;
+}
+
+void test_motorpoll_schedule(void *env) {
+    pbio_servo_t *servo_a, *servo_b;
+    const pbio_motorpoll_stats_t *stats = pbio_motorpoll_get_stats();
+    const clock_time_t tick = clock_from_msec(PBIO_CONFIG_MOTORPOLL_TICK_MS);
+
+    pbdrv_init();
+    _pbio_motorpoll_reset_all();
+
+    tt_uint_op(pbio_motorpoll_get_servo(PBIO_PORT_A, &servo_a), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_motorpoll_get_servo(PBIO_PORT_B, &servo_b), ==, PBIO_SUCCESS);
+    tt_uint_op(servo_a->control.period, ==, PBIO_CONFIG_SERVO_PERIOD_MS);
+    tt_uint_op(pbio_servo_setup(servo_a, PBIO_DIRECTION_CLOCKWISE, F16C(1, 0)), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_servo_setup(servo_b, PBIO_DIRECTION_CLOCKWISE, F16C(1, 0)), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_motorpoll_set_servo_status(servo_a, PBIO_ERROR_AGAIN), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_motorpoll_set_servo_status(servo_b, PBIO_ERROR_AGAIN), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_servo_run(servo_a, 500), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_servo_run(servo_b, 500), ==, PBIO_SUCCESS);
+
+    // periods must be a multiple of the tick
+    tt_uint_op(pbio_motorpoll_set_servo_schedule(servo_a, 0, 0), ==, PBIO_ERROR_INVALID_ARG);
+    tt_uint_op(pbio_motorpoll_set_servo_schedule(servo_a, PBIO_CONFIG_MOTORPOLL_TICK_MS + 1, 0), ==, PBIO_ERROR_INVALID_ARG);
+
+    // both servos run every other tick, but not in the same tick
+    tt_uint_op(pbio_motorpoll_set_servo_schedule(servo_a, 2 * PBIO_CONFIG_MOTORPOLL_TICK_MS, 0), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_motorpoll_set_servo_schedule(servo_b, 2 * PBIO_CONFIG_MOTORPOLL_TICK_MS, 0), ==, PBIO_SUCCESS);
+
+    // the controller and its logger know the new period
+    tt_uint_op(servo_a->control.period, ==, 2 * PBIO_CONFIG_MOTORPOLL_TICK_MS);
+    tt_uint_op(pbio_logger_period(&servo_a->control.log), ==, 2 * PBIO_CONFIG_MOTORPOLL_TICK_MS);
+
+    _pbio_motorpoll_poll();
+    tt_uint_op(stats->servo[0].count, ==, 1);
+    tt_uint_op(stats->servo[1].count, ==, 0);
+
+    clock_tick(tick);
+    _pbio_motorpoll_poll();
+    tt_uint_op(stats->servo[0].count, ==, 1);
+    tt_uint_op(stats->servo[1].count, ==, 1);
+
+    for (int i = 0; i < 8; i++) {
+        clock_tick(tick);
+        _pbio_motorpoll_poll();
+    }
+    tt_uint_op(stats->servo[0].count, ==, 5);
+    tt_uint_op(stats->servo[1].count, ==, 5);
+
+    // a late poll runs the tasks that were missed once, and keeps the phase
+    clock_tick(2 * tick);
+    _pbio_motorpoll_poll();
+    tt_uint_op(stats->servo[0].count, ==, 6);
+    tt_uint_op(stats->servo[1].count, ==, 6);
+    clock_tick(tick);
+    _pbio_motorpoll_poll();
+    tt_uint_op(stats->servo[0].count, ==, 7);
+    tt_uint_op(stats->servo[1].count, ==, 6);
+    clock_tick(tick);
+    _pbio_motorpoll_poll();
+    tt_uint_op(stats->servo[0].count, ==, 7);
+    tt_uint_op(stats->servo[1].count, ==, 7);
+
+    // callbacks that are due in the same tick run in order of priority, and
+    // stop once they return anything other than PBIO_ERROR_AGAIN
+    static int32_t calls_low, calls_high;
+    calls_low = 2;
+    calls_high = 3;
+    callback_log_count = 0;
+    tt_uint_op(pbio_motorpoll_add_callback(test_callback, &calls_low, PBIO_CONFIG_MOTORPOLL_TICK_MS, 1), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_motorpoll_add_callback(test_callback, &calls_high, PBIO_CONFIG_MOTORPOLL_TICK_MS, 2), ==, PBIO_SUCCESS);
+    for (int i = PBIO_CONFIG_MOTORPOLL_NUM_CALLBACKS; i > 2; i--) {
+        tt_uint_op(pbio_motorpoll_add_callback(test_callback, NULL, PBIO_CONFIG_MOTORPOLL_TICK_MS, 0), ==, PBIO_SUCCESS);
+        tt_uint_op(pbio_motorpoll_remove_callback(test_callback, NULL), ==, PBIO_SUCCESS);
+    }
+    for (int i = 0; i < 4; i++) {
+        clock_tick(tick);
+        _pbio_motorpoll_poll();
+    }
+    tt_uint_op(callback_log_count, ==, 5);
+    tt_uint_op(callback_log[0], ==, 3);
+    tt_uint_op(callback_log[1], ==, 2);
+    tt_uint_op(callback_log[2], ==, 2);
+    tt_uint_op(callback_log[3], ==, 1);
+    tt_uint_op(callback_log[4], ==, 1);
+
+    // finished callbacks make room for new ones
+    for (int i = 0; i < PBIO_CONFIG_MOTORPOLL_NUM_CALLBACKS; i++) {
+        tt_uint_op(pbio_motorpoll_add_callback(test_callback, &calls_low, PBIO_CONFIG_MOTORPOLL_TICK_MS, 0), ==, PBIO_SUCCESS);
+    }
+    tt_uint_op(pbio_motorpoll_add_callback(test_callback, &calls_low, PBIO_CONFIG_MOTORPOLL_TICK_MS, 0), ==, PBIO_ERROR_NO_DEV);
+
+end:
+    ;
+}
+
+void test_servo_get_state_user(void *env) {
+    pbio_servo_t *servo;
+    int32_t angle, speed, duty;
+
+    pbdrv_init();
+    _pbio_motorpoll_reset_all();
+
+    tt_uint_op(pbio_motorpoll_get_servo(PBIO_PORT_A, &servo), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_servo_setup(servo, PBIO_DIRECTION_COUNTERCLOCKWISE, F16C(1, 0)), ==, PBIO_SUCCESS);
+
+    // state is given in user units, from the point of view of the user
+    pbio_test_counter_set_state(0, -90, -360);
+    tt_uint_op(pbio_servo_set_duty_cycle(servo, -40), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_servo_get_state_user(servo, &angle, &speed, &duty), ==, PBIO_SUCCESS);
+    tt_want_int_op(angle, ==, 90);
+    tt_want_int_op(speed, ==, 360);
+    tt_want_int_op(duty, ==, -40);
+
+end:
+    ;
+}
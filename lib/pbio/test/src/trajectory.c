@@ -0,0 +1,136 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <tinytest.h>
+#include <tinytest_macros.h>
+
+#include <pbio/error.h>
+#include <pbio/trajectory.h>
+
+#define TEST_STEP (1000) // us
+
+// Checks that a trajectory starts at the given state, ends at the given count,
+// and that speed and acceleration change no faster than the given limits.
+static void check_trajectory(pbio_trajectory_t *trj, int32_t th0, int32_t w0, int32_t th3, int32_t a, int32_t j) {
+    int32_t count, count_ext, rate, acceleration;
+    int32_t rate_prev = w0;
+    int32_t acceleration_prev = 0;
+
+    pbio_trajectory_get_reference(trj, trj->t0, &count, &count_ext, &rate, &acceleration);
+    tt_want_int_op(abs(count - th0), <=, 1);
+    tt_want_int_op(abs(rate - w0), <=, 1);
+
+    for (int32_t t = trj->t0; t - (trj->t3 + trj->tj) <= 0; t += TEST_STEP) {
+        pbio_trajectory_get_reference(trj, t, &count, &count_ext, &rate, &acceleration);
+
+        // Allow for some round off. The trapezoid that the S-curve is made
+        // from may jump by a count or so between phases, because the phase
+        // durations are rounded to milliseconds.
+        tt_want_int_op(abs(rate - rate_prev), <=, timest(a, TEST_STEP) + 1 + 2 * MS_PER_SECOND * US_PER_MS / trj->tj);
+        tt_want_int_op(abs(acceleration), <=, a + a / 100);
+        tt_want_int_op(abs(acceleration - acceleration_prev), <=, timest(j, TEST_STEP) + j / 100);
+
+        rate_prev = rate;
+        acceleration_prev = acceleration;
+    }
+
+    pbio_trajectory_get_reference(trj, trj->t3 + trj->tj, &count, &count_ext, &rate, &acceleration);
+    tt_want_int_op(abs(count - th3), <=, 1);
+    tt_want_int_op(rate, ==, 0);
+    tt_want_int_op(acceleration, ==, 0);
+}
+
+void test_trajectory_scurve_angle(void *env) {
+    pbio_trajectory_t trj;
+
+    // from standstill, long enough to reach full speed
+    tt_want_int_op(pbio_trajectory_make_angle_based(&trj, 0, 0, 3600, 0, 1000, 1000, 2000, 2000, 20000), ==, PBIO_SUCCESS);
+    tt_want_int_op(trj.tj, ==, 100000);
+    check_trajectory(&trj, 0, 0, 3600, 2000, 20000);
+
+    // short and backward, from a moving start
+    tt_want_int_op(pbio_trajectory_make_angle_based(&trj, 12345, 100, -50, 300, 1000, 1000, 2000, 2000, 40000), ==, PBIO_SUCCESS);
+    check_trajectory(&trj, 100, 300, -50, 2000, 40000);
+}
+
+void test_trajectory_scurve_time(void *env) {
+    pbio_trajectory_t trj;
+
+    // duration includes the smoothing time
+    tt_want_int_op(pbio_trajectory_make_time_based(&trj, 0, 2000000, 0, 0, 0, 500, 1000, 2000, 2000, 20000), ==, PBIO_SUCCESS);
+    tt_want_int_op(trj.t3 + trj.tj, ==, 2000000);
+
+    int32_t count, count_ext, rate, acceleration;
+    pbio_trajectory_get_reference(&trj, 1000000, &count, &count_ext, &rate, &acceleration);
+    tt_want_int_op(rate, ==, 500);
+    tt_want_int_op(acceleration, ==, 0);
+
+    pbio_trajectory_get_reference(&trj, trj.t3 + trj.tj, &count, &count_ext, &rate, &acceleration);
+    tt_want_int_op(rate, ==, 0);
+}
+
+void test_trajectory_trapezoid(void *env) {
+    pbio_trajectory_t trj;
+
+    // without jerk limit, this is the usual trapezoid
+    tt_want_int_op(pbio_trajectory_make_angle_based(&trj, 0, 0, 3600, 0, 1000, 1000, 2000, 2000, 0), ==, PBIO_SUCCESS);
+    tt_want_int_op(trj.tj, ==, 0);
+    tt_want_int_op(trj.t1, ==, 500000);
+    tt_want_int_op(trj.th1, ==, 250);
+    tt_want_int_op(trj.t3, ==, 4100000);
+
+    int32_t count, count_ext, rate, acceleration;
+    pbio_trajectory_get_reference(&trj, 250000, &count, &count_ext, &rate, &acceleration);
+    tt_want_int_op(count, ==, 62);
+    tt_want_int_op(count_ext, ==, 500);
+    tt_want_int_op(rate, ==, 500);
+    tt_want_int_op(acceleration, ==, 2000);
+}
+
+// Evaluates a trapezoid in floating point, in millicounts
+static double get_mcount_exact(pbio_trajectory_t *trj, int32_t t) {
+    double dt;
+    if (t - trj->t1 < 0) {
+        dt = (t - trj->t0) / 1e6;
+        return (trj->th0 * 1000.0 + trj->th0_ext) + (trj->w0 * dt + trj->a0 * dt * dt / 2) * 1000;
+    }
+    if (trj->forever || t - trj->t2 <= 0) {
+        dt = (t - trj->t1) / 1e6;
+        return (trj->th1 * 1000.0 + trj->th1_ext) + trj->w1 * dt * 1000;
+    }
+    dt = (t - trj->t2) / 1e6;
+    return (trj->th2 * 1000.0 + trj->th2_ext) + (trj->w1 * dt + trj->a2 * dt * dt / 2) * 1000;
+}
+
+static void check_fixed_point(pbio_trajectory_t *trj, int32_t t, int32_t tolerance) {
+    int32_t count, count_ext, rate, acceleration;
+    pbio_trajectory_get_reference(trj, t, &count, &count_ext, &rate, &acceleration);
+
+    // Count and millicounts have the same sign, as with integer division
+    tt_want(count_ext > -1000 && count_ext < 1000);
+    tt_want(count == 0 || count_ext == 0 || (count < 0) == (count_ext < 0));
+
+    tt_want_int_op(abs((int32_t)llround(get_mcount_exact(trj, t)) - (count * 1000 + count_ext)), <=, tolerance);
+}
+
+void test_trajectory_fixed_point(void *env) {
+    pbio_trajectory_t trj;
+
+    // precomputed coefficients agree with the exact trapezoid, forward and backward
+    tt_want_int_op(pbio_trajectory_make_angle_based(&trj, 1000, -20, 5000, 37, 777, 1000, 1234, 2000, 0), ==, PBIO_SUCCESS);
+    for (int32_t t = trj.t0; t - trj.t3 < 0; t += 997) {
+        check_fixed_point(&trj, t, 1);
+    }
+    tt_want_int_op(pbio_trajectory_make_time_based(&trj, -5000, 3000000, -400, -321, 150, -999, 1000, 3456, 5000, 0), ==, PBIO_SUCCESS);
+    for (int32_t t = trj.t0; t - trj.t3 < 0; t += 997) {
+        check_fixed_point(&trj, t, 1);
+    }
+
+    // and stay close to it long into a maneuver that runs forever
+    tt_want_int_op(pbio_trajectory_make_time_based(&trj, 0, DURATION_FOREVER, 0, 0, 0, -1500, 2000, 3000, 3000, 0), ==, PBIO_SUCCESS);
+    check_fixed_point(&trj, DURATION_MAX_S * US_PER_SECOND, 100);
+}
@@ -211,6 +211,9 @@ PT_THREAD(test_boost_color_distance_sensor(struct pt *pt)) {
     static const uint8_t msg90[] = { 0x46, 0x08, 0xB1 }; // extened mode info
     static const uint8_t msg91[] = { 0xD0, 0x00, 0x00, 0x00, 0x00, 0x2F }; // mode 8 data
 
+    static const uint8_t msg92[] = { 0x5C, 0x23, 0x00, 0x00, 0x10, 0x30, 0x00, 0x00, 0x00, 0xA0 }; // WRITE mode combo
+    static const uint8_t msg93[] = { 0xD0, 0x03, 0x05, 0x20, 0x00, 0x09 }; // DATA color, proximity and reflection combo
+
     // used in SIMULATE_RX/TX_MSG macros
     static struct pt child;
     static bool ok;
@@ -572,6 +575,7 @@ PT_THREAD(test_boost_color_distance_sensor(struct pt *pt)) {
 
     // static struct etimer timer;
     int err;
+    static uint32_t seq;
 
     PT_WAIT_WHILE(pt, {
         clock_tick(1);
@@ -586,6 +590,10 @@ PT_THREAD(test_boost_color_distance_sensor(struct pt *pt)) {
     tt_uint_op(pbio_iodev_set_mode_end(iodev), ==, PBIO_ERROR_AGAIN);
     tt_uint_op(iodev->mode, !=, 1);
 
+    // there is no new data until the device sends data for the new mode
+    tt_uint_op(pbio_iodev_get_data_seq(iodev, &seq), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_iodev_wait_data(iodev, seq), ==, PBIO_ERROR_AGAIN);
+
     // data message with new mode
     SIMULATE_RX_MSG(msg88);
 
@@ -595,6 +603,8 @@ PT_THREAD(test_boost_color_distance_sensor(struct pt *pt)) {
     });
     tt_uint_op(err, ==, PBIO_SUCCESS);
     tt_uint_op(iodev->mode, ==, 1);
+    tt_uint_op(pbio_iodev_wait_data(iodev, seq), ==, PBIO_SUCCESS);
+    tt_uint_op(iodev->data_seq, ==, seq + 1);
 
 
     // also do mode 8 since it requires the extended mode flag
@@ -623,6 +633,77 @@ PT_THREAD(test_boost_color_distance_sensor(struct pt *pt)) {
     tt_uint_op(err, ==, PBIO_SUCCESS);
     tt_uint_op(iodev->mode, ==, 8);
 
+
+    // test combining modes, so that the sensor sends them all at once
+
+    static const uint8_t bad_combo_modes[] = { 0, 5 };
+    tt_uint_op(pbio_iodev_set_mode_combo_begin(iodev, bad_combo_modes, 2), ==, PBIO_ERROR_NOT_SUPPORTED);
+
+    static const uint8_t combo_modes[] = { 0, 1, 3 };
+    PT_WAIT_WHILE(pt, {
+        clock_tick(1);
+        (err = pbio_iodev_set_mode_combo_begin(iodev, combo_modes, 3)) == PBIO_ERROR_AGAIN;
+    });
+    tt_uint_op(err, ==, PBIO_SUCCESS);
+    SIMULATE_TX_MSG(msg92);
+    tt_uint_op(pbio_iodev_set_mode_combo_end(iodev), ==, PBIO_ERROR_AGAIN);
+
+    // a device that ignores the combination keeps sending data for its mode,
+    // so waiting for the combination only ends when it is canceled
+    for (i = 0; i < 3; i++) {
+        SIMULATE_TX_MSG(msg84);
+        SIMULATE_RX_MSG(msg90);
+        SIMULATE_RX_MSG(msg91);
+        tt_uint_op(pbio_iodev_set_mode_combo_end(iodev), ==, PBIO_ERROR_AGAIN);
+    }
+    pbio_iodev_set_mode_combo_cancel(iodev);
+    tt_uint_op(pbio_iodev_set_mode_combo_end(iodev), ==, PBIO_ERROR_CANCELED);
+    tt_uint_op(iodev->num_combo_modes, ==, 0);
+    tt_uint_op(iodev->mode, ==, 8);
+
+    // trying again works if the device does send the combination
+    PT_WAIT_WHILE(pt, {
+        clock_tick(1);
+        (err = pbio_iodev_set_mode_combo_begin(iodev, combo_modes, 3)) == PBIO_ERROR_AGAIN;
+    });
+    tt_uint_op(err, ==, PBIO_SUCCESS);
+
+    // wait for mode combo message to be sent
+    SIMULATE_TX_MSG(msg92);
+
+    // data for a single mode is ignored, even if it has the same padded size
+    SIMULATE_RX_MSG(msg90);
+    SIMULATE_RX_MSG(msg88);
+    SIMULATE_RX_MSG(msg91);
+    tt_uint_op(pbio_iodev_set_mode_combo_end(iodev), ==, PBIO_ERROR_AGAIN);
+
+    SIMULATE_RX_MSG(msg85);
+    SIMULATE_RX_MSG(msg93);
+
+    PT_WAIT_WHILE(pt, {
+        clock_tick(1);
+        (err = pbio_iodev_set_mode_combo_end(iodev)) == PBIO_ERROR_AGAIN;
+    });
+    tt_uint_op(err, ==, PBIO_SUCCESS);
+
+    static uint8_t *combo_data;
+    tt_uint_op(pbio_iodev_get_combo_data(iodev, 0, &combo_data), ==, PBIO_SUCCESS);
+    tt_uint_op(combo_data[0], ==, 3);
+    tt_uint_op(pbio_iodev_get_combo_data(iodev, 1, &combo_data), ==, PBIO_SUCCESS);
+    tt_uint_op(combo_data[0], ==, 5);
+    tt_uint_op(pbio_iodev_get_combo_data(iodev, 3, &combo_data), ==, PBIO_SUCCESS);
+    tt_uint_op(combo_data[0], ==, 32);
+    tt_uint_op(pbio_iodev_get_combo_data(iodev, 2, &combo_data), ==, PBIO_ERROR_INVALID_OP);
+
+    // setting a mode ends the combination
+    PT_WAIT_WHILE(pt, {
+        clock_tick(1);
+        (err = pbio_iodev_set_mode_begin(iodev, 1)) == PBIO_ERROR_AGAIN;
+    });
+    tt_uint_op(err, ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_iodev_get_combo_data(iodev, 1, &combo_data), ==, PBIO_ERROR_INVALID_OP);
+    SIMULATE_TX_MSG(msg87);
+
     PT_YIELD(pt);
 
 end:
@@ -1364,6 +1445,36 @@ PT_THREAD(test_technic_xl_motor(struct pt *pt)) {
         SIMULATE_RX_MSG(msg57);
     }
 
+    // replay the same stream with a corrupted message and a stray byte
+    static const uint8_t bad_checksum[] = { 0xD8, 0x64, 0xFF, 0xFF, 0xFF, 0xFF, 0x41, 0x00, 0x00, 0x03 };
+    static const uint8_t bad_header[] = { 0x00 };
+    static const pbio_uartdev_stats_t *stats;
+    tt_uint_op(pbio_uartdev_get_stats(0, &stats), ==, PBIO_SUCCESS);
+    tt_uint_op(pbio_uartdev_reset_stats(0), ==, PBIO_SUCCESS);
+    for (i = 0; i < 10; i++) {
+        SIMULATE_TX_MSG(msg58);
+        if (i == 3) {
+            SIMULATE_RX_MSG(bad_checksum);
+        } else if (i == 6) {
+            SIMULATE_RX_MSG(bad_header);
+            SIMULATE_RX_MSG(msg57);
+        } else {
+            SIMULATE_RX_MSG(msg57);
+        }
+    }
+
+    tt_want_uint_op(stats->tx_bytes, ==, 10);
+    tt_want_uint_op(stats->rx_bytes, ==, 10 * PBIO_ARRAY_SIZE(msg57) + 1);
+    tt_want_uint_op(stats->rx_msgs, ==, 9);
+    tt_want_uint_op(stats->rx_data_msgs, ==, 9);
+    tt_want_uint_op(stats->checksum_errors, ==, 1);
+    tt_want_uint_op(stats->bad_msgs, ==, 1);
+    tt_want_uint_op(stats->keepalive_misses, ==, 1);
+    tt_want_uint_op(stats->resyncs, ==, 0);
+    tt_want_uint_op(stats->data_intervals, ==, 8);
+    tt_want_uint_op(stats->data_interval_max, ==, 200 * 1000);
+    tt_want_uint_op(stats->data_interval_total, ==, 900 * 1000);
+
     static pbio_iodev_t *iodev;
     tt_uint_op(pbio_uartdev_get(0, &iodev), ==, PBIO_SUCCESS);
     tt_want_uint_op(iodev->info->type_id, ==, PBIO_IODEV_TYPE_ID_TECHNIC_XL_MOTOR);
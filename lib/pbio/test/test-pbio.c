@@ -81,6 +81,13 @@ static struct testcase_t pbdrv_pwm_tests[] = {
     END_OF_TESTCASES
 };
 
+PBIO_TEST_FUNC(test_uart_dma_rx);
+
+static struct testcase_t pbdrv_uart_tests[] = {
+    PBIO_TEST(test_uart_dma_rx),
+    END_OF_TESTCASES
+};
+
 // PBIO
 
 PBIO_TEST_FUNC(test_rgb_to_hsv);
@@ -111,6 +118,31 @@ static struct testcase_t pbio_light_tests[] = {
     END_OF_TESTCASES
 };
 
+PBIO_TEST_FUNC(test_logger_linear);
+PBIO_TEST_FUNC(test_logger_circular);
+
+static struct testcase_t pbio_logger_tests[] = {
+    PBIO_TEST(test_logger_linear),
+    PBIO_TEST(test_logger_circular),
+    END_OF_TESTCASES
+};
+
+PBIO_TEST_FUNC(test_lzss_decode);
+
+static struct testcase_t pbio_lzss_tests[] = {
+    PBIO_TEST(test_lzss_decode),
+    END_OF_TESTCASES
+};
+
+PBIO_TEST_FUNC(test_motorcmd_queue);
+PBIO_TEST_FUNC(test_motorcmd_servo);
+
+static struct testcase_t pbio_motorcmd_tests[] = {
+    PBIO_TEST(test_motorcmd_queue),
+    PBIO_TEST(test_motorcmd_servo),
+    END_OF_TESTCASES
+};
+
 PBIO_TEST_FUNC(test_sqrt);
 PBIO_TEST_FUNC(test_mul_i32_fix16);
 PBIO_TEST_FUNC(test_div_i32_fix16);
@@ -124,10 +156,45 @@ static struct testcase_t pbio_math_tests[] = {
 
 PBIO_PT_THREAD_TEST_FUNC(test_servo_run_angle);
 PBIO_PT_THREAD_TEST_FUNC(test_servo_run_time);
+PBIO_TEST_FUNC(test_servo_queue_target);
+PBIO_TEST_FUNC(test_servo_get_state_user);
+PBIO_TEST_FUNC(test_motorpoll_stats);
+PBIO_TEST_FUNC(test_motorpoll_schedule);
 
 static struct testcase_t pbio_motor_tests[] = {
     PBIO_PT_THREAD_TEST(test_servo_run_angle),
     PBIO_PT_THREAD_TEST(test_servo_run_time),
+    PBIO_TEST(test_servo_queue_target),
+    PBIO_TEST(test_servo_get_state_user),
+    PBIO_TEST(test_motorpoll_stats),
+    PBIO_TEST(test_motorpoll_schedule),
+    END_OF_TESTCASES
+};
+
+PBIO_TEST_FUNC(test_drivebase_pool);
+
+static struct testcase_t pbio_drivebase_tests[] = {
+    PBIO_TEST(test_drivebase_pool),
+    END_OF_TESTCASES
+};
+
+PBIO_TEST_FUNC(test_observer_speed);
+
+static struct testcase_t pbio_observer_tests[] = {
+    PBIO_TEST(test_observer_speed),
+    END_OF_TESTCASES
+};
+
+PBIO_TEST_FUNC(test_trajectory_trapezoid);
+PBIO_TEST_FUNC(test_trajectory_scurve_angle);
+PBIO_TEST_FUNC(test_trajectory_scurve_time);
+PBIO_TEST_FUNC(test_trajectory_fixed_point);
+
+static struct testcase_t pbio_trajectory_tests[] = {
+    PBIO_TEST(test_trajectory_trapezoid),
+    PBIO_TEST(test_trajectory_scurve_angle),
+    PBIO_TEST(test_trajectory_scurve_time),
+    PBIO_TEST(test_trajectory_fixed_point),
     END_OF_TESTCASES
 };
 
@@ -156,10 +223,17 @@ static struct testcase_t pbsys_status_tests[] = {
 static struct testgroup_t test_groups[] = {
     { "drv/counter/", pbdrv_counter_tests },
     { "drv/pwm/", pbdrv_pwm_tests },
+    { "drv/uart/", pbdrv_uart_tests },
     { "src/color/", pbio_color_tests },
+    { "src/drivebase/", pbio_drivebase_tests },
     { "src/light/", pbio_light_tests },
+    { "src/logger/", pbio_logger_tests },
+    { "src/lzss/", pbio_lzss_tests },
     { "src/math/", pbio_math_tests },
     { "src/motor/", pbio_motor_tests },
+    { "src/motorcmd/", pbio_motorcmd_tests },
+    { "src/observer/", pbio_observer_tests },
+    { "src/trajectory/", pbio_trajectory_tests },
     { "src/uartdev/", pbio_uartdev_tests, },
     { "sys/status/", pbsys_status_tests, },
     END_OF_GROUPS
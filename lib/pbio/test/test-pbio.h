@@ -7,6 +7,7 @@
 #include <stdint.h>
 
 #include <pbio/button.h>
+#include <pbio/port.h>
 
 // this can be used by tests that consume the button driver
 void pbio_test_button_set_pressed(pbio_button_flags_t flags);
@@ -15,5 +16,33 @@ void pbio_test_button_set_pressed(pbio_button_flags_t flags);
 void pbio_test_counter_set_count(int32_t count);
 void pbio_test_counter_set_abs_count(int32_t count);
 void pbio_test_counter_set_rate(int32_t rate);
+void pbio_test_counter_set_state(uint8_t id, int32_t count, int32_t rate);
+
+// these can be used by tests that consume a motor device
+
+typedef enum {
+    PBIO_TEST_H_BRIDGE_OUTPUT_LL,
+    PBIO_TEST_H_BRIDGE_OUTPUT_LH,
+    PBIO_TEST_H_BRIDGE_OUTPUT_HL,
+    PBIO_TEST_H_BRIDGE_OUTPUT_HH,
+} pbio_test_h_bridge_output_t;
+
+void pbio_test_motor_get_output(pbio_port_t port, pbio_test_h_bridge_output_t *output, uint16_t *duty_cycle);
+
+// these can be used to close the control loop with a simulated motor
+
+typedef struct {
+    double no_load_speed;       /**< Speed (deg/s) at 100% duty without load */
+    double time_constant;       /**< Mechanical time constant (s) */
+    double friction;            /**< Coulomb friction, as fraction of the stall torque */
+    double load;                /**< Constant external load, as fraction of the stall torque */
+    int32_t rate_resolution;    /**< Step size (counts/s) of the reported rate */
+} pbio_test_motor_sim_params_t;
+
+extern const pbio_test_motor_sim_params_t pbio_test_motor_sim_params_default;
+
+void pbio_test_motor_sim_init(pbio_port_t port, const pbio_test_motor_sim_params_t *params, double angle);
+void pbio_test_motor_sim_step(uint32_t usecs);
+void pbio_test_motor_sim_get_state(pbio_port_t port, double *angle, double *speed);
 
 #endif // _TEST_PBIO_H_
@@ -9,6 +9,7 @@
 
 #include <pbio/light.h>
 #include <pbio/color.h>
+#include <pbio/motorcmd.h>
 
 #include "py/misc.h"
 #include "py/obj.h"
@@ -31,6 +32,19 @@ typedef struct _common_ColorLight_internal_obj_t {
     #endif
 } common_ColorLight_internal_obj_t;
 
+// Replaces the animation cells after a new animation has started with new ones.
+// The old cells can't be reused before that, since the light may still be
+// animating them.
+STATIC void common_ColorLight_internal_replace_cells(common_ColorLight_internal_obj_t *self, void *cells, size_t cells_size) {
+    #if MICROPY_MALLOC_USES_ALLOCATED_SIZE
+    m_free(self->animation_cells, self->cells_size);
+    self->cells_size = cells_size;
+    #else
+    m_free(self->animation_cells);
+    #endif
+    self->animation_cells = cells;
+}
+
 // pybricks._common.ColorLight.on
 STATIC mp_obj_t common_ColorLight_internal_on(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
     // Parse arguments
@@ -38,7 +52,12 @@ STATIC mp_obj_t common_ColorLight_internal_on(size_t n_args, const mp_obj_t *pos
         common_ColorLight_internal_obj_t, self,
         PB_ARG_REQUIRED(color));
 
-    pb_assert(pbio_color_light_on_hsv(self->light, pb_type_Color_get_hsv(color_in)));
+    const pbio_color_hsv_t *hsv = pb_type_Color_get_hsv(color_in);
+
+    pbio_lock();
+    pbio_error_t err = pbio_color_light_on_hsv(self->light, hsv);
+    pbio_unlock();
+    pb_assert(err);
 
     return mp_const_none;
 }
@@ -48,7 +67,10 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_KW(common_ColorLight_internal_on_obj, 1, common_C
 STATIC mp_obj_t common_ColorLight_internal_off(mp_obj_t self_in) {
     common_ColorLight_internal_obj_t *self = MP_OBJ_TO_PTR(self_in);
 
-    pb_assert(pbio_color_light_off(self->light));
+    pbio_lock();
+    pbio_error_t err = pbio_color_light_off(self->light);
+    pbio_unlock();
+    pb_assert(err);
 
     return mp_const_none;
 }
@@ -64,14 +86,7 @@ STATIC mp_obj_t common_ColorLight_internal_blink(size_t n_args, const mp_obj_t *
     mp_int_t durations_len = mp_obj_get_int(mp_obj_len(durations_in));
 
     size_t cells_size = sizeof(uint16_t) * (durations_len + 1);
-    #if MICROPY_MALLOC_USES_ALLOCATED_SIZE
-    self->animation_cells = m_realloc(self->animation_cells, self->cells_size, cells_size);
-    self->cells_size = cells_size;
-    #else
-    self->animation_cells = m_realloc(self->animation_cells, cells_size);
-    #endif
-
-    uint16_t *cells = self->animation_cells;
+    uint16_t *cells = m_malloc(cells_size);
     mp_obj_iter_buf_t iter_buf;
     mp_obj_t durations_iter = mp_getiter(durations_in, &iter_buf);
     for (int i = 0; i < durations_len; i++) {
@@ -85,7 +100,13 @@ STATIC mp_obj_t common_ColorLight_internal_blink(size_t n_args, const mp_obj_t *
     // sentinel value
     cells[durations_len] = 0;
 
-    pbio_color_light_start_blink_animation(self->light, pb_type_Color_get_hsv(color_in), cells);
+    const pbio_color_hsv_t *hsv = pb_type_Color_get_hsv(color_in);
+
+    pbio_lock();
+    pbio_color_light_start_blink_animation(self->light, hsv, cells);
+    pbio_unlock();
+
+    common_ColorLight_internal_replace_cells(self, cells, cells_size);
 
     return mp_const_none;
 }
@@ -101,14 +122,7 @@ STATIC mp_obj_t common_ColorLight_internal_animate(size_t n_args, const mp_obj_t
     mp_int_t colors_len = mp_obj_get_int(mp_obj_len(colors_in));
 
     size_t cells_size = sizeof(pbio_color_compressed_hsv_t) * (colors_len + 1);
-    #if MICROPY_MALLOC_USES_ALLOCATED_SIZE
-    self->animation_cells = m_realloc(self->animation_cells, self->cells_size, cells_size);
-    self->cells_size = cells_size;
-    #else
-    self->animation_cells = m_realloc(self->animation_cells, cells_size);
-    #endif
-
-    pbio_color_compressed_hsv_t *cells = self->animation_cells;
+    pbio_color_compressed_hsv_t *cells = m_malloc(cells_size);
     mp_obj_iter_buf_t iter_buf;
     mp_obj_t colors_iter = mp_getiter(colors_in, &iter_buf);
     for (int i = 0; i < colors_len; i++) {
@@ -120,7 +134,11 @@ STATIC mp_obj_t common_ColorLight_internal_animate(size_t n_args, const mp_obj_t
 
     mp_int_t interval = pb_obj_get_int(interval_in);
 
+    pbio_lock();
     pbio_color_light_start_animation(self->light, interval, cells);
+    pbio_unlock();
+
+    common_ColorLight_internal_replace_cells(self, cells, cells_size);
 
     return mp_const_none;
 }
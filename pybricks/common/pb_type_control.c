@@ -6,6 +6,7 @@
 #if PYBRICKS_PY_COMMON_MOTORS
 
 #include <pbio/control.h>
+#include <pbio/motorcmd.h>
 
 #include "py/obj.h"
 
@@ -44,10 +45,10 @@ mp_obj_t common_Control_obj_make_new(pbio_control_t *control) {
     return self;
 }
 
-STATIC void raise_if_control_busy(pbio_control_t *ctl) {
-    if (ctl->type != PBIO_CONTROL_NONE) {
-        pb_assert(PBIO_ERROR_INVALID_OP);
-    }
+// Settings can only be changed while control is not active. Call this while
+// holding pbio_lock(), together with the change itself.
+STATIC pbio_error_t control_check_idle(pbio_control_t *ctl) {
+    return ctl->type == PBIO_CONTROL_NONE ? PBIO_SUCCESS : PBIO_ERROR_INVALID_OP;
 }
 
 // pybricks._common.Control.limits
@@ -61,7 +62,9 @@ STATIC mp_obj_t common_Control_limits(size_t n_args, const mp_obj_t *pos_args, m
 
     // Read current values
     int32_t speed, acceleration, actuation;
+    pbio_lock();
     pbio_control_settings_get_limits(&self->control->settings, &speed, &acceleration, &actuation);
+    pbio_unlock();
 
     // If all given values are none, return current values
     if (speed_in == mp_const_none && acceleration_in == mp_const_none && actuation_in == mp_const_none) {
@@ -72,20 +75,53 @@ STATIC mp_obj_t common_Control_limits(size_t n_args, const mp_obj_t *pos_args, m
         return mp_obj_new_tuple(3, ret);
     }
 
-    // Assert control is not active
-    raise_if_control_busy(self->control);
-
     // Set user settings
     speed = pb_obj_get_default_int(speed_in, speed);
     acceleration = pb_obj_get_default_int(acceleration_in, acceleration);
     actuation = pb_obj_get_default_int(actuation_in, actuation);
 
-    pb_assert(pbio_control_settings_set_limits(&self->control->settings, speed, acceleration, actuation));
+    pbio_lock();
+    pbio_error_t err = control_check_idle(self->control);
+    if (err == PBIO_SUCCESS) {
+        err = pbio_control_settings_set_limits(&self->control->settings, speed, acceleration, actuation);
+    }
+    pbio_unlock();
+    pb_assert(err);
 
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(common_Control_limits_obj, 1, common_Control_limits);
 
+// pybricks._common.Control.jerk_limit
+STATIC mp_obj_t common_Control_jerk_limit(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+
+    PB_PARSE_ARGS_METHOD(n_args, pos_args, kw_args,
+        common_Control_obj_t, self,
+        PB_ARG_DEFAULT_NONE(jerk));
+
+    // If no value is given, return current value
+    if (jerk_in == mp_const_none) {
+        int32_t jerk;
+        pbio_lock();
+        pbio_control_settings_get_jerk(&self->control->settings, &jerk);
+        pbio_unlock();
+        return mp_obj_new_int(jerk);
+    }
+
+    mp_int_t jerk = pb_obj_get_int(jerk_in);
+
+    pbio_lock();
+    pbio_error_t err = control_check_idle(self->control);
+    if (err == PBIO_SUCCESS) {
+        err = pbio_control_settings_set_jerk(&self->control->settings, jerk);
+    }
+    pbio_unlock();
+    pb_assert(err);
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(common_Control_jerk_limit_obj, 1, common_Control_jerk_limit);
+
 // pybricks._common.Control.pid
 STATIC mp_obj_t common_Control_pid(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
 
@@ -101,7 +137,9 @@ STATIC mp_obj_t common_Control_pid(size_t n_args, const mp_obj_t *pos_args, mp_m
     // Read current values
     int16_t kp, ki, kd;
     int32_t integral_range, integral_rate, feed_forward;
+    pbio_lock();
     pbio_control_settings_get_pid(&self->control->settings, &kp, &ki, &kd, &integral_range, &integral_rate, &feed_forward);
+    pbio_unlock();
 
     // If all given values are none, return current values
     if (kp_in == mp_const_none && ki_in == mp_const_none && kd_in == mp_const_none &&
@@ -116,9 +154,6 @@ STATIC mp_obj_t common_Control_pid(size_t n_args, const mp_obj_t *pos_args, mp_m
         return mp_obj_new_tuple(6, ret);
     }
 
-    // Assert control is not active
-    raise_if_control_busy(self->control);
-
     // Set user settings
     kp = pb_obj_get_default_int(kp_in, kp);
     ki = pb_obj_get_default_int(ki_in, ki);
@@ -127,7 +162,13 @@ STATIC mp_obj_t common_Control_pid(size_t n_args, const mp_obj_t *pos_args, mp_m
     integral_rate = pb_obj_get_default_int(integral_rate_in, integral_rate);
     feed_forward = pb_obj_get_default_int(feed_forward_in, feed_forward);
 
-    pb_assert(pbio_control_settings_set_pid(&self->control->settings, kp, ki, kd, integral_range, integral_rate, feed_forward));
+    pbio_lock();
+    pbio_error_t err = control_check_idle(self->control);
+    if (err == PBIO_SUCCESS) {
+        err = pbio_control_settings_set_pid(&self->control->settings, kp, ki, kd, integral_range, integral_rate, feed_forward);
+    }
+    pbio_unlock();
+    pb_assert(err);
 
     return mp_const_none;
 }
@@ -143,7 +184,9 @@ STATIC mp_obj_t common_Control_target_tolerances(size_t n_args, const mp_obj_t *
 
     // Read current values
     int32_t speed, position;
+    pbio_lock();
     pbio_control_settings_get_target_tolerances(&self->control->settings, &speed, &position);
+    pbio_unlock();
 
     // If all given values are none, return current values
     if (speed_in == mp_const_none && position_in == mp_const_none) {
@@ -153,14 +196,17 @@ STATIC mp_obj_t common_Control_target_tolerances(size_t n_args, const mp_obj_t *
         return mp_obj_new_tuple(2, ret);
     }
 
-    // Assert control is not active
-    raise_if_control_busy(self->control);
-
     // Set user settings
     speed = pb_obj_get_default_int(speed_in, speed);
     position = pb_obj_get_default_int(position_in, position);
 
-    pb_assert(pbio_control_settings_set_target_tolerances(&self->control->settings, speed, position));
+    pbio_lock();
+    pbio_error_t err = control_check_idle(self->control);
+    if (err == PBIO_SUCCESS) {
+        err = pbio_control_settings_set_target_tolerances(&self->control->settings, speed, position);
+    }
+    pbio_unlock();
+    pb_assert(err);
 
     return mp_const_none;
 }
@@ -176,7 +222,9 @@ STATIC mp_obj_t common_Control_stall_tolerances(size_t n_args, const mp_obj_t *p
 
     // Read current values
     int32_t speed, time;
+    pbio_lock();
     pbio_control_settings_get_stall_tolerances(&self->control->settings, &speed, &time);
+    pbio_unlock();
 
     // If all given values are none, return current values
     if (speed_in == mp_const_none && time_in == mp_const_none) {
@@ -186,14 +234,17 @@ STATIC mp_obj_t common_Control_stall_tolerances(size_t n_args, const mp_obj_t *p
         return mp_obj_new_tuple(2, ret);
     }
 
-    // Assert control is not active
-    raise_if_control_busy(self->control);
-
     // Set user settings
     speed = pb_obj_get_default_int(speed_in, speed);
     time = pb_obj_get_default_int(time_in, time);
 
-    pb_assert(pbio_control_settings_set_stall_tolerances(&self->control->settings, speed, time));
+    pbio_lock();
+    pbio_error_t err = control_check_idle(self->control);
+    if (err == PBIO_SUCCESS) {
+        err = pbio_control_settings_set_stall_tolerances(&self->control->settings, speed, time);
+    }
+    pbio_unlock();
+    pb_assert(err);
 
     return mp_const_none;
 }
@@ -206,9 +257,12 @@ STATIC mp_obj_t common_Control_trajectory(mp_obj_t self_in) {
 
     mp_obj_t parms[12];
 
+    pbio_lock();
     trajectory = self->control->trajectory;
+    bool active = self->control->type != PBIO_CONTROL_NONE;
+    pbio_unlock();
 
-    if (self->control->type != PBIO_CONTROL_NONE) {
+    if (active) {
         parms[0] = mp_obj_new_int((trajectory.t0 - trajectory.t0) / 1000);
         parms[1] = mp_obj_new_int((trajectory.t1 - trajectory.t0) / 1000);
         parms[2] = mp_obj_new_int((trajectory.t2 - trajectory.t0) / 1000);
@@ -230,20 +284,27 @@ MP_DEFINE_CONST_FUN_OBJ_1(common_Control_trajectory_obj, common_Control_trajecto
 // pybricks._common.Control.done
 STATIC mp_obj_t common_Control_done(mp_obj_t self_in) {
     common_Control_obj_t *self = MP_OBJ_TO_PTR(self_in);
-    return mp_obj_new_bool(pbio_control_is_done(self->control));
+    pbio_lock();
+    bool done = pbio_control_is_done(self->control);
+    pbio_unlock();
+    return mp_obj_new_bool(done);
 }
 MP_DEFINE_CONST_FUN_OBJ_1(common_Control_done_obj, common_Control_done);
 
 // pybricks._common.Control.stalled
 STATIC mp_obj_t common_Control_stalled(mp_obj_t self_in) {
     common_Control_obj_t *self = MP_OBJ_TO_PTR(self_in);
-    return mp_obj_new_bool(pbio_control_is_stalled(self->control));
+    pbio_lock();
+    bool stalled = pbio_control_is_stalled(self->control);
+    pbio_unlock();
+    return mp_obj_new_bool(stalled);
 }
 MP_DEFINE_CONST_FUN_OBJ_1(common_Control_stalled_obj, common_Control_stalled);
 
 // dir(pybricks.common.Control)
 STATIC const mp_rom_map_elem_t common_Control_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_limits), MP_ROM_PTR(&common_Control_limits_obj) },
+    { MP_ROM_QSTR(MP_QSTR_jerk_limit), MP_ROM_PTR(&common_Control_jerk_limit_obj) },
     { MP_ROM_QSTR(MP_QSTR_pid), MP_ROM_PTR(&common_Control_pid_obj) },
     { MP_ROM_QSTR(MP_QSTR_target_tolerances), MP_ROM_PTR(&common_Control_target_tolerances_obj) },
     { MP_ROM_QSTR(MP_QSTR_stall_tolerances), MP_ROM_PTR(&common_Control_stall_tolerances_obj) },
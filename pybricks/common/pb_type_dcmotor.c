@@ -5,6 +5,8 @@
 
 #if PYBRICKS_PY_COMMON_MOTORS
 
+#include <pbio/motorcmd.h>
+
 #include "py/mphal.h"
 
 #include <pybricks/common.h>
@@ -27,7 +29,13 @@ STATIC mp_obj_t common_DCMotor_make_new(const mp_obj_type_t *type, size_t n_args
     // Get and initialize DC Motor
     pbio_dcmotor_t *dc;
     pbio_error_t err;
-    while ((err = pbio_dcmotor_get(port, &dc, direction, false)) == PBIO_ERROR_AGAIN) {
+    while (true) {
+        pbio_lock();
+        err = pbio_dcmotor_get(port, &dc, direction, false);
+        pbio_unlock();
+        if (err != PBIO_ERROR_AGAIN) {
+            break;
+        }
         mp_hal_delay_ms(1000);
     }
     pb_assert(err);
@@ -60,21 +68,32 @@ void common_DCMotor_print(const mp_print_t *print, mp_obj_t self_in, mp_print_ki
 // pybricks._common.DCMotor.dc
 // pybricks._common.Motor.dc
 STATIC mp_obj_t common_DCMotor_duty(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
-    // Parse all arguments except the first one (self)
-    PB_PARSE_ARGS_METHOD_SKIP_SELF(n_args, pos_args, kw_args,
-        PB_ARG_REQUIRED(duty));
+    mp_int_t duty;
+
+    // This is typically called in fast control loops with a single positional
+    // integer, so skip the generic argument parsing in that case.
+    if (n_args == 2 && kw_args->used == 0 && MP_OBJ_IS_SMALL_INT(pos_args[1])) {
+        duty = MP_OBJ_SMALL_INT_VALUE(pos_args[1]);
+    } else {
+        // Parse all arguments except the first one (self)
+        PB_PARSE_ARGS_METHOD_SKIP_SELF(n_args, pos_args, kw_args,
+            PB_ARG_REQUIRED(duty));
 
-    mp_int_t duty = pb_obj_get_int(duty_in);
+        duty = pb_obj_get_int(duty_in);
+    }
 
     // Object type is either Motor or DCMotor
     bool is_servo = mp_obj_is_type(pos_args[0], &pb_type_Motor);
 
     if (is_servo) {
         common_Motor_obj_t *self = MP_OBJ_TO_PTR(pos_args[0]);
-        pb_assert(pbio_servo_set_duty_cycle(self->srv, duty));
+        pb_assert(pbio_motorcmd_servo_set_duty_cycle(self->srv, duty));
     } else {
         common_DCMotor_obj_t *self = MP_OBJ_TO_PTR(pos_args[0]);
-        pb_assert(pbio_dcmotor_set_duty_cycle_usr(self->dcmotor, duty));
+        pbio_lock();
+        pbio_error_t err = pbio_dcmotor_set_duty_cycle_usr(self->dcmotor, duty);
+        pbio_unlock();
+        pb_assert(err);
     }
 
     return mp_const_none;
@@ -90,10 +109,13 @@ STATIC mp_obj_t common_DCMotor_stop(mp_obj_t self_in) {
 
     if (is_servo) {
         common_Motor_obj_t *self = MP_OBJ_TO_PTR(self_in);
-        pb_assert(pbio_servo_stop(self->srv, PBIO_ACTUATION_COAST));
+        pb_assert(pbio_motorcmd_servo_stop(self->srv, PBIO_ACTUATION_COAST));
     } else {
         common_DCMotor_obj_t *self = MP_OBJ_TO_PTR(self_in);
-        pb_assert(pbio_dcmotor_coast(self->dcmotor));
+        pbio_lock();
+        pbio_error_t err = pbio_dcmotor_coast(self->dcmotor);
+        pbio_unlock();
+        pb_assert(err);
     }
     return mp_const_none;
 }
@@ -108,15 +130,22 @@ STATIC mp_obj_t common_DCMotor_brake(mp_obj_t self_in) {
 
     if (is_servo) {
         common_Motor_obj_t *self = MP_OBJ_TO_PTR(self_in);
-        pb_assert(pbio_servo_stop(self->srv, PBIO_ACTUATION_BRAKE));
+        pb_assert(pbio_motorcmd_servo_stop(self->srv, PBIO_ACTUATION_BRAKE));
     } else {
         common_DCMotor_obj_t *self = MP_OBJ_TO_PTR(self_in);
+        pbio_error_t err;
         #if PYBRICKS_PY_EV3DEVICES
         // Workaround for ev3dev dc-motor not coasting on first try
-        pb_assert(pbio_dcmotor_set_duty_cycle_usr(self->dcmotor, 1));
+        pbio_lock();
+        err = pbio_dcmotor_set_duty_cycle_usr(self->dcmotor, 1);
+        pbio_unlock();
+        pb_assert(err);
         mp_hal_delay_ms(1);
         #endif
-        pb_assert(pbio_dcmotor_brake(self->dcmotor));
+        pbio_lock();
+        err = pbio_dcmotor_brake(self->dcmotor);
+        pbio_unlock();
+        pb_assert(err);
     }
     return mp_const_none;
 }
@@ -11,11 +11,14 @@
 
 #include <pbio/config.h>
 #include <pbio/logger.h>
+#include <pbio/motorcmd.h>
 #include <pbio/servo.h>
 
 #include "py/obj.h"
 #include "py/runtime.h"
 #include "py/mpconfig.h"
+#include "py/mperrno.h"
+#include "py/stream.h"
 
 #include <pybricks/util_pb/pb_error.h>
 #include <pybricks/util_mp/pb_obj_helper.h>
@@ -33,21 +36,69 @@ STATIC mp_obj_t tools_Logger_start(size_t n_args, const mp_obj_t *pos_args, mp_m
     PB_PARSE_ARGS_METHOD(n_args, pos_args, kw_args,
         tools_Logger_obj_t, self,
         PB_ARG_REQUIRED(duration),
-        PB_ARG_DEFAULT_INT(divisor, 1));
+        PB_ARG_DEFAULT_INT(divisor, 1),
+        PB_ARG_DEFAULT_FALSE(circular));
 
     mp_int_t divisor = pb_obj_get_int(divisor_in);
     divisor = max(divisor, 1);
-    mp_int_t rows = pb_obj_get_int(duration_in) / PBIO_CONFIG_SERVO_PERIOD_MS / divisor;
+
+    // In circular mode, duration is how much of the most recent data to keep.
+    // There is one row per control update, which depends on the schedule.
+    mp_int_t period = max(pbio_logger_period(self->log), 1);
+    mp_int_t rows = pb_obj_get_int(duration_in) / period / divisor;
+    rows = max(rows, 0);
     mp_int_t size = rows * pbio_logger_cols(self->log);
+    bool circular = mp_obj_is_true(circular_in);
+
+    // The control loop must be done with the old buffer before it moves
+    pbio_lock();
+    pbio_logger_stop(self->log);
+    pbio_unlock();
+
     self->buf = m_renew(int32_t, self->buf, self->size, size);
     self->size = size;
 
-    pbio_logger_start(self->log, self->buf, rows, divisor);
+    pbio_lock();
+    if (circular) {
+        pbio_logger_start_circular(self->log, self->buf, rows, divisor);
+    } else {
+        pbio_logger_start(self->log, self->buf, rows, divisor);
+    }
+    pbio_unlock();
 
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(tools_Logger_start_obj, 1, tools_Logger_start);
 
+STATIC mp_obj_t tools_Logger_drain(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    PB_PARSE_ARGS_METHOD(n_args, pos_args, kw_args,
+        tools_Logger_obj_t, self,
+        PB_ARG_REQUIRED(buffer));
+
+    // Rows are copied as packed 32-bit integers, as many as fit
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(buffer_in, &bufinfo, MP_BUFFER_WRITE);
+    if ((uintptr_t)bufinfo.buf % sizeof(int32_t)) {
+        pb_assert(PBIO_ERROR_INVALID_ARG);
+    }
+    uint32_t max_rows = bufinfo.len / (sizeof(int32_t) * pbio_logger_cols(self->log));
+
+    uint32_t rows;
+    pbio_lock();
+    pbio_error_t err = pbio_logger_drain(self->log, bufinfo.buf, max_rows, &rows);
+    pbio_unlock();
+    pb_assert(err);
+
+    return mp_obj_new_int_from_uint(rows);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(tools_Logger_drain_obj, 1, tools_Logger_drain);
+
+STATIC mp_obj_t tools_Logger_dropped(mp_obj_t self_in) {
+    tools_Logger_obj_t *self = MP_OBJ_TO_PTR(self_in);
+    return mp_obj_new_int_from_uint(pbio_logger_dropped(self->log));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(tools_Logger_dropped_obj, tools_Logger_dropped);
+
 STATIC mp_obj_t tools_Logger_get(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
     PB_PARSE_ARGS_METHOD(n_args, pos_args, kw_args,
         tools_Logger_obj_t, self,
@@ -60,7 +111,10 @@ STATIC mp_obj_t tools_Logger_get(size_t n_args, const mp_obj_t *pos_args, mp_map
     int32_t data[MAX_LOG_VALUES];
 
     // Get data for this sample
-    pb_assert(pbio_logger_read(self->log, index, data));
+    pbio_lock();
+    pbio_error_t err = pbio_logger_read(self->log, index, data);
+    pbio_unlock();
+    pb_assert(err);
     uint8_t num_values = pbio_logger_cols(self->log);
 
     // Convert data to user objects
@@ -74,7 +128,9 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_KW(tools_Logger_get_obj, 1, tools_Logger_get);
 STATIC mp_obj_t tools_Logger_stop(mp_obj_t self_in) {
     tools_Logger_obj_t *self = MP_OBJ_TO_PTR(self_in);
 
+    pbio_lock();
     pbio_logger_stop(self->log);
+    pbio_unlock();
 
     return mp_const_none;
 }
@@ -126,7 +182,10 @@ STATIC mp_obj_t tools_Logger_save(size_t n_args, const mp_obj_t *pos_args, mp_ma
     // Read log size information
     int32_t data[MAX_LOG_VALUES];
 
+    // Once stopped, the control loop no longer touches the log
+    pbio_lock();
     pbio_logger_stop(self->log);
+    pbio_unlock();
 
     uint8_t num_values = pbio_logger_cols(self->log);
     int32_t sampled = pbio_logger_rows(self->log);
@@ -173,6 +232,55 @@ STATIC mp_obj_t tools_Logger_save(size_t n_args, const mp_obj_t *pos_args, mp_ma
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(tools_Logger_save_obj, 1, tools_Logger_save);
 
+// Number of rows copied at a time when dumping to a stream
+#define DUMP_CHUNK_ROWS (8)
+
+STATIC mp_obj_t tools_Logger_dump(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    PB_PARSE_ARGS_METHOD(n_args, pos_args, kw_args,
+        tools_Logger_obj_t, self,
+        PB_ARG_DEFAULT_NONE(stream));
+
+    pbio_lock();
+    pbio_logger_stop(self->log);
+    pbio_unlock();
+
+    uint8_t num_values = pbio_logger_cols(self->log);
+    int32_t sampled = pbio_logger_rows(self->log);
+    size_t row_size = num_values * sizeof(int32_t);
+
+    // Without a stream, return all rows as one bytes object
+    if (stream_in == mp_const_none) {
+        vstr_t vstr;
+        vstr_init_len(&vstr, sampled * row_size);
+        for (int32_t i = 0; i < sampled; i++) {
+            int32_t data[MAX_LOG_VALUES];
+            pb_assert(pbio_logger_read(self->log, i, data));
+            memcpy(&vstr.buf[i * row_size], data, row_size);
+        }
+        return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
+    }
+
+    // Otherwise, write the rows to the stream a few at a time
+    mp_get_stream_raise(stream_in, MP_STREAM_OP_WRITE);
+    int32_t chunk[DUMP_CHUNK_ROWS * MAX_LOG_VALUES];
+
+    for (int32_t i = 0; i < sampled; i += DUMP_CHUNK_ROWS) {
+        int32_t rows = min(sampled - i, DUMP_CHUNK_ROWS);
+        for (int32_t j = 0; j < rows; j++) {
+            pb_assert(pbio_logger_read(self->log, i + j, &chunk[j * num_values]));
+        }
+
+        int errcode = 0;
+        mp_uint_t size = rows * row_size;
+        if (mp_stream_rw(stream_in, chunk, size, &errcode, MP_STREAM_RW_WRITE) != size) {
+            mp_raise_OSError(errcode ? errcode : MP_EIO);
+        }
+    }
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(tools_Logger_dump_obj, 1, tools_Logger_dump);
+
 STATIC mp_obj_t tools_Logger_unary_op(mp_unary_op_t op, mp_obj_t self_in) {
     tools_Logger_obj_t *self = MP_OBJ_TO_PTR(self_in);
     switch (op) {
@@ -187,8 +295,11 @@ STATIC mp_obj_t tools_Logger_unary_op(mp_unary_op_t op, mp_obj_t self_in) {
 STATIC const mp_rom_map_elem_t tools_Logger_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_start), MP_ROM_PTR(&tools_Logger_start_obj) },
     { MP_ROM_QSTR(MP_QSTR_get), MP_ROM_PTR(&tools_Logger_get_obj) },
+    { MP_ROM_QSTR(MP_QSTR_drain), MP_ROM_PTR(&tools_Logger_drain_obj) },
+    { MP_ROM_QSTR(MP_QSTR_dropped), MP_ROM_PTR(&tools_Logger_dropped_obj) },
     { MP_ROM_QSTR(MP_QSTR_stop), MP_ROM_PTR(&tools_Logger_stop_obj) },
     { MP_ROM_QSTR(MP_QSTR_save), MP_ROM_PTR(&tools_Logger_save_obj) },
+    { MP_ROM_QSTR(MP_QSTR_dump), MP_ROM_PTR(&tools_Logger_dump_obj) },
 };
 STATIC MP_DEFINE_CONST_DICT(tools_Logger_locals_dict, tools_Logger_locals_dict_table);
 
@@ -5,6 +5,7 @@
 
 #if PYBRICKS_PY_COMMON_MOTORS
 
+#include <pbio/motorcmd.h>
 #include <pbio/motorpoll.h>
 #include <pbio/servo.h>
 
@@ -22,7 +23,8 @@
 
 STATIC void wait_for_completion(pbio_servo_t *srv) {
     pbio_error_t err;
-    while ((err = pbio_motorpoll_get_servo_status(srv)) == PBIO_ERROR_AGAIN && !pbio_control_is_done(&srv->control)) {
+    bool done;
+    while ((err = pbio_motorcmd_servo_get_status(srv, &done)) == PBIO_ERROR_AGAIN && !done) {
         mp_hal_delay_ms(5);
     }
     if (err != PBIO_ERROR_AGAIN) {
@@ -81,11 +83,19 @@ STATIC mp_obj_t common_Motor_make_new(const mp_obj_type_t *type, size_t n_args,
 
     // Get servo device, set it up, and tell the poller if we succeeded.
     pb_assert(pbio_motorpoll_get_servo(port, &srv));
-    while ((err = pbio_servo_setup(srv, positive_direction, gear_ratio)) == PBIO_ERROR_AGAIN) {
+    while (true) {
+        pbio_lock();
+        err = pbio_servo_setup(srv, positive_direction, gear_ratio);
+        if (err == PBIO_SUCCESS) {
+            err = pbio_motorpoll_set_servo_status(srv, PBIO_ERROR_AGAIN);
+        }
+        pbio_unlock();
+        if (err != PBIO_ERROR_AGAIN) {
+            break;
+        }
         mp_hal_delay_ms(1000);
     }
     pb_assert(err);
-    pb_assert(pbio_motorpoll_set_servo_status(srv, PBIO_ERROR_AGAIN));
 
     // On success, proceed to create and return the MicroPython object
     common_Motor_obj_t *self = m_new_obj(common_Motor_obj_t);
@@ -103,7 +113,9 @@ STATIC mp_obj_t common_Motor_angle(mp_obj_t self_in) {
     common_Motor_obj_t *self = MP_OBJ_TO_PTR(self_in);
     int32_t angle;
 
-    pb_assert(pbio_tacho_get_angle(self->srv->tacho, &angle));
+    // This is typically called in fast control loops, so get only the angle
+    // instead of the full state, which would read the speed and duty too.
+    pb_assert(pbio_motorcmd_servo_get_angle(self->srv, &angle));
 
     return mp_obj_new_int(angle);
 }
@@ -122,7 +134,10 @@ STATIC mp_obj_t common_Motor_reset_angle(size_t n_args, const mp_obj_t *pos_args
     mp_int_t reset_angle = reset_to_abs ? 0 : pb_obj_get_int(angle_in);
 
     // Set the new angle
-    pb_assert(pbio_servo_reset_angle(self->srv, reset_angle, reset_to_abs));
+    pbio_lock();
+    pbio_error_t err = pbio_servo_reset_angle(self->srv, reset_angle, reset_to_abs);
+    pbio_unlock();
+    pb_assert(err);
 
     return mp_const_none;
 }
@@ -133,7 +148,8 @@ STATIC mp_obj_t common_Motor_speed(mp_obj_t self_in) {
     common_Motor_obj_t *self = MP_OBJ_TO_PTR(self_in);
     int32_t speed;
 
-    pb_assert(pbio_tacho_get_angular_rate(self->srv->tacho, &speed));
+    // Like angle(), get only the speed
+    pb_assert(pbio_motorcmd_servo_get_speed(self->srv, &speed));
 
     return mp_obj_new_int(speed);
 }
@@ -146,7 +162,7 @@ STATIC mp_obj_t common_Motor_run(size_t n_args, const mp_obj_t *pos_args, mp_map
         PB_ARG_REQUIRED(speed));
 
     mp_int_t speed = pb_obj_get_int(speed_in);
-    pb_assert(pbio_servo_run(self->srv, speed));
+    pb_assert(pbio_motorcmd_servo_run(self->srv, speed));
 
     return mp_const_none;
 }
@@ -155,7 +171,7 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_KW(common_Motor_run_obj, 1, common_Motor_run);
 // pybricks._common.Motor.hold
 STATIC mp_obj_t common_Motor_hold(mp_obj_t self_in) {
     common_Motor_obj_t *self = MP_OBJ_TO_PTR(self_in);
-    pb_assert(pbio_servo_stop(self->srv, PBIO_ACTUATION_HOLD));
+    pb_assert(pbio_motorcmd_servo_stop(self->srv, PBIO_ACTUATION_HOLD));
     return mp_const_none;
 }
 MP_DEFINE_CONST_FUN_OBJ_1(common_Motor_hold_obj, common_Motor_hold);
@@ -179,7 +195,7 @@ STATIC mp_obj_t common_Motor_run_time(size_t n_args, const mp_obj_t *pos_args, m
     pbio_actuation_t then = pb_type_enum_get_value(then_in, &pb_enum_type_Stop);
 
     // Call pbio with parsed user/default arguments
-    pb_assert(pbio_servo_run_time(self->srv, speed, time, then));
+    pb_assert(pbio_motorcmd_servo_run_time(self->srv, speed, time, then));
 
     if (mp_obj_is_true(wait_in)) {
         wait_for_completion(self->srv);
@@ -204,25 +220,28 @@ STATIC mp_obj_t common_Motor_run_until_stalled(size_t n_args, const mp_obj_t *po
     bool override_duty_limit = duty_limit_in != mp_const_none;
 
     int32_t orig_speed, acceleration, actuation;
+    pbio_error_t err;
 
     if (override_duty_limit) {
-        // Read original values so we can restore them when we're done
-        pbio_control_settings_get_limits(&self->srv->control.settings, &orig_speed, &acceleration, &actuation);
-
         // Get user given limit
         mp_int_t duty_limit = pb_obj_get_int(duty_limit_in);
         duty_limit = duty_limit < 0 ? -duty_limit : duty_limit;
         duty_limit = duty_limit > 100 ? 100 : duty_limit;
 
-        // Apply the user limit
-        pb_assert(pbio_control_settings_set_limits(&self->srv->control.settings, orig_speed, acceleration, duty_limit));
+        // Read original values so we can restore them when we're done, and
+        // apply the user limit
+        pbio_lock();
+        pbio_control_settings_get_limits(&self->srv->control.settings, &orig_speed, &acceleration, &actuation);
+        err = pbio_control_settings_set_limits(&self->srv->control.settings, orig_speed, acceleration, duty_limit);
+        pbio_unlock();
+        pb_assert(err);
     }
 
     mp_obj_t ex = MP_OBJ_NULL;
     nlr_buf_t nlr;
     if (nlr_push(&nlr) == 0) {
         // Call pbio with parsed user/default arguments
-        pb_assert(pbio_servo_run_until_stalled(self->srv, speed, then));
+        pb_assert(pbio_motorcmd_servo_run_until_stalled(self->srv, speed, then));
 
         // In this command we always wait for completion, so we can return the
         // final angle below.
@@ -235,7 +254,10 @@ STATIC mp_obj_t common_Motor_run_until_stalled(size_t n_args, const mp_obj_t *po
 
     // Restore original settings
     if (override_duty_limit) {
-        pb_assert(pbio_control_settings_set_limits(&self->srv->control.settings, orig_speed, acceleration, actuation));
+        pbio_lock();
+        err = pbio_control_settings_set_limits(&self->srv->control.settings, orig_speed, acceleration, actuation);
+        pbio_unlock();
+        pb_assert(err);
     }
 
     if (ex != MP_OBJ_NULL) {
@@ -243,8 +265,8 @@ STATIC mp_obj_t common_Motor_run_until_stalled(size_t n_args, const mp_obj_t *po
     }
 
     // Read the angle upon completion of the stall maneuver
-    int32_t stall_point;
-    pb_assert(pbio_tacho_get_angle(self->srv->tacho, &stall_point));
+    int32_t stall_point, speed_now, duty_now;
+    pb_assert(pbio_motorcmd_servo_get_state_user(self->srv, &stall_point, &speed_now, &duty_now));
 
     // Return angle at which the motor stalled
     return mp_obj_new_int(stall_point);
@@ -265,7 +287,7 @@ STATIC mp_obj_t common_Motor_run_angle(size_t n_args, const mp_obj_t *pos_args,
     pbio_actuation_t then = pb_type_enum_get_value(then_in, &pb_enum_type_Stop);
 
     // Call pbio with parsed user/default arguments
-    pb_assert(pbio_servo_run_angle(self->srv, speed, angle, then));
+    pb_assert(pbio_motorcmd_servo_run_angle(self->srv, speed, angle, then));
 
     if (mp_obj_is_true(wait_in)) {
         wait_for_completion(self->srv);
@@ -289,7 +311,7 @@ STATIC mp_obj_t common_Motor_run_target(size_t n_args, const mp_obj_t *pos_args,
     pbio_actuation_t then = pb_type_enum_get_value(then_in, &pb_enum_type_Stop);
 
     // Call pbio with parsed user/default arguments
-    pb_assert(pbio_servo_run_target(self->srv, speed, target_angle, then));
+    pb_assert(pbio_motorcmd_servo_run_target(self->srv, speed, target_angle, then));
 
     if (mp_obj_is_true(wait_in)) {
         wait_for_completion(self->srv);
@@ -299,6 +321,25 @@ STATIC mp_obj_t common_Motor_run_target(size_t n_args, const mp_obj_t *pos_args,
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(common_Motor_run_target_obj, 1, common_Motor_run_target);
 
+// pybricks._common.Motor.queue_target
+STATIC mp_obj_t common_Motor_queue_target(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    PB_PARSE_ARGS_METHOD(n_args, pos_args, kw_args,
+        common_Motor_obj_t, self,
+        PB_ARG_REQUIRED(speed),
+        PB_ARG_REQUIRED(target_angle),
+        PB_ARG_DEFAULT_OBJ(then, pb_Stop_HOLD_obj));
+
+    mp_int_t speed = pb_obj_get_int(speed_in);
+    mp_int_t target_angle = pb_obj_get_int(target_angle_in);
+    pbio_actuation_t then = pb_type_enum_get_value(then_in, &pb_enum_type_Stop);
+
+    // Runs after the ongoing maneuver, without stopping in between
+    pb_assert(pbio_motorcmd_servo_queue_target(self->srv, speed, target_angle, then));
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(common_Motor_queue_target_obj, 1, common_Motor_queue_target);
+
 // pybricks._common.Motor.track_target
 STATIC mp_obj_t common_Motor_track_target(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
     PB_PARSE_ARGS_METHOD(n_args, pos_args, kw_args,
@@ -306,7 +347,7 @@ STATIC mp_obj_t common_Motor_track_target(size_t n_args, const mp_obj_t *pos_arg
         PB_ARG_REQUIRED(target_angle));
 
     mp_int_t target_angle = pb_obj_get_int(target_angle_in);
-    pb_assert(pbio_servo_track_target(self->srv, target_angle));
+    pb_assert(pbio_motorcmd_servo_track_target(self->srv, target_angle));
 
     return mp_const_none;
 }
@@ -315,23 +356,28 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_KW(common_Motor_track_target_obj, 1, common_Motor
 // dir(pybricks.builtins.Motor)
 STATIC const mp_rom_map_elem_t common_Motor_locals_dict_table[] = {
     //
-    // Methods common to DC motors and encoded motors
+    // Methods used in fast control loops. Methods are looked up in order,
+    // so these come first.
     //
+    { MP_ROM_QSTR(MP_QSTR_angle), MP_ROM_PTR(&common_Motor_angle_obj) },
+    { MP_ROM_QSTR(MP_QSTR_speed), MP_ROM_PTR(&common_Motor_speed_obj) },
     { MP_ROM_QSTR(MP_QSTR_dc), MP_ROM_PTR(&common_DCMotor_duty_obj) },
+    //
+    // Methods common to DC motors and encoded motors
+    //
     { MP_ROM_QSTR(MP_QSTR_stop), MP_ROM_PTR(&common_DCMotor_stop_obj) },
     { MP_ROM_QSTR(MP_QSTR_brake), MP_ROM_PTR(&common_DCMotor_brake_obj) },
     //
     // Methods specific to encoded motors
     //
     { MP_ROM_QSTR(MP_QSTR_hold), MP_ROM_PTR(&common_Motor_hold_obj) },
-    { MP_ROM_QSTR(MP_QSTR_angle), MP_ROM_PTR(&common_Motor_angle_obj) },
-    { MP_ROM_QSTR(MP_QSTR_speed), MP_ROM_PTR(&common_Motor_speed_obj) },
     { MP_ROM_QSTR(MP_QSTR_reset_angle), MP_ROM_PTR(&common_Motor_reset_angle_obj) },
     { MP_ROM_QSTR(MP_QSTR_run), MP_ROM_PTR(&common_Motor_run_obj) },
     { MP_ROM_QSTR(MP_QSTR_run_time), MP_ROM_PTR(&common_Motor_run_time_obj) },
     { MP_ROM_QSTR(MP_QSTR_run_until_stalled), MP_ROM_PTR(&common_Motor_run_until_stalled_obj) },
     { MP_ROM_QSTR(MP_QSTR_run_angle), MP_ROM_PTR(&common_Motor_run_angle_obj) },
     { MP_ROM_QSTR(MP_QSTR_run_target), MP_ROM_PTR(&common_Motor_run_target_obj) },
+    { MP_ROM_QSTR(MP_QSTR_queue_target), MP_ROM_PTR(&common_Motor_queue_target_obj) },
     { MP_ROM_QSTR(MP_QSTR_track_target), MP_ROM_PTR(&common_Motor_track_target_obj) },
     { MP_ROM_QSTR(MP_QSTR_control), MP_ROM_ATTRIBUTE_OFFSET(common_Motor_obj_t, control) },
 };
@@ -9,11 +9,22 @@
 #include "py/obj.h"
 #include "py/runtime.h"
 
+#include <pbdrv/config.h>
+#include <pbio/config.h>
+#include <pbio/motorcmd.h>
+#include <pbio/motorpoll.h>
+#include <pbio/uartdev.h>
 #include <pbsys/sys.h>
 
+#include <pybricks/common.h>
 #include <pybricks/experimental.h>
+#include <pybricks/parameters.h>
 #include <pybricks/robotics.h>
 
+#include <pybricks/util_mp/pb_kwarg_helper.h>
+#include <pybricks/util_mp/pb_obj_helper.h>
+#include <pybricks/util_pb/pb_error.h>
+
 #if PYBRICKS_HUB_PRIMEHUB || PYBRICKS_HUB_TECHNICHUB
 
 #include <lsm6ds3tr_c_reg.h>
@@ -412,6 +423,24 @@ STATIC mp_obj_t mod_experimental_pthread_raise(mp_obj_t thread_id_in, mp_obj_t e
     return mp_obj_new_int(mp_thread_schedule_exception(thread_id, ex_in));
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_experimental_pthread_raise_obj, mod_experimental_pthread_raise);
+
+// Returns (priority, ticks, missed, mean latency, max latency) of the control loop thread, with latencies in microseconds
+STATIC mp_obj_t mod_experimental_control_thread_stats(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    PB_PARSE_ARGS_FUNCTION(n_args, pos_args, kw_args,
+        PB_ARG_DEFAULT_FALSE(reset));
+
+    pybricks_task_caller_stats_t stats;
+    pybricks_get_task_caller_stats(&stats, mp_obj_is_true(reset_in));
+
+    mp_obj_t values[5];
+    values[0] = mp_obj_new_int(stats.priority);
+    values[1] = mp_obj_new_int_from_uint(stats.ticks);
+    values[2] = mp_obj_new_int_from_uint(stats.missed);
+    values[3] = mp_obj_new_int_from_uint(stats.ticks ? stats.latency_total / stats.ticks : 0);
+    values[4] = mp_obj_new_int_from_uint(stats.latency_max);
+    return mp_obj_new_tuple(5, values);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(mod_experimental_control_thread_stats_obj, 0, mod_experimental_control_thread_stats);
 #endif // PYBRICKS_HUB_EV3BRICK
 
 STATIC mp_obj_t experimental_getchar() {
@@ -424,9 +453,142 @@ STATIC mp_obj_t experimental_getchar() {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(experimental_getchar_obj, experimental_getchar);
 
+#if PBIO_CONFIG_MOTORPOLL_STATS
+
+// Makes a (bin_width, count, mean, max, bins) tuple, with all times in microseconds
+STATIC mp_obj_t experimental_histogram_to_tuple(const pbio_motorpoll_histogram_t *hist) {
+    mp_obj_t bins[PBIO_MOTORPOLL_STATS_NUM_BINS];
+    for (int i = 0; i < PBIO_MOTORPOLL_STATS_NUM_BINS; i++) {
+        bins[i] = mp_obj_new_int_from_uint(hist->bins[i]);
+    }
+
+    mp_obj_t values[5];
+    values[0] = mp_obj_new_int_from_uint(hist->bin_width);
+    values[1] = mp_obj_new_int_from_uint(hist->count);
+    values[2] = mp_obj_new_int_from_uint(hist->count ? hist->total / hist->count : 0);
+    values[3] = mp_obj_new_int_from_uint(hist->max);
+    values[4] = mp_obj_new_tuple(PBIO_MOTORPOLL_STATS_NUM_BINS, bins);
+    return mp_obj_new_tuple(5, values);
+}
+
+STATIC mp_obj_t experimental_control_stats(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    PB_PARSE_ARGS_FUNCTION(n_args, pos_args, kw_args,
+        PB_ARG_DEFAULT_FALSE(reset));
+
+    // Take a copy, so the control loop can go on while we make the tuples
+    pbio_motorpoll_stats_t copy;
+    const pbio_motorpoll_stats_t *stats = &copy;
+    bool reset = mp_obj_is_true(reset_in);
+    pbio_lock();
+    copy = *pbio_motorpoll_get_stats();
+    if (reset) {
+        pbio_motorpoll_reset_stats();
+    }
+    pbio_unlock();
+
+    mp_obj_t servos[PBDRV_CONFIG_NUM_MOTOR_CONTROLLER];
+    for (int i = 0; i < PBDRV_CONFIG_NUM_MOTOR_CONTROLLER; i++) {
+        servos[i] = experimental_histogram_to_tuple(&stats->servo[i]);
+    }
+
+    mp_obj_t drivebases[PBIO_CONFIG_NUM_DRIVEBASES];
+    for (int i = 0; i < PBIO_CONFIG_NUM_DRIVEBASES; i++) {
+        drivebases[i] = experimental_histogram_to_tuple(&stats->drivebase[i]);
+    }
+
+    mp_obj_t values[4];
+    values[0] = mp_obj_new_int_from_uint(stats->overruns);
+    values[1] = experimental_histogram_to_tuple(&stats->period);
+    values[2] = mp_obj_new_tuple(PBDRV_CONFIG_NUM_MOTOR_CONTROLLER, servos);
+    values[3] = mp_obj_new_tuple(PBIO_CONFIG_NUM_DRIVEBASES, drivebases);
+
+    return mp_obj_new_tuple(4, values);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(experimental_control_stats_obj, 0, experimental_control_stats);
+
+#endif // PBIO_CONFIG_MOTORPOLL_STATS
+
+#if PBIO_CONFIG_UARTDEV_STATS
+
+STATIC mp_obj_t experimental_lump_stats(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    PB_PARSE_ARGS_FUNCTION(n_args, pos_args, kw_args,
+        PB_ARG_REQUIRED(port),
+        PB_ARG_DEFAULT_FALSE(reset));
+
+    // UART devices are numbered in the same order as the I/O ports
+    mp_int_t port = pb_type_enum_get_value(port_in, &pb_enum_type_Port);
+    if (port < PBDRV_CONFIG_IOPORT_LPF2_FIRST_PORT) {
+        pb_assert(PBIO_ERROR_INVALID_PORT);
+    }
+    uint8_t id = port - PBDRV_CONFIG_IOPORT_LPF2_FIRST_PORT;
+
+    const pbio_uartdev_stats_t *stats;
+    pbio_error_t err = pbio_uartdev_get_stats(id, &stats);
+    pb_assert(err == PBIO_ERROR_INVALID_ARG ? PBIO_ERROR_INVALID_PORT : err);
+
+    mp_obj_t values[12];
+    values[0] = mp_obj_new_int_from_uint(stats->rx_bytes);
+    values[1] = mp_obj_new_int_from_uint(stats->tx_bytes);
+    values[2] = mp_obj_new_int_from_uint(stats->rx_msgs);
+    values[3] = mp_obj_new_int_from_uint(stats->rx_data_msgs);
+    values[4] = mp_obj_new_int_from_uint(stats->checksum_errors);
+    values[5] = mp_obj_new_int_from_uint(stats->bad_msgs);
+    values[6] = mp_obj_new_int_from_uint(stats->keepalive_misses);
+    values[7] = mp_obj_new_int_from_uint(stats->resyncs);
+    values[8] = mp_obj_new_int_from_uint(stats->baud_changes);
+    values[9] = mp_obj_new_int_from_uint(stats->data_intervals);
+    values[10] = mp_obj_new_int_from_uint(stats->data_intervals ? stats->data_interval_total / stats->data_intervals : 0);
+    values[11] = mp_obj_new_int_from_uint(stats->data_interval_max);
+
+    if (mp_obj_is_true(reset_in)) {
+        pb_assert(pbio_uartdev_reset_stats(id));
+    }
+
+    return mp_obj_new_tuple(12, values);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(experimental_lump_stats_obj, 0, experimental_lump_stats);
+
+#endif // PBIO_CONFIG_UARTDEV_STATS
+
+#if PYBRICKS_PY_COMMON_MOTORS
+
+STATIC mp_obj_t experimental_control_schedule(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    PB_PARSE_ARGS_FUNCTION(n_args, pos_args, kw_args,
+        PB_ARG_REQUIRED(motor),
+        PB_ARG_REQUIRED(period),
+        PB_ARG_DEFAULT_INT(priority, 0));
+
+    common_Motor_obj_t *motor = MP_OBJ_TO_PTR(pb_obj_get_base_class_obj(motor_in, &pb_type_Motor));
+    mp_int_t period = pb_obj_get_int(period_in);
+    mp_int_t priority = pb_obj_get_int(priority_in);
+
+    if (period <= 0 || priority < 0 || priority > UINT8_MAX) {
+        pb_assert(PBIO_ERROR_INVALID_ARG);
+    }
+
+    pbio_lock();
+    pbio_error_t err = pbio_motorpoll_set_servo_schedule(motor->srv, period, priority);
+    pbio_unlock();
+    pb_assert(err);
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(experimental_control_schedule_obj, 0, experimental_control_schedule);
+
+#endif // PYBRICKS_PY_COMMON_MOTORS
+
 STATIC const mp_rom_map_elem_t experimental_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_experimental_c) },
     { MP_ROM_QSTR(MP_QSTR_getchar),  MP_ROM_PTR(&experimental_getchar_obj)},
+    #if PBIO_CONFIG_MOTORPOLL_STATS
+    { MP_ROM_QSTR(MP_QSTR_control_stats), MP_ROM_PTR(&experimental_control_stats_obj)},
+    #endif // PBIO_CONFIG_MOTORPOLL_STATS
+    #if PBIO_CONFIG_UARTDEV_STATS
+    { MP_ROM_QSTR(MP_QSTR_lump_stats), MP_ROM_PTR(&experimental_lump_stats_obj)},
+    #endif // PBIO_CONFIG_UARTDEV_STATS
+    #if PYBRICKS_PY_COMMON_MOTORS
+    { MP_ROM_QSTR(MP_QSTR_control_schedule), MP_ROM_PTR(&experimental_control_schedule_obj)},
+    #endif // PYBRICKS_PY_COMMON_MOTORS
     #if PYBRICKS_HUB_TECHNICHUB || PYBRICKS_HUB_PRIMEHUB
     { MP_ROM_QSTR(MP_QSTR_IMU), MP_ROM_PTR(&mod_experimental_IMU_type) },
     #endif // PYBRICKS_HUB_TECHNICHUB || PYBRICKS_HUB_PRIMEHUB
@@ -436,6 +598,7 @@ STATIC const mp_rom_map_elem_t experimental_globals_table[] = {
     #if PYBRICKS_HUB_EV3BRICK
     { MP_ROM_QSTR(MP_QSTR___init__), MP_ROM_PTR(&mod_experimental___init___obj) },
     { MP_ROM_QSTR(MP_QSTR_pthread_raise), MP_ROM_PTR(&mod_experimental_pthread_raise_obj) },
+    { MP_ROM_QSTR(MP_QSTR_control_thread_stats), MP_ROM_PTR(&mod_experimental_control_thread_stats_obj) },
     #endif // PYBRICKS_HUB_EV3BRICK
 };
 STATIC MP_DEFINE_CONST_DICT(pb_module_experimental_globals, experimental_globals_table);
@@ -57,19 +57,22 @@ STATIC mp_obj_t iodevices_LUMPDevice_make_new(const mp_obj_type_t *type, size_t
 STATIC mp_obj_t iodevices_LUMPDevice_read(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
     PB_PARSE_ARGS_METHOD(n_args, pos_args, kw_args,
         iodevices_LUMPDevice_obj_t, self,
-        PB_ARG_REQUIRED(mode));
+        PB_ARG_REQUIRED(mode),
+        PB_ARG_DEFAULT_FALSE(wait));
 
-    // Get data already in correct data format
+    // Get data already in correct data format. If requested, wait for the
+    // device to send new data instead of returning the last received values.
     int32_t data[PBIO_IODEV_MAX_DATA_SIZE];
     mp_obj_t objs[PBIO_IODEV_MAX_DATA_SIZE];
-    pb_device_get_values(self->pbdev, mp_obj_get_int(mode_in), data);
+    uint8_t mode = mp_obj_get_int(mode_in);
+    if (mp_obj_is_true(wait_in)) {
+        pb_device_get_new_values(self->pbdev, mode, data);
+    } else {
+        pb_device_get_values(self->pbdev, mode, data);
+    }
 
-    // Get info about the sensor and its mode
-    pbio_port_t port;
-    pbio_iodev_type_id_t id;
-    uint8_t curr_mode;
-    uint8_t num_values;
-    pb_device_get_info(self->pbdev, &port, &id, &curr_mode, &num_values);
+    // Get the number of values of this mode
+    uint8_t num_values = pb_device_get_num_values(self->pbdev, mode);
 
     // Return as MicroPython objects
     for (uint8_t i = 0; i < num_values; i++) {
@@ -108,10 +111,38 @@ STATIC mp_obj_t iodevices_LUMPDevice_write(size_t n_args, const mp_obj_t *pos_ar
 }
 MP_DEFINE_CONST_FUN_OBJ_KW(iodevices_LUMPDevice_write_obj, 1, iodevices_LUMPDevice_write);
 
+// pybricks.iodevices.LUMPDevice.combine
+STATIC mp_obj_t iodevices_LUMPDevice_combine(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    PB_PARSE_ARGS_METHOD(n_args, pos_args, kw_args,
+        iodevices_LUMPDevice_obj_t, self,
+        PB_ARG_REQUIRED(modes));
+
+    // Unpack the modes tuple
+    mp_obj_t *objs;
+    size_t num_modes;
+    mp_obj_get_array(modes_in, &num_modes, &objs);
+    if (num_modes > PBIO_IODEV_MAX_COMBO_VALUES) {
+        pb_assert(PBIO_ERROR_INVALID_ARG);
+    }
+
+    uint8_t modes[PBIO_IODEV_MAX_COMBO_VALUES];
+    for (uint8_t i = 0; i < num_modes; i++) {
+        modes[i] = mp_obj_get_int(objs[i]);
+    }
+
+    // Make the device send all of these modes at once. After this, reading
+    // any of these modes does not require a mode change.
+    pb_device_set_mode_combo(self->pbdev, modes, num_modes);
+
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_KW(iodevices_LUMPDevice_combine_obj, 1, iodevices_LUMPDevice_combine);
+
 // dir(pybricks.iodevices.LUMPDevice)
 STATIC const mp_rom_map_elem_t iodevices_LUMPDevice_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_read),       MP_ROM_PTR(&iodevices_LUMPDevice_read_obj) },
     { MP_ROM_QSTR(MP_QSTR_write),      MP_ROM_PTR(&iodevices_LUMPDevice_write_obj)},
+    { MP_ROM_QSTR(MP_QSTR_combine),    MP_ROM_PTR(&iodevices_LUMPDevice_combine_obj)},
     { MP_ROM_QSTR(MP_QSTR_ID),         MP_ROM_ATTRIBUTE_OFFSET(iodevices_LUMPDevice_obj_t, id) },
 };
 STATIC MP_DEFINE_CONST_DICT(iodevices_LUMPDevice_locals_dict, iodevices_LUMPDevice_locals_dict_table);
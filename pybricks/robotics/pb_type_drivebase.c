@@ -9,6 +9,7 @@
 #include <stdlib.h>
 
 #include <pbio/drivebase.h>
+#include <pbio/motorcmd.h>
 #include <pbio/motorpoll.h>
 
 #include "py/mphal.h"
@@ -58,10 +59,18 @@ STATIC mp_obj_t robotics_DriveBase_make_new(const mp_obj_type_t *type, size_t n_
         pb_assert(PBIO_ERROR_INVALID_ARG);
     }
 
+    fix16_t wheel_diameter = pb_obj_get_fix16(wheel_diameter_in);
+    fix16_t axle_track = pb_obj_get_fix16(axle_track_in);
+
     // Create drivebase
-    pb_assert(pbio_motorpoll_get_drivebase(&self->db));
-    pb_assert(pbio_drivebase_setup(self->db, srv_left, srv_right, pb_obj_get_fix16(wheel_diameter_in), pb_obj_get_fix16(axle_track_in)));
-    pb_assert(pbio_motorpoll_set_drivebase_status(self->db, PBIO_ERROR_AGAIN));
+    pb_assert(pbio_motorpoll_get_drivebase(srv_left, srv_right, &self->db));
+    pbio_lock();
+    pbio_error_t err = pbio_drivebase_setup(self->db, srv_left, srv_right, wheel_diameter, axle_track);
+    if (err == PBIO_SUCCESS) {
+        err = pbio_motorpoll_set_drivebase_status(self->db, PBIO_ERROR_AGAIN);
+    }
+    pbio_unlock();
+    pb_assert(err);
 
     // Create instances of the Control class
     self->heading_control = common_Control_obj_make_new(&self->db->control_heading);
@@ -69,8 +78,10 @@ STATIC mp_obj_t robotics_DriveBase_make_new(const mp_obj_type_t *type, size_t n_
 
     // Get defaults for drivebase as 1/3 of maximum for the underlying motors
     int32_t straight_speed_limit, straight_acceleration_limit, turn_rate_limit, turn_acceleration_limit, _;
+    pbio_lock();
     pbio_control_settings_get_limits(&self->db->control_distance.settings, &straight_speed_limit, &straight_acceleration_limit, &_);
     pbio_control_settings_get_limits(&self->db->control_heading.settings, &turn_rate_limit, &turn_acceleration_limit, &_);
+    pbio_unlock();
 
     self->straight_speed = straight_speed_limit / 3;
     self->straight_acceleration = straight_acceleration_limit / 3;
@@ -82,7 +93,8 @@ STATIC mp_obj_t robotics_DriveBase_make_new(const mp_obj_type_t *type, size_t n_
 
 STATIC void wait_for_completion_drivebase(pbio_drivebase_t *db) {
     pbio_error_t err;
-    while ((err = pbio_motorpoll_get_drivebase_status(db)) == PBIO_ERROR_AGAIN && (!pbio_control_is_done(&db->control_distance) || !pbio_control_is_done(&db->control_heading))) {
+    bool done;
+    while ((err = pbio_motorcmd_drivebase_get_status(db, &done)) == PBIO_ERROR_AGAIN && !done) {
         mp_hal_delay_ms(5);
     }
     if (err != PBIO_ERROR_AGAIN) {
@@ -97,7 +109,7 @@ STATIC mp_obj_t robotics_DriveBase_straight(size_t n_args, const mp_obj_t *pos_a
         PB_ARG_REQUIRED(distance));
 
     mp_int_t distance = pb_obj_get_int(distance_in);
-    pb_assert(pbio_drivebase_straight(self->db, distance, self->straight_speed, self->straight_acceleration));
+    pb_assert(pbio_motorcmd_drivebase_straight(self->db, distance, self->straight_speed, self->straight_acceleration));
 
     wait_for_completion_drivebase(self->db);
 
@@ -112,7 +124,7 @@ STATIC mp_obj_t robotics_DriveBase_turn(size_t n_args, const mp_obj_t *pos_args,
         PB_ARG_REQUIRED(angle));
 
     mp_int_t angle_val = pb_obj_get_int(angle_in);
-    pb_assert(pbio_drivebase_turn(self->db, angle_val, self->turn_rate, self->turn_acceleration));
+    pb_assert(pbio_motorcmd_drivebase_turn(self->db, angle_val, self->turn_rate, self->turn_acceleration));
 
     wait_for_completion_drivebase(self->db);
 
@@ -131,7 +143,7 @@ STATIC mp_obj_t robotics_DriveBase_drive(size_t n_args, const mp_obj_t *pos_args
     mp_int_t speed = pb_obj_get_int(speed_in);
     mp_int_t turn_rate = pb_obj_get_int(turn_rate_in);
 
-    pb_assert(pbio_drivebase_drive(self->db, speed, turn_rate));
+    pb_assert(pbio_motorcmd_drivebase_drive(self->db, speed, turn_rate));
 
     return mp_const_none;
 }
@@ -140,7 +152,7 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_KW(robotics_DriveBase_drive_obj, 1, robotics_Driv
 // pybricks._common.DriveBase.stop
 STATIC mp_obj_t robotics_DriveBase_stop(mp_obj_t self_in) {
     robotics_DriveBase_obj_t *self = MP_OBJ_TO_PTR(self_in);
-    pb_assert(pbio_drivebase_stop(self->db, PBIO_ACTUATION_COAST));
+    pb_assert(pbio_motorcmd_drivebase_stop(self->db, PBIO_ACTUATION_COAST));
     return mp_const_none;
 }
 MP_DEFINE_CONST_FUN_OBJ_1(robotics_DriveBase_stop_obj, robotics_DriveBase_stop);
@@ -150,7 +162,7 @@ STATIC mp_obj_t robotics_DriveBase_distance(mp_obj_t self_in) {
     robotics_DriveBase_obj_t *self = MP_OBJ_TO_PTR(self_in);
 
     int32_t distance, drive_speed, angle, turn_rate;
-    pb_assert(pbio_drivebase_get_state(self->db, &distance, &drive_speed, &angle, &turn_rate));
+    pb_assert(pbio_motorcmd_drivebase_get_state(self->db, &distance, &drive_speed, &angle, &turn_rate));
 
     return mp_obj_new_int(distance);
 }
@@ -161,7 +173,7 @@ STATIC mp_obj_t robotics_DriveBase_angle(mp_obj_t self_in) {
     robotics_DriveBase_obj_t *self = MP_OBJ_TO_PTR(self_in);
 
     int32_t distance, drive_speed, angle, turn_rate;
-    pb_assert(pbio_drivebase_get_state(self->db, &distance, &drive_speed, &angle, &turn_rate));
+    pb_assert(pbio_motorcmd_drivebase_get_state(self->db, &distance, &drive_speed, &angle, &turn_rate));
 
     return mp_obj_new_int(angle);
 }
@@ -172,7 +184,7 @@ STATIC mp_obj_t robotics_DriveBase_state(mp_obj_t self_in) {
     robotics_DriveBase_obj_t *self = MP_OBJ_TO_PTR(self_in);
 
     int32_t distance, drive_speed, angle, turn_rate;
-    pb_assert(pbio_drivebase_get_state(self->db, &distance, &drive_speed, &angle, &turn_rate));
+    pb_assert(pbio_motorcmd_drivebase_get_state(self->db, &distance, &drive_speed, &angle, &turn_rate));
 
     mp_obj_t ret[4];
     ret[0] = mp_obj_new_int(distance);
@@ -189,7 +201,10 @@ MP_DEFINE_CONST_FUN_OBJ_1(robotics_DriveBase_state_obj, robotics_DriveBase_state
 STATIC mp_obj_t robotics_DriveBase_reset(mp_obj_t self_in) {
     robotics_DriveBase_obj_t *self = MP_OBJ_TO_PTR(self_in);
 
-    pb_assert(pbio_drivebase_reset_state(self->db));
+    pbio_lock();
+    pbio_error_t err = pbio_drivebase_reset_state(self->db);
+    pbio_unlock();
+    pb_assert(err);
 
     return mp_const_none;
 }
@@ -219,14 +234,17 @@ STATIC mp_obj_t robotics_DriveBase_settings(size_t n_args, const mp_obj_t *pos_a
         return mp_obj_new_tuple(4, ret);
     }
 
-    if (self->db->control_distance.type != PBIO_CONTROL_NONE || self->db->control_heading.type != PBIO_CONTROL_NONE) {
-        pb_assert(PBIO_ERROR_INVALID_OP);
-    }
-
     // If some values are given, set them, bound by the control limits
     int32_t straight_speed_limit, straight_acceleration_limit, turn_rate_limit, turn_acceleration_limit, _;
+    pbio_lock();
+    bool busy = self->db->control_distance.type != PBIO_CONTROL_NONE || self->db->control_heading.type != PBIO_CONTROL_NONE;
     pbio_control_settings_get_limits(&self->db->control_distance.settings, &straight_speed_limit, &straight_acceleration_limit, &_);
     pbio_control_settings_get_limits(&self->db->control_heading.settings, &turn_rate_limit, &turn_acceleration_limit, &_);
+    pbio_unlock();
+
+    if (busy) {
+        pb_assert(PBIO_ERROR_INVALID_OP);
+    }
 
     self->straight_speed = min(straight_speed_limit, abs(pb_obj_get_default_int(straight_speed_in, self->straight_speed)));
     self->straight_acceleration = min(straight_acceleration_limit, abs(pb_obj_get_default_int(straight_acceleration_in, self->straight_acceleration)));
@@ -5,9 +5,12 @@
 
 #if PYBRICKS_PY_TOOLS
 
+#include <pbio/motorcmd.h>
+
 #include "py/mphal.h"
 #include "py/runtime.h"
 
+#include <pybricks/common.h>
 #include <pybricks/tools.h>
 
 #include <pybricks/util_mp/pb_kwarg_helper.h>
@@ -26,10 +29,96 @@ STATIC mp_obj_t tools_wait(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_KW(tools_wait_obj, 0, tools_wait);
 
+#if PYBRICKS_PY_COMMON_MOTORS
+
+// Number of values per motor in the buffer of read_motors()
+#define TOOLS_READ_MOTORS_COLS (3)
+
+// Gets the servo of a Motor, raising TypeError if the object is not a Motor
+STATIC pbio_servo_t *tools_get_servo(mp_obj_t motor_in) {
+    return ((common_Motor_obj_t *)MP_OBJ_TO_PTR(pb_obj_get_base_class_obj(motor_in, &pb_type_Motor)))->srv;
+}
+
+// Gets a buffer of 32-bit integers with room for at least the given number of values
+STATIC int32_t *tools_get_int32_buffer(mp_obj_t buffer_in, size_t count, mp_uint_t flags) {
+    mp_buffer_info_t bufinfo;
+    mp_get_buffer_raise(buffer_in, &bufinfo, flags);
+    if ((uintptr_t)bufinfo.buf % sizeof(int32_t) || bufinfo.len < count * sizeof(int32_t)) {
+        pb_assert(PBIO_ERROR_INVALID_ARG);
+    }
+    return bufinfo.buf;
+}
+
+STATIC mp_obj_t tools_read_motors(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    PB_PARSE_ARGS_FUNCTION(n_args, pos_args, kw_args,
+        PB_ARG_REQUIRED(motors),
+        PB_ARG_REQUIRED(buffer));
+
+    size_t n_motors;
+    mp_obj_t *motors;
+    mp_obj_get_array(motors_in, &n_motors, &motors);
+    int32_t *buf = tools_get_int32_buffer(buffer_in, n_motors * TOOLS_READ_MOTORS_COLS, MP_BUFFER_WRITE);
+
+    // Check all arguments before sampling any motor
+    for (size_t i = 0; i < n_motors; i++) {
+        tools_get_servo(motors[i]);
+    }
+
+    // Sample all motors in one go, so the control loop does not run in between
+    pbio_error_t err = PBIO_SUCCESS;
+    pbio_lock();
+    for (size_t i = 0; i < n_motors && err == PBIO_SUCCESS; i++) {
+        int32_t *row = &buf[i * TOOLS_READ_MOTORS_COLS];
+        err = pbio_servo_get_state_user(tools_get_servo(motors[i]), &row[0], &row[1], &row[2]);
+    }
+    pbio_unlock();
+    pb_assert(err);
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(tools_read_motors_obj, 0, tools_read_motors);
+
+STATIC mp_obj_t tools_write_motors(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args) {
+    PB_PARSE_ARGS_FUNCTION(n_args, pos_args, kw_args,
+        PB_ARG_REQUIRED(motors),
+        PB_ARG_REQUIRED(duties));
+
+    size_t n_motors;
+    mp_obj_t *motors;
+    mp_obj_get_array(motors_in, &n_motors, &motors);
+    const int32_t *duties = tools_get_int32_buffer(duties_in, n_motors, MP_BUFFER_READ);
+
+    // Check all arguments before moving any motor
+    for (size_t i = 0; i < n_motors; i++) {
+        tools_get_servo(motors[i]);
+    }
+
+    // Apply all duty cycles, then report the first error, if any
+    pbio_error_t err = PBIO_SUCCESS;
+    pbio_lock();
+    for (size_t i = 0; i < n_motors; i++) {
+        pbio_error_t motor_err = pbio_servo_set_duty_cycle(tools_get_servo(motors[i]), duties[i]);
+        if (err == PBIO_SUCCESS) {
+            err = motor_err;
+        }
+    }
+    pbio_unlock();
+    pb_assert(err);
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(tools_write_motors_obj, 0, tools_write_motors);
+
+#endif // PYBRICKS_PY_COMMON_MOTORS
+
 STATIC const mp_rom_map_elem_t tools_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__),    MP_ROM_QSTR(MP_QSTR_tools)      },
     { MP_ROM_QSTR(MP_QSTR_wait),        MP_ROM_PTR(&tools_wait_obj)     },
     { MP_ROM_QSTR(MP_QSTR_StopWatch),   MP_ROM_PTR(&pb_type_StopWatch)  },
+    #if PYBRICKS_PY_COMMON_MOTORS
+    { MP_ROM_QSTR(MP_QSTR_read_motors), MP_ROM_PTR(&tools_read_motors_obj) },
+    { MP_ROM_QSTR(MP_QSTR_write_motors), MP_ROM_PTR(&tools_write_motors_obj) },
+    #endif // PYBRICKS_PY_COMMON_MOTORS
 };
 STATIC MP_DEFINE_CONST_DICT(pb_module_tools_globals, tools_globals_table);
 
@@ -16,12 +16,18 @@ pb_device_t *pb_device_get_device(pbio_port_t port, pbio_iodev_type_id_t valid_i
 
 void pb_device_get_values(pb_device_t *pbdev, uint8_t mode, int32_t *values);
 
+void pb_device_get_new_values(pb_device_t *pbdev, uint8_t mode, int32_t *values);
+
 void pb_device_set_values(pb_device_t *pbdev, uint8_t mode, int32_t *values, uint8_t num_values);
 
+void pb_device_set_mode_combo(pb_device_t *pbdev, const uint8_t *modes, uint8_t num_modes);
+
 void pb_device_set_power_supply(pb_device_t *pbdev, int32_t duty);
 
 void pb_device_get_info(pb_device_t *pbdev, pbio_port_t *port, pbio_iodev_type_id_t *id, uint8_t *mode, uint8_t *num_values);
 
+uint8_t pb_device_get_num_values(pb_device_t *pbdev, uint8_t mode);
+
 int8_t pb_device_get_mode_id_from_str(pb_device_t *pbdev, const char *mode_str);
 
 void pb_device_color_light_on(pb_device_t *pbdev, const pbio_color_hsv_t *hsv);
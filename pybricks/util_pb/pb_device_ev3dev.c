@@ -2,6 +2,8 @@
 // Copyright (c) 2019-2020 The Pybricks Authors
 
 #include <dirent.h>
+#include <errno.h>
+#include <poll.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
@@ -15,6 +17,8 @@
 #include <ev3dev_stretch/nxtcolor.h>
 
 #include "py/mphal.h"
+#include "py/mpthread.h"
+#include "py/runtime.h"
 
 #include <pybricks/util_pb/pb_error.h>
 #include <pybricks/util_pb/pb_device.h>
@@ -81,7 +85,7 @@ static pbio_error_t get_device(pb_device_t **pbdev, pbio_iodev_type_id_t valid_i
         return err;
     }
     // Get corresponding data info
-    err = lego_sensor_get_info(_pbdev->sensor, &_pbdev->data_len, &_pbdev->data_type);
+    err = lego_sensor_get_info(_pbdev->sensor, _pbdev->mode, &_pbdev->data_len, &_pbdev->data_type);
     if (err != PBIO_SUCCESS) {
         return err;
     }
@@ -130,7 +134,7 @@ static pbio_error_t get_values(pb_device_t *pbdev, uint8_t mode, int32_t *values
         }
         // Set the new mode and corresponding data info
         pbdev->mode = mode;
-        err = lego_sensor_get_info(pbdev->sensor, &pbdev->data_len, &pbdev->data_type);
+        err = lego_sensor_get_info(pbdev->sensor, mode, &pbdev->data_len, &pbdev->data_type);
         if (err != PBIO_SUCCESS) {
             return err;
         }
@@ -184,24 +188,59 @@ static pbio_error_t get_values(pb_device_t *pbdev, uint8_t mode, int32_t *values
     return PBIO_SUCCESS;
 }
 
+// How long to keep trying to get a device after its port was configured (ms)
+#define GET_DEVICE_TIMEOUT (15000)
+
+// How long to wait for a hotplug event before trying again anyway (ms)
+#define GET_DEVICE_RETRY_INTERVAL (1000)
+
+// Wait until a sensor or port is added, removed or changed, or until the
+// timeout expires. The GIL is released while waiting.
+static void wait_for_hotplug(int fd, mp_uint_t timeout) {
+    if (fd == -1) {
+        mp_hal_delay_ms(timeout);
+        return;
+    }
+
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    mp_uint_t start = mp_hal_ticks_ms();
+    mp_uint_t elapsed = 0;
+    for (;;) {
+        mp_handle_pending(true);
+        MP_THREAD_GIL_EXIT();
+        int ret = poll(&pfd, 1, timeout - elapsed);
+        int errsv = errno;
+        MP_THREAD_GIL_ENTER();
+        elapsed = mp_hal_ticks_ms() - start;
+        if (ret == -1 && errsv == EINTR && elapsed < timeout) {
+            continue;
+        }
+        break;
+    }
+}
+
 pb_device_t *pb_device_get_device(pbio_port_t port, pbio_iodev_type_id_t valid_id) {
     pb_device_t *pbdev = NULL;
     pbio_error_t err;
 
-    // Try to get the device
-    err = get_device(&pbdev, valid_id, port);
+    // Start monitoring before the first attempt, since that may configure the
+    // port, after which the sensor shows up some time later.
+    int fd;
+    if (lego_sensor_get_hotplug_fd(&fd) != PBIO_SUCCESS) {
+        fd = -1;
+    }
 
-    // FIXME: Reading port mode is not enough confirmation that we are done,
-    // So we cannot wait until PBIO_ERROR_AGAIN disappears. Use udev instead.
-    // For now, just wait a little longer before giving up.
-    if (err == PBIO_ERROR_AGAIN) {
-        for (uint8_t i = 0; i < 5; i++) {
-            err = get_device(&pbdev, valid_id, port);
-            if (err == PBIO_SUCCESS) {
-                break;
-            }
-            mp_hal_delay_ms(1000 * (i + 1));
+    // Try to get the device until it is ready, trying again whenever
+    // something changes. Not every step of setting up a port is announced,
+    // so also try again every now and then.
+    mp_uint_t start = mp_hal_ticks_ms();
+    for (;;) {
+        lego_sensor_clear_hotplug();
+        err = get_device(&pbdev, valid_id, port);
+        if (err != PBIO_ERROR_AGAIN || mp_hal_ticks_ms() - start >= GET_DEVICE_TIMEOUT) {
+            break;
         }
+        wait_for_hotplug(fd, GET_DEVICE_RETRY_INTERVAL);
     }
     pb_assert(err);
     return pbdev;
@@ -214,10 +253,20 @@ void pb_device_get_values(pb_device_t *pbdev, uint8_t mode, int32_t *values) {
     pb_assert(err);
 }
 
+void pb_device_get_new_values(pb_device_t *pbdev, uint8_t mode, int32_t *values) {
+    // The sysfs interface does not tell us when the sensor has new data, so
+    // this is the same as reading the latest values.
+    pb_device_get_values(pbdev, mode, values);
+}
+
 void pb_device_set_values(pb_device_t *pbdev, uint8_t mode, int32_t *values, uint8_t num_values) {
     pb_assert(PBIO_ERROR_NOT_SUPPORTED);
 }
 
+void pb_device_set_mode_combo(pb_device_t *pbdev, const uint8_t *modes, uint8_t num_modes) {
+    pb_assert(PBIO_ERROR_NOT_SUPPORTED);
+}
+
 void pb_device_set_power_supply(pb_device_t *pbdev, int32_t duty) {
     pb_assert(PBIO_ERROR_NOT_SUPPORTED);
 }
@@ -229,6 +278,18 @@ void pb_device_get_info(pb_device_t *pbdev, pbio_port_t *port, pbio_iodev_type_i
     *num_values = pbdev->data_len;
 }
 
+uint8_t pb_device_get_num_values(pb_device_t *pbdev, uint8_t mode) {
+    if (mode == pbdev->mode) {
+        return pbdev->data_len;
+    }
+
+    // Other modes are only known if they were used before
+    uint8_t data_len;
+    lego_sensor_data_type_t data_type;
+    pb_assert(lego_sensor_get_info(pbdev->sensor, mode, &data_len, &data_type));
+    return data_len;
+}
+
 int8_t pb_device_get_mode_id_from_str(pb_device_t *pbdev, const char *mode_str) {
     uint8_t mode;
     pb_assert(lego_sensor_get_mode_id_from_str(pbdev->sensor, mode_str, &mode));
@@ -1,6 +1,7 @@
 // SPDX-License-Identifier: MIT
 // Copyright (c) 2018-2020 The Pybricks Authors
 
+#include <stdbool.h>
 #include <string.h>
 
 #include <pbdrv/ioport.h>
@@ -20,12 +21,18 @@ struct _pb_device_t {
     pbio_iodev_t iodev;
 };
 
-static void wait(pbio_error_t (*end)(pbio_iodev_t *), void (*cancel)(pbio_iodev_t *), pbio_iodev_t *iodev) {
+// Waits for an operation to end. If it takes longer than timeout (ms), it is
+// canceled and TIMEDOUT is raised. A negative timeout waits forever.
+static void wait_timeout(pbio_error_t (*end)(pbio_iodev_t *), void (*cancel)(pbio_iodev_t *), pbio_iodev_t *iodev, int32_t timeout) {
     nlr_buf_t nlr;
     pbio_error_t err;
+    mp_uint_t start = mp_hal_ticks_ms();
 
     if (nlr_push(&nlr) == 0) {
         while ((err = end(iodev)) == PBIO_ERROR_AGAIN) {
+            if (timeout >= 0 && mp_hal_ticks_ms() - start > (mp_uint_t)timeout) {
+                pb_assert(PBIO_ERROR_TIMEDOUT);
+            }
             MICROPY_EVENT_POLL_HOOK
         }
         nlr_pop();
@@ -39,6 +46,10 @@ static void wait(pbio_error_t (*end)(pbio_iodev_t *), void (*cancel)(pbio_iodev_
     }
 }
 
+static void wait(pbio_error_t (*end)(pbio_iodev_t *), void (*cancel)(pbio_iodev_t *), pbio_iodev_t *iodev) {
+    wait_timeout(end, cancel, iodev, -1);
+}
+
 
 // Get the required mode switch time delay for a given sensor type and/or mode
 static uint32_t get_mode_switch_delay(pbio_iodev_type_id_t id, uint8_t mode) {
@@ -55,10 +66,16 @@ static uint32_t get_mode_switch_delay(pbio_iodev_type_id_t id, uint8_t mode) {
     }
 }
 
+static bool is_combo_mode(pbio_iodev_t *iodev, uint8_t mode) {
+    uint8_t *unused;
+    return pbio_iodev_get_combo_data(iodev, mode, &unused) == PBIO_SUCCESS;
+}
+
 static void set_mode(pbio_iodev_t *iodev, uint8_t new_mode) {
     pbio_error_t err;
 
-    if (iodev->mode == new_mode) {
+    // Nothing to do if the device already sends data for this mode
+    if ((iodev->mode == new_mode && iodev->num_combo_modes == 0) || is_combo_mode(iodev, new_mode)) {
         return;
     }
 
@@ -96,18 +113,22 @@ pb_device_t *pb_device_get_device(pbio_port_t port, pbio_iodev_type_id_t valid_i
     return (pb_device_t *)iodev;
 }
 
-void pb_device_get_values(pb_device_t *pbdev, uint8_t mode, int32_t *values) {
+// Maximum time to wait for new data before giving up. Devices that are still
+// connected send data much more often than this.
+#define DATA_TIMEOUT_MS (1000)
 
-    pbio_iodev_t *iodev = &pbdev->iodev;
+static void get_values(pbio_iodev_t *iodev, uint8_t mode, int32_t *values) {
 
     uint8_t *data;
     uint8_t len;
     pbio_iodev_data_type_t type;
 
-    set_mode(iodev, mode);
-
-    pb_assert(pbio_iodev_get_data(iodev, &data));
-    pb_assert(pbio_iodev_get_data_format(iodev, iodev->mode, &len, &type));
+    if (iodev->num_combo_modes) {
+        pb_assert(pbio_iodev_get_combo_data(iodev, mode, &data));
+    } else {
+        pb_assert(pbio_iodev_get_data(iodev, &data));
+    }
+    pb_assert(pbio_iodev_get_data_format(iodev, mode, &len, &type));
 
     if (len == 0) {
         pb_assert(PBIO_ERROR_IO);
@@ -135,6 +156,46 @@ void pb_device_get_values(pb_device_t *pbdev, uint8_t mode, int32_t *values) {
     }
 }
 
+void pb_device_get_values(pb_device_t *pbdev, uint8_t mode, int32_t *values) {
+    pbio_iodev_t *iodev = &pbdev->iodev;
+    set_mode(iodev, mode);
+    get_values(iodev, mode, values);
+}
+
+void pb_device_get_new_values(pb_device_t *pbdev, uint8_t mode, int32_t *values) {
+    pbio_iodev_t *iodev = &pbdev->iodev;
+    set_mode(iodev, mode);
+
+    // Wait for the device to send data that we have not seen yet
+    uint32_t seq;
+    pb_assert(pbio_iodev_get_data_seq(iodev, &seq));
+
+    pbio_error_t err;
+    mp_uint_t start = mp_hal_ticks_ms();
+    while ((err = pbio_iodev_wait_data(iodev, seq)) == PBIO_ERROR_AGAIN) {
+        if (mp_hal_ticks_ms() - start > DATA_TIMEOUT_MS) {
+            pb_assert(PBIO_ERROR_TIMEDOUT);
+        }
+        MICROPY_EVENT_POLL_HOOK
+    }
+    pb_assert(err);
+
+    get_values(iodev, mode, values);
+}
+
+void pb_device_set_mode_combo(pb_device_t *pbdev, const uint8_t *modes, uint8_t num_modes) {
+    pbio_iodev_t *iodev = &pbdev->iodev;
+    pbio_error_t err;
+
+    while ((err = pbio_iodev_set_mode_combo_begin(iodev, modes, num_modes)) == PBIO_ERROR_AGAIN) {
+        ;
+    }
+    pb_assert(err);
+
+    // Devices that accept the combination send data in its layout right away
+    wait_timeout(pbio_iodev_set_mode_combo_end, pbio_iodev_set_mode_combo_cancel, iodev, DATA_TIMEOUT_MS);
+}
+
 void pb_device_set_values(pb_device_t *pbdev, uint8_t mode, int32_t *values, uint8_t num_values) {
 
     pbio_iodev_t *iodev = &pbdev->iodev;
@@ -197,6 +258,13 @@ void pb_device_get_info(pb_device_t *pbdev, pbio_port_t *port, pbio_iodev_type_i
     *num_values = pbdev->iodev.info->mode_info[*mode].num_values;
 }
 
+uint8_t pb_device_get_num_values(pb_device_t *pbdev, uint8_t mode) {
+    if (mode >= pbdev->iodev.info->num_modes) {
+        pb_assert(PBIO_ERROR_INVALID_ARG);
+    }
+    return pbdev->iodev.info->mode_info[mode].num_values;
+}
+
 int8_t pb_device_get_mode_id_from_str(pb_device_t *pbdev, const char *mode_str) {
     pb_assert(PBIO_ERROR_NOT_IMPLEMENTED);
     return 0;
@@ -6,8 +6,8 @@ watch = StopWatch()
 for i in range(0, 10000):
     avg_pos = left.angle() + right.angle()
     formula = i // 100 - avg_pos // 36
-    left.duty(formula)
-    right.duty(formula)
+    left.dc(formula)
+    right.dc(formula)
 
 watch.pause()
 
@@ -0,0 +1,70 @@
+# Cost of the motor methods that are used in fast control loops, such as in a
+# balancing robot. Each method is timed separately, along with the memory it
+# allocates. The methods should not allocate memory at all, so that the loop
+# is not interrupted by garbage collection.
+
+from array import array
+from gc import collect, disable, enable, mem_alloc
+
+motor = Motor(Port.A)
+watch = StopWatch()
+
+LOOPS = 10000
+
+
+def angle():
+    for i in range(LOOPS):
+        motor.angle()
+
+
+def speed():
+    for i in range(LOOPS):
+        motor.speed()
+
+
+def dc():
+    for i in range(LOOPS):
+        motor.dc(i % 100)
+
+
+state = array("i", [0, 0, 0])
+duties = array("i", [0])
+motors = (motor,)
+
+
+def read():
+    for i in range(LOOPS):
+        read_motors(motors, state)
+
+
+def write():
+    for i in range(LOOPS):
+        duties[0] = i % 100
+        write_motors(motors, duties)
+
+
+def empty():
+    for i in range(LOOPS):
+        pass
+
+
+def run(func):
+    collect()
+    disable()
+    alloc = mem_alloc()
+    watch.reset()
+    watch.resume()
+    func()
+    watch.pause()
+    alloc = mem_alloc() - alloc
+    enable()
+    return watch.time() * 1000 // LOOPS, alloc
+
+
+overhead, _ = run(empty)
+
+for func in (angle, speed, dc, read, write):
+    usecs, alloc = run(func)
+    print("{}: {} usec/call, {} bytes allocated".format(func.__name__, usecs - overhead, alloc))
+
+motor.stop()
@@ -0,0 +1,104 @@
+// SPDX-License-Identifier: MIT
+// Copyright (c) 2020 The Pybricks Authors
+
+// Microbenchmark for reading the tacho counter attributes, comparing stdio
+// with the pread() functions in lib/ev3dev/src/ev3dev_stretch/sysfs.c.
+//
+// Usage: ev3dev-mocks-run bench-sysfs [iterations]
+//
+// The counter attributes are read for every motor in every control loop
+// iteration, so this should be run on an EV3 too, not just with umockdev.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <ev3dev_stretch/sysfs.h>
+
+// Same as in motor/motor.py
+#define IIO_BASE \
+    "/sys/devices/platform/soc@1c00000/ti-pruss/1c32000.pru1" \
+    "/remoteproc/remoteproc0/virtio0/virtio0.ev3-tacho-rpmsg.-1.0" \
+    "/iio:device1/"
+
+#define DEFAULT_ITERATIONS 10000
+
+static uint64_t nsecs(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// The way the counter driver used to read attributes
+static int bench_stdio(const char *path, uint32_t iterations, int32_t *value) {
+    FILE *file = fopen(path, "r");
+    if (!file) {
+        return -1;
+    }
+    setbuf(file, NULL);
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        if (fseek(file, 0, SEEK_SET) == -1 || fscanf(file, "%" SCNd32, value) == EOF) {
+            fclose(file);
+            return -1;
+        }
+    }
+
+    fclose(file);
+    return 0;
+}
+
+static int bench_pread(const char *path, uint32_t iterations, int32_t *value) {
+    int fd;
+    if (sysfs_open_fd(&fd, path) != PBIO_SUCCESS) {
+        return -1;
+    }
+
+    for (uint32_t i = 0; i < iterations; i++) {
+        if (sysfs_pread_int(fd, value) != PBIO_SUCCESS) {
+            close(fd);
+            return -1;
+        }
+    }
+
+    close(fd);
+    return 0;
+}
+
+static const struct {
+    const char *name;
+    int (*run)(const char *path, uint32_t iterations, int32_t *value);
+} benchmarks[] = {
+    { "stdio", bench_stdio },
+    { "pread", bench_pread },
+};
+
+static const char *const attributes[] = {
+    "in_count0_raw",
+    "in_frequency0_input",
+};
+
+int main(int argc, char **argv) {
+    uint32_t iterations = argc > 1 ? strtoul(argv[1], NULL, 0) : DEFAULT_ITERATIONS;
+    char path[256];
+
+    for (size_t a = 0; a < sizeof(attributes) / sizeof(attributes[0]); a++) {
+        snprintf(path, sizeof(path), IIO_BASE "%s", attributes[a]);
+
+        for (size_t b = 0; b < sizeof(benchmarks) / sizeof(benchmarks[0]); b++) {
+            int32_t value;
+            uint64_t start = nsecs();
+            if (benchmarks[b].run(path, iterations, &value) != 0) {
+                perror(path);
+                return EXIT_FAILURE;
+            }
+            uint64_t elapsed = nsecs() - start;
+            printf("%s %s: %" PRIu64 " ns/read (value %" PRId32 ")\n",
+                attributes[a], benchmarks[b].name, elapsed / iterations, value);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,89 @@
+#!/usr/bin/env python3
+
+# SPDX-License-Identifier: MIT
+# Copyright (c) 2020 The Pybricks Authors
+
+"""Compress MPY files for the hubs. The format must match the decoder in
+lib/pbio/src/lzss.c."""
+
+import argparse
+
+WINDOW_BITS = 8
+LENGTH_BITS = 4
+
+# Compressed programs start with this, so the hub can tell them apart from
+# plain .mpy files. The last byte is the format of the compressed data.
+PROGRAM_MAGIC = b"PBZ" + bytes([WINDOW_BITS << 4 | LENGTH_BITS])
+
+
+class BitWriter:
+    """Packs bits into bytes, most significant bit first."""
+
+    def __init__(self):
+        self.data = bytearray()
+        self.bits = 0
+        self.num_bits = 0
+
+    def write(self, value, num_bits):
+        self.bits = self.bits << num_bits | value
+        self.num_bits += num_bits
+        while self.num_bits >= 8:
+            self.num_bits -= 8
+            self.data.append(self.bits >> self.num_bits & 0xFF)
+
+    def flush(self):
+        """Pads the last byte with zeros, which the decoder ignores."""
+        if self.num_bits:
+            self.write(0, 8 - self.num_bits)
+        return bytes(self.data)
+
+
+def compress(data):
+    """Compresses data with LZSS, using a greedy search for matches."""
+
+    window = 1 << WINDOW_BITS
+    max_length = 1 << LENGTH_BITS
+    out = BitWriter()
+    pos = 0
+
+    while pos < len(data):
+        best_length = 0
+        best_offset = 0
+        for offset in range(1, min(pos, window) + 1):
+            length = 0
+            while (
+                length < max_length
+                and pos + length < len(data)
+                and data[pos + length - offset] == data[pos + length]
+            ):
+                length += 1
+            if length > best_length:
+                best_length = length
+                best_offset = offset
+
+        # Back-references only pay off if they are shorter than literals
+        if best_length * (1 + 8) > 1 + WINDOW_BITS + LENGTH_BITS:
+            out.write(0, 1)
+            out.write(best_offset - 1, WINDOW_BITS)
+            out.write(best_length - 1, LENGTH_BITS)
+            pos += best_length
+        else:
+            out.write(1, 1)
+            out.write(data[pos], 8)
+            pos += 1
+
+    return out.flush()
+
+
+def compress_program(mpy_bytes):
+    """Gets the compressed form of an MPY file that hubs can load."""
+    return PROGRAM_MAGIC + compress(mpy_bytes)
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description="Compress an MPY file for a hub.")
+    parser.add_argument("input", type=argparse.FileType("rb"))
+    parser.add_argument("output", type=argparse.FileType("wb"))
+    args = parser.parse_args()
+
+    args.output.write(compress_program(args.input.read()))
@@ -6,6 +6,8 @@
 import argparse
 import serial
 import time
+import zlib
+from lzss import compress_program
 from mpybytes import mpy_bytes_from_file, mpy_bytes_from_str
 
 
@@ -33,12 +35,79 @@ def send_message(ser, data):
         raise ValueError("Did not receive expected checksum.")
 
 
-def download_and_run(device, mpy_bytes):
+def read_reply(ser, size, timeout):
+    """Read a reply of known size from the hub, or None on timeout."""
+    reply = b""
+    end = time.monotonic() + timeout
+    while len(reply) < size and time.monotonic() < end:
+        reply += ser.read(size - len(reply))
+    return reply if len(reply) == size else None
+
+
+# Download protocol version 2, see get_program_v2() in bricks/stm32/main.c
+DOWNLOAD_V2_MAGIC = b"PBD2"
+DOWNLOAD_V2_ACK = 0x06
+DOWNLOAD_V2_NAK = 0x15
+
+# How long to wait for a reply before resending. The hub sends a NAK after
+# 0.1 s of silence and only gives up after 5 s, so this must be in between.
+DOWNLOAD_V2_REPLY_TIMEOUT = 0.5
+
+
+def send_program_v2(ser, mpy_bytes):
+    """Send an MPY file with several checksummed chunks in flight."""
+
+    # Ask for protocol version 2 and get the chunk size and window
+    send_message(ser, DOWNLOAD_V2_MAGIC)
+    info = read_reply(ser, 4, 1)
+    if not info or info[0] != 2:
+        raise OSError("Hub does not support download protocol version 2.")
+    window = info[1]
+    size = int.from_bytes(info[2:4], byteorder="little")
+
+    send_message(ser, len(mpy_bytes).to_bytes(4, byteorder="little"))
+
+    frames = []
+    for index, start in enumerate(range(0, len(mpy_bytes), size)):
+        frame = index.to_bytes(2, byteorder="little")
+        frame += mpy_bytes[start : start + size]
+        frames.append(frame + zlib.crc32(frame).to_bytes(4, byteorder="little"))
+
+    # Go-back-N: keep up to window frames in flight, resend from where the
+    # hub asks us to after an error.
+    acked = 0
+    sent = 0
+    retries = 0
+    while acked < len(frames):
+        while sent < len(frames) and sent < acked + window:
+            ser.write(frames[sent])
+            sent += 1
+
+        reply = read_reply(ser, 3, DOWNLOAD_V2_REPLY_TIMEOUT)
+        if reply is None:
+            # Lost a reply or the hub lost track, so start over from the
+            # first frame that was not acknowledged.
+            reply = bytes([DOWNLOAD_V2_NAK])
+            reply += acked.to_bytes(2, byteorder="little")
+
+        index = int.from_bytes(reply[1:3], byteorder="little")
+        if reply[0] == DOWNLOAD_V2_ACK:
+            acked = max(acked, index + 1)
+            retries = 0
+        elif reply[0] == DOWNLOAD_V2_NAK:
+            # A single lost frame can cause a NAK from the hub as well as a
+            # timeout here, so allow a few more retries in a row.
+            retries += 1
+            if retries > 10:
+                raise OSError("Too many errors while sending program.")
+            acked = sent = index
+        else:
+            raise ValueError("Unexpected reply from hub.")
+
+
+def send_program_legacy(ser, mpy_bytes):
     """Split bytes from an MPY file into chunks and send to the hub."""
 
-    # Open serial port
-    ser = serial.Serial(device, baudrate=115200, timeout=0)
-
     # Get the mpy file size as 4 bytes
     send_message(ser, len(mpy_bytes).to_bytes(4, byteorder="big"))
 
@@ -50,6 +119,22 @@ def download_and_run(device, mpy_bytes):
     for chunk in chunks:
         send_message(ser, chunk)
 
+
+def download_and_run(device, mpy_bytes, legacy=False):
+    """Send an MPY file to the hub and run it."""
+
+    # Open serial port
+    ser = serial.Serial(device, baudrate=115200, timeout=0)
+
+    if legacy:
+        send_program_legacy(ser, mpy_bytes)
+    else:
+        # Hubs that support version 2 also take compressed programs
+        compressed = compress_program(mpy_bytes)
+        if len(compressed) < len(mpy_bytes):
+            mpy_bytes = compressed
+        send_program_v2(ser, mpy_bytes)
+
     # Give hub time to start program
     time.sleep(0.2)
 
@@ -110,6 +195,11 @@ if __name__ == "__main__":
 
     parser.add_argument("--mpy_cross", dest="mpy_cross", nargs="?", type=str, required=True)
     parser.add_argument("--dev", dest="device", nargs="?", type=str, required=True)
+    parser.add_argument(
+        "--legacy",
+        action="store_true",
+        help="use the download protocol of older firmware",
+    )
     group = parser.add_mutually_exclusive_group(required=True)
     group.add_argument("--file", dest="file", nargs="?", const=1, type=str)
     group.add_argument("--string", dest="string", nargs="?", const=1, type=str)
@@ -121,4 +211,4 @@ if __name__ == "__main__":
     if args.string:
         bytearr = mpy_bytes_from_str(args.mpy_cross, args.string)
 
-    download_and_run(args.device, bytearr)
+    download_and_run(args.device, bytearr, args.legacy)